@@ -0,0 +1,94 @@
+/* ** EXPLANATION **
+
+    Allocator class hands out index ranges of a fixed size buffer.
+
+*/
+
+#include "Allocator.h"                                                  // class ray::Allocator declared here
+
+
+using namespace ray;
+
+
+// *****************************************
+//  Constructor
+// *****************************************
+
+Allocator::Allocator(int capacity) : capacity(capacity), freesize(capacity) {
+
+    /* Initialize a free list with the whole buffer. */
+
+    if (capacity > 0) freelist.push_back({ 0, capacity });
+
+}
+
+
+// *****************************************
+//  Alloc
+// *****************************************
+
+int Allocator::Alloc(int size) {
+
+    /* Allocate a range first-fit. */
+
+    if (size <= 0) return -1;
+
+    for (int n = 0; n < (int)freelist.size(); ++n) {
+
+        if (freelist[n].size < size) continue;
+
+        int start = freelist[n].start;
+
+        freelist[n].start += size; freelist[n].size -= size;
+        if (freelist[n].size == 0) freelist.erase(freelist.begin() + n);
+
+        freesize -= size;
+
+        return start;
+
+    }
+
+    return -1;
+
+}
+
+
+// *****************************************
+//  Free
+// *****************************************
+
+void Allocator::Free(int start, int size) {
+
+    /* Insert a range into the free list and merge it with the neighbouring free ranges. */
+
+    if (size <= 0) return;
+
+    int n = 0; while (n < (int)freelist.size() && freelist[n].start < start) { ++n; }
+
+    freelist.insert(freelist.begin() + n, { start, size });
+
+    freesize += size;
+
+    if (n + 1 < (int)freelist.size() && freelist[n].start + freelist[n].size == freelist[n + 1].start) {
+        freelist[n].size += freelist[n + 1].size; freelist.erase(freelist.begin() + n + 1);     // merge with the next range
+    }
+
+    if (n > 0 && freelist[n - 1].start + freelist[n - 1].size == freelist[n].start) {
+        freelist[n - 1].size += freelist[n].size; freelist.erase(freelist.begin() + n);         // merge with the previous range
+    }
+
+}
+
+
+// *****************************************
+
+// *****************************************
+
+int Allocator::GetCapacity(void) const { return capacity; }
+
+int Allocator::GetFreeSize(void) const { return freesize; }
+
+int Allocator::GetUsedEnd(void) const {
+    /* Return the end of the last allocated range. */
+    return (!freelist.empty() && freelist.back().start + freelist.back().size == capacity) ? freelist.back().start : capacity;
+}
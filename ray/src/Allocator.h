@@ -0,0 +1,47 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Allocator class hands out index ranges of a fixed size buffer, e.g. the (UBO) Plane/Unit Buffers.
+
+*/
+
+#include <vector>
+
+namespace ray {
+
+	class Allocator;
+
+}
+
+class ray::Allocator {
+
+	/*
+		In this class:
+
+			- Allocate contiguous ranges first-fit from a free list sorted by start index.
+
+			- Free ranges and merge them with their free neighbours.
+	*/
+
+	struct Range { int start, size; };
+
+	std::vector<Range> freelist;
+
+	int capacity, freesize;
+
+public:
+
+	Allocator(int capacity);											// all of [0, capacity) is free
+
+	int Alloc(int size);												// return the start index of a new range (-1 if no range fits)
+
+	void Free(int start, int size);										// release a range returned by Alloc(..)
+
+	int GetCapacity(void) const;
+
+	int GetFreeSize(void) const;										// total free size (may be fragmented)
+
+	int GetUsedEnd(void) const;											// end of the last allocated range
+
+};
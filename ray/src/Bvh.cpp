@@ -0,0 +1,350 @@
+/* ** EXPLANATION **
+
+    Bvh class is a bounding volume hierarchy (AABB tree) over items such as Ray Objects, for tracing rays on the Cpu.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "Bvh.h"                                                        // class ray::Bvh declared here
+
+
+using namespace ray;
+
+
+#define LEAFSIZE 4                                                      // max items per leaf
+#define BINSIZE 16                                                      // SAH bins per split
+#define MAXSAHDEPTH 48                                                  // deeper nodes are split by the median (bounds the depth)
+#define MINPARALLELSIZE 4096                                            // min items of a subtree built as a job
+#define MAXSTACKSIZE 256                                                // traversal stack (> 2 * max depth)
+
+const float BIGVAL = 1.0e30f;
+
+static bool isempty(const Bvh::Box& box);
+
+
+// *****************************************
+//  Build
+// *****************************************
+
+namespace {
+
+    struct BuildContext {
+        /* This structure contains the subtrees to be built in parallel. */
+        Bvh* bvh; const void* task; void* local;
+    };
+
+}
+
+void Bvh::Build(const Box* box, int size, Jobs* jobs) {
+
+    /*
+        Split the top levels on the calling thread until the ranges are small enough to spread over the jobs,
+        build those subtrees in parallel into their own node lists, then append them under their placeholder nodes.
+    */
+
+    node.clear(); item.clear(); leaf.assign(size, -1); centroid.resize(3 * (size_t)size);
+
+    buildbox = box; itemsize = size;
+
+    for (int n = 0; n < size; ++n) {
+
+        if (isempty(box[n])) continue;                                  // left out
+
+        item.push_back(n);
+
+        for (int i = 0; i < 3; ++i) { centroid[3 * n + i] = 0.5f * (box[n].min[i] + box[n].max[i]); }
+
+    }
+
+    if (item.empty()) return;
+
+    // top levels
+
+    int threadsize = jobs ? jobs->GetThreadSize() + 1 : 1;
+    int parallelsize = std::max(MINPARALLELSIZE, (int)item.size() / (4 * threadsize));
+
+    std::vector<Task> task;
+
+    node.emplace_back(); Split(node, 0, 0, (int)item.size(), 0, (threadsize > 1) ? parallelsize : 0, &task);
+
+    // subtrees
+
+    std::vector<std::vector<Node>> local(task.size());
+
+    if (!task.empty()) {
+        BuildContext context = { this, task.data(), local.data() };
+        jobs->Run((int)task.size(), 1, BuildTask, &context);
+    }
+
+    for (size_t t = 0; t < task.size(); ++t) {
+
+        int base = (int)node.size() - 1;                                // local node i (>= 1) goes to base + i
+
+        for (size_t i = 1; i < local[t].size(); ++i) {
+            node.push_back(local[t][i]); if (node.back().child >= 0) node.back().child += base;
+        }
+
+        Node root = local[t][0]; if (root.child >= 0) root.child += base;
+
+        node[task[t].node] = root;
+
+    }
+
+    // links
+
+    for (int n = 0; n < (int)node.size(); ++n) {
+
+        if (node[n].size > 0) { for (int k = node[n].start; k < node[n].start + node[n].size; ++k) { leaf[item[k]] = n; } }
+        else { node[node[n].child].parent = n; node[node[n].child + 1].parent = n; }
+
+    }
+
+    centroid.clear(); centroid.shrink_to_fit();
+
+}
+
+bool Bvh::Refit(const Box* box, const int* item, int itemsize) {
+
+    /*
+        Refit from the leaves of the moved items up while the boxes change. Many moved items refit all nodes children first.
+
+        An item left out of the tree (empty at the build) which has a box now cannot be refit: return false, to be rebuilt.
+    */
+
+    for (int k = 0; k < itemsize; ++k) {
+        if (item[k] >= 0 && item[k] < (int)leaf.size() && leaf[item[k]] < 0 && !isempty(box[item[k]])) return false;
+    }
+
+    if (node.empty()) return true;
+
+    buildbox = box;
+
+    if (itemsize * 4 > (int)node.size()) { for (int n = (int)node.size() - 1; n >= 0; --n) { SetBox(n); } return true; }
+
+    for (int k = 0; k < itemsize; ++k) {
+
+        if (item[k] < 0 || item[k] >= (int)leaf.size()) continue;      // not built yet
+
+        for (int n = leaf[item[k]]; n >= 0; n = node[n].parent) {
+
+            Box prev = node[n].box;
+
+            SetBox(n);
+
+            if (std::equal(prev.min, prev.min + 6, node[n].box.min)) break;     // the ancestors do not change
+
+        }
+
+    }
+
+    return true;
+
+}
+
+
+// *****************************************
+//  Traverse
+// *****************************************
+
+static float slab(const Bvh::Box& box, const float pos[3], const float invdir[3], float tmax);
+
+int Bvh::Traverse(const float pos[3], const float dir[3], float tmax, Hit hit, void* context, float* outdist) const {
+
+    /*
+        Visit the nearer child first and skip the nodes entered beyond the closest hit so far.
+    */
+
+    struct Entry { int node; float t; };
+
+    if (node.empty()) return -1;
+
+    float invdir[3] = {}; for (int i = 0; i < 3; ++i) { invdir[i] = 1.0f / ((std::fabs(dir[i]) > 1.0e-30f) ? dir[i] : 1.0e-30f); }
+
+    Entry stack[MAXSTACKSIZE]; int stacksize = 0, res = -1;
+
+    float t = slab(node[0].box, pos, invdir, tmax); if (t < 0.0f) return -1;
+
+    stack[stacksize++] = { 0, t };
+
+    while (stacksize > 0) {
+
+        Entry e = stack[--stacksize];
+
+        if (e.t >= tmax) continue;                                      // behind the closest hit
+
+        const Node& n = node[e.node];
+
+        if (n.size > 0) {
+
+            for (int k = n.start; k < n.start + n.size; ++k) {
+                float d = hit(context, item[k], tmax);
+                if (d >= 0.0f && d < tmax) { tmax = d; res = item[k]; }
+            }
+
+            continue;
+
+        }
+
+        float t0 = slab(node[n.child].box, pos, invdir, tmax), t1 = slab(node[n.child + 1].box, pos, invdir, tmax);
+
+        Entry near = { n.child, t0 }, far = { n.child + 1, t1 };
+        if (t1 >= 0.0f && (t0 < 0.0f || t1 < t0)) { std::swap(near, far); }
+
+        if (far.t >= 0.0f) stack[stacksize++] = far;                    // pushed first, visited later
+        if (near.t >= 0.0f) stack[stacksize++] = near;
+
+    }
+
+    if (outdist && res >= 0) *outdist = tmax;
+
+    return res;
+
+}
+
+
+// *****************************************
+//  Access
+// *****************************************
+
+int Bvh::GetItemSize(void) const { return itemsize; }
+
+int Bvh::GetNodeSize(void) const { return (int)node.size(); }
+
+
+// *****************************************
+
+// *****************************************
+
+void Bvh::Split(std::vector<Node>& out, int index, int begin, int end, int depth, int parallelsize, std::vector<Task>* task) {
+
+    /*
+        Choose the split of the least SAH cost among BINSIZE bins along the longest centroid axis.
+        (Falls back to the median when all of the items fall into a bin, or deeper than MAXSAHDEPTH.)
+    */
+
+    Box box = { { BIGVAL, BIGVAL, BIGVAL }, { -BIGVAL, -BIGVAL, -BIGVAL } }, cbox = box;
+
+    for (int k = begin; k < end; ++k) {
+        Union(box, buildbox[item[k]]);
+        const float* c = &centroid[3 * item[k]]; Box cb = { { c[0], c[1], c[2] }, { c[0], c[1], c[2] } }; Union(cbox, cb);
+    }
+
+    out[index].box = box;
+
+    if (end - begin <= LEAFSIZE) { out[index].start = begin; out[index].size = end - begin; return; }
+
+    if (task && end - begin <= parallelsize) { task->push_back({ begin, end, index, depth }); return; }
+
+    int axis = 0; for (int i = 1; i < 3; ++i) { if (cbox.max[i] - cbox.min[i] > cbox.max[axis] - cbox.min[axis]) axis = i; }
+
+    const float extent = cbox.max[axis] - cbox.min[axis];
+
+    int mid = begin;
+
+    if (extent > 0.0f && depth < MAXSAHDEPTH) {
+
+        int count[BINSIZE] = {}; Box bin[BINSIZE];
+        for (int b = 0; b < BINSIZE; ++b) { bin[b] = { { BIGVAL, BIGVAL, BIGVAL }, { -BIGVAL, -BIGVAL, -BIGVAL } }; }
+
+        auto binof = [&](int n) { return std::min(BINSIZE - 1, (int)((centroid[3 * n + axis] - cbox.min[axis]) / extent * BINSIZE)); };
+
+        for (int k = begin; k < end; ++k) { int b = binof(item[k]); ++count[b]; Union(bin[b], buildbox[item[k]]); }
+
+        auto area = [](const Box& b) {
+            float d[3]; for (int i = 0; i < 3; ++i) { d[i] = std::max(0.0f, b.max[i] - b.min[i]); }
+            return d[0] * d[1] + d[1] * d[2] + d[2] * d[0];
+        };
+
+        // sweep the bins from the right, then from the left
+
+        float rightcost[BINSIZE] = {}; {
+            Box acc = bin[BINSIZE - 1]; int n = 0;
+            for (int b = BINSIZE - 1; b > 0; --b) { Union(acc, bin[b]); n += count[b]; rightcost[b] = area(acc) * n; }
+        }
+
+        float best = BIGVAL; int bestbin = -1; {
+            Box acc = bin[0]; int n = 0;
+            for (int b = 0; b < BINSIZE - 1; ++b) {
+                Union(acc, bin[b]); n += count[b];
+                float cost = area(acc) * n + rightcost[b + 1];
+                if (n > 0 && n < end - begin && cost < best) { best = cost; bestbin = b; }
+            }
+        }
+
+        if (bestbin >= 0) { mid = (int)(std::partition(item.begin() + begin, item.begin() + end, [&](int n) { return binof(n) <= bestbin; }) - item.begin()); }
+
+    }
+
+    if (mid <= begin || mid >= end) {                                   // median
+
+        mid = (begin + end) / 2;
+
+        std::nth_element(item.begin() + begin, item.begin() + mid, item.begin() + end,
+            [&](int a, int b) { return centroid[3 * a + axis] < centroid[3 * b + axis]; });
+
+    }
+
+    int child = (int)out.size(); out.resize(out.size() + 2);
+
+    out[index].child = child;
+
+    Split(out, child, begin, mid, depth + 1, parallelsize, task);
+    Split(out, child + 1, mid, end, depth + 1, parallelsize, task);
+
+}
+
+void Bvh::SetBox(int index) {
+
+    Node& n = node[index];
+
+    n.box = { { BIGVAL, BIGVAL, BIGVAL }, { -BIGVAL, -BIGVAL, -BIGVAL } };
+
+    if (n.size > 0) { for (int k = n.start; k < n.start + n.size; ++k) { Union(n.box, buildbox[item[k]]); } }
+    else { Union(n.box, node[n.child].box); Union(n.box, node[n.child + 1].box); }
+
+}
+
+void Bvh::BuildTask(void* context, int begin, int end) {
+
+    /* Build the subtrees [begin, end) into their own node lists. */
+
+    const BuildContext& c = *(const BuildContext*)context;
+
+    for (int t = begin; t < end; ++t) {
+
+        const Task& task = ((const Task*)c.task)[t];
+        std::vector<Node>& local = ((std::vector<Node>*)c.local)[t];
+
+        local.emplace_back();
+
+        c.bvh->Split(local, 0, task.begin, task.end, task.depth, 0, nullptr);
+
+    }
+
+}
+
+void Bvh::Union(Box& out, const Box& box) {
+    for (int i = 0; i < 3; ++i) { out.min[i] = std::min(out.min[i], box.min[i]); out.max[i] = std::max(out.max[i], box.max[i]); }
+}
+
+static float slab(const Bvh::Box& box, const float pos[3], const float invdir[3], float tmax) {
+
+    /* Return the entry distance of a ray into a box (< 0: missed, 0: inside). */
+
+    float t0 = 0.0f, t1 = tmax;
+
+    for (int i = 0; i < 3; ++i) {
+
+        float a = (box.min[i] - pos[i]) * invdir[i], b = (box.max[i] - pos[i]) * invdir[i];
+
+        t0 = std::max(t0, std::min(a, b)); t1 = std::min(t1, std::max(a, b));
+
+    }
+
+    return (t0 <= t1) ? t0 : -1.0f;
+
+}
+
+static bool isempty(const Bvh::Box& box) { return box.min[0] > box.max[0] || box.min[1] > box.max[1] || box.min[2] > box.max[2]; }
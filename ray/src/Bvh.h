@@ -0,0 +1,81 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Bvh class is a bounding volume hierarchy (AABB tree) over items such as Ray Objects, for tracing rays on the Cpu.
+
+*/
+
+#include <vector>
+
+#include "Jobs.h"                                                       // class ray::Jobs declared here
+
+namespace ray {
+
+	class Bvh;
+
+}
+
+class ray::Bvh {
+
+	/*
+		In this class:
+
+			- Build the tree top-down by binned SAH. The top levels are split on the calling thread, and the subtrees below are built in parallel.
+
+			- Refit the boxes of moved items and their ancestors without changing the tree. (Items left out of the tree, which become
+			  non-empty, need a rebuild.)
+
+			- Traverse a ray front to back and stop at nodes behind the closest hit so far.
+
+		Children are stored after their parents, so a reverse walk over the nodes visits children first.
+	*/
+
+public:
+
+	struct Box {
+		/* This structure contains an axis aligned bounding box. (min > max: empty, left out of the tree) */
+		float min[3], max[3];
+	};
+
+	typedef float(*Hit)(void* context, int item, float tmax);			// return the hit distance of a ray (< 0 or >= tmax: no hit)
+
+
+	void Build(const Box* box, int size, Jobs* jobs);					// rebuild over items [0, size)
+
+	bool Refit(const Box* box, const int* item, int itemsize);			// refit the boxes of moved items (box: all item boxes)
+																		// false: an item left out of the tree has a box now (call Build(..))
+
+	int Traverse(const float pos[3], const float dir[3], float tmax, Hit hit, void* context, float* outdist) const;	// return the closest hit item (-1: none)
+
+	int GetItemSize(void) const;										// size given to the last Build(..)
+
+	int GetNodeSize(void) const;
+
+private:
+
+	struct Node {
+		/* This structure contains a tree node. (size > 0: leaf of items[start, start + size), otherwise children child and child + 1) */
+		Box box; int child = -1, start = 0, size = 0, parent = -1;
+	};
+
+	struct Task { int begin, end, node, depth; };								// a subtree to be built in parallel
+
+	std::vector<Node> node;
+
+	std::vector<int> item, leaf;										// item: item indices grouped by leaf, leaf: leaf node per item (-1: not in the tree)
+
+	std::vector<float> centroid;										// [size][3] (while building)
+
+	const Box* buildbox = nullptr; int itemsize = 0;
+
+	void Split(std::vector<Node>& out, int index, int begin, int end, int depth, int parallelsize, std::vector<Task>* task);
+																		// build a node and its subtree (task: collect subtrees of up to parallelsize items)
+
+	void SetBox(int index);												// union of the boxes of the items or children of a node (given buildbox)
+
+	static void BuildTask(void* context, int begin, int end);			// Jobs::Task for the subtrees
+
+	static void Union(Box& out, const Box& box);
+
+};
@@ -0,0 +1,403 @@
+/* ** EXPLANATION **
+
+    Csg class compiles the CSG trees of Ray Objects into selection programs, and runs them on the Cpu.
+
+    The interval ops are the same as in select.frag, where t[0] is the entry distance and t[1] the exit distance of a ray in a region.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+#include <map>
+
+#include "Csg.h"                                                        // class ray::Csg declared here
+
+
+using namespace ray;
+
+
+#define MAXDEPTH 64                                                     // max depth of a tree
+#define EPSILON 1.0e-5f                                                 // tolerance of the bounds (rounded to float at conversion)
+
+const float BIGVAL = 1.0e30f;                                           // extent of unbounded axes (as in Polytope.cpp)
+
+
+// *****************************************
+//  Compile
+// *****************************************
+
+namespace {
+
+    struct Item {
+        /* This structure contains a node of a simplified tree. */
+        int op, left, right;                                            // (OP_LOAD: left is the unit index)
+        float min[3], max[3];                                           // AABB of the result (model space)
+        int source;                                                     // unit whose bounds are the AABB (-1: none)
+    };
+
+    struct Tree {
+        /* This structure contains a tree being compiled. */
+        const std::vector<Csg::Node>* node; const int* unitkey; const Scene::Bounds* unitbounds;
+        std::vector<Item> item; std::map<int, int> operand;             // operand: by unit key
+        Csg::Program* out;
+    };
+
+}
+
+static int simplify(Tree& tree, int node, int depth);
+
+static bool same(const Tree& tree, int a, int b);
+
+static void reorder(Tree& tree, int item);
+
+static int need(const Tree& tree, int item);
+
+static bool emit(Tree& tree, int item);
+
+
+bool Csg::Compile(const std::vector<Node>& tree, int root, const int* unitkey, const Scene::Bounds* unitbounds, Program& out) {
+
+    /*
+        Simplify the tree bottom up by the unit AABBs, order the subtraction chains, then emit the program from the root.
+
+        Units of the same key (e.g. the same geometry and texscale) are loaded once, so a ray unit segment is drawn once per unit left.
+    */
+
+    out.size = 0; out.leaf.clear(); out.bounds = Scene::Bounds();
+
+    Tree t = { &tree, unitkey, unitbounds, {}, {}, &out };
+
+    int item = (root >= 0 && root < (int)tree.size()) ? simplify(t, root, 0) : -1;
+
+    if (item < 0) {                                                     // nothing left
+        out.bounds.state = Scene::BOUNDS_EMPTY;
+        for (int i = 0; i < 3; ++i) { out.bounds.min[i] = BIGVAL; out.bounds.max[i] = -BIGVAL; }
+        return true;
+    }
+
+    reorder(t, item);
+
+    if (need(t, item) > MAXREGSIZE || !emit(t, item)) { out.size = 0; out.leaf.clear(); return false; }
+
+    // bounds
+
+    const Item& res = t.item[item];
+
+    if (res.source >= 0) { out.bounds = unitbounds[res.source]; return true; }
+
+    out.bounds.state = Scene::BOUNDS_BOUNDED;
+
+    double radius2 = 0.0;
+
+    for (int i = 0; i < 3; ++i) {
+        out.bounds.min[i] = res.min[i]; out.bounds.max[i] = res.max[i];
+        if (res.min[i] <= -0.5f * BIGVAL || res.max[i] >= 0.5f * BIGVAL) { out.bounds.state = Scene::BOUNDS_UNBOUNDED; continue; }
+        out.bounds.center[i] = 0.5f * (res.min[i] + res.max[i]);
+        radius2 += 0.25 * ((double)res.max[i] - res.min[i]) * ((double)res.max[i] - res.min[i]);
+    }
+
+    if (out.bounds.state == Scene::BOUNDS_UNBOUNDED) { for (int i = 0; i < 3; ++i) { out.bounds.center[i] = 0.0f; } out.bounds.radius = BIGVAL; }
+    else { out.bounds.radius = (float)std::sqrt(radius2) * (1.0f + 1.0e-6f); }    // (the sphere of the AABB)
+
+    return true;
+
+}
+
+static bool disjoint(const Item& a, const Item& b) {
+
+    /* Test if two AABBs are apart. (Touching boxes are not.) */
+
+    for (int i = 0; i < 3; ++i) {
+        float eps = EPSILON * (1.0f + std::max(std::fabs(a.max[i]), std::fabs(b.min[i])));
+        if (a.max[i] + eps < b.min[i] || b.max[i] + eps < a.min[i]) return true;
+    }
+
+    return false;
+
+}
+
+static int simplify(Tree& tree, int node, int depth) {
+
+    /*
+        Simplify a subtree and return its item (-1: empty).
+
+            A | 0 = A,  A & 0 = 0,  A - 0 = A,  0 - B = 0,  (apart) A & B = 0,  A - B = A,  (the same subtree) A | A = A & A = A,  A - A = 0
+    */
+
+    if (depth > MAXDEPTH) return -1;
+
+    const Csg::Node& n = (*tree.node)[node];
+
+    if (n.op == Csg::OP_LOAD) {
+
+        const Scene::Bounds& bounds = tree.unitbounds[n.left];
+
+        if (bounds.state == Scene::BOUNDS_EMPTY) return -1;
+
+        Item item = { Csg::OP_LOAD, n.left, -1, {}, {}, n.left };
+        for (int i = 0; i < 3; ++i) { item.min[i] = bounds.min[i]; item.max[i] = bounds.max[i]; }
+
+        tree.item.push_back(item); return (int)tree.item.size() - 1;
+
+    }
+
+    int left = simplify(tree, n.left, depth + 1), right = simplify(tree, n.right, depth + 1);
+
+    switch (n.op) {
+
+    case Csg::OP_UNION: if (left < 0 || right < 0) return std::max(left, right); if (same(tree, left, right)) return left; break;
+
+    case Csg::OP_INTERSECT: if (left < 0 || right < 0 || disjoint(tree.item[left], tree.item[right])) return -1; if (same(tree, left, right)) return left; break;
+
+    case Csg::OP_SUBTRACT: if (left < 0) return -1; if (right < 0 || disjoint(tree.item[left], tree.item[right])) return left; if (same(tree, left, right)) return -1; break;
+
+    default: return -1;
+
+    }
+
+    const Item& a = tree.item[left]; const Item& b = tree.item[right];
+
+    Item item = { n.op, left, right, {}, {}, -1 };
+
+    for (int i = 0; i < 3; ++i) {
+        if (n.op == Csg::OP_UNION) { item.min[i] = std::min(a.min[i], b.min[i]); item.max[i] = std::max(a.max[i], b.max[i]); }
+        else if (n.op == Csg::OP_INTERSECT) { item.min[i] = std::max(a.min[i], b.min[i]); item.max[i] = std::min(a.max[i], b.max[i]); }
+        else { item.min[i] = a.min[i]; item.max[i] = a.max[i]; }       // (a subtraction stays within its minuend)
+    }
+
+    if (n.op == Csg::OP_SUBTRACT) { item.source = a.source; }
+    else if (n.op == Csg::OP_INTERSECT) {                               // keep the bounds of a unit which lies inside the other
+        bool ina = true, inb = true;
+        for (int i = 0; i < 3; ++i) { ina = ina && item.min[i] == a.min[i] && item.max[i] == a.max[i]; inb = inb && item.min[i] == b.min[i] && item.max[i] == b.max[i]; }
+        item.source = ina ? a.source : inb ? b.source : -1;
+    }
+
+    tree.item.push_back(item); return (int)tree.item.size() - 1;
+
+}
+
+static bool same(const Tree& tree, int a, int b) {
+
+    /* Test if two subtrees are the same. (Units of the same key are the same.) */
+
+    const Item& x = tree.item[a]; const Item& y = tree.item[b];
+
+    if (x.op != y.op) return false;
+
+    if (x.op == Csg::OP_LOAD) return tree.unitkey[x.left] == tree.unitkey[y.left];
+
+    return same(tree, x.left, y.left) && same(tree, x.right, y.right);
+
+}
+
+static void reorder(Tree& tree, int item) {
+
+    /*
+        Order the subtrahends of a subtraction chain ((A - B) - C) - .. by the share of the AABB of A they cover, most first.
+
+        The interval of a ray is more likely to be cut out by the first ones, and the loads after an empty interval are skipped.
+    */
+
+    if (item < 0 || tree.item[item].op == Csg::OP_LOAD) return;
+
+    if (tree.item[item].op != Csg::OP_SUBTRACT) { reorder(tree, tree.item[item].left); reorder(tree, tree.item[item].right); return; }
+
+    std::vector<int> chain; int base = item;                            // chain: the subtraction nodes from the top
+    while (tree.item[base].op == Csg::OP_SUBTRACT) { chain.push_back(base); base = tree.item[base].left; }
+
+    reorder(tree, base);
+
+    std::vector<std::pair<double, int>> sub;                            // (coverage, subtrahend)
+
+    for (int node : chain) {
+
+        const Item& a = tree.item[base]; const Item& b = tree.item[tree.item[node].right];
+
+        double coverage = 1.0;
+        for (int i = 0; i < 3; ++i) {
+            double extent = (double)a.max[i] - a.min[i], overlap = (double)std::min(a.max[i], b.max[i]) - std::max(a.min[i], b.min[i]);
+            coverage *= (extent > 0.0) ? std::max(0.0, std::min(1.0, overlap / extent)) : 1.0;
+        }
+
+        sub.push_back({ coverage, tree.item[node].right }); reorder(tree, tree.item[node].right);
+
+    }
+
+    std::stable_sort(sub.begin(), sub.end(), [](const std::pair<double, int>& a, const std::pair<double, int>& b) { return a.first > b.first; });
+
+    int left = base;                                                    // rebuild the chain (the nodes keep their bounds: those of A)
+    for (int n = (int)chain.size() - 1, k = 0; n >= 0; --n, ++k) { tree.item[chain[n]].left = left; tree.item[chain[n]].right = sub[k].second; left = chain[n]; }
+
+}
+
+static int need(const Tree& tree, int item) {
+
+    /* Return the number of registers (stack entries) needed to evaluate a subtree. (Sethi-Ullman) */
+
+    const Item& n = tree.item[item];
+
+    if (n.op == Csg::OP_LOAD) return 1;
+
+    int l = need(tree, n.left), r = need(tree, n.right);
+
+    return (l == r) ? l + 1 : std::max(l, r);
+
+}
+
+static bool emit(Tree& tree, int item) {
+
+    /* Emit the codes of a subtree, the operand needing more registers first. (false: too many units) */
+
+    const Item& n = tree.item[item];
+
+    Csg::Program& out = *tree.out;
+
+    if (n.op == Csg::OP_LOAD) {
+
+        auto res = tree.operand.insert({ tree.unitkey[n.left], (int)out.leaf.size() });
+
+        if (res.second) {
+            if ((int)out.leaf.size() >= Csg::MAXLEAFSIZE) return false;
+            out.leaf.push_back(n.left);
+        }
+
+        out.code[out.size++] = Csg::OP_LOAD | res.first->second << 4;
+
+        return true;
+
+    }
+
+    bool swap = need(tree, n.right) > need(tree, n.left);
+
+    if (!emit(tree, swap ? n.right : n.left) || !emit(tree, swap ? n.left : n.right)) return false;
+
+    out.code[out.size++] = (swap && n.op == Csg::OP_SUBTRACT) ? Csg::OP_REVSUBTRACT : n.op;
+
+    return true;
+
+}
+
+
+// *****************************************
+//  Program
+// *****************************************
+
+void Csg::Chain(int unitsize, const Scene::Bounds& primary, Program& out) {
+
+    /* Emit the program of the first unit minus the others in turn. (The ray units of objects without a tree.) */
+
+    out.size = 0; out.leaf.clear(); out.bounds = primary;
+
+    for (int m = 0; m < unitsize && m < MAXLEAFSIZE; ++m) {
+        out.code[out.size++] = OP_LOAD | m << 4; out.leaf.push_back(m);
+        if (m > 0) out.code[out.size++] = OP_SUBTRACT;
+    }
+
+}
+
+bool Csg::IsValid(const int* code, int size, int unitsize) {
+
+    /* Test the ops, the operands and the stack of a program. */
+
+    if (size == 0) return true;
+
+    if (size < 0 || size > MAXPROGRAMSIZE || unitsize > MAXLEAFSIZE) return false;
+
+    int depth = 0;
+
+    for (int n = 0; n < size; ++n) {
+
+        int op = code[n] & 15, operand = code[n] >> 4;
+
+        if (op == OP_LOAD) { if (operand < 0 || operand >= unitsize || ++depth > MAXREGSIZE) return false; }
+        else if (op >= OPSIZE || operand != 0 || --depth < 1) return false;
+
+    }
+
+    return depth == 1;
+
+}
+
+int Csg::Subtrahends(const int* code, int size) {
+
+    /*
+        Find the units which are only cut out of the others: dropping such a unit grows the result by its own region at most.
+        (A valid program is expected.)
+    */
+
+    int stack[MAXREGSIZE], depth = 0, subtracted = 0, used = 0;         // stack: operand of a loaded unit (-1: a result)
+
+    for (int n = 0; n < size; ++n) {
+
+        int op = code[n] & 15, operand = code[n] >> 4;
+
+        if (op == OP_LOAD) { stack[depth++] = operand; continue; }
+
+        int a = stack[depth - 2], b = stack[depth - 1]; --depth;
+
+        int sub = (op == OP_SUBTRACT) ? b : (op == OP_REVSUBTRACT) ? a : -1, other = (op == OP_SUBTRACT) ? a : (op == OP_REVSUBTRACT) ? b : -1;
+
+        if (sub >= 0) subtracted |= 1 << sub;
+        if (op != OP_SUBTRACT && op != OP_REVSUBTRACT) { if (a >= 0) used |= 1 << a; if (b >= 0) used |= 1 << b; }
+        else if (other >= 0) used |= 1 << other;
+
+        stack[depth - 1] = -1;
+
+    }
+
+    if (depth == 1 && stack[0] >= 0) used |= 1 << stack[0];            // a single unit
+
+    return subtracted & ~used;
+
+}
+
+Csg::Interval Csg::Run(const int* code, int size, Load load, void* context) {
+
+    /*
+        Run a program over the intervals of a ray.
+
+        A load followed by a subtraction from, or an intersection with, an empty interval is skipped: the result is empty anyway.
+    */
+
+    auto empty = [](const Interval& a) { return !(a.t[0] < a.t[1]); };
+
+    Interval stack[MAXREGSIZE] = {}; int depth = 0;
+
+    for (int n = 0; n < size; ++n) {
+
+        int op = code[n] & 15;
+
+        if (op == OP_LOAD) {
+            int next = (n + 1 < size) ? code[n + 1] & 15 : OP_LOAD;
+            if (depth > 0 && empty(stack[depth - 1]) && (next == OP_SUBTRACT || next == OP_INTERSECT)) { ++n; continue; }
+            load(context, code[n] >> 4, stack[depth++]); continue;
+        }
+
+        Interval b = stack[--depth]; Interval& a = stack[depth - 1];
+
+        if (op == OP_REVSUBTRACT) { std::swap(a, b); op = OP_SUBTRACT; }
+
+        switch (op) {
+
+        case OP_UNION:                                                  // (apart: the front one)
+            if (empty(a) || (!empty(b) && a.t[0] <= b.t[1] && b.t[0] <= a.t[1])) { if (!empty(a)) { b.t[0] = std::min(a.t[0], b.t[0]); b.t[1] = std::max(a.t[1], b.t[1]); } a = b; }
+            else if (!empty(b) && b.t[0] < a.t[0]) { a = b; }
+            break;
+
+        case OP_INTERSECT: a.t[0] = std::max(a.t[0], b.t[0]); a.t[1] = std::min(a.t[1], b.t[1]); break;
+
+        case OP_SUBTRACT:                                               // the front piece, or else the back piece
+            if (empty(b)) break;
+            if (a.t[0] < std::min(a.t[1], b.t[0])) { a.t[1] = std::min(a.t[1], b.t[0]); }
+            else { a.t[0] = std::max(a.t[0], b.t[1]); }
+            break;
+
+        }
+
+    }
+
+    if (depth > 0) return stack[0];
+
+    Interval res = { { 1.0f, 0.0f } }; return res;
+
+}
@@ -0,0 +1,79 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Csg class compiles the CSG tree of a Ray Object (union, intersection and subtraction of its Ray Units) into a selection program,
+	which is run per pixel by the Selection Calculations (select.frag) and per ray by the Cpu tracer.
+
+*/
+
+#include <vector>
+
+#include "Scene.h"                                                      // class ray::Scene declared here
+
+namespace ray {
+
+	class Csg;
+
+}
+
+class ray::Csg {
+
+	/*
+		In this class:
+
+			- Simplify a tree by the unit bounds: prune empty and disjoint branches, and fold repeated units.
+
+			- Order the subtrahends of subtraction chains by their expected coverage (most first), so that cut out intervals end early.
+
+			- Emit a postfix program in Sethi-Ullman order (the operand needing more registers first), using only the units left in the tree.
+
+		A program is a list of codes (op | operand << 4) over a stack of intervals, one per ray:
+		LOAD pushes the interval of a unit, and the binary ops pop two intervals and push the result.
+
+		An interval keeps a single piece, as in the Ray2/Selection Calculations: a split result keeps its front piece.
+	*/
+
+public:
+
+	enum Op { OP_LOAD = 0, OP_UNION, OP_INTERSECT, OP_SUBTRACT, OP_REVSUBTRACT, OPSIZE };	// OP_REVSUBTRACT: top minus second
+
+	static const int MAXLEAFSIZE = 8;									// max size of ray units per program (= MAXUNITSIZE in Ray.cpp)
+
+	static const int MAXREGSIZE = 4;									// max stack depth of a program (= REGSIZE in select.frag)
+
+	static const int MAXPROGRAMSIZE = 2 * MAXLEAFSIZE;					// (n units: 2n - 1 codes)
+
+	struct Node {
+		/* This structure contains a node of a CSG tree. */
+		int op, left, right;											// op: Op (OP_LOAD: left is the unit index), left/right: child nodes
+	};
+
+	struct Program {
+		/* This structure contains a compiled selection program. */
+		int code[MAXPROGRAMSIZE], size;									// size 0: empty object (no unit left)
+		std::vector<int> leaf;											// units used by the program (operand n: leaf[n])
+		Scene::Bounds bounds;											// bounds of the result in model space
+	};
+
+	struct Interval {
+		/* This structure contains a ray interval. (t[0] >= t[1]: empty) */
+		float t[2];
+	};
+
+	typedef void(*Load)(void* context, int operand, Interval& out);	// find the interval of a unit of a program
+
+
+	static bool Compile(const std::vector<Node>& tree, int root, const int* unitkey, const Scene::Bounds* unitbounds, Program& out);
+																		// compile a tree (unitkey: units of the same key are the same unit)
+																		// false: too many units (MAXLEAFSIZE) left
+
+	static void Chain(int unitsize, const Scene::Bounds& primary, Program& out);	// the first unit minus the others (the default program)
+
+	static bool IsValid(const int* code, int size, int unitsize);		// test a program read from a file
+
+	static int Subtrahends(const int* code, int size);					// operands only loaded to be subtracted (bit n: operand n)
+
+	static Interval Run(const int* code, int size, Load load, void* context);	// run a program (loads are skipped where the result is known)
+
+};
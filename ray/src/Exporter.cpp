@@ -0,0 +1,346 @@
+/* ** EXPLANATION **
+
+    Exporter class writes the frames read back by Ray (see Ray::SetExport(..)) as image files on writer threads of its own.
+
+*/
+
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <iostream>
+
+#include "Exporter.h"                                                   // class ray::Exporter declared here
+
+#include "constant.h"
+
+
+using namespace ray;
+
+
+struct Exporter::Item {
+    /* This structure contains a frame queued. */
+    unsigned int frame = 0; bool selection = false;
+    std::vector<unsigned char> rgb; std::vector<float> depth; std::vector<int> index;
+};
+
+static bool checkpattern(const std::string& pattern);
+
+static bool endswith(const std::string& s, const char* end);
+
+static std::string filename(const std::string& pattern, unsigned int frame);
+
+static bool writefile(const std::string& file, const void* data, size_t size);
+
+static void encodepng(const unsigned char* rgb, int width, int height, std::vector<unsigned char>& out);
+
+
+// *****************************************
+//  Constructor
+// *****************************************
+
+Exporter::Exporter(const char* pattern, const char* selectionpattern, int threadsize) : writtensize(0), failedsize(0), waitsize(0) {
+
+    /* Check the patterns, make the buffers and start the writers. */
+
+    this->pattern = pattern ? pattern : ""; this->selectionpattern = selectionpattern ? selectionpattern : "";
+
+    format = endswith(this->pattern, ".png") ? FORMAT_PNG : endswith(this->pattern, ".ppm") ? FORMAT_PPM : FORMAT_RAW;
+
+    open = checkpattern(this->pattern) && (this->selectionpattern.empty() || checkpattern(this->selectionpattern));
+
+    if (!open) { std::cout << "Error: Export file pattern must have a single %d. (\"" << this->pattern << "\", \"" << this->selectionpattern << "\")\n"; return; }
+
+    for (int n = 0; n < QUEUESIZE; ++n) { pool.emplace_back(new Item); freelist.push_back(pool.back().get()); }
+
+    for (int n = 0; n < std::max(threadsize, 1); ++n) { writer.emplace_back(&Exporter::Work, this); }
+
+}
+
+
+// *****************************************
+//  Close
+// *****************************************
+
+Exporter::~Exporter(void) { Close(); }
+
+void Exporter::Close(void) {
+
+    { std::lock_guard<std::mutex> lock(mutex); quit = true; }
+
+    wake.notify_all();
+
+    for (std::thread& t : writer) { t.join(); }                         // (the writers empty the queue first)
+
+    writer.clear(); open = false;
+
+}
+
+
+// *****************************************
+//  Push
+// *****************************************
+
+bool Exporter::IsOpen(void) const { return open; }
+
+bool Exporter::HasSelection(void) const { return open && !selectionpattern.empty(); }
+
+int Exporter::GetWrittenSize(void) const { return writtensize.load(); }
+
+int Exporter::GetFailedSize(void) const { return failedsize.load(); }
+
+int Exporter::GetWaitSize(void) const { return waitsize.load(); }
+
+void Exporter::Push(const Ray::ExportFrame& frame) {
+
+    /* Take a free buffer (waiting for one if the writers are QUEUESIZE frames behind), copy the frame into it, and queue it. */
+
+    if (!open || !frame.rgb) return;
+
+    Item* item = nullptr;
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        if (freelist.empty()) { ++waitsize; space.wait(lock, [this] { return !freelist.empty(); }); }
+
+        item = freelist.back(); freelist.pop_back();
+    }
+
+    const size_t size = (size_t)PIXELS_W * PIXELS_H;
+
+    item->frame = frame.frame;
+    item->rgb.assign(frame.rgb, frame.rgb + 3 * size);                  // (no allocation once the buffer is grown)
+
+    item->selection = !selectionpattern.empty() && frame.depth && frame.index;
+
+    if (item->selection) { item->depth.assign(frame.depth, frame.depth + size); item->index.assign(&frame.index[0][0], &frame.index[0][0] + 3 * size); }
+
+    { std::lock_guard<std::mutex> lock(mutex); queue.push_back(item); }
+
+    wake.notify_one();
+
+}
+
+
+// *****************************************
+//  Write
+// *****************************************
+
+void Exporter::Work(void) {
+
+    /* Write the frames queued until quit, then the ones left. */
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+
+        wake.wait(lock, [this] { return quit || !queue.empty(); });
+
+        if (queue.empty()) break;                                       // (quit)
+
+        Item* item = queue.front(); queue.erase(queue.begin());
+
+        lock.unlock();
+
+        bool res = Write(*item);
+
+        (res ? writtensize : failedsize).fetch_add(1);
+
+        lock.lock();
+
+        freelist.push_back(item); space.notify_one();
+
+    }
+
+}
+
+bool Exporter::Write(const Item& item) {
+
+    /* Encode the screen in the format, and write it and the selection files. */
+
+    const std::string file = filename(pattern, item.frame);
+
+    bool res = false;
+
+    if (format == FORMAT_PNG) {
+
+        thread_local std::vector<unsigned char> png;                    // (a buffer per writer, reused)
+
+        encodepng(item.rgb.data(), PIXELS_W, PIXELS_H, png);
+
+        res = writefile(file, png.data(), png.size());
+
+    }
+    else if (format == FORMAT_PPM) {
+
+        char header[32]; int headersize = std::snprintf(header, sizeof(header), "P6\n%d %d\n255\n", PIXELS_W, PIXELS_H);
+
+        FILE* fp = std::fopen(file.c_str(), "wb");
+
+        res = fp && std::fwrite(header, 1, headersize, fp) == (size_t)headersize && std::fwrite(item.rgb.data(), 1, item.rgb.size(), fp) == item.rgb.size();
+
+        if (fp) res = (std::fclose(fp) == 0) && res;
+
+    }
+    else { res = writefile(file, item.rgb.data(), item.rgb.size()); }
+
+    if (res && item.selection) {
+
+        const std::string selectionfile = filename(selectionpattern, item.frame);
+
+        res = writefile(selectionfile + ".depth", item.depth.data(), sizeof(float) * item.depth.size())
+            && writefile(selectionfile + ".index", item.index.data(), sizeof(int) * item.index.size());
+
+    }
+
+    if (!res) std::cout << "Error: Export file cannot be written. (\"" << file << "\")\n";
+
+    return res;
+
+}
+
+
+// *****************************************
+//  Files
+// *****************************************
+
+static bool checkpattern(const std::string& pattern) {
+
+    /* A pattern has a single conversion, %d with an optional zero flag and width (e.g. %05d). "%%" is a '%'. */
+
+    int size = 0;
+
+    for (size_t i = 0; i < pattern.size(); ++i) {
+
+        if (pattern[i] != '%') continue;
+
+        if (i + 1 < pattern.size() && pattern[i + 1] == '%') { ++i; continue; }
+
+        size_t j = i + 1; while (j < pattern.size() && pattern[j] >= '0' && pattern[j] <= '9') { ++j; }
+
+        if (j >= pattern.size() || pattern[j] != 'd' || j - i > 4) return false;       // (width up to 3 digits)
+
+        ++size; i = j;
+
+    }
+
+    return size == 1;
+
+}
+
+static bool endswith(const std::string& s, const char* end) {
+
+    size_t size = std::strlen(end);
+
+    return s.size() >= size && s.compare(s.size() - size, size, end) == 0;
+
+}
+
+static std::string filename(const std::string& pattern, unsigned int frame) {
+
+    char file[1024]; std::snprintf(file, sizeof(file), pattern.c_str(), (int)frame);     // (the pattern is checked)
+
+    return file;
+
+}
+
+static bool writefile(const std::string& file, const void* data, size_t size) {
+
+    FILE* fp = std::fopen(file.c_str(), "wb"); if (!fp) return false;
+
+    bool res = std::fwrite(data, 1, size, fp) == size;
+
+    return (std::fclose(fp) == 0) && res;
+
+}
+
+static unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc = 0);
+
+static void encodepng(const unsigned char* rgb, int width, int height, std::vector<unsigned char>& out) {
+
+    /*
+        Encode an RGB image as PNG: a zlib stream of stored deflate blocks (not compressed), each row with filter 0.
+
+        The encoding is a copy with checksums, so that a writer keeps up with the frames. (A PNG optimizer can compress the files later.)
+    */
+
+    const size_t rowsize = 3 * (size_t)width + 1, rawsize = rowsize * height;
+    const size_t BLOCKSIZE = 65535;                                     // max bytes of a stored block
+
+    auto put32 = [&out](unsigned int v) { out.push_back(v >> 24); out.push_back((v >> 16) & 255); out.push_back((v >> 8) & 255); out.push_back(v & 255); };
+
+    out.clear(); out.reserve(rawsize + rawsize / BLOCKSIZE * 5 + 128);
+
+    const unsigned char signature[8] = { 137, 'P', 'N', 'G', 13, 10, 26, 10 };
+    out.insert(out.end(), signature, signature + 8);
+
+    // IHDR
+
+    put32(13); size_t chunk = out.size();
+    out.insert(out.end(), { 'I', 'H', 'D', 'R' }); put32(width); put32(height);
+    out.insert(out.end(), { 8, 2, 0, 0, 0 });                           // 8 bits, RGB, deflate, filter 0, no interlace
+    put32(crc32(&out[chunk], out.size() - chunk));
+
+    // IDAT (a single chunk)
+
+    size_t sizepos = out.size(); put32(0); chunk = out.size();
+    out.insert(out.end(), { 'I', 'D', 'A', 'T', 0x78, 0x01 });         // zlib header (deflate, 32K window, no preset)
+
+    unsigned int a = 1, b = 0;                                          // adler32 of the raw data
+
+    size_t blockleft = 0;
+
+    for (size_t n = 0; n < rawsize; ) {
+
+        if (blockleft == 0) {
+            blockleft = std::min(BLOCKSIZE, rawsize - n);
+            out.push_back(n + blockleft == rawsize);                    // BFINAL, BTYPE 00 (stored)
+            out.push_back(blockleft & 255); out.push_back(blockleft >> 8); out.push_back(~blockleft & 255); out.push_back((~blockleft >> 8) & 255);
+        }
+
+        const size_t y = n / rowsize, x = n % rowsize;
+
+        const size_t size = std::min(blockleft, (x == 0) ? 1 : rowsize - x);
+
+        const unsigned char zero = 0;
+        const unsigned char* src = (x == 0) ? &zero : rgb + 3 * (size_t)width * y + (x - 1);
+
+        out.insert(out.end(), src, src + size);
+
+        for (size_t i = 0; i < size; ++i) { a += src[i]; if (a >= 65521) a -= 65521; b += a; if (b >= 65521) b -= 65521; }
+
+        n += size; blockleft -= size;
+
+    }
+
+    put32((b << 16) | a);
+
+    const unsigned int datasize = (unsigned int)(out.size() - chunk - 4);
+    out[sizepos] = datasize >> 24; out[sizepos + 1] = (datasize >> 16) & 255; out[sizepos + 2] = (datasize >> 8) & 255; out[sizepos + 3] = datasize & 255;
+
+    put32(crc32(&out[chunk], out.size() - chunk));
+
+    // IEND
+
+    put32(0); chunk = out.size();
+    out.insert(out.end(), { 'I', 'E', 'N', 'D' });
+    put32(crc32(&out[chunk], out.size() - chunk));
+
+}
+
+static unsigned int crc32(const unsigned char* data, size_t size, unsigned int crc) {
+
+    /* The CRC of PNG chunks (by a table of the bytes, made at the first call). */
+
+    static const struct Table {
+        unsigned int value[256];
+        Table(void) { for (unsigned int n = 0; n < 256; ++n) { unsigned int c = n; for (int k = 0; k < 8; ++k) { c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1; } value[n] = c; } }
+    } table;
+
+    crc = ~crc;
+
+    for (size_t n = 0; n < size; ++n) { crc = table.value[(crc ^ data[n]) & 255] ^ (crc >> 8); }
+
+    return ~crc;
+
+}
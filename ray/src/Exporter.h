@@ -0,0 +1,86 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Exporter class writes the frames read back by Ray (see Ray::SetExport(..)) as image files on writer threads of its own.
+
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Ray.h"
+
+namespace ray {
+
+	class Exporter;
+
+}
+
+class ray::Exporter {
+
+	/*
+		In this class:
+
+			- Copy a frame passed by Ray into a buffer of a pool, and queue it. (The GL thread only copies: the buffers are reused.)
+
+			- Encode and write the frames queued on the writer threads: the screen as PNG (stored, not compressed: encoded at the
+			  speed of a copy), PPM or raw RGB, and the selection depth (float) and index ((ray object, unit, plane) ints) as raw files.
+
+		The file names are printf patterns of the frame number (one %d, e.g. "out/frame%05d.png").
+		If the writers fall behind by QUEUESIZE frames, Push(..) waits for them, so that no frame is dropped.
+	*/
+
+public:
+
+	enum Format { FORMAT_PNG = 0, FORMAT_PPM, FORMAT_RAW };
+
+	static const int QUEUESIZE = 16;									// frames queued for the writers
+
+	Exporter(const char* pattern, const char* selectionpattern = nullptr, int threadsize = 2);
+																		// pattern: screen files (format by extension: ".png", ".ppm", else raw)
+																		// selectionpattern: selection files (".depth", ".index" appended, nullptr: none)
+
+	~Exporter(void);													// close
+
+	void Close(void);													// write the frames queued and join the writers (no frames are taken after)
+
+	bool IsOpen(void) const;											// false: a pattern is not valid
+
+	bool HasSelection(void) const;										// selection files are written
+
+	void Push(const Ray::ExportFrame& frame);							// copy a frame and queue it (GL thread)
+
+	int GetWrittenSize(void) const;										// frames written
+
+	int GetFailedSize(void) const;										// frames which could not be written
+
+	int GetWaitSize(void) const;										// times Push(..) waited for the writers
+
+private:
+
+	struct Item;														// a frame queued (or a free buffer)
+
+	std::string pattern, selectionpattern; Format format = FORMAT_PNG; bool open = false;
+
+	std::vector<std::unique_ptr<Item>> pool;							// all the buffers
+	std::vector<Item*> queue, freelist;									// queue: frames to be written, oldest first
+
+	std::mutex mutex; std::condition_variable wake, space; bool quit = false;
+
+	std::atomic<int> writtensize, failedsize, waitsize;
+
+	std::vector<std::thread> writer;
+
+	void Work(void);													// writer thread loop
+
+	bool Write(const Item& item);										// encode and write the files of a frame
+
+	Exporter(const Exporter&) = delete; Exporter& operator=(const Exporter&) = delete;
+
+};
@@ -0,0 +1,258 @@
+/* ** EXPLANATION **
+
+    FrameStats class collects the frame times into a histogram, and reports percentiles and frame drops at an interval on a thread of its own.
+
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+
+#include "FrameStats.h"                                                 // class ray::FrameStats declared here
+
+
+using namespace ray;
+
+
+static int bucketof(double ms);
+
+static double timeof(int bucket);
+
+static double percentile(const unsigned long long* bucket, unsigned long long count, double p);
+
+
+// *****************************************
+//  Constructor
+// *****************************************
+
+FrameStats::FrameStats(int intervalms, double targetms) : sum(0), max(0), drops(0), intervalms(intervalms > 0 ? intervalms : 1000), targetms(targetms) {
+
+    /* Start the report thread. It sleeps until the next interval. */
+
+    for (std::atomic<unsigned int>& b : bucket) { b.store(0); }
+
+    reported = std::chrono::steady_clock::now();
+
+    reporter = std::thread(&FrameStats::Work, this);
+
+}
+
+
+// *****************************************
+//  Destructor
+// *****************************************
+
+FrameStats::~FrameStats(void) {
+
+    { std::lock_guard<std::mutex> lock(mutex); quit = true; }
+
+    wake.notify_all();
+
+    reporter.join();                                                    // (the last interval is reported on the way out)
+
+}
+
+
+// *****************************************
+//  Record
+// *****************************************
+
+void FrameStats::SetOutput(bool console, const char* logfile, const char* metricsfile) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    this->console = console; this->logfile = logfile ? logfile : ""; this->metricsfile = metricsfile ? metricsfile : "";
+
+}
+
+void FrameStats::Record(double ms) {
+
+    /* Count a frame. (Relaxed atomics: an interval taken during the call may count the frame in its bucket but not yet in its sum.) */
+
+    if (!(ms >= 0.0)) return;                                           // (nan)
+
+    bucket[bucketof(ms)].fetch_add(1, std::memory_order_relaxed);
+
+    long long us = (long long)(ms * 1000.0);
+
+    sum.fetch_add(us, std::memory_order_relaxed);
+
+    long long prev = max.load(std::memory_order_relaxed);
+    while (us > prev && !max.compare_exchange_weak(prev, us, std::memory_order_relaxed)) {}
+
+    long long drop = std::llround(ms / targetms) - 1;
+
+    if (drop > 0) drops.fetch_add(drop, std::memory_order_relaxed);
+
+}
+
+bool FrameStats::GetSummary(Summary& out, bool total) {
+
+    std::lock_guard<std::mutex> lock(mutex);
+
+    out = total ? this->total : last;
+
+    return out.count > 0;
+
+}
+
+
+// *****************************************
+//  Report
+// *****************************************
+
+void FrameStats::Work(void) {
+
+    /* Report at each interval until quit, then report the frames left. */
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (!quit) {
+
+        wake.wait_for(lock, std::chrono::milliseconds(intervalms), [this] { return quit; });
+
+        lock.unlock(); Report(); lock.lock();
+
+    }
+
+}
+
+void FrameStats::Report(void) {
+
+    /*
+        Take the counts of the interval, add them to the total, and write the reports.
+
+        Nothing is written for an interval without frames (e.g. while the window is not drawn). A file which cannot be written is not tried again.
+    */
+
+    const std::chrono::steady_clock::time_point now = std::chrono::steady_clock::now();
+
+    const double elapsed = std::chrono::duration<double>(now - reported).count(); reported = now;     // (s)
+
+    unsigned long long interval[BUCKETSIZE] = {}, count = 0;
+
+    for (int n = 0; n < BUCKETSIZE; ++n) { interval[n] = bucket[n].exchange(0, std::memory_order_relaxed); count += interval[n]; totalbucket[n] += interval[n]; }
+
+    const double intervalsum = sum.exchange(0, std::memory_order_relaxed) * 1.0e-3, intervalmax = max.exchange(0, std::memory_order_relaxed) * 1.0e-3;
+    const long long intervaldrops = drops.exchange(0, std::memory_order_relaxed);
+
+    if (count == 0) return;
+
+    totalsum += intervalsum; totaldrops += intervaldrops; if (intervalmax > totalmax) totalmax = intervalmax;
+
+    unsigned long long totalcount = 0; for (unsigned long long b : totalbucket) { totalcount += b; }
+
+    Summary s, t;
+
+    s.count = (long long)count; s.drops = intervaldrops; s.mean = intervalsum / count; s.max = intervalmax;
+    s.p50 = percentile(interval, count, 0.50); s.p90 = percentile(interval, count, 0.90); s.p99 = percentile(interval, count, 0.99);
+    s.p50 = std::min(s.p50, s.max); s.p90 = std::min(s.p90, s.max); s.p99 = std::min(s.p99, s.max);     // (the bucket middle may be over the max)
+
+    t.count = (long long)totalcount; t.drops = totaldrops; t.mean = totalsum / totalcount; t.max = totalmax;
+    t.p50 = percentile(totalbucket, totalcount, 0.50); t.p90 = percentile(totalbucket, totalcount, 0.90); t.p99 = percentile(totalbucket, totalcount, 0.99);
+    t.p50 = std::min(t.p50, t.max); t.p90 = std::min(t.p90, t.max); t.p99 = std::min(t.p99, t.max);
+
+    bool console = false; std::string logfile, metricsfile;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        last = s; total = t;
+
+        console = this->console; logfile = this->logfile; metricsfile = this->metricsfile;
+    }
+
+    // console: a line rewritten in place
+
+    if (console) {
+        std::printf("\r%5.1f fps | frame p50 %6.2f p90 %6.2f p99 %6.2f max %7.2f ms | drops %lld (total %lld) ", s.count / std::max(elapsed, 1.0e-3),
+            s.p50, s.p90, s.p99, s.max, s.drops, t.drops);
+        std::fflush(stdout);
+    }
+
+    // log file: a line per interval (appended)
+
+    if (!logfile.empty()) {
+
+        FILE* fp = std::fopen(logfile.c_str(), "a");
+
+        if (fp) {
+            std::fprintf(fp, "frames %lld mean %.3f p50 %.3f p90 %.3f p99 %.3f max %.3f drops %lld total_frames %lld total_p99 %.3f total_drops %lld\n",
+                s.count, s.mean, s.p50, s.p90, s.p99, s.max, s.drops, t.count, t.p99, t.drops);
+            std::fclose(fp);
+        }
+        else { std::cout << "\nError: Frame stats log file cannot be written. (\"" << logfile << "\")\n"; std::lock_guard<std::mutex> lock(mutex); this->logfile.clear(); }
+
+    }
+
+    // metrics file: the totals as counters, the interval as gauges (written aside, then renamed over, so a reader never sees a part)
+
+    if (!metricsfile.empty()) {
+
+        std::string tmpfile = metricsfile + ".tmp";
+
+        FILE* fp = std::fopen(tmpfile.c_str(), "w");
+
+        bool res = fp != nullptr;
+
+        if (fp) {
+            std::fprintf(fp, "# TYPE ray_frames_total counter\nray_frames_total %lld\n", t.count);
+            std::fprintf(fp, "# TYPE ray_frame_drops_total counter\nray_frame_drops_total %lld\n", t.drops);
+            std::fprintf(fp, "# TYPE ray_frame_time_ms gauge\n");
+            const char* label[4] = { "0.5", "0.9", "0.99", "1" }; const double value[4] = { s.p50, s.p90, s.p99, s.max };
+            for (int i = 0; i < 4; ++i) { std::fprintf(fp, "ray_frame_time_ms{quantile=\"%s\"} %.3f\n", label[i], value[i]); }
+            std::fprintf(fp, "# TYPE ray_frame_time_mean_ms gauge\nray_frame_time_mean_ms %.3f\n", s.mean);
+            res = std::fclose(fp) == 0;
+        }
+
+        if (res && std::rename(tmpfile.c_str(), metricsfile.c_str()) != 0) {
+            std::remove(metricsfile.c_str());                           // (rename does not replace a file on some systems)
+            res = std::rename(tmpfile.c_str(), metricsfile.c_str()) == 0;
+        }
+
+        if (!res) { std::cout << "\nError: Frame stats metrics file cannot be written. (\"" << metricsfile << "\")\n"; std::lock_guard<std::mutex> lock(mutex); this->metricsfile.clear(); }
+
+    }
+
+}
+
+
+// *****************************************
+
+// *****************************************
+
+static int bucketof(double ms) {
+
+    /* The bucket of a frame time: BUCKETSTEP per octave from MINTIME (shorter: the first, longer: the last). */
+
+    if (ms <= FrameStats::MINTIME) return 0;
+
+    int n = (int)(std::log2(ms / FrameStats::MINTIME) * FrameStats::BUCKETSTEP);
+
+    return (n < FrameStats::BUCKETSIZE) ? n : FrameStats::BUCKETSIZE - 1;
+
+}
+
+static double timeof(int bucket) {
+
+    /* The frame time of a bucket: the geometric middle of its bounds. */
+
+    return FrameStats::MINTIME * std::exp2((bucket + 0.5) / FrameStats::BUCKETSTEP);
+
+}
+
+static double percentile(const unsigned long long* bucket, unsigned long long count, double p) {
+
+    /* The percentile of a histogram, by nearest rank. */
+
+    unsigned long long rank = (unsigned long long)std::ceil(p * count), seen = 0;
+
+    if (rank < 1) rank = 1;
+
+    for (int n = 0; n < FrameStats::BUCKETSIZE; ++n) { seen += bucket[n]; if (seen >= rank) return timeof(n); }
+
+    return timeof(FrameStats::BUCKETSIZE - 1);
+
+}
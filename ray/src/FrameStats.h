@@ -0,0 +1,88 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	FrameStats class collects the frame times into a histogram, and reports percentiles and frame drops at an interval on a thread of its own.
+
+*/
+
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <mutex>
+#include <string>
+#include <thread>
+
+namespace ray {
+
+	class FrameStats;
+
+}
+
+class ray::FrameStats {
+
+	/*
+		In this class:
+
+			- Count the frame times into a fixed histogram of log spaced buckets (BUCKETSTEP per octave from MINTIME),
+			  by atomic increments: the render thread takes no lock and allocates nothing.
+
+			- Take the histogram of the last interval on the report thread (the counts are exchanged for zeros), and add it to the total one.
+
+			- Report the percentiles (by bucket, about 4% apart), the mean, the max and the frame drops of the interval and of the total:
+			  a line on the console, a line appended to a log file, and a metrics text file (Prometheus exposition format, replaced whole).
+
+		A frame drops the vertical blanks it takes beyond the first: round(time / target) - 1 (at least 0).
+	*/
+
+public:
+
+	static const int BUCKETSIZE = 256;									// histogram buckets (the last one also counts longer frames)
+
+	static const int BUCKETSTEP = 16;									// buckets per octave
+
+	static constexpr double MINTIME = 0.1;								// lower bound of the first bucket (ms)
+
+	struct Summary {
+		/* This structure contains the statistics of frame times (ms). */
+		long long count = 0, drops = 0;									// drops: vertical blanks missed
+		double mean = 0.0, p50 = 0.0, p90 = 0.0, p99 = 0.0, max = 0.0;
+	};
+
+	FrameStats(int intervalms = 1000, double targetms = 1000.0 / 60.0);	// start the report thread (targetms: the frame time of a vertical blank)
+
+	~FrameStats(void);													// report the last interval and join the report thread
+
+	void SetOutput(bool console, const char* logfile, const char* metricsfile);	// set the reports (nullptr: none), before the frames are recorded
+
+	void Record(double ms);												// count a frame time (render thread, no lock)
+
+	bool GetSummary(Summary& out, bool total);							// get the last interval reported (total: all of the intervals), false: none
+
+private:
+
+	std::atomic<unsigned int> bucket[BUCKETSIZE];						// counts of the current interval
+	std::atomic<long long> sum, max, drops;								// sum, max: (us)
+
+	unsigned long long totalbucket[BUCKETSIZE] = {};					// counts of the reported intervals (report thread)
+	double totalsum = 0.0, totalmax = 0.0; long long totaldrops = 0;
+
+	Summary last, total;												// the last reports (guarded by mutex)
+
+	const int intervalms; const double targetms;
+
+	std::chrono::steady_clock::time_point reported;						// time of the last report (report thread)
+
+	bool console = false; std::string logfile, metricsfile;
+
+	std::mutex mutex; std::condition_variable wake; bool quit = false;
+
+	std::thread reporter;
+
+	void Work(void);													// report thread loop
+
+	void Report(void);													// take the interval and write the reports
+
+	FrameStats(const FrameStats&) = delete; FrameStats& operator=(const FrameStats&) = delete;
+
+};
@@ -0,0 +1,150 @@
+/* ** EXPLANATION **
+
+    Jobs class runs batches of a Cpu task in parallel on a pool of worker threads.
+
+*/
+
+#include "Jobs.h"                                                       // class ray::Jobs declared here
+#include "Timeline.h"                                                   // class ray::Timeline declared here
+
+
+using namespace ray;
+
+
+// *****************************************
+//  Constructor
+// *****************************************
+
+Jobs::Jobs(int threadsize) : next(0), remaining(0) {
+
+    /* Start the workers. They sleep until a task is run. */
+
+    if (threadsize < 0) { threadsize = (int)std::thread::hardware_concurrency() - 1; }
+
+    for (int n = 0; n < threadsize; ++n) { worker.emplace_back(&Jobs::Work, this); }
+
+}
+
+
+// *****************************************
+//  Destructor
+// *****************************************
+
+Jobs::~Jobs(void) {
+
+    { std::lock_guard<std::mutex> lock(mutex); quit = true; }
+
+    start.notify_all();
+
+    for (std::thread& t : worker) { t.join(); }
+
+}
+
+
+// *****************************************
+//  Run
+// *****************************************
+
+void Jobs::Run(int size, int batchsize, Task task, void* context) {
+
+    /*
+        Process [0, size) in batches. A task of a single batch (or without workers) is run on the calling thread only.
+
+        Batches are taken through an atomic counter, so uneven batches are balanced over the threads.
+    */
+
+    if (size <= 0) return;
+
+    if (batchsize < 1) batchsize = 1;
+
+    if (worker.empty() || size <= batchsize) { task(context, 0, size); return; }
+
+    {
+        std::unique_lock<std::mutex> lock(mutex);
+
+        done.wait(lock, [this] { return active == 0; });                // a worker late for the last task may still be leaving it
+
+        this->task = task; this->context = context; this->size = size; this->batchsize = batchsize;
+
+        next.store(0); remaining.store((size + batchsize - 1) / batchsize);
+
+        ++generation;
+    }
+
+    start.notify_all();
+
+    Batch();                                                            // the calling thread takes batches too
+
+    // wait for the batches taken by the workers, and for the workers to leave the task
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    done.wait(lock, [this] { return remaining.load() == 0 && active == 0; });
+
+}
+
+
+// *****************************************
+//  Access
+// *****************************************
+
+int Jobs::GetThreadSize(void) const { return (int)worker.size(); }
+
+
+// *****************************************
+
+// *****************************************
+
+void Jobs::Work(void) {
+
+    /* Wait for a new task, take its batches and report when it is done. */
+
+    unsigned int seen = 0;
+
+    while (true) {
+
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+
+            start.wait(lock, [this, seen] { return quit || generation != seen; });
+
+            if (quit) return;
+
+            seen = generation; ++active;
+        }
+
+        Batch();
+
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+
+            --active;
+        }
+
+        done.notify_all();
+
+    }
+
+}
+
+void Jobs::Batch(void) {
+
+    /* Take batches until none is left. */
+
+    const int batchsize = this->batchsize;
+
+    while (true) {
+
+        int begin = next.fetch_add(1) * batchsize;
+
+        if (begin >= size) return;
+
+        int end = (begin + batchsize < size) ? begin + batchsize : size;
+
+        { Timeline::Scope scope("Jobs batch"); task(context, begin, end); }     // (recorded on the timeline of this thread)
+
+        remaining.fetch_sub(1);
+
+    }
+
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Jobs class runs batches of a Cpu task in parallel on a pool of worker threads.
+
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace ray {
+
+	class Jobs;
+
+}
+
+class ray::Jobs {
+
+	/*
+		In this class:
+
+			- Keep worker threads waiting for tasks. (Started once, not per task.)
+
+			- Split a task over [0, size) into batches, which the workers and the calling thread take in turn.
+
+		Tasks are run one at a time, and Run(..) returns when all of the batches are done.
+	*/
+
+public:
+
+	typedef void(*Task)(void* context, int begin, int end);			// process the indices [begin, end)
+
+	Jobs(int threadsize = -1);											// threadsize: number of workers (-1: hardware threads - 1)
+
+	~Jobs(void);														// join the workers
+
+	void Run(int size, int batchsize, Task task, void* context);		// process [0, size) in batches of batchsize (the task must be thread safe)
+
+	int GetThreadSize(void) const;										// number of workers (the calling thread is not counted)
+
+private:
+
+	std::vector<std::thread> worker;
+
+	std::mutex mutex; std::condition_variable start, done;
+
+	Task task = nullptr; void* context = nullptr;
+
+	int size = 0, batchsize = 1;
+
+	std::atomic<int> next, remaining;									// next: index of the next batch, remaining: batches not done yet
+
+	unsigned int generation = 0; int active = 0; bool quit = false;	// generation: counts the tasks, active: workers in the current task
+
+	void Work(void);													// worker thread loop
+
+	void Batch(void);													// take and process batches until none is left
+
+	Jobs(const Jobs&) = delete; Jobs& operator=(const Jobs&) = delete;
+
+};
@@ -0,0 +1,939 @@
+/* ** EXPLANATION **
+
+    Mesh class imports triangle meshes as Ray Units.
+
+    Triangles are wound counterclockwise seen from outside. (A mesh of negative volume is flipped.)
+
+    Unit planes are written as [(pos, 1.0), (normal, 0.0), (u-axis, 0.0)] with the normals out, as in Unit.h.
+
+*/
+
+#include <algorithm>
+#include <cctype>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <iostream>
+#include <map>
+#include <sstream>
+#include <string>
+#include <tuple>
+#include <unordered_map>
+
+#include "Mesh.h"                                                       // class ray::Mesh declared here
+
+
+using namespace ray;
+
+
+#define EPSILON 1.0e-6                                                  // tolerance of a point on a plane (relative to the mesh size)
+#define MINVOLUME 1.0e-3                                                // pockets below this fraction of the mesh hull volume are dropped
+#define MAXLEVEL 3                                                      // levels of parts (the mesh hull, its pockets and theirs: up to 4 registers in a program)
+#define NORMALCELL 1.0e-2                                               // cell size of the normal grid to find coplanar faces
+#define CLASSIFYANGLE 2.0e-3                                            // max angle of a triangle on a hull plane (thin triangles: less exact normals)
+#define MERGEANGLE 0.02                                                 // first angle (rad) of merging face normals (doubled while a hull has too many planes)
+#define MAXMERGEANGLE 0.7                                               // last angle (the planes still surround the hull)
+
+
+// *****************************************
+//  Load
+// *****************************************
+
+static bool readfile(const char* file, std::string& out);
+
+static bool loadobj(const std::string& text, std::vector<float>& outvertex, std::vector<int>& outtriangle);
+
+static bool loadply(const std::string& text, std::vector<float>& outvertex, std::vector<int>& outtriangle);
+
+
+bool Mesh::Load(const char* file, std::vector<float>& outvertex, std::vector<int>& outtriangle) {
+
+    /* Read a mesh by its file extension (".obj" or ".ply"). Polygons are split into triangle fans (convex polygons are assumed). */
+
+    outvertex.clear(); outtriangle.clear();
+
+    const char* ext = std::strrchr(file, '.'); std::string text;
+
+    if (!ext || !readfile(file, text)) return false;
+
+    std::string lower(ext); for (char& c : lower) { c = (char)std::tolower((unsigned char)c); }
+
+    if (lower == ".obj") return loadobj(text, outvertex, outtriangle);
+    if (lower == ".ply") return loadply(text, outvertex, outtriangle);
+
+    return false;
+
+}
+
+static bool readfile(const char* file, std::string& out) {
+
+    /* Read a whole file. */
+
+    FILE* fp = std::fopen(file, "rb"); if (!fp) return false;
+
+    std::fseek(fp, 0, SEEK_END); long size = std::ftell(fp); std::fseek(fp, 0, SEEK_SET);
+
+    out.assign(size > 0 ? size : 0, '\0');
+    bool res = size <= 0 || std::fread(&out[0], 1, size, fp) == (size_t)size;
+
+    std::fclose(fp);
+
+    return res;
+
+}
+
+static bool loadobj(const std::string& text, std::vector<float>& outvertex, std::vector<int>& outtriangle) {
+
+    /* Read the "v" and "f" statements of an OBJ file. (Face vertices "v/vt/vn": only v is read. Negative: relative to the last vertex.) */
+
+    std::istringstream in(text); std::string line;
+
+    while (std::getline(in, line)) {
+
+        std::istringstream ls(line); std::string tag; ls >> tag;
+
+        if (tag == "v") {
+
+            float p[3]; if (!(ls >> p[0] >> p[1] >> p[2])) return false;
+
+            outvertex.insert(outvertex.end(), p, p + 3);
+
+        }
+        else if (tag == "f") {
+
+            std::vector<int> face; std::string token; int vertexsize = (int)(outvertex.size() / 3);
+
+            while (ls >> token) {
+                int index = std::atoi(token.c_str()); index = (index < 0) ? vertexsize + index : index - 1;
+                if (index < 0 || index >= vertexsize) return false;
+                face.push_back(index);
+            }
+
+            for (size_t i = 2; i < face.size(); ++i) { outtriangle.push_back(face[0]); outtriangle.push_back(face[i - 1]); outtriangle.push_back(face[i]); }
+
+        }
+
+    }
+
+    return true;
+
+}
+
+namespace {
+
+    enum PlyType { PLY_CHAR = 0, PLY_UCHAR, PLY_SHORT, PLY_USHORT, PLY_INT, PLY_UINT, PLY_FLOAT, PLY_DOUBLE, PLYTYPESIZE };
+
+    struct PlyProperty {
+        /* This structure contains a property of a PLY element. */
+        std::string name; int type, counttype; bool list;             // list: counttype values, then count values of type
+    };
+
+    struct PlyElement {
+        /* This structure contains an element of a PLY file. */
+        std::string name; long long count; std::vector<PlyProperty> property;
+    };
+
+    struct PlyReader {
+
+        /* This structure reads the values of a PLY body. */
+
+        const char* ptr; const char* end; int format;                   // format: 0: ascii, 1: binary little endian, 2: binary big endian
+
+        bool Read(int type, double& out);
+
+    };
+
+}
+
+static int plytype(const std::string& name);
+
+static bool loadply(const std::string& text, std::vector<float>& outvertex, std::vector<int>& outtriangle) {
+
+    /* Read the vertex positions (x, y, z) and faces (vertex_indices) of a PLY file. Other elements and properties are skipped. */
+
+    size_t headerend = text.find("end_header"); if (text.compare(0, 3, "ply") != 0 || headerend == std::string::npos) return false;
+
+    size_t bodystart = text.find('\n', headerend); if (bodystart == std::string::npos) return false;
+
+    std::vector<PlyElement> element; int format = -1; {
+
+        std::istringstream in(text.substr(0, headerend)); std::string line;
+
+        while (std::getline(in, line)) {
+
+            std::istringstream ls(line); std::string tag; ls >> tag;
+
+            if (tag == "format") {
+
+                std::string name; ls >> name;
+                format = (name == "ascii") ? 0 : (name == "binary_little_endian") ? 1 : (name == "binary_big_endian") ? 2 : -1;
+
+            }
+            else if (tag == "element") {
+
+                PlyElement e = { "", 0, {} }; if (!(ls >> e.name >> e.count) || e.count < 0) return false;
+                element.push_back(e);
+
+            }
+            else if (tag == "property") {
+
+                if (element.empty()) return false;
+
+                PlyProperty p = { "", -1, -1, false }; std::string type; ls >> type;
+
+                if (type == "list") { std::string counttype; ls >> counttype >> type; p.list = true; p.counttype = plytype(counttype); if (p.counttype < 0) return false; }
+
+                p.type = plytype(type); ls >> p.name;
+                if (p.type < 0 || p.name.empty()) return false;
+
+                element.back().property.push_back(p);
+
+            }
+
+        }
+
+    }
+
+    if (format < 0) return false;
+
+    PlyReader reader = { text.data() + bodystart + 1, text.data() + text.size(), format };
+
+    for (const PlyElement& e : element) {
+
+        int axis[3] = { -1, -1, -1 }, face = -1;
+
+        for (int p = 0; p < (int)e.property.size(); ++p) {
+            const std::string& name = e.property[p].name;
+            if (e.name == "vertex" && !e.property[p].list && name.size() == 1 && name[0] >= 'x' && name[0] <= 'z') axis[name[0] - 'x'] = p;
+            if (e.name == "face" && e.property[p].list && (name == "vertex_indices" || name == "vertex_index")) face = p;
+        }
+
+        if (e.name == "vertex" && (axis[0] < 0 || axis[1] < 0 || axis[2] < 0)) return false;
+
+        for (long long n = 0; n < e.count; ++n) {
+
+            float pos[3] = {}; std::vector<int> polygon;
+
+            for (int p = 0; p < (int)e.property.size(); ++p) {
+
+                const PlyProperty& prop = e.property[p];
+
+                double count = 1.0; if (prop.list && !reader.Read(prop.counttype, count)) return false;
+                if (count < 0.0 || count > 1.0e6) return false;
+
+                for (int i = 0; i < (int)count; ++i) {
+
+                    double val = 0.0; if (!reader.Read(prop.type, val)) return false;
+
+                    for (int k = 0; k < 3; ++k) { if (p == axis[k]) pos[k] = (float)val; }
+
+                    if (p == face) polygon.push_back((int)val);
+
+                }
+
+            }
+
+            if (e.name == "vertex") { outvertex.insert(outvertex.end(), pos, pos + 3); }
+
+            for (size_t i = 2; i < polygon.size(); ++i) { outtriangle.push_back(polygon[0]); outtriangle.push_back(polygon[i - 1]); outtriangle.push_back(polygon[i]); }
+
+        }
+
+    }
+
+    for (int index : outtriangle) { if (index < 0 || index >= (int)(outvertex.size() / 3)) return false; }
+
+    return true;
+
+}
+
+static int plytype(const std::string& name) {
+
+    /* Find a PLY type by its name. (Both the old and the sized names.) */
+
+    const char* namelist[2][PLYTYPESIZE] = {
+        { "char", "uchar", "short", "ushort", "int", "uint", "float", "double" },
+        { "int8", "uint8", "int16", "uint16", "int32", "uint32", "float32", "float64" }
+    };
+
+    for (int i = 0; i < PLYTYPESIZE; ++i) { if (name == namelist[0][i] || name == namelist[1][i]) return i; }
+
+    return -1;
+
+}
+
+bool PlyReader::Read(int type, double& out) {
+
+    /* Read a value. (Binary values are byte swapped if the file endian differs from the host.) */
+
+    if (format == 0) {
+
+        while (ptr < end && std::isspace((unsigned char)*ptr)) { ++ptr; }
+
+        char* tail = nullptr; std::string token;
+        for (const char* p = ptr; p < end && !std::isspace((unsigned char)*p); ++p) { token += *p; }
+
+        out = std::strtod(token.c_str(), &tail);
+        if (token.empty() || tail != token.c_str() + token.size()) return false;
+
+        ptr += token.size(); return true;
+
+    }
+
+    const int size[PLYTYPESIZE] = { 1, 1, 2, 2, 4, 4, 4, 8 };
+
+    if (end - ptr < size[type]) return false;
+
+    unsigned char bytes[8]; std::memcpy(bytes, ptr, size[type]); ptr += size[type];
+
+    const unsigned int one = 1; bool little = *(const unsigned char*)&one == 1;
+
+    if ((format == 1) != little) { std::reverse(bytes, bytes + size[type]); }
+
+    switch (type) {
+        case PLY_CHAR: { signed char v; std::memcpy(&v, bytes, 1); out = v; break; }
+        case PLY_UCHAR: { unsigned char v; std::memcpy(&v, bytes, 1); out = v; break; }
+        case PLY_SHORT: { short v; std::memcpy(&v, bytes, 2); out = v; break; }
+        case PLY_USHORT: { unsigned short v; std::memcpy(&v, bytes, 2); out = v; break; }
+        case PLY_INT: { int v; std::memcpy(&v, bytes, 4); out = v; break; }
+        case PLY_UINT: { unsigned int v; std::memcpy(&v, bytes, 4); out = v; break; }
+        case PLY_FLOAT: { float v; std::memcpy(&v, bytes, 4); out = v; break; }
+        default: { double v; std::memcpy(&v, bytes, 8); out = v; break; }
+    }
+
+    return true;
+
+}
+
+
+// *****************************************
+//  Decompose
+// *****************************************
+
+namespace {
+
+    struct Triangle {
+        /* This structure contains a welded mesh triangle. */
+        int v[3]; double normal[3]; bool degenerate;                    // normal: unit normal (counterclockwise)
+    };
+
+    struct Face {
+        /* This structure contains a face of a hull being built. */
+        int v[3]; double normal[3], dist; std::vector<int> outside; bool alive;     // outside: points in front of the face
+    };
+
+    struct Plane {
+        /* This structure contains a plane of a hull (merged faces). */
+        double normal[3], dist, area, center[3];                        // center: area weighted center of the faces
+    };
+
+    struct Piece {
+        /* This structure contains a part of the decomposition: the hull of its triangles minus its pockets. */
+        std::vector<int> triangle; bool flip; int parent, level;       // flip: a pocket (its triangles face into the solid), level: 0: the mesh
+        bool valid = false; double volume = 0.0;                        // valid: a hull was found
+        std::vector<Plane> plane;                                       // hull planes (reduced)
+        std::vector<std::vector<int>> pocket;                           // triangles of its pockets (off the hull, connected by edges)
+        std::vector<int> child;                                         // pieces taken from its pockets
+    };
+
+    struct Context {
+        /* This structure contains a mesh being decomposed (shared by the jobs). */
+        std::vector<double> vertex; std::vector<Triangle> triangle; double eps;
+        std::vector<Piece>* piece; int begin;                           // begin: first piece of the level
+    };
+
+    struct NormalGrid {
+
+        /* This structure finds the planes of close normals: normals are hashed by cells of a size, and a query visits the cells within a tolerance. */
+
+        double cell; std::unordered_map<long long, std::vector<int>> map;
+
+        long long Key(const long long* index) const { return (index[0] << 40) + (index[1] << 20) + index[2]; }
+
+        void Add(const double* normal, int n) {
+            long long index[3]; for (int i = 0; i < 3; ++i) { index[i] = (long long)std::floor((normal[i] + 1.0) / cell); }
+            map[Key(index)].push_back(n);
+        }
+
+        template<class F> void Find(const double* normal, double tolerance, F found) const {    // (tolerance: up to the cell size)
+
+            long long lo[3], hi[3];
+            for (int i = 0; i < 3; ++i) {
+                double x = (normal[i] + 1.0) / cell; long long c = (long long)std::floor(x);
+                lo[i] = c - (x - c < tolerance / cell); hi[i] = c + (c + 1 - x < tolerance / cell);
+            }
+
+            long long index[3];
+            for (index[0] = lo[0]; index[0] <= hi[0]; ++index[0]) {
+                for (index[1] = lo[1]; index[1] <= hi[1]; ++index[1]) {
+                    for (index[2] = lo[2]; index[2] <= hi[2]; ++index[2]) {
+                        auto it = map.find(Key(index)); if (it == map.end()) continue;
+                        for (int n : it->second) { found(n); }
+                    }
+                }
+            }
+
+        }
+
+    };
+
+    struct Classification {
+        /* This structure contains a piece whose triangles are tested against its hull planes (as jobs). */
+        const Context* c; const Piece* piece; const std::vector<Plane>* plane; const NormalGrid* grid; std::vector<char>* onhull;
+    };
+
+}
+
+static bool hull(const Context& c, const std::vector<int>& point, std::vector<Face>& out);
+
+static void reduce(const Context& c, const std::vector<Face>& face, const std::vector<int>& point, std::vector<Plane>& exact, std::vector<Plane>& out);
+
+static void build(const Context& c, Piece& piece, Jobs* jobs);
+
+static void classifytask(void* context, int begin, int end);
+
+static void piecetask(void* context, int begin, int end);
+
+static int tree(const Context& c, int piece, std::vector<int>& partindex, Mesh::Decomposition& out);
+
+
+bool Mesh::Decompose(const std::vector<float>& vertex, const std::vector<int>& triangle, Decomposition& out, Jobs* jobs) {
+
+    /*
+        Decompose a mesh level by level: the pockets of the pieces of a level are hulled in parallel, and taken largest first as the next level.
+
+        A pocket is bounded by its triangles and by lids on the hull of its parent, which are faces of its own hull, so only its triangles are classified.
+        Pockets of the same volume as their parent (the decomposition does not converge there) are dropped.
+    */
+
+    out = Decomposition(); out.trianglesize = (int)(triangle.size() / 3);
+
+    Context c = {};
+
+    // weld vertices and drop the degenerate triangles
+
+    std::vector<int> weld(vertex.size() / 3); {
+
+        std::map<std::tuple<float, float, float>, int> index;
+
+        for (size_t v = 0; v < weld.size(); ++v) {
+            auto res = index.insert({ std::make_tuple(vertex[3 * v], vertex[3 * v + 1], vertex[3 * v + 2]), (int)(c.vertex.size() / 3) });
+            if (res.second) { for (int i = 0; i < 3; ++i) { c.vertex.push_back(vertex[3 * v + i]); } }
+            weld[v] = res.first->second;
+        }
+
+    }
+
+    double min[3] = { 1.0e30, 1.0e30, 1.0e30 }, max[3] = { -1.0e30, -1.0e30, -1.0e30 };
+    for (size_t v = 0; v < c.vertex.size(); v += 3) { for (int i = 0; i < 3; ++i) { min[i] = std::min(min[i], c.vertex[v + i]); max[i] = std::max(max[i], c.vertex[v + i]); } }
+
+    double scale = 0.0; for (int i = 0; i < 3; ++i) { scale = std::max(scale, max[i] - min[i]); }
+
+    if (c.vertex.size() < 12 || scale <= 0.0) return false;
+
+    c.eps = EPSILON * scale;
+
+    double volume = 0.0;
+
+    for (size_t t = 0; t + 2 < triangle.size(); t += 3) {
+
+        Triangle tri = {}; for (int k = 0; k < 3; ++k) { tri.v[k] = weld[triangle[t + k]]; }
+
+        const double* p[3] = { &c.vertex[3 * tri.v[0]], &c.vertex[3 * tri.v[1]], &c.vertex[3 * tri.v[2]] };
+
+        double a[3], b[3]; for (int i = 0; i < 3; ++i) { a[i] = p[1][i] - p[0][i]; b[i] = p[2][i] - p[0][i]; }
+
+        double n[3] = { a[1] * b[2] - a[2] * b[1], a[2] * b[0] - a[0] * b[2], a[0] * b[1] - a[1] * b[0] };
+        double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        tri.degenerate = length <= c.eps * c.eps;
+        for (int i = 0; i < 3; ++i) { tri.normal[i] = tri.degenerate ? 0.0 : n[i] / length; }
+
+        volume += (p[0][0] * n[0] + p[0][1] * n[1] + p[0][2] * n[2]) / 6.0;
+
+        c.triangle.push_back(tri);
+
+    }
+
+    if (volume < 0.0) {                                                 // wound clockwise
+        for (Triangle& tri : c.triangle) { std::swap(tri.v[1], tri.v[2]); for (int i = 0; i < 3; ++i) { tri.normal[i] = -tri.normal[i]; } }
+    }
+
+    // levels
+
+    std::vector<Piece> piece(1); c.piece = &piece;
+
+    piece[0].flip = false; piece[0].parent = -1; piece[0].level = 0;
+    for (int t = 0; t < (int)c.triangle.size(); ++t) { piece[0].triangle.push_back(t); }
+
+    build(c, piece[0], jobs);                                           // (the mesh: classified in parallel over its triangles)
+
+    if (!piece[0].valid) return false;
+
+    int taken = 1;
+
+    for (int level = 1, begin = 0, end = 1; begin < end; ++level) {
+
+        // hull the pockets of the last level
+
+        int next = (int)piece.size();
+
+        std::vector<Piece> pocket;
+
+        for (int n = begin; n < end; ++n) {
+
+            if (!piece[n].valid) continue;                              // (not taken)
+
+            for (std::vector<int>& triangle : piece[n].pocket) {
+                if (level >= MAXLEVEL) { ++out.droppedsize; continue; }
+                Piece p; p.triangle.swap(triangle); p.flip = !piece[n].flip; p.parent = n; p.level = level;
+                pocket.push_back(std::move(p));
+            }
+
+        }
+
+        for (Piece& p : pocket) { piece.push_back(std::move(p)); }
+
+        c.begin = next;
+
+        if (jobs) { jobs->Run((int)piece.size() - next, 1, piecetask, &c); } else { piecetask(&c, 0, (int)piece.size() - next); }
+
+        // take the largest ones within the budget
+
+        std::vector<int> order; for (int n = next; n < (int)piece.size(); ++n) { order.push_back(n); }
+
+        std::sort(order.begin(), order.end(), [&](int a, int b) { return piece[a].volume > piece[b].volume; });
+
+        for (int n : order) {
+
+            Piece& p = piece[n];
+
+            bool large = p.valid && p.volume >= MINVOLUME * piece[0].volume && p.volume < (1.0 - EPSILON) * piece[p.parent].volume;
+
+            if (large && taken < Csg::MAXLEAFSIZE) { ++taken; piece[p.parent].child.push_back(n); } else { p.valid = false; out.droppedsize += large; }
+
+        }
+
+        begin = next; end = (int)piece.size();
+
+    }
+
+    // units and tree
+
+    std::vector<int> partindex(piece.size(), -1);
+
+    tree(c, 0, partindex, out);
+
+    return true;
+
+}
+
+static void build(const Context& c, Piece& piece, Jobs* jobs) {
+
+    /* Hull a piece, reduce its planes, and find its pockets: the triangles off its hull, connected by edges. (jobs: classify in parallel) */
+
+    std::vector<int> point;
+
+    for (int t : piece.triangle) { point.insert(point.end(), c.triangle[t].v, c.triangle[t].v + 3); }
+
+    std::sort(point.begin(), point.end()); point.erase(std::unique(point.begin(), point.end()), point.end());
+
+    std::vector<Face> face; if (!hull(c, point, face)) return;
+
+    std::vector<Plane> exact; reduce(c, face, point, exact, piece.plane);
+
+    piece.volume = 0.0; for (const Plane& pl : exact) { piece.volume += pl.area * pl.dist / 3.0; }
+
+    piece.valid = piece.volume > 0.0;
+
+    // classify the triangles against the exact hull planes
+
+    std::vector<char> onhull(piece.triangle.size(), 0);
+
+    NormalGrid grid = { NORMALCELL, {} }; for (int p = 0; p < (int)exact.size(); ++p) { grid.Add(exact[p].normal, p); }
+
+    Classification classification = { &c, &piece, &exact, &grid, &onhull };
+
+    if (jobs) { jobs->Run((int)piece.triangle.size(), 1024, classifytask, &classification); } else { classifytask(&classification, 0, (int)piece.triangle.size()); }
+
+    // connect the triangles off the hull by their edges (union find)
+
+    std::vector<int> root(piece.triangle.size());
+    for (size_t n = 0; n < root.size(); ++n) { root[n] = (int)n; }
+
+    auto find = [&](int n) { while (root[n] != n) { root[n] = root[root[n]]; n = root[n]; } return n; };
+
+    std::map<std::pair<int, int>, int> edge;
+
+    for (int n = 0; n < (int)piece.triangle.size(); ++n) {
+
+        if (onhull[n]) continue;
+
+        const Triangle& tri = c.triangle[piece.triangle[n]];
+
+        for (int k = 0; k < 3; ++k) {
+            std::pair<int, int> e(std::min(tri.v[k], tri.v[(k + 1) % 3]), std::max(tri.v[k], tri.v[(k + 1) % 3]));
+            auto res = edge.insert({ e, n });
+            if (!res.second) root[find(n)] = find(res.first->second);
+        }
+
+    }
+
+    std::map<int, int> component;
+
+    for (int n = 0; n < (int)piece.triangle.size(); ++n) {
+
+        if (onhull[n]) continue;
+
+        auto res = component.insert({ find(n), (int)piece.pocket.size() });
+        if (res.second) piece.pocket.emplace_back();
+
+        piece.pocket[res.first->second].push_back(piece.triangle[n]);
+
+    }
+
+}
+
+static void classifytask(void* context, int begin, int end) {
+
+    /* Test the triangles [begin, end) of a piece: on the hull if they lie on a hull plane of a close normal. (Degenerate ones are ignored.) */
+
+    const Classification& cl = *(const Classification*)context; const Context& c = *cl.c; const Piece& piece = *cl.piece;
+
+    for (int n = begin; n < end; ++n) {
+
+        const Triangle& tri = c.triangle[piece.triangle[n]];
+
+        bool on = tri.degenerate;
+
+        double normal[3]; for (int i = 0; i < 3; ++i) { normal[i] = piece.flip ? -tri.normal[i] : tri.normal[i]; }
+
+        cl.grid->Find(normal, CLASSIFYANGLE, [&](int p) {
+
+            const Plane& pl = (*cl.plane)[p];
+
+            bool plane = !on;
+            for (int k = 0; plane && k < 3; ++k) {
+                const double* x = &c.vertex[3 * tri.v[k]];
+                plane = std::fabs(pl.normal[0] * x[0] + pl.normal[1] * x[1] + pl.normal[2] * x[2] - pl.dist) <= c.eps;
+            }
+
+            on = on || plane;
+
+        });
+
+        (*cl.onhull)[n] = on;
+
+    }
+
+}
+
+static void piecetask(void* context, int begin, int end) {
+
+    /* Build the pieces [begin, end) of a level. (Each piece is built sequentially.) */
+
+    const Context& c = *(const Context*)context;
+
+    for (int n = begin; n < end; ++n) { build(c, (*c.piece)[c.begin + n], nullptr); }
+
+}
+
+static bool hull(const Context& c, const std::vector<int>& point, std::vector<Face>& out) {
+
+    /*
+        Find the convex hull of the points (quickhull): a face takes the farthest of the points in front of it,
+        the faces it sees are replaced by a fan from it over their horizon, and their points are given to the new faces.
+
+        false: fewer than 4 points or flat.
+    */
+
+    out.clear(); if (point.size() < 4) return false;
+
+    const std::vector<double>& x = c.vertex; const double eps = c.eps;
+
+    auto pos = [&](int v) { return &x[3 * v]; };
+
+    auto dist = [&](const Face& f, int v) { const double* p = pos(v); return f.normal[0] * p[0] + f.normal[1] * p[1] + f.normal[2] * p[2] - f.dist; };
+
+    auto make = [&](int a, int b, int v) {
+        Face f = {}; f.v[0] = a; f.v[1] = b; f.v[2] = v; f.alive = true;
+        const double* p[3] = { pos(a), pos(b), pos(v) };
+        double e0[3], e1[3]; for (int i = 0; i < 3; ++i) { e0[i] = p[1][i] - p[0][i]; e1[i] = p[2][i] - p[0][i]; }
+        double n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+        double length = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]); if (length <= 0.0) length = 1.0;
+        for (int i = 0; i < 3; ++i) { f.normal[i] = n[i] / length; }
+        f.dist = f.normal[0] * p[0][0] + f.normal[1] * p[0][1] + f.normal[2] * p[0][2];
+        return f;
+    };
+
+    // initial tetrahedron: the widest axis, the farthest point from its line, and from their plane
+
+    int a = point[0], b = point[0]; {
+
+        double width = -1.0;
+
+        for (int i = 0; i < 3; ++i) {
+            int lo = point[0], hi = point[0];
+            for (int v : point) { if (pos(v)[i] < pos(lo)[i]) lo = v; if (pos(v)[i] > pos(hi)[i]) hi = v; }
+            if (pos(hi)[i] - pos(lo)[i] > width) { width = pos(hi)[i] - pos(lo)[i]; a = lo; b = hi; }
+        }
+
+        if (width <= eps) return false;
+
+    }
+
+    int v2 = -1; {
+
+        double d[3], best = eps; for (int i = 0; i < 3; ++i) { d[i] = pos(b)[i] - pos(a)[i]; }
+        double length = std::sqrt(d[0] * d[0] + d[1] * d[1] + d[2] * d[2]);
+
+        for (int v : point) {
+            double e[3]; for (int i = 0; i < 3; ++i) { e[i] = pos(v)[i] - pos(a)[i]; }
+            double n[3] = { d[1] * e[2] - d[2] * e[1], d[2] * e[0] - d[0] * e[2], d[0] * e[1] - d[1] * e[0] };
+            double h = std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]) / length;
+            if (h > best) { best = h; v2 = v; }
+        }
+
+        if (v2 < 0) return false;
+
+    }
+
+    int v3 = -1; {
+
+        Face f = make(a, b, v2); double best = eps;
+
+        for (int v : point) { if (std::fabs(dist(f, v)) > best) { best = std::fabs(dist(f, v)); v3 = v; } }
+
+        if (v3 < 0) return false;
+
+        if (dist(f, v3) > 0.0) std::swap(a, b);                         // (the base faces away from the apex)
+
+    }
+
+    std::vector<Face>& face = out;
+
+    face.push_back(make(a, b, v2)); face.push_back(make(a, v3, b)); face.push_back(make(b, v3, v2)); face.push_back(make(v2, v3, a));
+
+    std::unordered_map<long long, int> edge; edge.reserve(6 * point.size());   // directed edge (a, b) -> face
+
+    auto key = [](int a, int b) { return ((long long)a << 32) | (unsigned int)b; };
+
+    auto link = [&](int f) { for (int k = 0; k < 3; ++k) { edge[key(face[f].v[k], face[f].v[(k + 1) % 3])] = f; } };
+
+    for (int f = 0; f < 4; ++f) { link(f); }
+
+    auto assign = [&](int v, int first) {
+        for (int f = first; f < (int)face.size(); ++f) { if (face[f].alive && dist(face[f], v) > eps) { face[f].outside.push_back(v); return; } }
+    };
+
+    for (int v : point) { if (v != a && v != b && v != v2 && v != v3) assign(v, 0); }
+
+    // add the points
+
+    for (int f = 0; f < (int)face.size(); ++f) {
+
+        if (!face[f].alive || face[f].outside.empty()) continue;
+
+        int eye = face[f].outside[0];
+        for (int v : face[f].outside) { if (dist(face[f], v) > dist(face[f], eye)) eye = v; }
+
+        // visible faces (connected to f) and their horizon
+
+        std::vector<int> visible = { f }, stack = { f }; std::vector<std::pair<int, int>> horizon;
+        face[f].alive = false;
+
+        while (!stack.empty()) {
+
+            int g = stack.back(); stack.pop_back();
+
+            for (int k = 0; k < 3; ++k) {
+
+                int p = face[g].v[k], q = face[g].v[(k + 1) % 3];
+                auto it = edge.find(key(q, p)); if (it == edge.end()) continue;
+
+                int h = it->second;
+
+                if (!face[h].alive) continue;                           // (visible already)
+
+                if (dist(face[h], eye) > eps) { face[h].alive = false; visible.push_back(h); stack.push_back(h); }
+
+            }
+
+        }
+
+        for (int g : visible) {
+            for (int k = 0; k < 3; ++k) {
+                int p = face[g].v[k], q = face[g].v[(k + 1) % 3];
+                auto it = edge.find(key(q, p));
+                if (it != edge.end() && face[it->second].alive) horizon.push_back({ p, q });
+            }
+        }
+
+        if (horizon.size() < 3) { for (int g : visible) { face[g].alive = true; } face[f].outside.clear(); continue; }     // (numerical trouble: give up the point)
+
+        std::vector<int> orphan;
+        for (int g : visible) {
+            for (int k = 0; k < 3; ++k) { edge.erase(key(face[g].v[k], face[g].v[(k + 1) % 3])); }
+            for (int v : face[g].outside) { if (v != eye) orphan.push_back(v); }
+            std::vector<int>().swap(face[g].outside);
+        }
+
+        int first = (int)face.size();
+
+        for (const std::pair<int, int>& e : horizon) { face.push_back(make(e.first, e.second, eye)); link((int)face.size() - 1); }
+
+        for (int v : orphan) { assign(v, first); }
+
+    }
+
+    std::vector<Face> alive; for (Face& f : face) { if (f.alive) alive.push_back(f); }
+
+    out.swap(alive);
+
+    return out.size() >= 4;
+
+}
+
+static void reduce(const Context& c, const std::vector<Face>& face, const std::vector<int>& point, std::vector<Plane>& exact, std::vector<Plane>& out) {
+
+    /*
+        Merge the coplanar faces of a hull into its exact planes, then merge close normals into at most Mesh::MAXPARTPLANESIZE planes.
+
+        Planes are merged into the largest plane of a close normal, at angles doubled from MERGEANGLE.
+        Merged planes keep its normal and take the support distance over the hull points.
+    */
+
+    exact.clear();
+
+    NormalGrid grid = { NORMALCELL, {} };
+
+    for (const Face& f : face) {
+
+        const double* p[3] = { &c.vertex[3 * f.v[0]], &c.vertex[3 * f.v[1]], &c.vertex[3 * f.v[2]] };
+
+        double e0[3], e1[3]; for (int i = 0; i < 3; ++i) { e0[i] = p[1][i] - p[0][i]; e1[i] = p[2][i] - p[0][i]; }
+        double n[3] = { e0[1] * e1[2] - e0[2] * e1[1], e0[2] * e1[0] - e0[0] * e1[2], e0[0] * e1[1] - e0[1] * e1[0] };
+        double area = 0.5 * std::sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+
+        int index = -1;
+
+        grid.Find(f.normal, std::sqrt(2.0 * EPSILON), [&](int q) {     // (the normals of cos > 1 - EPSILON)
+            double cos = exact[q].normal[0] * f.normal[0] + exact[q].normal[1] * f.normal[1] + exact[q].normal[2] * f.normal[2];
+            if (index < 0 && cos > 1.0 - EPSILON && std::fabs(exact[q].dist - f.dist) <= c.eps) index = q;
+        });
+
+        if (index < 0) {
+            index = (int)exact.size(); grid.Add(f.normal, index);
+            exact.push_back({ { f.normal[0], f.normal[1], f.normal[2] }, f.dist, 0.0, { 0.0, 0.0, 0.0 } });
+        }
+
+        Plane& pl = exact[index];
+
+        for (int i = 0; i < 3; ++i) { pl.center[i] = (pl.center[i] * pl.area + area * (p[0][i] + p[1][i] + p[2][i]) / 3.0) / std::max(pl.area + area, 1.0e-300); }
+        pl.area += area;
+
+    }
+
+    out = exact;
+
+    if ((int)out.size() <= Mesh::MAXPARTPLANESIZE) return;
+
+    for (double angle = MERGEANGLE; (int)out.size() > Mesh::MAXPARTPLANESIZE && angle <= MAXMERGEANGLE; angle *= 2.0) {
+
+        std::vector<Plane> sorted; sorted.swap(out);                   // (merging the planes of the last angle)
+        std::sort(sorted.begin(), sorted.end(), [](const Plane& a, const Plane& b) { return a.area > b.area; });
+
+        NormalGrid merge = { angle, {} };
+
+        for (const Plane& p : sorted) {
+
+            int index = -1;                                             // (the largest one: the first added)
+
+            merge.Find(p.normal, angle, [&](int q) {
+                if ((index < 0 || q < index) && out[q].normal[0] * p.normal[0] + out[q].normal[1] * p.normal[1] + out[q].normal[2] * p.normal[2] > std::cos(angle)) index = q;
+            });
+
+            if (index < 0) { merge.Add(p.normal, (int)out.size()); out.push_back(p); continue; }
+
+            Plane& pl = out[index];
+
+            for (int i = 0; i < 3; ++i) { pl.center[i] = (pl.center[i] * pl.area + p.center[i] * p.area) / (pl.area + p.area); }
+            pl.area += p.area;
+
+        }
+
+    }
+
+    for (Plane& pl : out) {
+        pl.dist = -1.0e300;
+        for (int v : point) { const double* x = &c.vertex[3 * v]; pl.dist = std::max(pl.dist, pl.normal[0] * x[0] + pl.normal[1] * x[1] + pl.normal[2] * x[2]); }
+    }
+
+}
+
+static int tree(const Context& c, int piece, std::vector<int>& partindex, Mesh::Decomposition& out) {
+
+    /*
+        Write a piece and its children: its hull minus its children. (The nodes are appended children first, the root is the last.)
+
+        Planes are placed at the centers of their faces (the texture origin), with the u-axis along the world axis least along the normal.
+    */
+
+    const Piece& p = (*c.piece)[piece];
+
+    partindex[piece] = (int)out.part.size(); out.part.emplace_back();  // (parts in pre-order: the mesh hull is the first)
+
+    for (const Plane& pl : p.plane) {
+
+        const double* n = pl.normal;
+
+        double offset = pl.dist - (n[0] * pl.center[0] + n[1] * pl.center[1] + n[2] * pl.center[2]);
+
+        int k = (std::fabs(n[0]) <= std::fabs(n[1]) && std::fabs(n[0]) <= std::fabs(n[2])) ? 0 : (std::fabs(n[1]) <= std::fabs(n[2])) ? 1 : 2;
+
+        double u[3] = { -n[k] * n[0], -n[k] * n[1], -n[k] * n[2] }; u[k] += 1.0;
+        double length = std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+
+        float row[POINTS_PER_UNIT] = {};
+        for (int i = 0; i < 3; ++i) {
+            row[i] = (float)(pl.center[i] + offset * n[i]); row[4 + i] = (float)n[i]; row[8 + i] = (float)(u[i] / length);
+        }
+        row[3] = 1.0f;
+
+        out.part[partindex[piece]].insert(out.part[partindex[piece]].end(), row, row + POINTS_PER_UNIT);
+
+    }
+
+    std::vector<int> childroot; for (int n : p.child) { childroot.push_back(tree(c, n, partindex, out)); }
+
+    out.tree.push_back({ Csg::OP_LOAD, partindex[piece], -1 });
+
+    for (int child : childroot) { out.tree.push_back({ Csg::OP_SUBTRACT, (int)out.tree.size() - 1, child }); }
+
+    return (int)out.tree.size() - 1;
+
+}
+
+
+// *****************************************
+//  Import
+// *****************************************
+
+bool Mesh::Import(const char* file, Decomposition& out, Jobs* jobs) {
+
+    /* Load and decompose a mesh file. */
+
+    std::vector<float> vertex; std::vector<int> triangle;
+
+    if (!Load(file, vertex, triangle)) { std::cout << "Error: Mesh file cannot be read. (\"" << file << "\")\n"; return false; }
+
+    if (!Decompose(vertex, triangle, out, jobs)) { std::cout << "Error: Mesh is empty or flat. (\"" << file << "\")\n"; return false; }
+
+    size_t plsize = 0; for (const std::vector<float>& part : out.part) { plsize += part.size() / POINTS_PER_UNIT; }
+
+    std::cout << "# Imported mesh \"" << file << "\". (" << out.trianglesize << " triangles, " << out.part.size() << " units, " << plsize << " planes, " << out.droppedsize << " pockets dropped)\n";
+
+    return true;
+
+}
@@ -0,0 +1,58 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Mesh class imports triangle meshes (OBJ/PLY files) as Ray Units: convex unit geometries and a CSG tree which combines them.
+
+*/
+
+#include <vector>
+
+#include "Csg.h"                                                        // class ray::Csg (and ray::Scene) declared here
+#include "Jobs.h"                                                       // class ray::Jobs declared here
+
+namespace ray {
+
+	class Mesh;
+
+}
+
+class ray::Mesh {
+
+	/*
+		In this class:
+
+			- Read the triangles of an OBJ file or of a PLY file (ascii or binary).
+
+			- Decompose a mesh by the alternating sum of volumes: the convex hull of the mesh minus its pockets (the regions of the hull outside the mesh),
+			  where a pocket is again its hull minus its own pockets. So a convex mesh is a single unit, and a concave one is a primary unit with subtractive units.
+
+			- Take pockets largest first within the unit budget (Csg::MAXLEAFSIZE). Small pockets are dropped, as each unit costs its planes in every Ray2 calc.
+
+			- Reduce the planes of a hull: coplanar faces are merged, and while a hull has more than MAXPARTPLANESIZE planes,
+			  faces of close normals are merged into planes at their support distances (so the unit still encloses the hull).
+
+		The hulls of a level of pockets are found in parallel.
+	*/
+
+public:
+
+	struct Decomposition {
+		/* This structure contains an imported mesh. */
+		std::vector<std::vector<float>> part;							// planes of the unit geometries ([plsize][POINTS_PER_UNIT] each)
+		std::vector<Csg::Node> tree;									// CSG tree of the parts (OP_LOAD: left is the part index, the root is the last node)
+		int trianglesize = 0, droppedsize = 0;							// droppedsize: pockets not taken for the budget or the depth (small ones are not counted)
+	};
+
+	static const int MAXPARTPLANESIZE = 32;								// max planes per unit geometry (coarser planes beyond)
+
+
+	static bool Load(const char* file, std::vector<float>& outvertex, std::vector<int>& outtriangle);
+																		// read a mesh (outvertex: [][3] positions, outtriangle: [][3] vertex indices)
+
+	static bool Decompose(const std::vector<float>& vertex, const std::vector<int>& triangle, Decomposition& out, Jobs* jobs);
+																		// decompose a mesh into units (false: empty or flat mesh)
+
+	static bool Import(const char* file, Decomposition& out, Jobs* jobs);	// load and decompose a mesh file (errors are printed)
+
+};
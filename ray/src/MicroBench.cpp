@@ -0,0 +1,305 @@
+/* ** EXPLANATION **
+
+    MicroBench class times the Cpu kernels of the startup and of a frame, and prints their throughput. (No Gpu context is needed.)
+
+*/
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <iostream>
+#include <vector>
+
+#include "MicroBench.h"                                                 // class ray::MicroBench declared here
+
+#include "RayKernel.h"                                                  // class ray::RayKernel declared here
+#include "Ray.h"                                                        // class ray::Ray declared here
+#include "Motion.h"                                                     // class ray::Motion (and ray::Jobs) declared here
+#include "Bvh.h"                                                        // class ray::Bvh declared here
+#include "Polytope.h"                                                   // class ray::Polytope (and ray::Scene) declared here
+#include "Csg.h"                                                        // class ray::Csg declared here
+
+#include "constant.h"
+
+
+using namespace ray;
+
+
+#define BENCHOBJECTSIZE 4096                                            // moving objects of the motion kernel, items of the bvh kernels
+#define BENCHUNITSIZE 256                                               // units of the polytope kernels
+#define BENCHUNITPLANESIZE 16                                           // planes per unit of the polytope kernels
+#define BENCHPROGRAMSIZE 1000                                           // trees compiled per run of the csg kernel
+
+template<class Kernel> static double medianms(Kernel kernel, int repetitions, int warmup);
+
+static void makeunit(unsigned int seed, std::vector<float>& outpl);
+
+
+// *****************************************
+//  Run
+// *****************************************
+
+void MicroBench::Run(int repetitions, int warmup, const char* scenefile) {
+
+    /*
+        Time the kernels, each run warmup times and then timed repetitions times, and print the median time of a run and its throughput:
+
+            makecamray          the camera ray data (GL_LoadCamRay()), pixels/s
+            makeviewmat4        the view matrix of a frame (SetViewmat4()), matrices/s
+            copyimage           the byte copy of an image read (Image::Image(..)), bytes/s
+            Image               an image file read, decoded and copied (GL_LoadImgData()), pixels/s
+            Motion::Update      the model matrices of the moving objects of a frame (the SoA batches of the built-in motions), objects/s
+            Bvh::Build          the bvh of the Cpu tracer over the objects (binned SAH), items/s
+            Bvh::Refit          the bvh refit for the objects moved in a frame (all of them), items/s
+            Polytope::Reduce    the removal of the planes which do not bound a unit (scene conversion), planes/s
+            Polytope::Bound     the polytope vertices and bounds of a unit (scene conversion), planes/s
+            Csg::Compile        the selection program of an object (scene conversion), programs/s
+            Ray::Ray            the ray object table and the residency of a scene, and their release, objects/s and planes/s
+            Ray::Trace          the Cpu Ray2 and Selection calcs: a grid of camera rays through the bvh, rays/s
+    */
+
+    if (repetitions < 1) repetitions = 1;
+    if (warmup < 0) warmup = 0;
+
+    auto print = [](const char* name, double ms, double work, const char* unit) {
+        std::printf("  %-18s %12.4f ms %12.3f M%s/s\n", name, ms, (ms > 0.0) ? work / ms * 1.0e-3 : 0.0, unit);
+    };
+
+    std::printf("# Cpu kernels (median of %d runs after %d warmup runs):\n", repetitions, warmup);
+
+    Jobs jobs(0);                                                       // (no workers: the parallel kernels run on this thread)
+
+    // camera rays
+
+    {
+        float (*screenraydir)[PIXELS_W][4] = new float[PIXELS_H][PIXELS_W][4]{}, (*screenraypos)[PIXELS_W][4] = new float[PIXELS_H][PIXELS_W][4]{};
+
+        print("makecamray", medianms([&] { RayKernel::MakeCamRay(screenraydir, screenraypos); }, repetitions, warmup), (double)PIXELS_W * PIXELS_H, "pixels");
+
+        delete[] screenraydir; delete[] screenraypos;
+    }
+
+    // view matrices (a batch of cameras per run, so that a run is long enough to time)
+
+    {
+        const int batchsize = 10000; volatile float sink = 0.0f;       // (keeps the results alive)
+
+        double ms = medianms([&] {
+            float sum = 0.0f;
+            for (int n = 0; n < batchsize; ++n) {
+                const float theta[3] = { 0.001f * n, 0.0f, 0.002f * n }, pos[3] = { 0.01f * n, 1.0f, 0.5f };
+                float mat4[4][4]; RayKernel::MakeViewmat4(mat4, theta, pos); sum += mat4[1][3];
+            }
+            sink = sum;
+        }, repetitions, warmup);
+
+        print("makeviewmat4", ms, batchsize, "matrices");
+    }
+
+    // image
+
+    {
+        const size_t size = 3 * (size_t)PIXELS_W * PIXELS_H;
+
+        std::vector<unsigned char> src(size);
+        for (size_t n = 0; n < size; ++n) { src[n] = (unsigned char)(n * 31); }
+
+        print("copyimage", medianms([&] { std::vector<unsigned char> buff; RayKernel::CopyImage(src.data(), size, buff); }, repetitions, warmup), (double)size, "bytes");
+
+        int pixelsize = 0;
+
+        double ms = medianms([&] { pixelsize = RayKernel::LoadImage("src/pic3.png"); }, repetitions, warmup);
+
+        if (pixelsize > 0) print("Image", ms, pixelsize, "pixels");
+    }
+
+    // motions (the built-in motions in turn, on a grid of objects)
+
+    std::vector<float> modelmat4buff(16 * (size_t)BENCHOBJECTSIZE);
+    float (*modelmat4)[4][4] = (float(*)[4][4])modelmat4buff.data();
+
+    {
+        Motion motion(&jobs);
+
+        for (int n = 0; n < BENCHOBJECTSIZE; ++n) {
+            for (int i = 0; i < 4; ++i) { modelmat4[n][i][i] = 1.0f; }
+            modelmat4[n][0][3] = 3.0f * (n % 64); modelmat4[n][1][3] = 3.0f * (n / 64);
+            const float param[Motion::PARAMSIZE] = { 0.001f * (1 + n % 7), 0.5f, 0.0f, 0.0f };
+            motion.Set(n, Scene::MOTION_ROTATEZ + n % 3, param, modelmat4[n]);
+        }
+
+        float time = 0.0f;
+
+        print("Motion::Update", medianms([&] { motion.Update(time += 16.0f, modelmat4); }, repetitions, warmup), BENCHOBJECTSIZE, "objects");
+    }
+
+    // bvh (the boxes of the objects moved above, a cube each)
+
+    {
+        std::vector<Bvh::Box> box(BENCHOBJECTSIZE); std::vector<int> item(BENCHOBJECTSIZE);
+
+        for (int n = 0; n < BENCHOBJECTSIZE; ++n) {
+            for (int i = 0; i < 3; ++i) { box[n].min[i] = modelmat4[n][i][3] - 1.0f; box[n].max[i] = modelmat4[n][i][3] + 1.0f; }
+            item[n] = n;
+        }
+
+        Bvh bvh;
+
+        print("Bvh::Build", medianms([&] { bvh.Build(box.data(), BENCHOBJECTSIZE, &jobs); }, repetitions, warmup), BENCHOBJECTSIZE, "items");
+
+        print("Bvh::Refit", medianms([&] { bvh.Refit(box.data(), item.data(), BENCHOBJECTSIZE); }, repetitions, warmup), BENCHOBJECTSIZE, "items");
+    }
+
+    // polytopes (units of tangent planes of random directions, in a box)
+
+    {
+        std::vector<float> plbuff;
+        for (int n = 0; n < BENCHUNITSIZE; ++n) { makeunit(1 + n, plbuff); }
+
+        const float (*pl)[POINTS_PER_UNIT] = (const float(*)[POINTS_PER_UNIT])plbuff.data();
+
+        std::vector<float> reduced;
+
+        print("Polytope::Reduce", medianms([&] {
+            for (int n = 0; n < BENCHUNITSIZE; ++n) { Polytope::Reduce(pl + n * BENCHUNITPLANESIZE, BENCHUNITPLANESIZE, reduced); }
+        }, repetitions, warmup), (double)BENCHUNITSIZE * BENCHUNITPLANESIZE, "planes");
+
+        Scene::Bounds bounds = {};
+
+        print("Polytope::Bound", medianms([&] {
+            for (int n = 0; n < BENCHUNITSIZE; ++n) { Polytope::Bound(pl + n * BENCHUNITPLANESIZE, BENCHUNITPLANESIZE, bounds); }
+        }, repetitions, warmup), (double)BENCHUNITSIZE * BENCHUNITPLANESIZE, "planes");
+    }
+
+    // selection programs (the first unit minus the others: notches around its front, and one unit apart, which is pruned)
+
+    {
+        const int unitsize = Csg::MAXLEAFSIZE;
+
+        std::vector<Csg::Node> tree; std::vector<int> unitkey(unitsize); std::vector<Scene::Bounds> unitbounds(unitsize);
+
+        for (int m = 0; m < unitsize; ++m) {
+
+            tree.push_back({ Csg::OP_LOAD, m, -1 });
+
+            const float radius = (m == 0) ? 1.0f : 0.3f + 0.05f * m;
+            const float center[3] = { (m == 0) ? 0.0f : (m == unitsize - 1) ? 5.0f : 0.6f * std::cos(0.9f * m), (m == 0) ? 0.0f : -0.9f, (m == 0) ? 0.0f : 0.6f * std::sin(0.9f * m) };
+
+            Scene::Bounds& b = unitbounds[m]; b.state = Scene::BOUNDS_BOUNDED; b.vertexsize = 8; b.radius = 1.7320508f * radius;
+            for (int i = 0; i < 3; ++i) { b.min[i] = center[i] - radius; b.max[i] = center[i] + radius; b.center[i] = center[i]; }
+
+            unitkey[m] = m;
+
+        }
+
+        for (int m = 1; m < unitsize; ++m) { tree.push_back({ Csg::OP_SUBTRACT, (m == 1) ? 0 : (int)tree.size() - 1, m }); }
+
+        Csg::Program program;
+
+        print("Csg::Compile", medianms([&] {
+            for (int n = 0; n < BENCHPROGRAMSIZE; ++n) { Csg::Compile(tree, (int)tree.size() - 1, unitkey.data(), unitbounds.data(), program); }
+        }, repetitions, warmup), BENCHPROGRAMSIZE, "programs");
+    }
+
+    // ray objects
+
+    if (!scenefile) return;
+
+    int objectsize = 0, plsize = 0;
+
+    {
+        Scene scene(scenefile);
+
+        if (!scene.IsOpen()) { std::cout << "Error: Scene file cannot be opened for the micro benchmark. (\"" << scenefile << "\")\n"; return; }
+
+        objectsize = scene.GetObjectSize(); plsize = scene.GetPlaneSize();
+    }
+
+    double ms = medianms([&] { Ray ray(scenefile); }, repetitions, warmup);
+
+    print("Ray::Ray", ms, objectsize, "objects"); print("", ms, plsize, "planes");
+
+    {
+        Ray ray(scenefile);
+
+        const int raywidth = 128, rayheight = 72; int hitsize = 0;      // (a coarse screen of camera rays)
+
+        const float pos[3] = {}, dir[3] = { 0.0f, 1.0f, 0.0f }; ray.Trace(pos, dir);     // (the bvh is built by the first trace)
+
+        double ms = medianms([&] {
+            hitsize = 0;
+            for (int i = 0; i < rayheight; ++i) {
+                for (int j = 0; j < raywidth; ++j) {
+                    const float raydir[3] = { 2.0f * (j + 0.5f) / raywidth - 1.0f, 1.0f, (2.0f * (i + 0.5f) / rayheight - 1.0f) * rayheight / raywidth };
+                    hitsize += (ray.Trace(pos, raydir) >= 0);
+                }
+            }
+        }, repetitions, warmup);
+
+        print("Ray::Trace", ms, (double)raywidth * rayheight, "rays");
+
+        std::printf("  (%d of %d rays hit)\n", hitsize, raywidth * rayheight);
+    }
+
+}
+
+
+// *****************************************
+//
+// *****************************************
+
+template<class Kernel> static double medianms(Kernel kernel, int repetitions, int warmup) {
+
+    /* Run a kernel, and return the median time of the timed runs (ms). */
+
+    for (int n = 0; n < warmup; ++n) { kernel(); }
+
+    std::vector<double> time(repetitions);
+
+    for (int n = 0; n < repetitions; ++n) {
+        auto start = std::chrono::steady_clock::now();
+        kernel();
+        time[n] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    }
+
+    std::sort(time.begin(), time.end());
+
+    return time[(repetitions - 1) / 2];
+
+}
+
+static void makeunit(unsigned int seed, std::vector<float>& outpl) {
+
+    /*
+        Append a unit of BENCHUNITPLANESIZE planes: the faces of a box (half size 1.5), and planes tangent to the unit sphere
+        of random directions (a fixed sequence by seed), which cut the box or not.
+
+        Rows: (pos, 1.0) (normal, 0.0) (u-axis, 0.0).
+    */
+
+    unsigned int state = seed * 2654435761u;                            // lcg
+    auto random = [&state]() { state = state * 1664525u + 1013904223u; return (state >> 8) / 8388608.0f - 1.0f; };   // [-1, 1)
+
+    for (int n = 0; n < BENCHUNITPLANESIZE; ++n) {
+
+        float normal[3] = {}, dist = 1.0f;
+
+        if (n < 6) { normal[n / 2] = (n % 2 == 0) ? 1.0f : -1.0f; dist = 1.5f; }
+        else {
+            float length = 0.0f;
+            while (length < 1.0e-3f) { for (int i = 0; i < 3; ++i) { normal[i] = random(); } length = std::sqrt(normal[0] * normal[0] + normal[1] * normal[1] + normal[2] * normal[2]); }
+            for (int i = 0; i < 3; ++i) { normal[i] /= length; }
+        }
+
+        const float axis[3] = { -normal[1], normal[0], 0.0f };         // (any direction on the plane, z-axis normals: the x-axis)
+        const bool zaxis = std::fabs(normal[2]) > 0.999f;
+        const float length = zaxis ? 1.0f : std::sqrt(axis[0] * axis[0] + axis[1] * axis[1]);
+
+        for (int i = 0; i < 3; ++i) { outpl.push_back(dist * normal[i]); } outpl.push_back(1.0f);
+        for (int i = 0; i < 3; ++i) { outpl.push_back(normal[i]); } outpl.push_back(0.0f);
+        for (int i = 0; i < 3; ++i) { outpl.push_back(zaxis ? (i == 0 ? 1.0f : 0.0f) : axis[i] / length); } outpl.push_back(0.0f);
+
+    }
+
+}
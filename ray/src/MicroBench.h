@@ -0,0 +1,34 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	MicroBench class times the Cpu kernels of the startup and of a frame, and prints their throughput. (No Gpu context is needed.)
+
+*/
+
+namespace ray {
+
+	class MicroBench;
+
+}
+
+class ray::MicroBench {
+
+	/*
+		In this class:
+
+			- Run each kernel warmup times, then time it repetitions times, and print the median time of a run and its throughput.
+
+			- Time the kernels of Ray.cpp (see RayKernel.h), and the ones of the other classes over synthetic inputs of a fixed seed,
+			  so that the runs are reproducible across builds and hardware.
+
+			- Time the ray object tables and the Cpu ray traces of a scene, if given. (The objects are not made resident.)
+
+		The kernels run on the calling thread: the parallel ones are given a job pool without workers.
+	*/
+
+public:
+
+	static void Run(int repetitions, int warmup, const char* scenefile);	// scenefile: nullptr: no scene kernels
+
+};
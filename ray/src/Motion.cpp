@@ -0,0 +1,289 @@
+/* ** EXPLANATION **
+
+    Motion class updates the model matrices of moving Ray Objects for a frame.
+
+    The built-in motions are computed lane by lane in fixed size SoA blocks without branches or library calls,
+    so that the loops are vectorized: 8 lanes per instruction with AVX2 (enabled in the Release builds of ray.vcxproj), 4 with SSE2/NEON.
+    Only the writes to the matrices are scalar.
+
+*/
+
+#include <cstring>
+
+#include "Motion.h"                                                     // class ray::Motion declared here
+
+#include "Scene.h"                                                      // ray::Scene::Motion declared here
+
+
+using namespace ray;
+
+
+#define BATCHSIZE 1024                                                  // objects per job (a multiple of LANESIZE)
+
+static_assert(BATCHSIZE % Motion::LANESIZE == 0, "Motion batch size error.");
+
+
+// *****************************************
+//  Constructor
+// *****************************************
+
+Motion::Motion(Jobs* jobs) : jobs(jobs) {}
+
+
+// *****************************************
+//  Set
+// *****************************************
+
+void Motion::Set(int object, int motion, const float param[PARAMSIZE], const float modelmat4[4][4]) {
+
+    /* Move an object to the stream of a built-in motion. */
+
+    const int kindlist[Scene::MOTIONSIZE] = { -1, KIND_ROTATEZ, KIND_TRANSLATE, KIND_ORBIT };           // indexed by Scene::Motion
+
+    Remove(object);
+
+    if (motion < 0 || motion >= Scene::MOTIONSIZE || kindlist[motion] < 0) return;
+
+    Stream& s = stream[kindlist[motion]];
+
+    int index = Push(object, kindlist[motion]);
+
+    for (int i = 0; i < PARAMSIZE; ++i) { s.param[i][index] = param ? param[i] : 0.0f; }
+    for (int i = 0; i < 3; ++i) { s.base[i][index] = modelmat4[i][3]; }
+
+}
+
+void Motion::Set(int object, Callback callback) {
+
+    /* Move an object to the stream of the custom motions. */
+
+    Remove(object);
+
+    if (!callback) return;
+
+    int index = Push(object, KIND_CALLBACK);
+
+    stream[KIND_CALLBACK].callback[index] = callback;
+
+}
+
+void Motion::SetBase(int object, const float modelmat4[4][4]) {
+
+    if (object < 0 || object >= (int)slot.size() || slot[object].kind < 0) return;
+
+    Stream& s = stream[slot[object].kind];
+
+    for (int i = 0; i < 3; ++i) { s.base[i][slot[object].index] = modelmat4[i][3]; }
+
+}
+
+void Motion::Remove(int object) {
+
+    /* Remove an object from its stream (swap with the last). */
+
+    if (object < 0 || object >= (int)slot.size() || slot[object].kind < 0) return;
+
+    Stream& s = stream[slot[object].kind];
+
+    int index = slot[object].index, last = (int)s.object.size() - 1;
+
+    s.object[index] = s.object[last]; slot[s.object[index]].index = index;
+
+    for (int i = 0; i < PARAMSIZE; ++i) { s.param[i][index] = s.param[i][last]; s.param[i].pop_back(); }
+    for (int i = 0; i < 3; ++i) { s.base[i][index] = s.base[i][last]; s.base[i].pop_back(); }
+    s.callback[index] = s.callback[last]; s.callback.pop_back();
+    s.changed.pop_back();
+
+    s.object.pop_back();
+
+    slot[object] = Slot();
+
+}
+
+
+// *****************************************
+//  Update
+// *****************************************
+
+namespace {
+
+    struct Context {
+        /* This structure contains a task of a stream. */
+        Motion::Callback const* callback; char* changed;
+        const int* object; const float* const* param; const float* const* base;
+        int kind; float time; float (*modelmat4list)[4][4];
+    };
+
+}
+
+void Motion::Update(float time, float (*modelmat4list)[4][4]) {
+
+    /*
+        Evaluate the streams over the jobs. (The objects of a stream are distinct, so the batches write distinct matrices.)
+    */
+
+    changed.clear();
+
+    for (int k = 0; k < KINDSIZE; ++k) {
+
+        Stream& s = stream[k];
+
+        const int size = (int)s.object.size(); if (size == 0) continue;
+
+        const float* param[PARAMSIZE] = {}; for (int i = 0; i < PARAMSIZE; ++i) { param[i] = s.param[i].data(); }
+        const float* base[3] = {}; for (int i = 0; i < 3; ++i) { base[i] = s.base[i].data(); }
+
+        Context context = { s.callback.data(), s.changed.data(), s.object.data(), param, base, k, time, modelmat4list };
+
+        jobs->Run(size, BATCHSIZE, (k == KIND_CALLBACK) ? Call : Evaluate, &context);
+
+        // collect the changed objects
+
+        if (k != KIND_CALLBACK) { changed.insert(changed.end(), s.object.begin(), s.object.end()); continue; }
+
+        for (int n = 0; n < size; ++n) { if (s.changed[n]) changed.push_back(s.object[n]); }
+
+    }
+
+}
+
+
+// *****************************************
+//  Access
+// *****************************************
+
+int Motion::GetChangedSize(void) const { return (int)changed.size(); }
+
+const int* Motion::GetChanged(void) const { return changed.data(); }
+
+
+// *****************************************
+
+// *****************************************
+
+int Motion::Push(int object, int kind) {
+
+    /* Append an object to a stream with zero parameters. */
+
+    Stream& s = stream[kind];
+
+    if (object >= (int)slot.size()) slot.resize(object + 1);
+
+    s.object.push_back(object);
+
+    for (int i = 0; i < PARAMSIZE; ++i) { s.param[i].push_back(0.0f); }
+    for (int i = 0; i < 3; ++i) { s.base[i].push_back(0.0f); }
+    s.callback.push_back(nullptr); s.changed.push_back(0);
+
+    slot[object].kind = kind; slot[object].index = (int)s.object.size() - 1;
+
+    return slot[object].index;
+
+}
+
+static void sincos(const float* x, float* outsin, float* outcos);
+
+void Motion::Evaluate(void* context, int begin, int end) {
+
+    /* Evaluate the built-in motion of the objects [begin, end) of a stream, LANESIZE objects per block. */
+
+    const Context& c = *(const Context*)context;
+
+    for (int start = begin; start < end; start += LANESIZE) {
+
+        const int lanes = (end - start < LANESIZE) ? end - start : LANESIZE;
+
+        float angle[LANESIZE] = {}, s[LANESIZE], co[LANESIZE], out[3][LANESIZE] = {};
+
+        // compute (vectorized)
+
+        if (c.kind == KIND_ROTATEZ || c.kind == KIND_ORBIT) {
+
+            const float* rate = c.param[0] + start;
+
+            for (int l = 0; l < LANESIZE; ++l) { angle[l] = (l < lanes) ? rate[l] * c.time : 0.0f; }
+
+            sincos(angle, s, co);
+
+        }
+
+        if (c.kind == KIND_TRANSLATE) {
+
+            for (int i = 0; i < 3; ++i) {
+                const float* base = c.base[i] + start; const float* velocity = c.param[i] + start;
+                for (int l = 0; l < lanes; ++l) { out[i][l] = base[l] + velocity[l] * c.time; }
+            }
+
+        }
+        else if (c.kind == KIND_ORBIT) {
+
+            const float* radius = c.param[1] + start; const float* basex = c.base[0] + start; const float* basey = c.base[1] + start;
+
+            for (int l = 0; l < lanes; ++l) { out[0][l] = basex[l] + radius[l] * co[l]; out[1][l] = basey[l] + radius[l] * s[l]; }
+
+        }
+
+        // write the matrices
+
+        for (int l = 0; l < lanes; ++l) {
+
+            float (*modelmat4)[4] = c.modelmat4list[c.object[start + l]];
+
+            if (c.kind == KIND_ROTATEZ) { modelmat4[0][0] = co[l]; modelmat4[0][1] = -s[l]; modelmat4[1][0] = s[l]; modelmat4[1][1] = co[l]; }
+            else if (c.kind == KIND_TRANSLATE) { for (int i = 0; i < 3; ++i) { modelmat4[i][3] = out[i][l]; } }
+            else { modelmat4[0][3] = out[0][l]; modelmat4[1][3] = out[1][l]; }
+
+        }
+
+    }
+
+}
+
+void Motion::Call(void* context, int begin, int end) {
+
+    /* Call the custom motions of the objects [begin, end) and flag the ones that changed their matrices. */
+
+    const Context& c = *(const Context*)context;
+
+    for (int n = begin; n < end; ++n) {
+
+        float (*modelmat4)[4] = c.modelmat4list[c.object[n]];
+
+        float prevmat4[4][4]; std::memcpy(prevmat4, modelmat4, sizeof(prevmat4));
+
+        c.callback[n](modelmat4);
+
+        c.changed[n] = std::memcmp(prevmat4, modelmat4, sizeof(prevmat4)) != 0;
+
+    }
+
+}
+
+static void sincos(const float* x, float* outsin, float* outcos) {
+
+    /*
+        Sine and cosine of LANESIZE angles. (Max error about 1e-7 for |x| < 1e4.)
+
+        The angle is reduced to [-pi/4, pi/4] by the quadrant (Cody-Waite), and polynomials (Cephes sinf/cosf) are selected by the quadrant.
+    */
+
+    const float TWO_OVER_PI = 0.636619772f, DP1 = 1.5703125f, DP2 = 4.837512969970703125e-4f, DP3 = 7.54978995489188216e-8f;
+
+    for (int l = 0; l < Motion::LANESIZE; ++l) {
+
+        float fq = x[l] * TWO_OVER_PI;
+        int q = (int)(fq + ((fq >= 0.0f) ? 0.5f : -0.5f));
+
+        float r = ((x[l] - q * DP1) - q * DP2) - q * DP3, r2 = r * r;
+
+        float sinr = r + r * r2 * (-1.6666654611e-1f + r2 * (8.3321608736e-3f + r2 * -1.9515295891e-4f));
+        float cosr = 1.0f - 0.5f * r2 + r2 * r2 * (4.166664568298827e-2f + r2 * (-1.388731625493765e-3f + r2 * 2.443315711809948e-5f));
+
+        float s = (q & 1) ? cosr : sinr, c = (q & 1) ? sinr : cosr;
+
+        outsin[l] = (q & 2) ? -s : s;
+        outcos[l] = ((q + 1) & 2) ? -c : c;
+
+    }
+
+}
@@ -0,0 +1,94 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Motion class updates the model matrices of moving Ray Objects for a frame.
+
+	Built-in motions (Scene::Motion) are evaluated in batches of LANESIZE objects from SoA streams, so that the compiler
+	vectorizes them, and custom motions (function pointers) are called in parallel batches.
+
+*/
+
+#include <vector>
+
+#include "Jobs.h"                                                       // class ray::Jobs declared here
+
+namespace ray {
+
+	class Motion;
+
+}
+
+class ray::Motion {
+
+	/*
+		In this class:
+
+			- Keep the moving objects per motion in SoA streams. (Static objects are not kept and cost nothing.)
+
+			- Evaluate the streams over the jobs and write the model matrices of the objects.
+
+		Built-in motions (time: game time in ms, param: motion parameters):
+
+			rotatez:	rotate around the local Z axis by param[0] * time rad		(the upper left 2x2 of the matrix is overwritten)
+			translate:	move from the initial position by param[0..2] * time
+			orbit:		circle around the initial position in the XY plane by param[0] * time rad with radius param[1]
+	*/
+
+public:
+
+	typedef void(*Callback)(float modelmat4[4][4]);					// custom motion (must be thread safe)
+
+	static const int LANESIZE = 16;										// objects per evaluation batch (a multiple of the Simd width)
+
+	static const int PARAMSIZE = 4;
+
+
+	Motion(Jobs* jobs);
+
+	void Set(int object, int motion, const float param[PARAMSIZE], const float modelmat4[4][4]);	// set a built-in motion (Scene::Motion)
+																		// modelmat4: the initial model matrix (MOTION_STATIC: remove the motion)
+
+	void Set(int object, Callback callback);							// set a custom motion
+
+	void SetBase(int object, const float modelmat4[4][4]);				// reset the initial position of a built-in motion
+
+	void Remove(int object);
+
+	void Update(float time, float (*modelmat4list)[4][4]);				// update the model matrices of the moving objects
+
+	int GetChangedSize(void) const;
+
+	const int* GetChanged(void) const;									// objects whose model matrices changed in the last Update(..)
+
+private:
+
+	enum Kind { KIND_ROTATEZ = 0, KIND_TRANSLATE, KIND_ORBIT, KIND_CALLBACK, KINDSIZE };
+
+	struct Stream {
+		/* This structure contains the moving objects of a kind in SoA layout. */
+		std::vector<int> object;
+		std::vector<float> param[PARAMSIZE], base[3];					// base: initial position
+		std::vector<Callback> callback;									// KIND_CALLBACK only
+		std::vector<char> changed;										// KIND_CALLBACK only (per object in the last Update(..))
+	};
+
+	struct Slot { int kind = -1, index = -1; };							// location of an object in the streams
+
+	Jobs* jobs;
+
+	Stream stream[KINDSIZE];
+
+	std::vector<Slot> slot;												// per object
+
+	std::vector<int> changed;
+
+	int Push(int object, int kind);										// add an object to a stream and return its index
+
+	static void Evaluate(void* context, int begin, int end);			// Jobs::Task for the built-in motions
+
+	static void Call(void* context, int begin, int end);				// Jobs::Task for the custom motions
+
+	Motion(const Motion&) = delete; Motion& operator=(const Motion&) = delete;
+
+};
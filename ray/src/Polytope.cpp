@@ -0,0 +1,408 @@
+/* ** EXPLANATION **
+
+    Polytope class finds the extent of Ray Units from their planes.
+
+    A unit is the intersection of the half-spaces behind its planes: { x | dot(normal, x - pos) <= 0 } (normals point out, as read by ray2.frag).
+
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "Polytope.h"                                                   // class ray::Polytope declared here
+
+
+using namespace ray;
+
+
+#define BOXSCALE 1.0e4                                                  // half size of the clipping box per the largest plane position
+#define EPSILON 1.0e-6                                                  // tolerance of a vertex outside a plane (relative to the scale)
+
+const float BIGVAL = 1.0e30f;                                           // extent of unbounded axes
+
+
+// *****************************************
+//  Bound
+// *****************************************
+
+namespace {
+
+    struct Plane {
+        /* This structure contains a normalized plane: dot(normal, x) <= dist. */
+        double normal[3], dist; int source;                             // source: the plane index in the unit (-1: the clipping box)
+    };
+
+}
+
+static void enumerate(const float (*plbuff)[POINTS_PER_UNIT], int plsize, std::vector<Plane>& pl, std::vector<double>& vertex, double& scale);
+
+void Polytope::Bound(const float (*plbuff)[POINTS_PER_UNIT], int plsize, Scene::Bounds& out, std::vector<float>* outvertex) {
+
+    /*
+        Enumerate the vertices of the half-spaces clipped by a box of BOXSCALE times the unit size. (Computed in double.)
+
+        A vertex on the box means the unit is unbounded along the axis, and no vertex means the half-spaces have no common region.
+        Planes without a normal are ignored. (They do not cut the space in ray2.frag either.)
+    */
+
+    std::vector<Plane> pl; std::vector<double> vertex; double scale = 1.0;
+
+    enumerate(plbuff, plsize, pl, vertex, scale);
+
+    const double boxsize = BOXSCALE * scale;
+
+    // bounds
+
+    out = Scene::Bounds();
+
+    if (vertex.empty()) { out.state = Scene::BOUNDS_EMPTY; for (int i = 0; i < 3; ++i) { out.min[i] = BIGVAL; out.max[i] = -BIGVAL; } return; }
+
+    double min[3] = { boxsize, boxsize, boxsize }, max[3] = { -boxsize, -boxsize, -boxsize };
+    for (size_t v = 0; v < vertex.size(); v += 3) { for (int i = 0; i < 3; ++i) { min[i] = std::min(min[i], vertex[v + i]); max[i] = std::max(max[i], vertex[v + i]); } }
+
+    out.state = Scene::BOUNDS_BOUNDED;
+
+    for (int i = 0; i < 3; ++i) {
+        bool open[2] = { min[i] <= -0.5 * boxsize, max[i] >= 0.5 * boxsize };     // reaches the clipping box
+        if (open[0] || open[1]) out.state = Scene::BOUNDS_UNBOUNDED;
+        out.min[i] = open[0] ? -BIGVAL : (float)min[i]; out.max[i] = open[1] ? BIGVAL : (float)max[i];
+    }
+
+    if (out.state == Scene::BOUNDS_UNBOUNDED) { out.radius = BIGVAL; }
+    else {
+
+        for (int i = 0; i < 3; ++i) { out.center[i] = (float)(0.5 * (min[i] + max[i])); }
+
+        double radius2 = 0.0;
+        for (size_t v = 0; v < vertex.size(); v += 3) {
+            double d2 = 0.0; for (int i = 0; i < 3; ++i) { d2 += (vertex[v + i] - out.center[i]) * (vertex[v + i] - out.center[i]); }
+            radius2 = std::max(radius2, d2);
+        }
+
+        out.radius = (float)std::sqrt(radius2) * (1.0f + 1.0e-6f);     // round up
+
+        out.vertexsize = (int)(vertex.size() / 3);
+
+        if (outvertex) { outvertex->assign(vertex.begin(), vertex.end()); }
+
+    }
+
+}
+
+static void enumerate(const float (*plbuff)[POINTS_PER_UNIT], int plsize, std::vector<Plane>& pl, std::vector<double>& vertex, double& scale) {
+
+    /* Normalize the planes (with the clipping box), and find the vertices of their half-spaces. */
+
+    pl.clear(); scale = 1.0; for (int n = 0; n < plsize; ++n) { for (int i = 0; i < 3; ++i) { scale = std::max(scale, std::fabs((double)plbuff[n][i])); } }
+
+    for (int n = 0; n < plsize; ++n) {
+
+        Plane p = {}; p.source = n; double length = 0.0;
+        for (int i = 0; i < 3; ++i) { p.normal[i] = plbuff[n][4 + i]; length += p.normal[i] * p.normal[i]; }
+
+        length = std::sqrt(length); if (length < 1.0e-12) continue;
+
+        for (int i = 0; i < 3; ++i) { p.normal[i] /= length; p.dist += p.normal[i] * plbuff[n][i]; }
+
+        pl.push_back(p);
+
+    }
+
+    const double boxsize = BOXSCALE * scale;
+
+    for (int i = 0; i < 3; ++i) {                                       // clipping box
+        Plane p = {}; p.source = -1; p.normal[i] = 1.0; p.dist = boxsize; pl.push_back(p);
+        p.normal[i] = -1.0; pl.push_back(p);
+    }
+
+    // vertices
+
+    auto cross = [](const double* a, const double* b, double* res) {
+        res[0] = a[1] * b[2] - a[2] * b[1]; res[1] = a[2] * b[0] - a[0] * b[2]; res[2] = a[0] * b[1] - a[1] * b[0];
+    };
+
+    vertex.clear();
+
+    const int size = (int)pl.size();
+
+    for (int a = 0; a < size; ++a) {
+        for (int b = a + 1; b < size; ++b) {
+
+            double ab[3]; cross(pl[a].normal, pl[b].normal, ab);
+
+            for (int c = b + 1; c < size; ++c) {
+
+                double bc[3], ca[3]; cross(pl[b].normal, pl[c].normal, bc); cross(pl[c].normal, pl[a].normal, ca);
+
+                double det = pl[a].normal[0] * bc[0] + pl[a].normal[1] * bc[1] + pl[a].normal[2] * bc[2];
+                if (std::fabs(det) < 1.0e-9) continue;                  // (nearly) parallel
+
+                double x[3]; for (int i = 0; i < 3; ++i) { x[i] = (pl[a].dist * bc[i] + pl[b].dist * ca[i] + pl[c].dist * ab[i]) / det; }
+
+                bool inside = true;
+                for (int m = 0; inside && m < size; ++m) {
+                    inside = pl[m].normal[0] * x[0] + pl[m].normal[1] * x[1] + pl[m].normal[2] * x[2] - pl[m].dist <= EPSILON * scale;
+                }
+
+                if (!inside) continue;
+
+                bool found = false;                                     // shared by more than 3 planes
+                for (size_t v = 0; !found && v < vertex.size(); v += 3) {
+                    found = std::fabs(vertex[v] - x[0]) + std::fabs(vertex[v + 1] - x[1]) + std::fabs(vertex[v + 2] - x[2]) <= EPSILON * scale;
+                }
+
+                if (!found) vertex.insert(vertex.end(), x, x + 3);
+
+            }
+
+        }
+    }
+
+}
+
+namespace {
+
+    struct Context {
+        /* This structure contains the unit geometries to be bound or coarsened as jobs. */
+        const float (*plbuff)[POINTS_PER_UNIT]; const Scene::Range* geometrybuff; Scene::Bounds* out; std::vector<Polytope::Level>* level;
+        std::vector<float>* reduced;
+    };
+
+}
+
+static void boundtask(void* context, int begin, int end);
+
+void Polytope::Bound(const float (*plbuff)[POINTS_PER_UNIT], const Scene::Range* geometrybuff, int geometrysize, Scene::Bounds* out, Jobs* jobs) {
+
+    Context context = { plbuff, geometrybuff, out, nullptr, nullptr };
+
+    if (jobs) { jobs->Run(geometrysize, 4, boundtask, &context); } else { boundtask(&context, 0, geometrysize); }
+
+}
+
+static void boundtask(void* context, int begin, int end) {
+
+    /* Bound the unit geometries [begin, end). */
+
+    const Context& c = *(const Context*)context;
+
+    for (int g = begin; g < end; ++g) { Polytope::Bound(c.plbuff + c.geometrybuff[g].plstart, c.geometrybuff[g].plsize, c.out[g]); }
+
+}
+
+
+// *****************************************
+//  Reduce
+// *****************************************
+
+void Polytope::Reduce(const float (*plbuff)[POINTS_PER_UNIT], int plsize, std::vector<float>& outpl) {
+
+    /*
+        Keep the planes with a face on the (clipped) polytope: 3 or more of its vertices on the plane. The others cut nothing off:
+        duplicates (only the first is kept), parallel planes behind others, planes dominated by the others, and planes without a normal.
+
+        The planes left are sorted, so the same units written in other plane orders become the same geometry.
+        Empty units are kept as they are (they are reported, and pruned from the programs).
+    */
+
+    std::vector<Plane> pl; std::vector<double> vertex; double scale = 1.0;
+
+    enumerate(plbuff, plsize, pl, vertex, scale);
+
+    if (vertex.empty()) { outpl.assign(plbuff[0], plbuff[0] + POINTS_PER_UNIT * (size_t)plsize); return; }
+
+    std::vector<const float*> kept;
+
+    for (size_t n = 0; n < pl.size(); ++n) {
+
+        const Plane& p = pl[n];
+
+        if (p.source < 0) continue;                                     // clipping box
+
+        bool duplicate = false;
+        for (size_t k = 0; !duplicate && k < n; ++k) {
+            duplicate = pl[k].source >= 0 && std::fabs(pl[k].dist - p.dist) <= EPSILON * scale
+                && std::fabs(pl[k].normal[0] - p.normal[0]) + std::fabs(pl[k].normal[1] - p.normal[1]) + std::fabs(pl[k].normal[2] - p.normal[2]) <= EPSILON;
+        }
+
+        if (duplicate) continue;
+
+        int facesize = 0;
+        for (size_t v = 0; facesize < 3 && v < vertex.size(); v += 3) {
+            facesize += std::fabs(p.normal[0] * vertex[v] + p.normal[1] * vertex[v + 1] + p.normal[2] * vertex[v + 2] - p.dist) <= EPSILON * scale;
+        }
+
+        if (facesize >= 3) kept.push_back(plbuff[p.source]);
+
+    }
+
+    if (kept.empty()) { outpl.assign(plbuff[0], plbuff[0] + POINTS_PER_UNIT * (size_t)plsize); return; }     // (no plane with a normal: the whole space)
+
+    std::sort(kept.begin(), kept.end(), [](const float* a, const float* b) { return std::lexicographical_compare(a, a + POINTS_PER_UNIT, b, b + POINTS_PER_UNIT); });
+
+    outpl.clear();
+    for (const float* row : kept) { outpl.insert(outpl.end(), row, row + POINTS_PER_UNIT); }
+
+}
+
+static void reducetask(void* context, int begin, int end);
+
+void Polytope::Reduce(const float (*plbuff)[POINTS_PER_UNIT], const Scene::Range* geometrybuff, int geometrysize, std::vector<float>* outpl, Jobs* jobs) {
+
+    Context context = { plbuff, geometrybuff, nullptr, nullptr, outpl };
+
+    if (jobs) { jobs->Run(geometrysize, 4, reducetask, &context); } else { reducetask(&context, 0, geometrysize); }
+
+}
+
+static void reducetask(void* context, int begin, int end) {
+
+    /* Reduce the unit geometries [begin, end). */
+
+    const Context& c = *(const Context*)context;
+
+    for (int g = begin; g < end; ++g) { Polytope::Reduce(c.plbuff + c.geometrybuff[g].plstart, c.geometrybuff[g].plsize, c.reduced[g]); }
+
+}
+
+
+// *****************************************
+//  Coarsen
+// *****************************************
+
+void Polytope::Coarsen(const float (*plbuff)[POINTS_PER_UNIT], int plsize, std::vector<Level>& out) {
+
+    /*
+        Merge the clusters of the closest mean normals, one pair at a time, and take a level at each half of the planes.
+
+        A level is put around the vertices of the unit itself (not of the previous level), so the levels do not drift outward.
+        The levels end at the first one which is not bounded (e.g. a box losing an axis).
+    */
+
+    out.clear();
+
+    std::vector<float> vertex; Scene::Bounds bounds;
+
+    Bound(plbuff, plsize, bounds, &vertex);
+
+    if (bounds.state != Scene::BOUNDS_BOUNDED) return;
+
+    struct Cluster { double normal[3]; int plane; };                    // normal: sum of the unit normals, plane: the first plane (for its u-axis)
+
+    std::vector<Cluster> cluster;
+
+    for (int n = 0; n < plsize; ++n) {
+
+        Cluster c = { { plbuff[n][4], plbuff[n][5], plbuff[n][6] }, n };
+
+        double length = std::sqrt(c.normal[0] * c.normal[0] + c.normal[1] * c.normal[1] + c.normal[2] * c.normal[2]);
+        if (length < 1.0e-12) continue;                                 // (no cut)
+
+        for (int i = 0; i < 3; ++i) { c.normal[i] /= length; }
+
+        cluster.push_back(c);
+
+    }
+
+    auto cosine = [](const Cluster& a, const Cluster& b) {
+        double dot = 0.0, la = 0.0, lb = 0.0;
+        for (int i = 0; i < 3; ++i) { dot += a.normal[i] * b.normal[i]; la += a.normal[i] * a.normal[i]; lb += b.normal[i] * b.normal[i]; }
+        return dot / std::sqrt(la * lb);
+    };
+
+    int target = (int)cluster.size() / 2;
+
+    while ((int)out.size() < MAXLEVELSIZE && target >= MINLEVELPLANESIZE) {
+
+        // merge the closest pair until the target size
+
+        while ((int)cluster.size() > target) {
+
+            size_t a = 0, b = 1; double best = -2.0;
+
+            for (size_t i = 0; i < cluster.size(); ++i) {
+                for (size_t j = i + 1; j < cluster.size(); ++j) { double c = cosine(cluster[i], cluster[j]); if (c > best) { best = c; a = i; b = j; } }
+            }
+
+            if (best < -1.0 + 1.0e-9) break;                            // (opposite normals only)
+
+            for (int i = 0; i < 3; ++i) { cluster[a].normal[i] += cluster[b].normal[i]; }
+            cluster.erase(cluster.begin() + b);
+
+        }
+
+        // planes at the support distances of the unit vertices
+
+        Level level = { {}, 0.0f };
+
+        for (const Cluster& c : cluster) {
+
+            double normal[3], length = std::sqrt(c.normal[0] * c.normal[0] + c.normal[1] * c.normal[1] + c.normal[2] * c.normal[2]);
+            for (int i = 0; i < 3; ++i) { normal[i] = c.normal[i] / length; }
+
+            double dist = -1.0e300;
+            for (size_t v = 0; v < vertex.size(); v += 3) { dist = std::max(dist, normal[0] * vertex[v] + normal[1] * vertex[v + 1] + normal[2] * vertex[v + 2]); }
+
+            const float* src = plbuff[c.plane];
+
+            double u[3] = { src[8], src[9], src[10] }, udot = u[0] * normal[0] + u[1] * normal[1] + u[2] * normal[2];     // u-axis on the merged plane
+            for (int i = 0; i < 3; ++i) { u[i] -= udot * normal[i]; }
+
+            double ulength = std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+            if (ulength < 1.0e-6) { int k = (std::fabs(normal[0]) < 0.9) ? 0 : 1; for (int i = 0; i < 3; ++i) { u[i] = (i == k) - normal[k] * normal[i]; } }
+            ulength = std::sqrt(u[0] * u[0] + u[1] * u[1] + u[2] * u[2]);
+
+            float pl[POINTS_PER_UNIT] = {};
+            for (int i = 0; i < 3; ++i) { pl[i] = (float)(normal[i] * dist); pl[4 + i] = (float)normal[i]; pl[8 + i] = (float)(u[i] / ulength); }
+            pl[3] = 1.0f;
+
+            level.pl.insert(level.pl.end(), pl, pl + POINTS_PER_UNIT);
+
+        }
+
+        // the error: the farthest vertex of the level outside the unit planes
+
+        std::vector<float> levelvertex; Scene::Bounds levelbounds;
+
+        Bound((const float(*)[POINTS_PER_UNIT])level.pl.data(), (int)cluster.size(), levelbounds, &levelvertex);
+
+        if (levelbounds.state != Scene::BOUNDS_BOUNDED) break;
+
+        for (size_t v = 0; v < levelvertex.size(); v += 3) {
+            for (int n = 0; n < plsize; ++n) {
+
+                double dot = 0.0, length = 0.0;
+                for (int i = 0; i < 3; ++i) { dot += plbuff[n][4 + i] * (levelvertex[v + i] - plbuff[n][i]); length += plbuff[n][4 + i] * plbuff[n][4 + i]; }
+
+                if (length >= 1.0e-24) level.error = std::max(level.error, (float)(dot / std::sqrt(length)));
+
+            }
+        }
+
+        out.push_back(level);
+
+        target = (int)cluster.size() / 2;
+
+    }
+
+}
+
+static void coarsentask(void* context, int begin, int end);
+
+void Polytope::Coarsen(const float (*plbuff)[POINTS_PER_UNIT], const Scene::Range* geometrybuff, int geometrysize, std::vector<Level>* out, Jobs* jobs) {
+
+    Context context = { plbuff, geometrybuff, nullptr, out, nullptr };
+
+    if (jobs) { jobs->Run(geometrysize, 1, coarsentask, &context); } else { coarsentask(&context, 0, geometrysize); }
+
+}
+
+static void coarsentask(void* context, int begin, int end) {
+
+    /* Coarsen the unit geometries [begin, end). */
+
+    const Context& c = *(const Context*)context;
+
+    for (int g = begin; g < end; ++g) { Polytope::Coarsen(c.plbuff + c.geometrybuff[g].plstart, c.geometrybuff[g].plsize, c.level[g]); }
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Polytope class finds the extent of Ray Units, which are defined only implicitly by the half-spaces of their planes.
+
+*/
+
+#include <vector>
+
+#include "Scene.h"                                                      // class ray::Scene declared here
+#include "Jobs.h"                                                       // class ray::Jobs declared here
+
+namespace ray {
+
+	class Polytope;
+
+}
+
+class ray::Polytope {
+
+	/*
+		In this class:
+
+			- Intersect the planes of a unit three at a time, and keep the points inside all of the planes as the polytope vertices.
+
+			- Clip the half-spaces by a large box first, so that unbounded units are told by vertices on the box, and empty units by no vertex.
+
+			- Bound the vertices by an AABB and a sphere in model space.
+
+			- Remove the planes which do not bound the unit (no face on the polytope), so they are not evaluated per pixel.
+
+			- Coarsen the planes of a bounded unit into levels of detail: the closest normals are merged pairwise (about half of the planes per level),
+			  and a merged plane is put at the support distance of the unit's vertices, so a level still encloses the unit.
+	*/
+
+public:
+
+	struct Level {
+		/* This structure contains a coarser level of a unit geometry. */
+		std::vector<float> pl;											// planes [plsize][POINTS_PER_UNIT]
+		float error;													// max distance of the level's vertices outside the unit (model space)
+	};
+
+	static const int MINLEVELPLANESIZE = 4;								// fewest planes of a level (a tetrahedron)
+
+	static const int MAXLEVELSIZE = 3;									// max coarser levels per unit geometry
+
+	static void Bound(const float (*plbuff)[POINTS_PER_UNIT], int plsize, Scene::Bounds& out, std::vector<float>* outvertex = nullptr);
+																		// bound the planes of a unit (outvertex: polytope vertices [][3] if given)
+
+	static void Bound(const float (*plbuff)[POINTS_PER_UNIT], const Scene::Range* geometrybuff, int geometrysize, Scene::Bounds* out, Jobs* jobs);
+																		// bound unit geometries in parallel
+
+	static void Reduce(const float (*plbuff)[POINTS_PER_UNIT], int plsize, std::vector<float>& outpl);
+																		// the planes bounding a unit, sorted ([plsize][POINTS_PER_UNIT], empty units: as they are)
+
+	static void Reduce(const float (*plbuff)[POINTS_PER_UNIT], const Scene::Range* geometrybuff, int geometrysize, std::vector<float>* outpl, Jobs* jobs);
+																		// reduce unit geometries in parallel
+
+	static void Coarsen(const float (*plbuff)[POINTS_PER_UNIT], int plsize, std::vector<Level>& out);
+																		// coarser levels of a unit, finest first (none: unbounded, empty or too few planes)
+
+	static void Coarsen(const float (*plbuff)[POINTS_PER_UNIT], const Scene::Range* geometrybuff, int geometrysize, std::vector<Level>* out, Jobs* jobs);
+																		// coarsen unit geometries in parallel
+
+};
@@ -8,6 +8,10 @@
 */
 
 #include <iostream>
+#include <vector>
+#include <cstring>
+#include <string>
+#include <algorithm>
 
 #include <glew.h>
 #include <glfw3.h>
@@ -22,14 +26,22 @@ using namespace ray;
 
 #define MAXUNITBUFFSIZE 20                                              // max size of (ubo) units
 #define MAXPLANEBUFFSIZE 200                                            // max size of (ubo) plane buffers
+#define MAXRAY2SEGMENTSIZE MAXUNITBUFFSIZE                              // max size of ray unit segments of the ray2 buffer (units drawn per frame, see cull.vert)
 
-#define  MAXOBJECTSIZE 5                                                // max size of ray objects per table
-#define MAXUNITSIZE 3                                                   // max size of ray units per ray object
+#define MAXUNITSIZE 8                                                   // max size of ray units per ray object (combined by its selection program)
 
 // *****************************************
 //  Table
 // *****************************************
 
+#include "Residency.h"                                                  // class ray::Residency (and ray::Scene) declared here
+#include "Motion.h"                                                     // class ray::Motion (and ray::Jobs) declared here
+#include "Tracer.h"                                                     // class ray::Tracer declared here
+#include "Mesh.h"                                                       // class ray::Mesh declared here
+#include "Timeline.h"                                                   // class ray::Timeline declared here
+
+static_assert(MAXUNITSIZE == Residency::MAXENTRYUNITSIZE, "Ray unit size per object mismatch.");
+
 struct Unit {
 
     /* This structure contains planes which construct a Ray Unit. */
@@ -42,20 +54,41 @@ struct Object {
 
     /* This structure contains Ray Units and attribute data which construct a Ray Object. */
 
-    void(*updatemat4)(float[4][4]) = nullptr;                           // func to update model matrix
-
-    float modelmat4[4][4] = {};                                         // model matrix of the ray object
-
-    int unitstart = 0, unitsize = 0;                                    // unitstart: ray unit start index in (ubo) unit buffer
+    int unitstart = 0, unitsize = 0;                                    // unitstart: ray unit start index in (ubo) unit buffer (while resident)
     Unit unit[MAXUNITSIZE] = {};
+    GLuint selectprgm = 0;                                              // selectprgm: variant of the selection program (resolved when loaded)
 
 };
 
 struct Ray::Table {
 
-    /* This structure contains Ray Objects. */
+    /* This structure contains Ray Objects and streams them in and out of the Gpu. */
+
+    int objectsize = 0; std::vector<Object> object;                     // scene objects, then runtime objects (indexed as in residency)
+
+    std::vector<float> modelmat4buff;                                   // model matrices of the ray objects [objectsize][4][4]
+
+    Jobs jobs; Motion motion{ &jobs };                                  // motion: moving ray objects (static ones are not kept)
+
+    std::vector<char> dirty; std::vector<int> dirtylist;                // ray objects whose model matrices are to be uploaded
+
+    Scene* scene = nullptr; Residency* residency = nullptr;             // scene: mapped scene file, residency: resident ray objects on Gpu
+
+    Tracer* tracer = nullptr;                                           // Cpu ray tracing (made by the first Trace(..))
+
+    float (*GetModelmat4(void))[4][4] { return (float(*)[4][4])modelmat4buff.data(); }
+
+    void SetDirty(int n) { if (!dirty[n]) { dirty[n] = 1; dirtylist.push_back(n); } }
+
+    void SetRange(int n) {                                              // set the buffer ranges of a resident ray object (dropped units: no plane)
+        const Residency::Entry& entry = residency->GetEntry(n); object[n].unitstart = entry.unitstart;
+        for (int m = 0; m < object[n].unitsize; ++m) { object[n].unit[m] = { entry.plstart[m], ((entry.dropped >> m) & 1) ? 0 : residency->GetGeometryRange(entry.geometry[m]).plsize }; }
+    }
+
+    int AddObject(int unitsize, const int geometry[], const float texscale[][2], const float modelmat4[4][4], const Csg::Program* program);
+                                                                        // add a runtime ray object (program: nullptr: the first unit minus the others)
 
-    int objectsize = 0; Object object[MAXOBJECTSIZE] = {};
+    ~Table(void) { delete tracer; delete residency; delete scene; }
 
 };
 
@@ -64,22 +97,46 @@ struct Ray::Table {
 //  Update
 // *****************************************
 
-static void GL_UnitBuffer_Reset(int unitstartindex, const float modelmat4[4][4]);
+static void GL_UnitBuffer_Set(int unitstartindex, int unitsize, const float modelmat4[4][4]);
+
+static void GL_UnitBuffer_Flush(void);
+
+static void GL_SlotBuffer_Reset(void);
 
-static void GL_UnitBuffer_Update(void);
+static void GL_SlotBuffer_Set(int unitindex, int unitstartindex, int unitsize, const Unit& unit, const Scene::Bounds& bounds);
 
-static void GL_Ray2Buffer_Initialize(int unitstartindex);
+static GLuint GL_GetSelectVariant(const int* program, int programsize);
 
-static void GL_Ray2Buffer_Update(const Unit* unit);
+static void GL_SlotBuffer_SetProgram(int unitstartindex, int unitsize, const int* program, int programsize, GLuint selectprgm, const Scene::Bounds& bounds);
 
-static void GL_Ray2Buffer_Release(void);
+static void GL_SlotBuffer_Flush(void);
 
-static void GL_SelectionBuffer_Reset(void);
+static void GL_CullBuffer_Update(void);
+
+static void GL_Ray2Buffer_Update(void);
 
 static void GL_SelectionBuffer_Update(void);
 
 static void GL_DrawBuffer_Update(void);
 
+static void GL_HizBuffer_Update(void);
+
+static void GL_HizBuffer_Invalidate(void);
+
+static void GL_ScreenRect_Enable(bool enable);
+
+static void GL_Timer_Begin(void);
+
+static void GL_Timer_Mark(int pass, int slot = -1);
+
+static void GL_Timer_SetSlot(int slot, int object, int unit);
+
+static void GL_Timer_End(void);
+
+static bool GL_Export_IsEnabled(void);
+
+static void GL_Export_Read(const int* slotobject, const int* slotunit, const int* slotplstart);
+
 static bool GL_CheckError(void);
 
 
@@ -87,6 +144,10 @@ static void SetNewFrame(void);
 
 static void SetViewmat4(void);
 
+static const float (*GetViewmat4(void))[4][4];
+
+static float GetFrame(void);
+
 static bool IsFirstUpdError(void);
 
 
@@ -94,60 +155,118 @@ void Ray::Update(void) {
 
     /*
         Update Ray Object's movements and process Ray2 Calculations for each Unit, Selection Calculations for each Object, and finally render to screen.
+
+        The Ray Units are culled on Gpu, which writes the draw commands of the Ray2/Selection Calculations per slot of the UBO Unit Buffer,
+        so the number of draw calls per frame is bounded by the buffer size, not by the scene.
     */
 
+    Timeline::Scope scope("Ray::Update");
+
     SetNewFrame();                                                      // advance to the next frame.
 
     SetViewmat4();                                                      // calc view matrix
 
+    if (!table->residency) return;
+
+    GL_Timer_Begin();                                                   // timestamps of the passes (if the gpu timer is enabled)
+
+    float (*modelmat4)[4][4] = table->GetModelmat4();
+
     // ** update ray object's movements ********
 
-    for (int n = 0; n < table->objectsize; ++n) {
+    { Timeline::Scope scope("Motion::Update"); table->motion.Update(GetFrame(), modelmat4); }     // update the moving ray object's model matrices (in parallel)
+
+    for (int i = 0; i < table->motion.GetChangedSize(); ++i) { table->SetDirty(table->motion.GetChanged()[i]); }
+
+    // ** stream ray objects in and out ********
 
-        table->object[n].updatemat4(table->object[n].modelmat4);        // update ray object's model matrix
+    { Timeline::Scope scope("Residency::Update"); table->residency->Update(*GetViewmat4(), modelmat4); }   // load/evict ray objects and choose their levels of detail within the frame budget
+
+    for (int i = 0; i < table->residency->GetLoadedSize(); ++i) {
+
+        int n = table->residency->GetLoaded()[i];                       // set the ubo buffer ranges of the loaded ray objects
+
+        table->SetRange(n);
+
+        table->object[n].selectprgm = GL_GetSelectVariant(table->residency->GetProgram(n), table->residency->GetProgramSize(n));
+
+        table->SetDirty(n);                                             // the unit data were loaded with the initial model matrix
 
     }
 
-    // upload ray unit's model matrices to Gpu
+    for (int i = 0; i < table->residency->GetChangedSize(); ++i) { table->SetRange(table->residency->GetChanged()[i]); }     // (levels of detail)
 
-    for (int n = 0; n < table->objectsize; ++n) {
+    const int residentsize = table->residency->GetResidentSize(); const int* resident = table->residency->GetResident();
 
-        GL_UnitBuffer_Reset(table->object[n].unitstart, table->object[n].modelmat4);    // init for uploading model matrices
+    // upload the changed model matrices to Gpu
 
-        for (int m = 0; m < table->object[n].unitsize; ++m) {
+    for (int n : table->dirtylist) {
 
-            GL_UnitBuffer_Update();                                                     // upload the ray object's model matrix for the ray unit's matrix
+        table->dirty[n] = 0;
 
-        }
+        if (table->residency->GetEntry(n).residentindex < 0) continue;  // uploaded when loaded
+
+        GL_UnitBuffer_Set(table->object[n].unitstart, table->object[n].unitsize, modelmat4[n]);
+
+        GL_HizBuffer_Invalidate();                                      // (a resident ray object moved: the depth of the last frame is stale)
 
     }
 
-    // ** ray2 and selection calc **************
+    if (table->tracer) table->tracer->Update(modelmat4, table->objectsize, table->dirtylist.data(), (int)table->dirtylist.size());     // refit the bvh
 
-    GL_SelectionBuffer_Reset();                                         // init for selction calc
+    table->dirtylist.clear();
 
-    // process through all ray objects/units
+    GL_UnitBuffer_Flush();                                              // upload the dirty unit ranges (coalesced)
 
-    for (int n = 0; n < table->objectsize; ++n) {
+    // ** culling, ray2 and selection calc *****
 
-        GL_Ray2Buffer_Initialize(table->object[n].unitstart);           // init for ray2 calc
+    GL_SlotBuffer_Reset();                                              // set the ray unit slots of the resident ray objects
 
-        for (int m = 0; m < table->object[n].unitsize; ++m) {
+    for (int i = 0; i < residentsize; ++i) {
 
-            GL_Ray2Buffer_Update(&table->object[n].unit[m]);            // init and process ray2 calc for a ray unit 
+        int n = resident[i]; const Object& object = table->object[n];
 
+        for (int m = 0; m < object.unitsize; ++m) {
+            GL_SlotBuffer_Set(object.unitstart + m, object.unitstart, object.unitsize, object.unit[m], table->residency->GetGeometryBounds(table->residency->GetEntry(n).geometry[m]));
+            GL_Timer_SetSlot(object.unitstart + m, n, m);
         }
 
-        GL_Ray2Buffer_Release();                                        // release for ray2 calc
-
-        GL_SelectionBuffer_Update();                                    // process selection calc for a ray object
+        GL_SlotBuffer_SetProgram(object.unitstart, object.unitsize, table->residency->GetProgram(n), table->residency->GetProgramSize(n), object.selectprgm, table->residency->GetObjectBounds(n));
 
     }
 
+    GL_SlotBuffer_Flush();                                              // upload the slots (if changed)
+
+    GL_Timer_Mark(PASS_UPLOAD);
+
+    GL_CullBuffer_Update();                                             // cull the ray units and write the draw commands on Gpu
+
+    GL_Timer_Mark(PASS_CULL);
+
+    GL_ScreenRect_Enable(true);                                         // scissor to the screen rect (if set)
+
+    GL_Ray2Buffer_Update();                                             // process ray2 calc for the ray units drawn
+
+    GL_SelectionBuffer_Update();                                        // process selection calc for the ray objects drawn
+
     // ** render to screen *********************    
 
     GL_DrawBuffer_Update();
 
+    GL_ScreenRect_Enable(false);
+
+    GL_Timer_Mark(PASS_DRAW);
+
+    GL_HizBuffer_Update();                                              // max depth pyramid for the culling of the next frame
+
+    GL_Timer_Mark(PASS_HIZ); GL_Timer_End();
+
+    if (GL_Export_IsEnabled()) {                                        // read the frame back for export (passed a few frames later)
+        int slotobject[MAXUNITBUFFSIZE], slotunit[MAXUNITBUFFSIZE], slotplstart[MAXUNITBUFFSIZE];
+        GetSlotMap(slotobject, slotunit, slotplstart);
+        GL_Export_Read(slotobject, slotunit, slotplstart);
+    }
+
 
     if (GL_CheckError() && IsFirstUpdError()) { std::cout << "\rError: Error has been confirmed in update process.\n."; }
 
@@ -158,161 +277,269 @@ void Ray::Update(void) {
 //  Constructor 
 // *****************************************
 
-#include <vector>
-#include "Unit.h"
+namespace data {
+    /*
+        The attribute data of a Ray Unit to be passed to uploading process.
+        (The data structure is the same as in (UBO) Unit Buffer and in the unit section of a scene file.)
+    */
+    typedef Scene::Unit Unit;
+}
+
+
+static void GL_PlaneBuffer_Reset(int plstartindex, const float(*plbuff)[POINTS_PER_UNIT], unsigned int plbufflines);
+
+static void GL_UnitBuffer_Reset(int unitstartindex, const data::Unit* unitbuff, unsigned int unitbuffsize);
+
+
+static Allocator* getplalloc(void);
+
+static Allocator* getunitalloc(void);
 
-namespace data { struct Unit; }
 
-struct data::Unit {
+Ray::Ray(void) : Ray(SCENEFILE) {}
+
+Ray::Ray(const char* scenefile) : table(new Table) {
+
     /*
-        This structure contains the attribute data of a Ray Unit to be passed to uploading process.
-        (The data structure is the same as in (UBO) Unit Buffer.)
+        Initialize Ray Objects from a binary scene file.
+
+        The scene file stays mapped, and the plane and unit data of the ray objects are streamed to Gpu in Update().
     */
-    float modelmat4[4][4] = {};                                         // model matrix of ray unit
-    float texscale[2] = { 1.0f, 1.0f }, padding[2] = {};                // texscale: scale factor of image texture (use negative val to flip tex)
-};
 
+    table->scene = new Scene(scenefile);
+
+    if (!table->scene->IsOpen()) { std::cout << "Error: Ray units/objects have not been loaded.\n"; return; }
+
+    const Scene::Object* objectbuff = table->scene->GetObjectBuff();
+
+    int objectsize = table->scene->GetObjectSize(), errorsize = 0;
+
+    table->object.resize(objectsize); table->modelmat4buff.resize(16 * (size_t)objectsize);
+
+    float (*modelmat4)[4][4] = table->GetModelmat4();
+
+    // process through ray objects
+
+    for (int n = 0; n < objectsize; ++n) {
+
+        const Scene::Object& src = objectbuff[n];
+
+        Object& object = table->object[n];
+
+        object.unitsize = (src.unitsize <= MAXUNITSIZE) ? src.unitsize : 0;                 // too many units are never made resident
+        errorsize += (src.unitsize > MAXUNITSIZE);
+
+        for (int m = 0; m < object.unitsize; ++m) { object.unit[m].plsize = table->scene->GetUnitRange(src.unitstart + m).plsize; }
+
+        std::memcpy(modelmat4[n], src.modelmat4, sizeof(src.modelmat4));
+
+        table->motion.Set(n, src.motion, src.motionparam, src.modelmat4);   // static ray objects are not kept
+
+    }
+
+    table->objectsize = objectsize; table->dirty.resize(objectsize);
+
+    if (errorsize > 0) { std::cout << "Error: Ray object unit size error. (" << errorsize << " objects)\n"; }
+
+
+    table->residency = new Residency(table->scene, getplalloc(), getunitalloc(), GL_PlaneBuffer_Reset, GL_UnitBuffer_Reset);
+
+}
+
+
+// *****************************************
+//  Runtime Objects
+// *****************************************
 
-static void GL_PlaneBuffer_Reset(const float(*plbuff)[POINTS_PER_UNIT], unsigned int plbufflines);
+int Ray::AddGeometry(const float (*plbuff)[POINTS_PER_UNIT], int plsize) {
 
-static void GL_UnitBuffer_Reset(const data::Unit* unitbuff, unsigned int unitbuffsize);
+    /* Add a unit geometry. The planes are uploaded when a ray object referencing it is added. */
 
+    if (!table->residency) return -1;
 
-static int getplbuffindex(void);
+    int res = table->residency->AddGeometry(plbuff, plsize);
 
-static void setnewplbuffindex(int increase);
+    if (res < 0) { std::cout << "Error: Ray unit geometry plane size error. (" << plsize << " planes)\n"; }
 
-static int getunitbuffindex(void);
+    return res;
 
-static void setunitbuffindex(int increase);
+}
 
-static void updatemat4_default(float modelmat4[4][4]);
+int Ray::AddObject(int unitsize, const int geometry[], const float texscale[][2], const float modelmat4[4][4]) {
 
-static void updatemat4(float modelmat4[4][4]);
+    return table->AddObject(unitsize, geometry, texscale, modelmat4, nullptr);
 
+}
 
-Ray::Ray(void) : table(new Table) {
+int Ray::AddMesh(const char* meshfile, const float modelmat4[4][4], const float texscale[2]) {
 
     /*
-        Initialize and upload Ray Units/Objects from arbitrary plane and attribute data.
+        Import a mesh at runtime (see Mesh.h): its parts are added as unit geometries, and its tree is compiled into the program of a ray object.
+
+        Parts pruned by the compilation stay as unused geometries.
     */
 
-    struct Mat4 { /* This structure contains a 4x4 matrix. */ float mat4[4][4] = {}; };
+    if (!table->residency) return -1;
 
-    struct Unit {
-        /* This structure contains planes and attribute data which construct a Ray Unit. */
-        int linesize = 0; float(*buff)[POINTS_PER_UNIT] = nullptr; data::Unit att = {};
-    };
+    Mesh::Decomposition d; if (!Mesh::Import(meshfile, d, &table->jobs)) return -1;
 
-    struct Object {
-        /* This structure contains Ray Units and attribute data which construct a Ray Object. */
-        Unit unit[MAXUNITSIZE] = {}; Mat4 modelmat = {}; void(*updatemat4)(float[4][4]) = nullptr;
-    };
+    std::vector<int> geometry, unitkey; std::vector<Scene::Bounds> unitbounds;
+
+    for (const std::vector<float>& part : d.part) {
+        int g = AddGeometry((const float(*)[POINTS_PER_UNIT])part.data(), (int)(part.size() / POINTS_PER_UNIT)); if (g < 0) return -1;
+        geometry.push_back(g); unitkey.push_back((int)unitkey.size()); unitbounds.push_back(table->residency->GetGeometryBounds(g));
+    }
+
+    Csg::Program program;
+
+    if (!Csg::Compile(d.tree, (int)d.tree.size() - 1, unitkey.data(), unitbounds.data(), program) || program.size == 0) {
+        std::cout << "Error: Mesh cannot be compiled into a ray object. (\"" << meshfile << "\")\n"; return -1;
+    }
 
-    const Mat4 initalmodelmat4 = { 1.0f, 0.0f, 0.0f, 0.0f,  0.0f, 1.0f, 0.0f, 3.0f,  0.0f, 0.0f, 1.0f, -1.2f,  0.0f, 0.0f, 0.0f, 1.0f };
+    int unitgeometry[MAXUNITSIZE] = {}; float unittexscale[MAXUNITSIZE][2] = {};
 
+    for (size_t m = 0; m < program.leaf.size(); ++m) {
+        unitgeometry[m] = geometry[program.leaf[m]];
+        for (int i = 0; i < 2; ++i) { unittexscale[m][i] = texscale ? texscale[i] : 1.0f; }
+    }
+
+    return table->AddObject((int)program.leaf.size(), unitgeometry, unittexscale, modelmat4, &program);
+
+}
 
-    Object object[MAXOBJECTSIZE] = {                                        // arbitrary unit/object data to init and upload
+int Ray::Table::AddObject(int unitsize, const int geometry[], const float texscale[][2], const float modelmat4[4][4], const Csg::Program* program) {
 
-        { // - object 0 -
-            {
-                { sizeof(cubeunit) / POINTS_PER_UNIT / sizeof(float), cubeunit, { {}, { 1.0f, 1.0f }, } },
+    /*
+        Add a ray object at runtime and upload its unit data (and its planes not resident yet) at once.
 
-                { sizeof(suboctahedronunit) / POINTS_PER_UNIT / sizeof(float), suboctahedronunit, { {}, { 1.0f, -1.0f }, } },
-            },
+        The buffer ranges come from the same free lists as the streamed scene objects, so no rebuild is needed.
+    */
 
-            initalmodelmat4, updatemat4
-        },
+    if (!residency || unitsize <= 0 || unitsize > MAXUNITSIZE) return -1;
 
-        { // - object 1 -
-            {
-                { sizeof(largecubeunit) / POINTS_PER_UNIT / sizeof(float), largecubeunit, { {}, { 100.0f, 100.0f }, } },
+    data::Unit unitbuff[MAXUNITSIZE] = {};
 
-                { sizeof(largesubcubeunit) / POINTS_PER_UNIT / sizeof(float), largesubcubeunit, { {}, { -100.0f, 100.0f }, } },
-            },
+    for (int m = 0; m < unitsize; ++m) {
+        std::memcpy(unitbuff[m].modelmat4, modelmat4, sizeof(unitbuff[m].modelmat4));
+        for (int i = 0; i < 2; ++i) { unitbuff[m].texscale[i] = texscale ? texscale[m][i] : 1.0f; }
+    }
 
-            initalmodelmat4, updatemat4_default
-        },
+    int n = residency->AddObject(geometry, unitbuff, unitsize, program);
 
-    };
+    if (n < 0) return -1;
 
-    int objectsize = 0;
-    std::vector<float> plbuff; std::vector<data::Unit> unitbuff;            // buffs for uploading ray unit plane and attribute data to Gpu
+    if (n >= objectsize) {                                              // a new index (removed indices are reused)
+        objectsize = n + 1; object.resize(n + 1); modelmat4buff.resize(16 * (size_t)(n + 1)); dirty.resize(n + 1);
+    }
 
-    unitbuff.reserve(MAXUNITBUFFSIZE); plbuff.reserve(MAXPLANEBUFFSIZE * POINTS_PER_UNIT);
+    object[n].unitsize = unitsize; SetRange(n);
 
-    // process through ray unit/object data
+    object[n].selectprgm = GL_GetSelectVariant(residency->GetProgram(n), residency->GetProgramSize(n));
 
-    for (int n = 0; n < MAXOBJECTSIZE; ++n) {
+    std::memcpy(GetModelmat4()[n], modelmat4, sizeof(float[4][4]));
 
-        if (object[n].unit[0].linesize == 0) break;
+    if (tracer) tracer->Invalidate();
 
+    return n;
 
-        int unitsize = 0;
-        std::vector<data::Unit> tmpunitbuff; std::vector<float> tmpplbuff;  // segmented buffs for uploading ray unit plane and attribute data
+}
 
-        tmpplbuff.reserve(MAXPLANEBUFFSIZE * POINTS_PER_UNIT); tmpunitbuff.reserve(MAXUNITSIZE);
+void Ray::RemoveObject(int object) {
 
-        for (int m = 0; m < MAXUNITSIZE; ++m) {
+    /* Remove a ray object added at runtime. Its buffer ranges are freed (not uploaded) and reused by later objects. */
 
-            if (object[n].unit[m].linesize == 0) break;
+    if (!table->residency || !table->residency->IsRuntimeObject(object)) return;
 
-            table->object[n].unit[m].plsize = object[n].unit[m].linesize;
+    table->residency->RemoveObject(object);
 
-            table->object[n].unit[m].plstart = getplbuffindex();
+    table->object[object] = Object(); table->motion.Remove(object);
 
-            setnewplbuffindex(object[n].unit[m].linesize);                  // increase the plane buffer index
+    if (table->tracer) table->tracer->Invalidate();
 
+}
 
-            for (int i = 0; i < POINTS_PER_UNIT * object[n].unit[m].linesize; ++i) { tmpplbuff.push_back(((float*)object[n].unit[m].buff)[i]); }
+void Ray::UpdateObject(int object, const float modelmat4[4][4]) {
 
-            tmpunitbuff.push_back(object[n].unit[m].att);
+    /* Set the model matrix of a ray object. It is uploaded for its units, and the bvh of Trace(..) is refit, in the next Update() (with the other changes). */
 
-            ++unitsize;
+    if (!table->residency || object < 0 || object >= table->objectsize) return;
 
-        }
+    std::memcpy(table->GetModelmat4()[object], modelmat4, sizeof(float[4][4]));
 
-        table->object[n].unitsize = unitsize;
+    table->motion.SetBase(object, modelmat4);                           // a moving ray object moves on from here
 
-        table->object[n].unitstart = getunitbuffindex();
+    table->SetDirty(object);
 
-        setunitbuffindex(unitsize);                                         // increase the unit buffer index
+}
+
+void Ray::SetObjectMotion(int object, int motion, const float motionparam[4]) {
 
+    /* Set a built-in motion (Scene::Motion) to a ray object, starting from its current model matrix. */
 
-        for (const auto& elm : tmpunitbuff) { unitbuff.push_back(elm); }
+    if (!table->residency || object < 0 || object >= table->objectsize) return;
 
-        for (auto elm : tmpplbuff) { plbuff.push_back(elm); }
+    table->motion.Set(object, motion, motionparam, table->GetModelmat4()[object]);
 
+}
 
-        for (int u = 0; u < 16; ++u) { table->object[n].modelmat4[u / 4][u % 4] = object[n].modelmat.mat4[u / 4][u % 4]; }
+void Ray::SetObjectMotion(int object, void(*updatemat4)(float modelmat4[4][4])) {
 
-        table->object[n].updatemat4 = object[n].updatemat4;
+    /* Set a custom motion to a ray object. It is called every frame in parallel with others, so it must be thread safe. */
 
+    if (!table->residency || object < 0 || object >= table->objectsize) return;
 
-        ++objectsize;
+    table->motion.Set(object, updatemat4);
 
-    }
+}
+
+
+int Ray::Trace(const float pos[3], const float dir[3], float* outdist) {
+
+    /*
+        Trace a ray in world space on the Cpu and return the closest ray object hit (-1: none).
+
+        The bvh is built by the first call and kept up to date by Update() afterwards.
+    */
+
+    if (!table->residency) return -1;
+
+    if (!table->tracer) table->tracer = new Tracer(table->residency, &table->jobs);
+
+    table->tracer->Update(table->GetModelmat4(), table->objectsize, nullptr, 0);    // rebuild if objects were added or removed
+
+    return table->tracer->Trace(pos, dir, outdist);
+
+}
+
+
+// *****************************************
+//  Statistics
+// *****************************************
+
+int Ray::GetResidentUnitSize(void) const {
 
-    table->objectsize = objectsize;
+    if (!table->residency) return 0;
 
-    // upload the data to Gpu
+    int size = 0;
+    for (int i = 0; i < table->residency->GetResidentSize(); ++i) { size += table->object[table->residency->GetResident()[i]].unitsize; }
 
-    if (plbuff.size() > POINTS_PER_UNIT * MAXPLANEBUFFSIZE) { std::cout << "Error: Plane buffer size error.\n"; }
+    return size;
+
+}
 
-    GL_PlaneBuffer_Reset(
-        (float(*)[POINTS_PER_UNIT])plbuff.data(),                           // upload ray unit plane data
-        (unsigned int)plbuff.size() / POINTS_PER_UNIT
-    );
+int Ray::GetResidentPlaneSize(void) const {
 
-    if (unitbuff.size() > MAXUNITBUFFSIZE) { std::cout << "Error: Ray unit buffer size error.\n"; }
+    /* The planes drawn per frame by the Ray2 Calculations if no ray unit is culled. (Each plane is drawn over the whole screen rect, per ray side.) */
 
-    GL_UnitBuffer_Reset(
-        unitbuff.data(),                                                    // upload ray unit attribute data
-        (unsigned int)unitbuff.size()
-    );
+    if (!table->residency) return 0;
 
+    int size = 0;
+    for (int i = 0; i < table->residency->GetResidentSize(); ++i) {
+        const Object& object = table->object[table->residency->GetResident()[i]];
+        for (int m = 0; m < object.unitsize; ++m) { size += object.unit[m].plsize; }
+    }
 
-    if (GL_CheckError()) { std::cout << "Error: Error has been confirmed in constructor.\n."; }
+    return size;
 
 }
 
@@ -334,17 +561,21 @@ static void GL_LoadUbo(void);
 
 static void GL_LoadFbo(void);
 
+static void GL_LoadCull(void);
+
 static void GL_LoadCamRay(void);
 
 static void GL_LoadImgData(void);
 
-static void GL_LoadScreenRender(void);
+static void GL_LoadScreenRender(bool offscreen);
 
 
-void Ray::Initialize(void) {
+void Ray::Initialize(bool offscreen) {
 
     /*
-        Initialize shaders, UBO buffers, FBO frame buffers, camera ray data, image data and screen rendering.
+        Initialize shaders, UBO buffers, FBO frame buffers, culling buffers, camera ray data, image data and screen rendering.
+
+        Offscreen, the results are rendered into a FBO frame buffer of the screen size (a context without a window or a default frame buffer).
     */
 
 
@@ -362,6 +593,10 @@ void Ray::Initialize(void) {
 
     GL_LoadFbo();
 
+    // ** Initialize culling buffers ***********
+
+    GL_LoadCull();
+
     // ** Initialize camera ray ****************
 
     GL_LoadCamRay();
@@ -372,7 +607,7 @@ void Ray::Initialize(void) {
 
     // ** Initialize screen rendering **********
 
-    GL_LoadScreenRender();
+    GL_LoadScreenRender(offscreen);
 
 
     if (GL_CheckError()) { std::cout << "Error: Error has been confirmed in initialization process.\n."; }
@@ -384,12 +619,18 @@ void Ray::Initialize(void) {
 //  Release
 // *****************************************
 
+static void GL_UnLoadTimer(void);
+
+static void GL_UnLoadExport(void);
+
 static void GL_UnLoadScreenRender(void);
 
 static void GL_UnLoadImgData(void);
 
 static void GL_UnLoadCamRay(void);
 
+static void GL_UnLoadCull(void);
+
 static void GL_UnLoadFbo(void);
 
 static void GL_UnLoadUbo(void);
@@ -400,9 +641,20 @@ static void GL_UnLoadShader(void);
 void Ray::Release(void) {
 
     /*
-        Release shaders, UBO buffers, FBO frame buffers, camera ray data, image data and screen rendering.
+        Release shaders, UBO buffers, FBO frame buffers, culling buffers, camera ray data, image data, screen rendering, the gpu timer
+        and the export. (The frames in flight are exported first.)
     */
 
+    // ** Release export ********************
+
+    FlushExport();
+
+    GL_UnLoadExport();
+
+    // ** Release gpu timer *****************
+
+    GL_UnLoadTimer();
+
     // ** Release screen rendering **********  
 
     GL_UnLoadScreenRender();
@@ -415,6 +667,10 @@ void Ray::Release(void) {
 
     GL_UnLoadCamRay();
 
+    // ** Release culling buffers ***********
+
+    GL_UnLoadCull();
+
     // ** Release fbo frame buffers *********
 
     GL_UnLoadFbo();
@@ -433,6 +689,126 @@ void Ray::Release(void) {
 }
 
 
+// *****************************************
+//  ReadScreen
+// *****************************************
+
+static void GL_ReadScreen(unsigned char* outrgb);
+
+static void GL_ReadSelection(float* outdepth, unsigned int (*outindex)[4]);
+
+static void mapindex(const unsigned int (*index)[4], const float* depth, size_t size, const int* slotobject, const int* slotunit, const int* slotplstart, int (*outindex)[3]);
+
+void Ray::ReadScreen(unsigned char* outrgb) {
+
+    /* Read the last frame rendered (from the offscreen FBO frame buffer, or from the back buffer before it is swapped). */
+
+    GL_ReadScreen(outrgb);
+
+}
+
+void Ray::ReadSelection(float* outdepth, int (*outindex)[3]) const {
+
+    /*
+        Read the selection depth and index buffers of the last frame, and map the ubo buffer indices (unit slot, plane) of a pixel
+        to the ray object, its unit and the plane of the unit, which do not depend on where the ray objects are resident.
+    */
+
+    const size_t size = (size_t)PIXELS_W * PIXELS_H;
+
+    std::vector<unsigned int> index(4 * size);
+
+    GL_ReadSelection(outdepth, (unsigned int(*)[4])index.data());
+
+    int slotobject[MAXUNITBUFFSIZE], slotunit[MAXUNITBUFFSIZE], slotplstart[MAXUNITBUFFSIZE];
+
+    GetSlotMap(slotobject, slotunit, slotplstart);
+
+    mapindex((const unsigned int(*)[4])index.data(), outdepth, size, slotobject, slotunit, slotplstart, outindex);
+
+}
+
+void Ray::GetSlotMap(int outobject[], int outunit[], int outplstart[]) const {
+
+    for (int m = 0; m < MAXUNITBUFFSIZE; ++m) { outobject[m] = outunit[m] = outplstart[m] = -1; }
+
+    for (int i = 0; table->residency && i < table->residency->GetResidentSize(); ++i) {
+        int n = table->residency->GetResident()[i]; const Object& object = table->object[n];
+        for (int m = 0; m < object.unitsize; ++m) { outobject[object.unitstart + m] = n; outunit[object.unitstart + m] = m; outplstart[object.unitstart + m] = object.unit[m].plstart; }
+    }
+
+}
+
+static void mapindex(const unsigned int (*index)[4], const float* depth, size_t size, const int* slotobject, const int* slotunit, const int* slotplstart, int (*outindex)[3]) {
+
+    /* Map the ubo buffer indices (unit slot, plane) of the pixels to (ray object, unit, plane of the unit). */
+
+    for (size_t p = 0; p < size; ++p) {
+
+        const unsigned int slot = index[p][0];
+
+        if (!(depth[p] < 1.0f) || slot >= MAXUNITBUFFSIZE || slotobject[slot] < 0) { outindex[p][0] = outindex[p][1] = outindex[p][2] = -1; continue; }   // (the cleared depth: none)
+
+        outindex[p][0] = slotobject[slot]; outindex[p][1] = slotunit[slot]; outindex[p][2] = (int)index[p][1] - slotplstart[slot];
+
+    }
+
+}
+
+
+// *****************************************
+//  SetScreenRect
+// *****************************************
+
+static int screenrect[4] = { 0, 0, PIXELS_W, PIXELS_H };               // rect of the screen rendered (x, y, width, height)
+
+static bool IsScreenRectSet(void) { return screenrect[0] != 0 || screenrect[1] != 0 || screenrect[2] != PIXELS_W || screenrect[3] != PIXELS_H; }
+
+void Ray::SetScreenRect(int x, int y, int width, int height) {
+
+    /*
+        Render only a rect of the screen: the Ray2, Selection and screen rendering passes are scissored to it (e.g. to time the calcs by the pixel count).
+
+        The pixels outside the rect keep their last contents, so the max depth pyramid is not used for occlusion culling while a smaller rect is set.
+    */
+
+    x = std::min(std::max(x, 0), PIXELS_W); y = std::min(std::max(y, 0), PIXELS_H);
+
+    screenrect[0] = x; screenrect[1] = y; screenrect[2] = std::min(std::max(width, 0), PIXELS_W - x); screenrect[3] = std::min(std::max(height, 0), PIXELS_H - y);
+
+}
+
+
+// *****************************************
+//  Gpu Timer
+// *****************************************
+
+static void GL_Timer_Read(void);
+
+static bool timerenabled = false;
+
+static Ray::GpuTime gputime;                                            // the latest frame read back
+
+void Ray::EnableGpuTimer(bool enable) {
+
+    /*
+        Time the passes of each frame on Gpu: a timestamp query is written after each pass (and after each draw of the Ray2/Selection Calculations),
+        and the queries of a frame are read back in a later Update() once available, so the Cpu never waits for them.
+    */
+
+    timerenabled = enable;
+
+}
+
+bool Ray::GetGpuTime(GpuTime& out) {
+
+    if (gputime.frame == 0) return false;
+
+    out = gputime; return true;
+
+}
+
+
 
 //*************************************************************
 
@@ -452,332 +828,992 @@ static GLuint
 
     ubounitbuff = 0, uboplbuff = 0,                                             // ubo buffers
 
-    ray2initprgm = 0, ray2prgm = 0, selectprgm = 0, drawprgm = 0;               // shader programs
+    uboslotbuff = 0,
+
+    cmdbuff = 0, cmdtex = 0,                                                    // draw command buffer (and its texture buffer)
+
+    hiztex = 0, hizfbo = 0,                                                     // max depth pyramid of the selection depth buffer
+
+    screenfbo = 0, screencolor = 0, screendepth = 0,                            // screen of offscreen rendering (screenfbo 0: the default frame buffer)
 
+    cullprgm = 0, ray2prgm = 0, selectprgm = 0, drawprgm = 0, hizprgm = 0,      // shader programs (generic)
 
+    ray2clearprgm = 0;                                                          // variant of the ray2 program initializing the ray unit segments
 
-static float ubomodelmat4[4][4] = {};                                   // retained model matrix of a ray object
-static int ubooffset = 0, ubounitstartindex = 0;                        // ubooffset: an offset of the ubo unit buff
-                                                                        // ubounitstartindex: a start index in the ubo unit buff
+#define RAY2PROGRAM 1                                                           // (indices of the shader list)
+#define SELECTPROGRAM 2
+#define DRAWPROGRAM 3
 
-static void GL_UnitBuffer_Reset(int unitstartindex, const float modelmat4[4][4]) {
+static GLuint GL_GetVariant(int prgmindex, const std::string& define);          // a shader program specialized by defines
 
-    /* Initialize for uploading model matrices to the UBO Unit Buffer. */
 
-    ubounitstartindex = unitstartindex;
-    ubooffset = 0;
 
-    for (int i = 0; i < 16; ++i) { ubomodelmat4[i / 4][i % 4] = modelmat4[i / 4][i % 4]; }
+static data::Unit ubounitshadow[MAXUNITBUFFSIZE] = {};                  // a copy of the ubo unit buff
+static bool ubounitdirty[MAXUNITBUFFSIZE] = {};                         // units changed since the last upload
+
+static void GL_UnitBuffer_Set(int unitstartindex, int unitsize, const float modelmat4[4][4]) {
+
+    /* Set a model matrix to the units of a ray object. (Uploaded by GL_UnitBuffer_Flush().) */
+
+    for (int m = unitstartindex; m < unitstartindex + unitsize; ++m) {
+        std::memcpy(ubounitshadow[m].modelmat4, modelmat4, sizeof(data::Unit::modelmat4)); ubounitdirty[m] = true;
+    }
 
 }
 
-static void GL_UnitBuffer_Update(void) {
+static void GL_UnitBuffer_Flush(void) {
 
-    /* Upload a model matrix to the UBO Unit buffer. */
+    /* Upload the changed units to the UBO Unit buffer, one upload per run of adjacent units. */
 
     glBindBuffer(GL_UNIFORM_BUFFER, ubounitbuff);
-    glBufferSubData(
-        GL_UNIFORM_BUFFER,
-        sizeof(data::Unit) * (ubooffset + ubounitstartindex),
-        sizeof(data::Unit::modelmat4),
-        ubomodelmat4
-    );
 
-    glBindBuffer(GL_UNIFORM_BUFFER, NULL);
+    for (int start = 0; start < MAXUNITBUFFSIZE; ++start) {
+
+        if (!ubounitdirty[start]) continue;
+
+        int end = start; while (end < MAXUNITBUFFSIZE && ubounitdirty[end]) { ubounitdirty[end++] = false; }
+
+        glBufferSubData(GL_UNIFORM_BUFFER, sizeof(data::Unit) * start, sizeof(data::Unit) * (end - start), ubounitshadow + start);
 
+        start = end;
 
-    ++ubooffset;
+    }
+
+    glBindBuffer(GL_UNIFORM_BUFFER, NULL);
 
 }
 
-static int ray2offset = 0, ray2unitstartindex = 0;                      // ray2offset: num of calls for ray2 calc
-                                                                        // ray2unitstartindex: a start index in the ubo unit buff
+namespace data {
 
-static void GL_Ray2Buffer_Initialize(int unitstartindex) {
+    struct Slot {
+        /* This structure contains a ray unit slot of the ubo unit buffer. (The same as in (UBO) Slot Buffer.) */
+        float sphere[4]; int range[4];                                  // sphere: bounding sphere in model space (radius < 0: empty unit)
+                                                                        // range: (plstart, plsize, unitstart, unitsize) (unitsize 0: empty slot)
+        float objectsphere[4]; int program[4];                          // objectsphere: bounding sphere of the ray object (of the program result)
+                                                                        // program: (2 codes of the selection program, programsize, 0)
+    };
 
-    /* Initialize the Ray2 FBO Frame Buffer before processing Ray2 Calculations for each Ray Unit. */
+    struct Command {
+        /* This structure contains an indirect draw command. (Written by the culling calc, a ray2 and a selection command per slot.) */
+        GLuint count, instancecount, first, baseinstance;
+    };
 
-    glBindFramebuffer(GL_FRAMEBUFFER, ray2fbo);
+}
 
-    glBindVertexArray(dummyvao);                                        // dummy (needed to render)
+#define RAY2COMMAND 0
+#define SELECTCOMMAND 1
+#define CLEARCOMMAND 2                                                  // (its first vertex index is 6 * the ray unit segment of the slot)
+#define COMMANDSIZE 3                                                   // draw commands per slot
 
-    glClearDepth(1.0f);                                                 // clear fbo ray2 depth buff to 1.0
+static data::Slot uboslotshadow[MAXUNITBUFFSIZE] = {};                  // slots of this frame
+static data::Slot uboslotuploaded[MAXUNITBUFFSIZE] = {};                // a copy of the ubo slot buff
+static bool uboslotvalid = false;
+
+static GLuint slotselectprgm[MAXUNITBUFFSIZE] = {};                     // selection program variants per first slot of the ray objects (0: none)
+
+static void GL_SlotBuffer_Reset(void) {
+    /* Clear the slots. */ std::memset(uboslotshadow, 0, sizeof(uboslotshadow)); std::memset(slotselectprgm, 0, sizeof(slotselectprgm));
+}
+
+static void GL_SlotBuffer_Set(int unitindex, int unitstartindex, int unitsize, const Unit& unit, const Scene::Bounds& bounds) {
+
+    /* Set a slot of a resident Ray Unit. (Unbounded units are never culled, empty ones always.) */
+
+    data::Slot& slot = uboslotshadow[unitindex];
+
+    for (int i = 0; i < 3; ++i) { slot.sphere[i] = bounds.center[i]; }
+
+    slot.sphere[3] = (bounds.state == Scene::BOUNDS_EMPTY) ? -1.0f : bounds.radius;     // (unbounded: radius 1.0e30)
+
+    slot.range[0] = unit.plstart; slot.range[1] = unit.plsize; slot.range[2] = unitstartindex; slot.range[3] = unitsize;
+
+}
+
+static void GL_SlotBuffer_SetProgram(int unitstartindex, int unitsize, const int* program, int programsize, GLuint selectprgm, const Scene::Bounds& bounds) {
+
+    /*
+        Set the selection program of a resident Ray Object over its slots (2 codes per slot, see Csg.h), its bounds to each slot,
+        and its variant of select.frag (see GL_GetSelectVariant(..)) to its first slot.
+    */
+
+    for (int m = 0; m < unitsize; ++m) {
+
+        data::Slot& slot = uboslotshadow[unitstartindex + m];
+
+        for (int i = 0; i < 3; ++i) { slot.objectsphere[i] = bounds.center[i]; }
+
+        slot.objectsphere[3] = (bounds.state == Scene::BOUNDS_EMPTY) ? -1.0f : bounds.radius;
+
+        for (int i = 0; i < 2; ++i) { slot.program[i] = (2 * m + i < programsize) ? program[2 * m + i] : 0; }
+
+        slot.program[2] = programsize;
+
+    }
+
+    if (unitsize > 0) slotselectprgm[unitstartindex] = selectprgm;
+
+}
+
+static GLuint GL_GetSelectVariant(const int* program, int programsize) {
+
+    /*
+        Return the variant of select.frag for a selection program. (Resolved once, when a Ray Object is loaded.)
+
+        The Selection Calculation of the object is drawn by the variant with the program as constants (PROGRAM),
+        so its loop has the trip count of the program and keeps only the registers it needs (REGSIZE).
+    */
+
+    std::string define = "#define PROGRAMSIZE " + std::to_string(programsize) + "\n#define PROGRAM int[](";
+
+    int depth = 0, regsize = 1;
+    for (int n = 0; n < programsize; ++n) {
+        define += std::to_string(program[n]) + ((n + 1 < programsize) ? ", " : ")\n");
+        depth += ((program[n] & 15) == Csg::OP_LOAD) ? 1 : -1; regsize = std::max(regsize, depth);
+    }
+
+    define += "#define REGSIZE " + std::to_string(regsize) + "\n";
+
+    return GL_GetVariant(SELECTPROGRAM, define);
+
+}
+
+static void GL_SlotBuffer_Flush(void) {
+
+    /* Upload the slots to the UBO Slot Buffer if they have changed. */
+
+    if (uboslotvalid && std::memcmp(uboslotshadow, uboslotuploaded, sizeof(uboslotshadow)) == 0) return;
+
+    GL_HizBuffer_Invalidate();                                          // (ray objects loaded, evicted, removed or changed levels: the depth of the last frame is stale)
+
+    glBindBuffer(GL_UNIFORM_BUFFER, uboslotbuff);
+    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(uboslotshadow), uboslotshadow);
+    glBindBuffer(GL_UNIFORM_BUFFER, NULL);
+
+    std::memcpy(uboslotuploaded, uboslotshadow, sizeof(uboslotshadow)); uboslotvalid = true;
+
+}
+
+static float hizviewmat4[4][4] = {};                                    // view matrix of the max depth pyramid
+static bool hizvalid = false;
+static int hizlevelsize = 0, hiztexindex = 0;                           // mip levels and texture unit index of the max depth pyramid
+
+static void GL_CullBuffer_Update(void) {
+
+    /*
+        Process the culling calc: a point per slot with rasterization discarded, writing the draw commands through transform feedback.
+
+        The depth of the last frame is used for occlusion only when the camera has not moved since, and no resident ray object has moved
+        or changed (see GL_HizBuffer_Invalidate()). Else an occluder moved away would still cull the objects uncovered, for a frame.
+    */
+
+    Timeline::Scope scope("GL_CullBuffer_Update");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, screenfbo);                       // (a complete frame buffer, also without a default one)
+    glBindVertexArray(dummyvao);                                        // dummy (needed to render)
+    glUseProgram(cullprgm);
+
+    glUniformMatrix4fv(glGetUniformLocation(cullprgm, "viewmat4"), 1, GL_TRUE, (const GLfloat*)GetViewmat4());
+    glUniform1i(glGetUniformLocation(cullprgm, "hizvalid"), hizvalid && std::memcmp(hizviewmat4, GetViewmat4(), sizeof(hizviewmat4)) == 0);
+
+    glEnable(GL_RASTERIZER_DISCARD);
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, cmdbuff);
+
+    glBeginTransformFeedback(GL_POINTS);
+    glDrawArrays(GL_POINTS, 0, MAXUNITBUFFSIZE);
+    glEndTransformFeedback();
+
+    glBindBufferBase(GL_TRANSFORM_FEEDBACK_BUFFER, 0, NULL);
+    glDisable(GL_RASTERIZER_DISCARD);
+
+
+    glUseProgram(NULL);
+    glBindVertexArray(NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, NULL);
+
+}
+
+static void GL_Ray2Buffer_Update(void) {
+
+    /*
+        Process the Ray2 Calculations for the Ray Units drawn, each into its own Ray Unit Segment of the Ray2 FBO Frame Buffer (given by cull.vert).
+
+        The segments drawn are initialized to depth 0.0 and index (-1, -1) by their clear commands, all the segments at once if the clear variant
+        is not built. (Segments not drawn are not read by the Selection Calculations.)
+    */
+
+    Timeline::Scope scope("GL_Ray2Buffer_Update");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, ray2fbo);
+    glBindVertexArray(dummyvao);                                        // dummy (needed to render)
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmdbuff);
+
+    if (ray2clearprgm != ray2prgm) {
+
+        glDepthFunc(GL_ALWAYS);
+        glUseProgram(ray2clearprgm);
+
+        for (int m = 0; m < MAXUNITBUFFSIZE; ++m) {
+            if (uboslotshadow[m].range[3] == 0) continue;               // empty slot
+            glDrawArraysIndirect(GL_TRIANGLES, (const void*)(sizeof(data::Command) * (COMMANDSIZE * m + CLEARCOMMAND)));  // (culled: no vertex)
+        }
+
+    }
+    else {
+
+        const GLfloat cleardepth = 0.0f; const GLuint clearindex[4] = { 0xFFFF, 0xFFFF, 0, 0 };
+
+        glClearBufferfv(GL_DEPTH, 0, &cleardepth);
+        glClearBufferuiv(GL_COLOR, 0, clearindex);
+
+    }
+
+    GL_Timer_Mark(Ray::PASS_RAY2INIT);
+
+    glDepthFunc(GL_GEQUAL);
+    glUseProgram(ray2prgm);
+
+    glUniformMatrix4fv(glGetUniformLocation(ray2prgm, "viewmat4"), 1, GL_TRUE, (const GLfloat*)GetViewmat4());
+
+    for (int m = 0; m < MAXUNITBUFFSIZE; ++m) {
+        if (uboslotshadow[m].range[3] == 0) continue;                   // empty slot
+        glDrawArraysIndirect(GL_TRIANGLES, (const void*)(sizeof(data::Command) * (COMMANDSIZE * m + RAY2COMMAND)));   // (culled: no vertex)
+        GL_Timer_Mark(Ray::PASS_RAY2, m);
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, NULL);
+
+
+    glUseProgram(NULL);
+
+    glBindVertexArray(NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, NULL);
+
+}
+
+static void GL_SelectionBuffer_Update(void) {
+
+    /* Process the Selection Calculations for the Ray Objects drawn (a command per first slot), grouped by the program variants. */
+
+    Timeline::Scope scope("GL_SelectionBuffer_Update");
+
+    int slot[MAXUNITBUFFSIZE] = {}, slotsize = 0;
+    for (int m = 0; m < MAXUNITBUFFSIZE; ++m) { if (slotselectprgm[m]) slot[slotsize++] = m; }
+
+    std::sort(slot, slot + slotsize, [](int a, int b) { return slotselectprgm[a] < slotselectprgm[b]; });
+
+    glBindFramebuffer(GL_FRAMEBUFFER, selectfbo);
+    glBindVertexArray(dummyvao);                                        // dummy (needed to render)
+
+    glClearDepth(1.0f);
     glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
 
-    ray2unitstartindex = unitstartindex;
-    ray2offset = 0;
+    GL_Timer_Mark(Ray::PASS_SELECTION);
+
+    glDepthFunc(GL_LESS);
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, cmdbuff);
+
+    for (int i = 0; i < slotsize; ++i) {
+        if (i == 0 || slotselectprgm[slot[i]] != slotselectprgm[slot[i - 1]]) glUseProgram(slotselectprgm[slot[i]]);
+        glDrawArraysIndirect(GL_TRIANGLES, (const void*)(sizeof(data::Command) * (COMMANDSIZE * slot[i] + SELECTCOMMAND)));
+        GL_Timer_Mark(Ray::PASS_SELECTION, slot[i]);
+    }
+
+    glBindBuffer(GL_DRAW_INDIRECT_BUFFER, NULL);
+
+
+    glUseProgram(NULL);
+
+    glBindVertexArray(NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, NULL);
+
+}
+
+static void GL_DrawBuffer_Update(void) {
+
+    /* Render the results to the screen. (Without texturing if no ray unit drawn is textured: texscale (0, 0).) */
+
+    Timeline::Scope scope("GL_DrawBuffer_Update");
+
+    bool textured = false;
+    for (int m = 0; m < MAXUNITBUFFSIZE && !textured; ++m) { textured = uboslotshadow[m].range[3] > 0 && (ubounitshadow[m].texscale[0] != 0.0f || ubounitshadow[m].texscale[1] != 0.0f); }
+
+    GLuint prgm = GL_GetVariant(DRAWPROGRAM, textured ? "" : "#define TEXTURE 0\n");
+
+    glBindFramebuffer(GL_FRAMEBUFFER, screenfbo);                       // (0: the default frame buffer)
+    glBindVertexArray(dummyvao);                                        // dummy (needed to render)
+    glUseProgram(prgm);
+
+    glClearDepth(1.0f);
+    glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+
+    glDepthFunc(GL_ALWAYS);
+
+    glUniformMatrix4fv(glGetUniformLocation(prgm, "viewmat4"), 1, GL_TRUE, (const GLfloat*)GetViewmat4());
+
+    glDrawArrays(GL_TRIANGLES, 0, 6);
+
+
+    glUseProgram(NULL);
+    glBindVertexArray(NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, NULL);
+
+}
+
+static void GL_HizBuffer_Update(void) {
+
+    /*
+        Build the max depth pyramid (Hi-Z) from the Selection depth buffer, level by level.
+
+        The level read is the only level in the texture's level range while the next level is rendered. (No feedback loop.)
+    */
+
+    Timeline::Scope scope("GL_HizBuffer_Update");
+
+    GLint viewport[4] = {}; glGetIntegerv(GL_VIEWPORT, viewport);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, hizfbo);
+    glBindVertexArray(dummyvao);                                        // dummy (needed to render)
+
+    glUseProgram(hizprgm);
+
+    glActiveTexture(GL_TEXTURE0 + hiztexindex);
+
+    for (int level = 0, w = PIXELS_W, h = PIXELS_H; level < hizlevelsize; ++level, w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+
+        int readlevel = (level == 0) ? 1 : level - 1;                   // (level 0 reads the selection depth buffer)
+
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, readlevel);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, readlevel);
+
+        glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, hiztex, level);
+
+        glViewport(0, 0, w, h);
+
+        glUniform1i(glGetUniformLocation(hizprgm, "level"), level);
+        glDrawArrays(GL_TRIANGLES, 0, 6);
+
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, hizlevelsize - 1);
+
+    glViewport(viewport[0], viewport[1], viewport[2], viewport[3]);
+
+
+    glUseProgram(NULL);
+
+    glBindVertexArray(NULL);
+    glBindFramebuffer(GL_FRAMEBUFFER, NULL);
+
+    std::memcpy(hizviewmat4, GetViewmat4(), sizeof(hizviewmat4)); hizvalid = !IsScreenRectSet();    // (a smaller rect: no depth outside it)
+
+}
+
+static void GL_HizBuffer_Invalidate(void) {
+    /* Do not use the max depth pyramid for the culling of this frame: the resident ray objects have changed since it was built. */ hizvalid = false;
+}
+
+static void GL_ScreenRect_Enable(bool enable) {
+
+    /* Scissor the passes rendering per pixel to the screen rect (nothing to do for the whole screen). */
+
+    if (!IsScreenRectSet()) return;
+
+    if (enable) { glEnable(GL_SCISSOR_TEST); glScissor(screenrect[0], screenrect[1], screenrect[2], screenrect[3]); }
+    else glDisable(GL_SCISSOR_TEST);
+
+}
+
+static_assert(Ray::MAXSLOTSIZE == MAXUNITBUFFSIZE, "slot size of the gpu timer");
+
+#define TIMERFRAMESIZE 4                                                // frames of timestamp queries in flight (a frame not read back by then is dropped)
+#define TIMERQUERYSIZE (7 + 2 * MAXUNITBUFFSIZE)                        // timestamps per frame: start, upload, cull, ray2 init, ray2 per slot, selection init,
+                                                                        // selection per slot, draw and hiz
+
+namespace {
+
+    struct TimerFrame {
+        /* This structure contains the timestamp queries of a frame. */
+        GLuint query[TIMERQUERYSIZE] = {}; int size = 0;                // size: queries written (0: free)
+        int pass[TIMERQUERYSIZE] = {}, slot[TIMERQUERYSIZE] = {};       // pass and slot of the interval ending at a query (slot -1: of the pass)
+        int object[MAXUNITBUFFSIZE] = {}, unit[MAXUNITBUFFSIZE] = {};   // ray object and unit of a slot (-1: empty)
+        unsigned int frame = 0;
+    };
+
+}
+
+static TimerFrame timerframe[TIMERFRAMESIZE];
+static TimerFrame* timeractive = nullptr;                               // the frame being written (nullptr: not timed)
+static int timerindex = 0; static unsigned int timercount = 0;          // timercount: frames timed
+
+static void GL_Timer_Begin(void) {
+
+    /* Read back the frames available, and start the timestamps of this frame in the next free one (the oldest one is dropped if not available yet). */
+
+    timeractive = nullptr;
+
+    if (!timerenabled && !Timeline::IsEnabled()) return;                // (the timeline records the gpu ranges)
+
+    if (timerframe[0].query[0] == 0) { for (TimerFrame& f : timerframe) { glGenQueries(TIMERQUERYSIZE, f.query); } }
+
+    GL_Timer_Read();
+
+    TimerFrame& f = timerframe[timerindex]; timerindex = (timerindex + 1) % TIMERFRAMESIZE;
+
+    f.size = 0; f.frame = ++timercount;
+    for (int m = 0; m < MAXUNITBUFFSIZE; ++m) { f.object[m] = -1; f.unit[m] = -1; }
+
+    timeractive = &f; GL_Timer_Mark(-1);
+
+}
+
+static void GL_Timer_Mark(int pass, int slot) {
+
+    /* Write a timestamp at the end of a pass (or of a draw of a slot). */
+
+    if (!timeractive || timeractive->size >= TIMERQUERYSIZE) return;
+
+    TimerFrame& f = *timeractive;
+
+    glQueryCounter(f.query[f.size], GL_TIMESTAMP);
+
+    f.pass[f.size] = pass; f.slot[f.size] = slot; ++f.size;
+
+}
+
+static void GL_Timer_SetSlot(int slot, int object, int unit) { if (timeractive) { timeractive->object[slot] = object; timeractive->unit[slot] = unit; } }
+
+static void GL_Timer_End(void) { timeractive = nullptr; }
+
+static void GL_Timer_Record(const TimerFrame& f, const GLuint64* t);
+
+static void GL_Timer_Read(void) {
+
+    /* Read back the frames whose last timestamp is available (then all of its timestamps are), oldest first. */
+
+    for (int i = 0; i < TIMERFRAMESIZE; ++i) {
+
+        TimerFrame& f = timerframe[(timerindex + i) % TIMERFRAMESIZE];  // (from the oldest)
+
+        if (f.size < 2) continue;
+
+        GLint available = 0; glGetQueryObjectiv(f.query[f.size - 1], GL_QUERY_RESULT_AVAILABLE, &available);
+
+        if (!available) continue;
+
+        GLuint64 t[TIMERQUERYSIZE] = {};
+        for (int n = 0; n < f.size; ++n) { glGetQueryObjectui64v(f.query[n], GL_QUERY_RESULT, &t[n]); }
+
+        Ray::GpuTime res; res.frame = f.frame; res.total = (t[f.size - 1] - t[0]) * 1.0e-6f;
+
+        for (int n = 1; n < f.size; ++n) {
+
+            float dt = (t[n] - t[n - 1]) * 1.0e-6f;                     // (ns to ms)
+
+            res.pass[f.pass[n]] += dt;
+
+            if (f.slot[n] >= 0) { (f.pass[n] == Ray::PASS_RAY2 ? res.ray2 : res.selection)[f.slot[n]] += dt; }
+
+        }
+
+        std::memcpy(res.object, f.object, sizeof(res.object)); std::memcpy(res.unit, f.unit, sizeof(res.unit));
+
+        if (Timeline::IsEnabled()) GL_Timer_Record(f, t);
+
+        if (res.frame > gputime.frame) gputime = res;
+
+        f.size = 0;
+
+    }
+
+}
+
+static void GL_Timer_Record(const TimerFrame& f, const GLuint64* t) {
+
+    /*
+        Record the ranges of a frame read back on the Gpu track of the timeline, in the Cpu clock.
+
+        The clocks are matched by the current Gpu time (queried without waiting), so the ranges may be off by the latency of that query.
+    */
+
+    static const char* const passname[Ray::PASSSIZE] = { "upload", "cull", "ray2 init", "ray2", "selection", "draw", "hiz" };
+
+    GLint64 gpunow = 0; glGetInteger64v(GL_TIMESTAMP, &gpunow);
+
+    const long long offset = Timeline::Now() - (long long)gpunow;
+
+    Timeline::RecordGpu("frame", (long long)t[0] + offset, (long long)t[f.size - 1] + offset, (int)f.frame);
+
+    for (int n = 1; n < f.size; ++n) { Timeline::RecordGpu(passname[f.pass[n]], (long long)t[n - 1] + offset, (long long)t[n] + offset, f.slot[n]); }
+
+}
+
+static void GL_UnLoadTimer(void) {
+
+    /* Release the timestamp queries. */
+
+    if (timerframe[0].query[0] != 0) { for (TimerFrame& f : timerframe) { glDeleteQueries(TIMERQUERYSIZE, f.query); } }
+
+    for (TimerFrame& f : timerframe) { f = TimerFrame(); }
+
+    timeractive = nullptr; timerindex = 0; timercount = 0; gputime = Ray::GpuTime();
+
+}
+
+
+// *****************************************
+//  Export
+// *****************************************
+
+#define EXPORTFRAMESIZE 3                                               // frames in flight (read into pixel buffers, mapped once their fences are signaled)
+
+namespace {
+
+    struct ExportSlot {
+        /* This structure contains a frame in flight of the export. */
+        GLuint pbo[3] = {};                                             // pixel pack buffers: screen color, selection depth, selection index
+        GLsync fence = nullptr;                                         // signaled when the frame is read (nullptr: free)
+        unsigned int frame = 0; bool selection = false;
+        int slotobject[MAXUNITBUFFSIZE], slotunit[MAXUNITBUFFSIZE], slotplstart[MAXUNITBUFFSIZE];  // slots of the frame (to map its index buffer)
+    };
+
+}
+
+static void (*exportframe)(const Ray::ExportFrame& frame) = nullptr;   // export function (nullptr: off)
+static bool exportselection = false;
+
+static ExportSlot exportslot[EXPORTFRAMESIZE];
+static int exportindex = 0; static unsigned int exportcount = 0;       // exportindex: the next slot to be read into, exportcount: frames read
+
+static void GL_Export_Pass(int waitsize);
+
+void Ray::SetExport(void(*exportframe)(const ExportFrame& frame), bool selection) {
+
+    FlushExport();                                                      // (the frames in flight go to the previous function)
+
+    ::exportframe = exportframe; exportselection = selection;
+
+}
+
+void Ray::FlushExport(void) { GL_Export_Pass(EXPORTFRAMESIZE); }
+
+static bool GL_Export_IsEnabled(void) { return exportframe != nullptr; }
+
+static void GL_Export_Read(const int* slotobject, const int* slotunit, const int* slotplstart) {
+
+    /*
+        Read the frame into the pixel buffers of the next slot, without waiting: the reads are queued on Gpu, and a fence marks their end.
+
+        The frames whose fences are signaled are passed first. If all the slots are in flight, the oldest one is waited for,
+        which happens only when the Gpu is EXPORTFRAMESIZE frames behind.
+    */
+
+    Timeline::Scope scope("GL_Export_Read");
+
+    const GLsizeiptr size[3] = { 3 * (GLsizeiptr)PIXELS_W * PIXELS_H, (GLsizeiptr)sizeof(float) * PIXELS_W * PIXELS_H, 4 * (GLsizeiptr)sizeof(GLuint) * PIXELS_W * PIXELS_H };
+
+    if (exportslot[0].pbo[0] == 0) {
+        for (ExportSlot& s : exportslot) {
+            glGenBuffers(3, s.pbo);
+            for (int i = 0; i < 3; ++i) { glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo[i]); glBufferData(GL_PIXEL_PACK_BUFFER, size[i], nullptr, GL_STREAM_READ); }
+        }
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, NULL);
+    }
+
+    GL_Export_Pass(exportslot[exportindex].fence ? 1 : 0);
+
+    ExportSlot& s = exportslot[exportindex]; exportindex = (exportindex + 1) % EXPORTFRAMESIZE;
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, screenfbo);
+    glReadBuffer(screenfbo ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo[0]);
+    glReadPixels(0, 0, PIXELS_W, PIXELS_H, GL_RGB, GL_UNSIGNED_BYTE, nullptr);
+
+    if (exportselection) {
+
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, selectfbo);
+        glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo[1]);
+        glReadPixels(0, 0, PIXELS_W, PIXELS_H, GL_DEPTH_COMPONENT, GL_FLOAT, nullptr);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo[2]);
+        glReadPixels(0, 0, PIXELS_W, PIXELS_H, GL_RGBA_INTEGER, GL_UNSIGNED_INT, nullptr);     // (see GL_ReadSelection(..))
+
+        std::memcpy(s.slotobject, slotobject, sizeof(s.slotobject)); std::memcpy(s.slotunit, slotunit, sizeof(s.slotunit));
+        std::memcpy(s.slotplstart, slotplstart, sizeof(s.slotplstart));
+
+    }
+
+    glBindBuffer(GL_PIXEL_PACK_BUFFER, NULL);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, NULL);
+
+    s.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0); s.frame = exportcount++; s.selection = exportselection;
+
+    glFlush();                                                          // (the fence is sent to Gpu, so a wait on it ends)
+
+}
+
+static void GL_Export_Pass(int waitsize) {
+
+    /*
+        Pass the frames in flight whose fences are signaled, in order, waiting for the oldest waitsize ones.
+
+        The rows are read bottom up: they are flipped while copied out of the mapped buffers.
+    */
+
+    static std::vector<unsigned char> rgb; static std::vector<float> depth; static std::vector<int> index;
+
+    for (int i = 0, n = 0; i < EXPORTFRAMESIZE; ++i) {
+
+        ExportSlot& s = exportslot[(exportindex + i) % EXPORTFRAMESIZE];   // (from the next slot to be read into: the frames in flight follow it in order)
+
+        if (!s.fence) continue;
+
+        GLenum res = glClientWaitSync(s.fence, GL_SYNC_FLUSH_COMMANDS_BIT, (n++ < waitsize) ? GL_TIMEOUT_IGNORED : 0);
+
+        if (res != GL_ALREADY_SIGNALED && res != GL_CONDITION_SATISFIED) break;     // (not yet: the later ones are not either)
+
+        glDeleteSync(s.fence); s.fence = nullptr;
+
+        if (!exportframe) continue;
+
+        Timeline::Scope scope("GL_Export_Pass");
+
+        Ray::ExportFrame frame; frame.frame = s.frame;
+
+        const size_t rowsize = (size_t)PIXELS_W, size = rowsize * PIXELS_H;
+
+        rgb.resize(3 * size);
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo[0]);
+        if (const unsigned char* src = (const unsigned char*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 3 * size, GL_MAP_READ_BIT)) {
+            for (int y = 0; y < PIXELS_H; ++y) { std::memcpy(&rgb[3 * rowsize * y], src + 3 * rowsize * (PIXELS_H - 1 - y), 3 * rowsize); }
+            glUnmapBuffer(GL_PIXEL_PACK_BUFFER); frame.rgb = rgb.data();
+        }
+
+        if (s.selection) {
+
+            depth.resize(size); index.resize(3 * size);
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo[1]);
+            if (const float* src = (const float*)glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, sizeof(float) * size, GL_MAP_READ_BIT)) {
+                for (int y = 0; y < PIXELS_H; ++y) { std::memcpy(&depth[rowsize * y], src + rowsize * (PIXELS_H - 1 - y), sizeof(float) * rowsize); }
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER); frame.depth = depth.data();
+            }
+
+            glBindBuffer(GL_PIXEL_PACK_BUFFER, s.pbo[2]);
+            const GLuint (*src)[4] = (const GLuint(*)[4])glMapBufferRange(GL_PIXEL_PACK_BUFFER, 0, 4 * sizeof(GLuint) * size, GL_MAP_READ_BIT);
+            if (src) {
+                for (int y = 0; frame.depth && y < PIXELS_H; ++y) {
+                    mapindex(src + rowsize * (PIXELS_H - 1 - y), &depth[rowsize * y], rowsize, s.slotobject, s.slotunit, s.slotplstart, (int(*)[3])&index[3 * rowsize * y]);
+                }
+                glUnmapBuffer(GL_PIXEL_PACK_BUFFER); if (frame.depth) frame.index = (const int(*)[3])index.data();
+            }
+
+        }
+
+        glBindBuffer(GL_PIXEL_PACK_BUFFER, NULL);
+
+        if (frame.rgb) exportframe(frame);
+        else std::cout << "Error: Export frame cannot be read. (" << s.frame << ")\n";
+
+    }
+
+}
+
+static void GL_UnLoadExport(void) {
+
+    /* Release the pixel buffers and the fences (call FlushExport() first to export the frames in flight). */
+
+    for (ExportSlot& s : exportslot) {
+        if (s.fence) glDeleteSync(s.fence);
+        if (s.pbo[0]) glDeleteBuffers(3, s.pbo);
+        s = ExportSlot();
+    }
+
+    exportindex = 0; exportcount = 0;
+
+}
+
+static void GL_PlaneBuffer_Reset(int plstartindex, const float (*plbuff)[POINTS_PER_UNIT], unsigned int plbufflines) {
+
+    /* Upload Ray Unit plane data to the UBO Plane Buffer.  */
+
+    glBindBuffer(GL_UNIFORM_BUFFER, uboplbuff);
+    glBufferSubData(GL_UNIFORM_BUFFER, sizeof(float) * POINTS_PER_UNIT * plstartindex, sizeof(float) * POINTS_PER_UNIT * plbufflines, plbuff);
+
+
+    glBindBuffer(GL_UNIFORM_BUFFER, NULL);
 
 }
 
-static const float (*GetViewmat4(void))[4][4];
+static void GL_UnitBuffer_Reset(int unitstartindex, const data::Unit* unitbuff, unsigned int unitbuffsize) {
 
-static void GL_Ray2Buffer_Update(const Unit* unit) {
+    /* Set Ray Unit attribute data to UBO Unit Buffer. (Uploaded by GL_UnitBuffer_Flush() together with the model matrices.) */
 
-    /* Initialize a Ray Unit Segment of the Ray2 FBO Frame Buffer and process a Ray2 Calculation for a Ray Unit. */
+    for (unsigned int m = 0; m < unitbuffsize; ++m) { ubounitshadow[unitstartindex + m] = unitbuff[m]; ubounitdirty[unitstartindex + m] = true; }
 
-    #define  UNIFORMSIZE 3
+}
 
-    struct Uniform {
-        /* This structure contains an Uniform GLSL int variable. */
-        int val = 0; const char* name = nullptr;
-    };
 
-    {
-        glDepthFunc(GL_ALWAYS);                                                             // init a ray unit segment of the fbo ray2 buff
+// *****************************************
 
-        glUseProgram(ray2initprgm);
+// *****************************************
 
-        glUniform1i(glGetUniformLocation(ray2initprgm, "unitsegment"), ray2offset);         // specify a ray unit segment of the fbo ray2 buff
-        glDrawArrays(GL_TRIANGLES, 0, 6);                                                   // init a ray unit segment of the fbo ray2 depth buff to 0.0
+#include <map>
 
-        glUseProgram(NULL);
-    }
+#define MAXSHADERTYPE 3
+#define PROGRAMSIZE 5
+#define MAXVARYINGSIZE 3
+#define MAXCHARSIZE 32
+#define MAXVARIANTSIZE 32                                               // max number of shader variants built (then the generic programs are used)
 
-    // process ray2 calc
+struct FileRead {
 
-    glDepthFunc(GL_GEQUAL);
+    /* This structure contains file text. */
 
-    glUseProgram(ray2prgm);
+    std::string str;
 
-    Uniform uniform[UNIFORMSIZE] = {
-        { unit->plstart, "plstart" },
-        { ray2offset + ray2unitstartindex, "unitindex" },
-        { ray2offset, "unitsegment" }                                                       // specify a ray unit segment of the fbo ray2 buff
-    };
+    FileRead(void);
+    FileRead(const char* file);                                         // read a file
 
-    for (int i = 0; i < UNIFORMSIZE; ++i) { glUniform1i(glGetUniformLocation(ray2prgm, uniform[i].name), uniform[i].val); }
+};
 
-    glUniformMatrix4fv(glGetUniformLocation(ray2prgm, "viewmat4"), 1, GL_TRUE, (const GLfloat*)GetViewmat4());
+namespace {
 
-    glDrawArrays(GL_TRIANGLES, 0, 6 * unit->plsize);
+    struct Shader {
+        /* This structure contains a list of shaders to be compiled and linked together. (An empty file: no shader of the type) */
+        GLuint* id = nullptr; const char file[MAXSHADERTYPE][MAXCHARSIZE] = {};
+        const char* varying[MAXVARYINGSIZE] = {};                       // outputs captured by transform feedback (interleaved)
+    };
 
-    glUseProgram(NULL);
+}
 
+static const Shader shaderlist[PROGRAMSIZE] = {                         // shaders for culling, ray2 calc, selection calc, drawing (screen rendering) and max depth pyramid
+    { &cullprgm, { "src/sh/cull.vert", "", "" }, { "ray2command", "selectcommand", "clearcommand" } },
+    { &ray2prgm, { "src/sh/ray2.vert", "src/sh/ray2.geom", "src/sh/ray2.frag" } },
+    { &selectprgm, { "src/sh/select.vert", "", "src/sh/select.frag" } },
+    { &drawprgm, { "src/sh/common.vert", "src/sh/common.geom", "src/sh/draw.frag" } },
+    { &hizprgm, { "src/sh/common.vert", "src/sh/common.geom", "src/sh/hiz.frag" } }
+};
 
-    ++ray2offset;
+static std::map<std::string, GLuint> shadervariant;                    // programs specialized by injected defines (key: program index and defines)
 
-}
+static GLuint GL_BuildProgram(const Shader& shader, const std::string& define);
 
-static void GL_Ray2Buffer_Release(void) {
-    glBindVertexArray(NULL);
-    glBindFramebuffer(GL_FRAMEBUFFER, NULL);
-}
+static void GL_CopyBinding(GLuint from, GLuint to);
 
-static void GL_SelectionBuffer_Reset(void) {
+static void GL_DeleteProgram(GLuint id);
 
-    /* Initialize the Selection FBO Frame Buffer before processing Selection Calculations for each Ray Object. */
+static bool GL_CheckLinkError(GLuint id);
 
-    glBindFramebuffer(GL_FRAMEBUFFER, selectfbo);
-    glBindVertexArray(dummyvao);                                        // dummy (needed to render)
 
-    glClearDepth(1.0f);
-    glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+static const char* const& getlval(const char* cchar);
 
 
-    glBindVertexArray(NULL);
-    glBindFramebuffer(GL_FRAMEBUFFER, NULL);
+static void GL_LoadShader(void) {
 
-}
+    /*
+        Initialize the shaders and upload them to GPU.
 
-static void GL_SelectionBuffer_Update(void) {
+        These are the generic programs. Their variants are built from the same shader files at first use (see GL_GetVariant(..)).
+    */
 
-    /* Process a Selection calculation for a Ray Object. */
+    Timeline::Scope scope("GL_LoadShader");
 
-    glBindFramebuffer(GL_FRAMEBUFFER, selectfbo);
-    glBindVertexArray(dummyvao);                                        // dummy (needed to render)
+    for (int i = 0; i < PROGRAMSIZE; ++i) { *shaderlist[i].id = GL_BuildProgram(shaderlist[i], ""); }
 
-    glDepthFunc(GL_LESS);
-    glUseProgram(selectprgm);
+}
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+static void GL_UnLoadShader(void) {
 
+    /*
+        Release the shaders (and the variants) on GPU.
+    */
 
-    glUseProgram(NULL);
+    for (auto& variant : shadervariant) {
+        bool generic = false; for (int n = 0; n < PROGRAMSIZE; ++n) { generic = generic || variant.second == *shaderlist[n].id; }
+        if (!generic) GL_DeleteProgram(variant.second);                 // (failed variants fall back to the generic programs)
+    }
 
-    glBindVertexArray(NULL);
-    glBindFramebuffer(GL_FRAMEBUFFER, NULL);
+    shadervariant.clear();
 
-}
+    for (int n = 0; n < PROGRAMSIZE; ++n) { GL_DeleteProgram(*shaderlist[n].id); *shaderlist[n].id = 0; }
 
-static void GL_DrawBuffer_Update(void) {
+}
 
-    /* Render the results to the screen. */
+static GLuint GL_GetVariant(int prgmindex, const std::string& define) {
 
-    glBindVertexArray(dummyvao);                                        // dummy (needed to render)
-    glUseProgram(drawprgm);
+    /*
+        Return the variant of a program built with the given defines, which the shader files read as constants.
 
-    glClearDepth(1.0f);
-    glClear(GL_DEPTH_BUFFER_BIT | GL_COLOR_BUFFER_BIT);
+        Variants are built at first use and cached by key. The generic program is returned for empty defines, once MAXVARIANTSIZE
+        variants are built, or if a variant fails to build. Sampler units and uniform block bindings are copied from the generic program.
+    */
 
-    glDepthFunc(GL_ALWAYS);
+    GLuint generic = *shaderlist[prgmindex].id;
 
-    glUniformMatrix4fv(glGetUniformLocation(drawprgm, "viewmat4"), 1, GL_TRUE, (const GLfloat*)GetViewmat4());
+    if (define.empty()) return generic;
 
-    glDrawArrays(GL_TRIANGLES, 0, 6);
+    std::string key = std::to_string(prgmindex) + "\n" + define;
 
+    auto it = shadervariant.find(key);
 
-    glUseProgram(NULL);
-    glBindVertexArray(NULL);
+    if (it != shadervariant.end()) return it->second;
 
-}
+    if ((int)shadervariant.size() >= MAXVARIANTSIZE) return generic;
 
-static void GL_PlaneBuffer_Reset(const float (*plbuff)[POINTS_PER_UNIT], unsigned int plbufflines) {
+    Timeline::Scope scope("GL_GetVariant (build)");
 
-    /* Upload Ray Unit plane data to the UBO Plane Buffer.  */
+    GLuint id = GL_BuildProgram(shaderlist[prgmindex], define);
 
-    glBindBuffer(GL_UNIFORM_BUFFER, uboplbuff);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(float) * POINTS_PER_UNIT * plbufflines, plbuff);
+    if (GL_CheckLinkError(id)) { GL_DeleteProgram(id); id = generic; }
+    else { GL_CopyBinding(generic, id); }
 
+    shadervariant[key] = id;
 
-    glBindBuffer(GL_UNIFORM_BUFFER, NULL);
+    return id;
 
 }
 
-static void GL_UnitBuffer_Reset(const data::Unit* unitbuff, unsigned int unitbuffsize) {
+static GLuint GL_BuildProgram(const Shader& shader, const std::string& define) {
 
-    /* Upload Ray Unit attribute data to UBO Unit Buffer.  */
+    /*
+        Compile and link the shaders of a program.
 
-    glBindBuffer(GL_UNIFORM_BUFFER, ubounitbuff);
-    glBufferSubData(GL_UNIFORM_BUFFER, 0, sizeof(data::Unit) * unitbuffsize, unitbuff);
+        The template constants (the buffer sizes) and the defines of a variant are injected after the "#version" line of each shader,
+        followed by "#line" to keep the line numbers of compile errors.
+    */
 
+    const GLenum shadertype[MAXSHADERTYPE] = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
 
-    glBindBuffer(GL_UNIFORM_BUFFER, NULL);
+    const std::string constant =
+        "#define MAXUNITBUFFSIZE " + std::to_string(MAXUNITBUFFSIZE) + "\n#define MAXPLANEBUFFSIZE " + std::to_string(MAXPLANEBUFFSIZE) +
+        "\n#define MAXRAY2SEGMENTSIZE " + std::to_string(MAXRAY2SEGMENTSIZE) + "\n";
 
-}
+    GLuint prgmid = glCreateProgram();
 
+    for (int j = 0; j < MAXSHADERTYPE; ++j) {
 
-// *****************************************
+        if (!shader.file[j][0]) continue;                               // no shader of the type
 
-// *****************************************
+        FileRead fr(shader.file[j]);
 
-#include <cstring>
-#include <string>
+        size_t head = fr.str.find("#version");
+        head = (head == std::string::npos) ? 0 : fr.str.find('\n', head);
+        head = (head == std::string::npos) ? fr.str.size() : head + 1;
 
-#define MAXSHADERTYPE 3
-#define PROGRAMSIZE 4
+        int line = (int)std::count(fr.str.begin(), fr.str.begin() + head, '\n');
 
-struct FileRead {
+        std::string source = fr.str.substr(0, head) + constant + define + "#line " + std::to_string(line) + "\n" + fr.str.substr(head);     // (the next line is line + 1)
 
-    /* This structure contains file text. */
+        GLuint shid = glCreateShader(shadertype[j]);
 
-    std::string str;
+        glShaderSource(shid, 1, &getlval(source.data()), nullptr);
+        glCompileShader(shid);
 
-    FileRead(void);
-    FileRead(const char* file);                                         // read a file
+        glAttachShader(prgmid, shid);
 
-};
+    }
 
-static bool GL_CheckLinkError(GLuint id);
+    int varyingsize = 0; while (varyingsize < MAXVARYINGSIZE && shader.varying[varyingsize]) { ++varyingsize; }
 
+    if (varyingsize > 0) glTransformFeedbackVaryings(prgmid, varyingsize, shader.varying, GL_INTERLEAVED_ATTRIBS);     // (before linking)
 
-static const char* const& getlval(const char* cchar);
+    glLinkProgram(prgmid);
 
 
-static void GL_LoadShader(void) {
+    if (GL_CheckLinkError(prgmid)) {                                    // check link error
 
-    /*
-        Initialize the shaders and upload them to GPU.
-    */
+        std::string shlist; for (int j = 0; j < MAXSHADERTYPE; ++j) { shlist += std::string(" ") + shader.file[j]; }
 
-    #define MAXCHARSIZE 32
+        GLchar* buff = new GLchar[512](); glGetProgramInfoLog(prgmid, 512 - 1, nullptr, buff);
+        std::cout << "Shader Link Error:" << shlist << ":\n" << define << buff << "\n";
 
-    struct Shader {
-        /* This structure contains a list of shaders to be compiled and linked together. */
-        GLuint* id = nullptr; const char file[MAXSHADERTYPE][MAXCHARSIZE] = {};
-    };
 
-    const GLenum shadertype[MAXSHADERTYPE] = { GL_VERTEX_SHADER, GL_GEOMETRY_SHADER, GL_FRAGMENT_SHADER };
+        delete[] buff;
+    }
 
+    return prgmid;
 
-    Shader prgmlist[PROGRAMSIZE] = {                                    // shaders for initializing ray2 calc. ray2 calc, selection calc and drawing (screen rendering)
-        { &ray2initprgm, { "src/sh/common.vert", "src/sh/ray2init.geom", "src/sh/ray2init.frag" } },
-        { &ray2prgm, { "src/sh/common.vert", "src/sh/ray2.geom", "src/sh/ray2.frag" } },
-        { &selectprgm, { "src/sh/common.vert", "src/sh/common.geom", "src/sh/select.frag" } },
-        { &drawprgm, { "src/sh/common.vert", "src/sh/common.geom", "src/sh/draw.frag" } }
-    };
+}
 
-    // process through shaders
+static void GL_CopyBinding(GLuint from, GLuint to) {
 
-    for (int i = 0; i < PROGRAMSIZE; ++i) {
+    /* Copy the sampler units and the uniform block bindings of a program to its variant. */
 
-        static GLuint prgmid = 0; prgmid = glCreateProgram();
-        *prgmlist[i].id = prgmid;
+    #define MAXNAMESIZE 64
 
-        GLuint shidlist[MAXSHADERTYPE] = {}; for (int j = 0; j < MAXSHADERTYPE; ++j) {      // shader ids
-        
-            static GLuint shid = 0; shid = glCreateShader(shadertype[j]);
-            shidlist[j] = shid;
+    const GLenum samplertype[] = {
+        GL_SAMPLER_2D, GL_SAMPLER_2D_ARRAY, GL_UNSIGNED_INT_SAMPLER_2D_ARRAY, GL_SAMPLER_BUFFER, GL_INT_SAMPLER_BUFFER, GL_UNSIGNED_INT_SAMPLER_BUFFER
+    };
 
-            glAttachShader(prgmid, shid);
-        }
+    glUseProgram(to);
 
-        FileRead frlist[MAXSHADERTYPE] = {}; for (int j = 0; j < MAXSHADERTYPE; ++j) {      // shader file strings
-            frlist[j] = FileRead(prgmlist[i].file[j]);
-        }
+    GLint size = 0; glGetProgramiv(to, GL_ACTIVE_UNIFORMS, &size);
 
-        for (int j = 0; j < MAXSHADERTYPE; ++j) {
+    for (GLint n = 0; n < size; ++n) {
 
-            glShaderSource(shidlist[j], 1, &getlval(frlist[j].str.data()), nullptr);
-            glCompileShader(shidlist[j]);
-        }
+        GLchar name[MAXNAMESIZE] = {}; GLint arraysize = 0; GLenum type = 0;
+        glGetActiveUniform(to, n, MAXNAMESIZE, nullptr, &arraysize, &type, name);
 
-        glLinkProgram(prgmid);
+        if (std::find(std::begin(samplertype), std::end(samplertype), type) == std::end(samplertype)) continue;
 
+        std::string base(name); base = base.substr(0, base.find('['));
 
-        if (GL_CheckLinkError(prgmid)) {                                // check link error
+        for (int i = 0; i < arraysize; ++i) {
 
-            char* shlist = new char[MAXSHADERTYPE * MAXCHARSIZE + 1](); {
+            std::string elm = (arraysize > 1) ? base + "[" + std::to_string(i) + "]" : base;
 
-                char (*str)[1 + MAXCHARSIZE] = new char[MAXSHADERTYPE][1 + MAXCHARSIZE]();
-                for (int j = 0; j < MAXSHADERTYPE; ++j) { snprintf(str[j], sizeof(str[j]), " %s", prgmlist[i].file[j]); }
+            GLint location = glGetUniformLocation(from, elm.c_str()), unit = 0;
+            if (location < 0) continue;
 
-                int shlistptr = 0;
+            glGetUniformiv(from, location, &unit); glUniform1i(glGetUniformLocation(to, elm.c_str()), unit);
 
-                size_t len[MAXSHADERTYPE]; for (int j = 0; j < MAXSHADERTYPE; ++j) { len[j] = std::strlen(str[j]); }
+        }
 
-                for (int j = 0; j < MAXSHADERTYPE; ++j) {
-                    for (int k = 0; k < len[j]; ++k) { shlist[shlistptr++] = str[j][k]; }
-                }
+    }
 
+    glGetProgramiv(to, GL_ACTIVE_UNIFORM_BLOCKS, &size);
 
-                delete[] str;
-            }
+    for (GLint n = 0; n < size; ++n) {
 
-            GLchar* buff = new GLchar[512](); glGetProgramInfoLog(prgmid, 512 - 1, nullptr, buff);
-            std::cout << "Shader Link Error:" << shlist << ":\n" << buff << "\n";
+        GLchar name[MAXNAMESIZE] = {}; glGetActiveUniformBlockName(to, n, MAXNAMESIZE, nullptr, name);
 
+        GLuint index = glGetUniformBlockIndex(from, name); GLint binding = 0;
+        if (index == GL_INVALID_INDEX) continue;
 
-            delete[] buff; delete[] shlist;
-        }
+        glGetActiveUniformBlockiv(from, index, GL_UNIFORM_BLOCK_BINDING, &binding); glUniformBlockBinding(to, n, binding);
 
     }
 
-}
-
-static void GL_UnLoadShader(void) {
 
-    /*
-        Release the shaders on GPU.
-    */
+    glUseProgram(NULL);
 
-    GLuint* prgmlist[PROGRAMSIZE] = { &ray2initprgm, &ray2prgm, &selectprgm, &drawprgm };
+}
 
-    for (int n = 0; n < PROGRAMSIZE; ++n) {
+static void GL_DeleteProgram(GLuint id) {
 
-        GLsizei attlen = 0; GLuint att[MAXSHADERTYPE] = {};
-        glGetAttachedShaders(*prgmlist[n], MAXSHADERTYPE, &attlen, att);
+    /* Delete a program and its shaders. */
 
+    GLsizei attlen = 0; GLuint att[MAXSHADERTYPE] = {};
+    glGetAttachedShaders(id, MAXSHADERTYPE, &attlen, att);
 
-        for (int m = 0; m < attlen; ++m) { glDeleteShader(att[m]); }
 
-        glDeleteProgram(*prgmlist[n]); *prgmlist[n] = 0;
+    for (int m = 0; m < attlen; ++m) { glDeleteShader(att[m]); }
 
-    }
+    glDeleteProgram(id);
 
 }
 
 
-#define UBOSIZE 2
+#define UBOSIZE 3
 
 static int getuboindex(void);
 
@@ -790,7 +1826,7 @@ static void GL_LoadUbo(void) {
         Initialize the UBO buffers on GPU.
     */
 
-    #define BINDSHADERSIZE 2
+    #define UBOBINDSHADERSIZE 5
 
     struct Ubo {
         /* This structure contains an UBO buffer to be allocated in GPU. */
@@ -798,9 +1834,10 @@ static void GL_LoadUbo(void) {
     };
 
 
-    Ubo ubolist[UBOSIZE] = {                                                           // ubo buffers for unit/plane buffers
+    Ubo ubolist[UBOSIZE] = {                                                           // ubo buffers for unit/plane/slot buffers
         { &ubounitbuff, sizeof(data::Unit) * MAXUNITBUFFSIZE, "UboUnitBuffer" },
-        { &uboplbuff, sizeof(float) * POINTS_PER_UNIT * MAXPLANEBUFFSIZE, "UboPlaneBuffer" }
+        { &uboplbuff, sizeof(float) * POINTS_PER_UNIT * MAXPLANEBUFFSIZE, "UboPlaneBuffer" },
+        { &uboslotbuff, sizeof(data::Slot) * MAXUNITBUFFSIZE, "UboSlotBuffer" }
     };
 
     // process through ubo buffers
@@ -816,10 +1853,13 @@ static void GL_LoadUbo(void) {
         glBindBufferBase(GL_UNIFORM_BUFFER, getuboindex(), id);
         glBufferData(GL_UNIFORM_BUFFER, ubolist[n].datasize, NULL, GL_DYNAMIC_DRAW);
 
-        GLuint bindshader[BINDSHADERSIZE] = { ray2prgm, drawprgm };                    // shaders in which the above ubo buffers are read
+        GLuint bindshader[UBOBINDSHADERSIZE] = { cullprgm, ray2prgm, selectprgm, drawprgm, hizprgm };      // shaders in which the above ubo buffers may be read
         const char* tmpname = ubolist[n].name;
 
-        for (int m = 0; m < BINDSHADERSIZE; ++m) { glUniformBlockBinding(bindshader[m], glGetUniformBlockIndex(bindshader[m], tmpname), getuboindex()); }
+        for (int m = 0; m < UBOBINDSHADERSIZE; ++m) {
+            GLuint blockindex = glGetUniformBlockIndex(bindshader[m], tmpname);
+            if (blockindex != GL_INVALID_INDEX) glUniformBlockBinding(bindshader[m], blockindex, getuboindex());
+        }
 
 
         glBindBuffer(GL_UNIFORM_BUFFER, NULL);
@@ -833,7 +1873,7 @@ static void GL_UnLoadUbo(void) {
         Release the UBO buffers on GPU.
     */
 
-    GLuint* ubolist[UBOSIZE] = { &ubounitbuff, &uboplbuff };
+    GLuint* ubolist[UBOSIZE] = { &ubounitbuff, &uboplbuff, &uboslotbuff };
 
     for (int n = 0; n < UBOSIZE; ++n) { glDeleteBuffers(1, ubolist[n]); *ubolist[n] = 0; }
 
@@ -875,7 +1915,7 @@ static void GL_LoadFbo(void) {
 
 
     Fbo fbolist[FBOSIZE] = {                                            // fbo frame buffers for ray2 and selection calculations
-        { &ray2fbo, selectprgm, RAYSIDELEN * MAXUNITSIZE },
+        { &ray2fbo, selectprgm, RAYSIDELEN * MAXRAY2SEGMENTSIZE },     // (the ray unit segments of the units drawn, see cull.vert)
         { &selectfbo, drawprgm, 1 }
     };
 
@@ -907,6 +1947,8 @@ static void GL_LoadFbo(void) {
                 tmplayersize, 0, texdeflist[m].format, texdeflist[m].type, nullptr
             );
             glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAX_LEVEL, 0);      // mip 0
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MIN_FILTER, GL_NEAREST);   // (integer textures are incomplete with linear filters: fetched as 0)
+            glTexParameteri(GL_TEXTURE_2D_ARRAY, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
 
             glUseProgram(tmppassshader);
 
@@ -960,10 +2002,117 @@ static void GL_UnLoadFbo(void) {
 }
 
 
+#define HIZTEXFORMAT GL_R32F
+
+static void GL_LoadCull(void) {
+
+    /*
+        Initialize the draw command buffer written by the culling calc, and the max depth pyramid (Hi-Z) read by it.
+    */
+
+    // draw command buffer (transform feedback output, indirect draw commands, and a texture buffer read by the selection calc)
+
+    const data::Command command[COMMANDSIZE * MAXUNITBUFFSIZE] = {};    // (nothing drawn until the first culling)
+
+    static GLuint id = 0; glGenBuffers(1, &id);
+    cmdbuff = id;
+
+    glBindBuffer(GL_ARRAY_BUFFER, id);
+    glBufferData(GL_ARRAY_BUFFER, sizeof(command), command, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_ARRAY_BUFFER, NULL);
+
+    setnewtextindex();
+    glActiveTexture(GL_TEXTURE0 + gettextindex());
+
+    static GLuint texid = 0; glGenTextures(1, &texid);
+    cmdtex = texid;
+
+    glBindTexture(GL_TEXTURE_BUFFER, texid);
+    glTexBuffer(GL_TEXTURE_BUFFER, GL_RGBA32UI, cmdbuff);               // a texel per command
+
+    GLuint cmdbindshader[2] = { ray2prgm, selectprgm };                 // shaders in which the commands are read
+
+    for (int n = 0; n < 2; ++n) {
+        glUseProgram(cmdbindshader[n]);
+        glUniform1i(glGetUniformLocation(cmdbindshader[n], "commandbuffer"), gettextindex());
+        glUseProgram(NULL);
+    }
+
+    ray2clearprgm = GL_GetVariant(RAY2PROGRAM, "#define CLEAR 1\n");   // (built first: the generic ray2 program if it fails)
+
+    // max depth pyramid (levels down to 1 x 1)
+
+    setnewtextindex();
+    glActiveTexture(GL_TEXTURE0 + gettextindex());
+    hiztexindex = gettextindex();
+
+    static GLuint hizid = 0; glGenTextures(1, &hizid);
+    hiztex = hizid;
+
+    glBindTexture(GL_TEXTURE_2D, hizid);
+
+    hizlevelsize = 0;
+    for (int w = PIXELS_W, h = PIXELS_H; ; w = std::max(1, w / 2), h = std::max(1, h / 2)) {
+        glTexImage2D(GL_TEXTURE_2D, hizlevelsize++, HIZTEXFORMAT, w, h, 0, GL_RED, GL_FLOAT, nullptr);
+        if (w == 1 && h == 1) break;
+    }
+
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAX_LEVEL, hizlevelsize - 1);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST_MIPMAP_NEAREST);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+
+    GLint depthtexindex = 0; glGetUniformiv(drawprgm, glGetUniformLocation(drawprgm, "depthbuffer"), &depthtexindex);     // the selection depth buffer
+
+    GLuint hizbindshader[2] = { cullprgm, hizprgm };                    // shaders in which the pyramid is read
+
+    for (int n = 0; n < 2; ++n) {
+        glUseProgram(hizbindshader[n]);
+        glUniform1i(glGetUniformLocation(hizbindshader[n], "hizbuffer"), hiztexindex);
+        glUseProgram(NULL);
+    }
+
+    glUseProgram(hizprgm);
+    glUniform1i(glGetUniformLocation(hizprgm, "depthbuffer"), depthtexindex);
+    glUseProgram(NULL);
+
+    static GLuint fboid = 0; glGenFramebuffers(1, &fboid);
+    hizfbo = fboid;
+
+    const GLenum ColorAttachments = GL_COLOR_ATTACHMENT0;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fboid);
+    glDrawBuffers(1, &ColorAttachments);
+    glBindFramebuffer(GL_FRAMEBUFFER, NULL);
+
+    hizvalid = false;
+
+}
+
+static void GL_UnLoadCull(void) {
+
+    /* Release the draw command buffer and the max depth pyramid on Gpu. */
+
+    glDeleteFramebuffers(1, &hizfbo); hizfbo = 0;
+
+    glDeleteTextures(1, &hiztex); hiztex = 0;
+
+    glDeleteTextures(1, &cmdtex); cmdtex = 0;
+
+    glDeleteBuffers(1, &cmdbuff); cmdbuff = 0;
+
+    ray2clearprgm = 0;                                                  // (released with the variants)
+
+    hizvalid = false; uboslotvalid = false;
+
+}
+
+
 #define RAYBUFFSIZE 2
 
 static void makecamray(float screenraydir[PIXELS_H][PIXELS_W][4], float screenraypos[PIXELS_H][PIXELS_W][4]);
 
+static void makepixelray(int wn, int hn, float outraypos[4]);
+
 
 static void GL_LoadCamRay(void) {
 
@@ -995,7 +2144,7 @@ static void GL_LoadCamRay(void) {
     int raytexindex[RAYBUFFSIZE] = {}; for (int n = 0; n < RAYBUFFSIZE; ++n) {
 
         setnewtextindex();
-        static int texindex = gettextindex();
+        int texindex = gettextindex();                                  // (one texture unit per ray buffer)
         raytexindex[n] = texindex;
 
         glActiveTexture(GL_TEXTURE0 + texindex);
@@ -1061,6 +2210,8 @@ static void GL_LoadImgData(void) {
         Initialize the image for mapping and upload the data to GPU.
     */
 
+    Timeline::Scope scope("GL_LoadImgData");
+
     #define TEXFILTERSIZE 2
 
     const int filterlist[TEXFILTERSIZE] = { GL_TEXTURE_MIN_FILTER, GL_TEXTURE_MAG_FILTER };
@@ -1093,20 +2244,102 @@ static void GL_UnLoadImgData(void) {
 }
 
 
-static void GL_LoadScreenRender(void) {
+static void GL_LoadScreenRender(bool offscreen) {
 
-    /* Initialize for screen rendering. */
+    /* Initialize for screen rendering. (Offscreen: a color and depth FBO frame buffer of the screen size.) */
 
     static GLuint id = 0; glGenVertexArrays(1, &id);
     dummyvao = id;                                                      // dummy vao opengl object
 
     glClearColor(0.0f, 0.0f, 0.0f, 0.0f);                               // set BG color to black transparent
 
+    if (!offscreen) return;
+
+    GLuint rb[2] = {}; glGenRenderbuffers(2, rb);
+    screencolor = rb[0]; screendepth = rb[1];
+
+    glBindRenderbuffer(GL_RENDERBUFFER, screencolor);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_RGBA8, PIXELS_W, PIXELS_H);
+    glBindRenderbuffer(GL_RENDERBUFFER, screendepth);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, PIXELS_W, PIXELS_H);
+    glBindRenderbuffer(GL_RENDERBUFFER, NULL);
+
+    static GLuint fboid = 0; glGenFramebuffers(1, &fboid);
+    screenfbo = fboid;
+
+    const GLenum ColorAttachments = GL_COLOR_ATTACHMENT0;
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fboid);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_RENDERBUFFER, screencolor);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, screendepth);
+    glDrawBuffers(1, &ColorAttachments);
+
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) { std::cout << "Error: Screen FBO frame buffer initialize error.\n"; }
+
+    glBindFramebuffer(GL_FRAMEBUFFER, NULL);
+
+    glViewport(0, 0, PIXELS_W, PIXELS_H);                               // (no window to size the viewport)
+
+}
+
+static void GL_ReadScreen(unsigned char* outrgb) {
+
+    /* Read the screen pixels as RGB bytes, the top row first. (Waits for the frame to be finished.) */
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, screenfbo);
+    glReadBuffer(screenfbo ? GL_COLOR_ATTACHMENT0 : GL_BACK);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, PIXELS_W, PIXELS_H, GL_RGB, GL_UNSIGNED_BYTE, outrgb);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, NULL);
+
+    const size_t rowsize = 3 * (size_t)PIXELS_W;                        // (rows are read bottom up)
+
+    std::vector<unsigned char> row(rowsize);
+
+    for (int y = 0; y < PIXELS_H / 2; ++y) {
+        unsigned char* a = outrgb + rowsize * y; unsigned char* b = outrgb + rowsize * (PIXELS_H - 1 - y);
+        std::memcpy(row.data(), a, rowsize); std::memcpy(a, b, rowsize); std::memcpy(b, row.data(), rowsize);
+    }
+
+}
+
+static void GL_ReadSelection(float* outdepth, unsigned int (*outindex)[4]) {
+
+    /*
+        Read the selection depth and index buffers, the top row first. (Waits for the frame to be finished.)
+
+        The index buffer is read as RGBA unsigned ints, the format every implementation reads an integer buffer in.
+    */
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, selectfbo);
+    glReadBuffer(GL_COLOR_ATTACHMENT0);
+
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, PIXELS_W, PIXELS_H, GL_DEPTH_COMPONENT, GL_FLOAT, outdepth);
+    glReadPixels(0, 0, PIXELS_W, PIXELS_H, GL_RGBA_INTEGER, GL_UNSIGNED_INT, outindex);
+
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, NULL);
+
+    for (int y = 0; y < PIXELS_H / 2; ++y) {                            // (rows are read bottom up)
+        std::swap_ranges(outdepth + (size_t)PIXELS_W * y, outdepth + (size_t)PIXELS_W * (y + 1), outdepth + (size_t)PIXELS_W * (PIXELS_H - 1 - y));
+        std::swap_ranges(outindex + (size_t)PIXELS_W * y, outindex + (size_t)PIXELS_W * (y + 1), outindex + (size_t)PIXELS_W * (PIXELS_H - 1 - y));
+    }
+
 }
 
 static void GL_UnLoadScreenRender(void) {
+
     /* Release for screen rendering. */
+
     glDeleteVertexArrays(1, &dummyvao); dummyvao = 0;
+
+    if (!screenfbo) return;
+
+    glDeleteFramebuffers(1, &screenfbo); screenfbo = 0;
+    GLuint rb[2] = { screencolor, screendepth }; glDeleteRenderbuffers(2, rb); screencolor = screendepth = 0;
+
 }
 
 static unsigned int frame = 0;                                          // the current frame
@@ -1135,6 +2368,8 @@ static void SetViewmat4(void) {
 
     /* Calculate and retain the view matrix. */
 
+    Timeline::Scope scope("SetViewmat4");
+
     float pos[3] = {}, theta[3] = {}; Call(pos, theta);                 // get cam pos and orientation
 
     float tmpmat4[4][4] = {}; makeviewmat4(tmpmat4, theta, pos);
@@ -1193,6 +2428,8 @@ FileRead::FileRead(const char* file) {
 
 #include <SOIL.h>
 
+static void copyimage(const unsigned char* src, size_t size, std::vector<unsigned char>& out);
+
 Image::Image(const char* file) {
 
     /* Read an image file. */
@@ -1204,49 +2441,30 @@ Image::Image(const char* file) {
 
     this->width = width; this->height = height; this->channels = channels;
 
-    this->buff.reserve(width * height * channels);
-    for (unsigned char* ptr = soilimagebuff; ptr < soilimagebuff + width * height * channels; ++ptr) { this->buff.push_back(*ptr); }
+    copyimage(soilimagebuff, (size_t)width * height * channels, this->buff);
 
     SOIL_free_image_data(soilimagebuff);
 
 }
 
-static int plbuffindex = 0;                                             // current index of the ubo plane buffer
-
-static int getplbuffindex(void) { return plbuffindex; }
+static void copyimage(const unsigned char* src, size_t size, std::vector<unsigned char>& out) {
 
-static void setnewplbuffindex(int increase) {
-    /* Increase the current index of the ubo plane buffer to write. */
-    plbuffindex += increase;
-}
-
-static int unitbuffindex = 0;
+    /* Copy the bytes of an image read. */
 
-static int getunitbuffindex(void) { return unitbuffindex; }
+    out.reserve(size);
+    for (const unsigned char* ptr = src; ptr < src + size; ++ptr) { out.push_back(*ptr); }
 
-static void setunitbuffindex(int increase) {
-    /* Increase the current index of the ubo unit buffer to write. */
-    unitbuffindex += increase;
 }
 
-static void updatemat4_default(float modelmat4[4][4]) { /* Change nothing. */ }
-
-#include <cmath>
-
-static void updatemat4(float modelmat4[4][4]) {
-
-    /* The ray object rotates around the local Z axis. */
+static Allocator plalloc(MAXPLANEBUFFSIZE);                             // allocator of the ubo plane buffer ranges
 
-    float tmpmat4[4][4] = {};  for (int i = 0; i < 16; ++i) { tmpmat4[i / 4][i % 4] = modelmat4[i / 4][i % 4]; }
+static Allocator* getplalloc(void) { return &plalloc; }
 
-    float time = GetFrame();
-    tmpmat4[0][0] = std::cos(-time / 800.0f); tmpmat4[0][1] = -std::sin(-time / 800.0f);
-    tmpmat4[1][0] = std::sin(-time / 800.0f); tmpmat4[1][1] = std::cos(-time / 800.0f);
+static Allocator unitalloc(MAXUNITBUFFSIZE);                            // allocator of the ubo unit buffer ranges
 
+static Allocator* getunitalloc(void) { return &unitalloc; }
 
-    for (int i = 0; i < 16; ++i) { modelmat4[i / 4][i % 4] = tmpmat4[i / 4][i % 4]; }
-
-}
+#include <cmath>
 
 static const char* contentschar = nullptr;                              // to convert an rvalue to an lvalue
 
@@ -1277,8 +2495,6 @@ static void makecamray(float screenraydir[PIXELS_H][PIXELS_W][4], float screenra
 
     #define RAYBUFFELMSIZE 4 * PIXELS_W * PIXELS_H
 
-    const float d = 2.0f / PIXELS_W * 1.0f;                             // angle of view = PI / 4 rad (= 1.0f)
-
 
     float* tmpray = new float[RAYBUFFELMSIZE] {};
     for (int n = 0; n < RAYBUFFELMSIZE / 4; ++n) {
@@ -1287,7 +2503,7 @@ static void makecamray(float screenraydir[PIXELS_H][PIXELS_W][4], float screenra
 
         float* tmprayelm = tmpray + (wn * 4 + hn * PIXELS_W * 4); {
 
-            float tmp[4] = { d * (-PIXELS_W / 2.0f + wn + 0.5f), 1.0f, d * (-PIXELS_H / 2.0f + hn + 0.5f), 0.0f };
+            float tmp[4] = {}; makepixelray(wn, hn, tmp);
 
             for (int m = 0; m < 4; ++m) { tmprayelm[m] = tmp[m]; }
 
@@ -1325,6 +2541,33 @@ static void makecamray(float screenraydir[PIXELS_H][PIXELS_W][4], float screenra
 
 }
 
+static void makepixelray(int wn, int hn, float outraypos[4]) {
+
+    /* Make the camera ray pos of a pixel (bottom row first) in ray space, on the screen plane y = 1. (Its dir is the pos normalized.) */
+
+    const float d = 2.0f / PIXELS_W * 1.0f;                             // angle of view = PI / 4 rad (= 1.0f)
+
+    outraypos[0] = d * (-PIXELS_W / 2.0f + wn + 0.5f); outraypos[1] = 1.0f; outraypos[2] = d * (-PIXELS_H / 2.0f + hn + 0.5f); outraypos[3] = 0.0f;
+
+}
+
+void Ray::GetCameraRay(int x, int y, float outpos[3], float outdir[3]) {
+
+    /* Transform the camera ray of a pixel (see makecamray(..)) from ray space to world space by the view matrix of the last frame (a rotation and a translation). */
+
+    float raypos[4] = {}; makepixelray(x, PIXELS_H - 1 - y, raypos);   // (the rows of the ray buffers are bottom first)
+
+    const float length = std::sqrt(dot3(raypos, raypos));
+
+    const float (&viewmat4)[4][4] = *GetViewmat4();
+
+    for (int i = 0; i < 3; ++i) {
+        outpos[i] = 0.0f; outdir[i] = 0.0f;
+        for (int j = 0; j < 3; ++j) { outpos[i] += viewmat4[j][i] * (raypos[j] - viewmat4[j][3]); outdir[i] += viewmat4[j][i] * raypos[j] / length; }
+    }
+
+}
+
 static void makeviewmat4(float outviewmat4[4][4], const float theta[3], const float pos[3]) {
 
     /* Get the camera position and orientation and make a view matrix. */
@@ -1348,3 +2591,18 @@ static void makeviewmat4(float outviewmat4[4][4], const float theta[3], const fl
     for (int i = 0; i < 16; ++i) { outviewmat4[i / 4][i % 4] = tmpmat4[i / 4][i % 4]; }
 
 }
+
+
+// *****************************************
+//  Kernel
+// *****************************************
+
+#include "RayKernel.h"                                                  // class ray::RayKernel declared here
+
+void RayKernel::MakeCamRay(float (*outraydir)[PIXELS_W][4], float (*outraypos)[PIXELS_W][4]) { makecamray(outraydir, outraypos); }
+
+void RayKernel::MakeViewmat4(float outviewmat4[4][4], const float theta[3], const float pos[3]) { makeviewmat4(outviewmat4, theta, pos); }
+
+void RayKernel::CopyImage(const unsigned char* src, size_t size, std::vector<unsigned char>& out) { copyimage(src, size, out); }
+
+int RayKernel::LoadImage(const char* file) { Image img(file); return img.width * img.height; }
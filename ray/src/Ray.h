@@ -8,6 +8,8 @@
 
 */
 
+#include "Scene.h"														// POINTS_PER_UNIT (the plane layout) defined here
+
 namespace ray { 
 	
 	void Call(float outpos[3], float outtheta[3]);						// get inputs that GLFW get
@@ -31,19 +33,91 @@ class ray::Ray {
 
 	Table* table;
 
+	void GetSlotMap(int outobject[], int outunit[], int outplstart[]) const;	// ray object, its unit and the unit's plane start of each slot (-1: empty)
+
 public:
 
-	Ray(void);															// init ray units/objects
+	Ray(void);															// init ray units/objects from the default scene file
+
+	Ray(const char* scenefile);											// init ray units/objects from a binary scene file
 
 	void Update(void);													// process ray calc for a frame
+
+	int AddGeometry(const float (*plbuff)[POINTS_PER_UNIT], int plsize);	// add a unit geometry [plsize][(pos, 1.0), (normal, 0.0), (u-axis, 0.0)], return its handle (-1: error)
+
+	int AddObject(int unitsize, const int geometry[], const float texscale[][2], const float modelmat4[4][4]);
+																		// add a ray object of unit geometries (handles of AddGeometry(..) or of the scene file), return its handle (-1: error)
+																		// texscale: per unit (nullptr: 1.0f)
+
+	int AddMesh(const char* meshfile, const float modelmat4[4][4], const float texscale[2] = nullptr);
+																		// add a ray object of the units imported from a mesh file (OBJ/PLY), return its handle (-1: error)
+
+	void RemoveObject(int object);										// remove a ray object added by AddObject(..)
+
+	void UpdateObject(int object, const float modelmat4[4][4]);			// set the model matrix of a ray object
+
+	void SetObjectMotion(int object, int motion, const float motionparam[4]);	// set a built-in motion (Scene::Motion, see Motion.h) to a ray object
+
+	void SetObjectMotion(int object, void(*updatemat4)(float modelmat4[4][4]));	// set a custom motion (called in parallel, must be thread safe)
+
+	int Trace(const float pos[3], const float dir[3], float* outdist = nullptr);	// trace a ray on the Cpu, return the closest ray object hit (-1: none)
+
+	int GetResidentUnitSize(void) const;								// ray units resident on Gpu (in the ubo unit buffer)
+
+	int GetResidentPlaneSize(void) const;								// planes of the resident ray units (at their levels of detail, dropped units: none)
+
+	void ReadSelection(float* outdepth, int (*outindex)[3]) const;		// read the selection calc of the last frame [PIXELS_H][PIXELS_W] (top row first): the depth (1.0f: none)
+																		// and the ray object handle, unit and plane (of the unit) hit (-1: none)
 	
 	~Ray(void);															// release ray units/objects
 
 
 	// ** static *******************************
 
-	static void Initialize(void);										// init Gpu memory and shaders for ray calc
+	static void Initialize(bool offscreen = false);						// init Gpu memory and shaders for ray calc
+																		// offscreen: render into a frame buffer object (headless contexts without a window)
+
+	static void ReadScreen(unsigned char* outrgb);						// read the last frame [PIXELS_H][PIXELS_W][3] (RGB, top row first)
+
+	static void GetCameraRay(int x, int y, float outpos[3], float outdir[3]);	// the camera ray of a pixel (top row first, as ReadSelection(..)) of the last frame in world space
+																		// (outdir: normalized, the depth of the selection calc is the hit distance from outpos / RAYDIST)
+
+	static void SetScreenRect(int x, int y, int width, int height);		// render only a rect of the screen (0, 0, PIXELS_W, PIXELS_H: the whole screen, by default)
+																		// (occlusion culling is off while a smaller rect is set)
 
 	static void Release(void);											// release Gpu memory and shaders
 
+
+	// ** Gpu timer ****************************
+
+	enum Pass { PASS_UPLOAD = 0, PASS_CULL, PASS_RAY2INIT, PASS_RAY2, PASS_SELECTION, PASS_DRAW, PASS_HIZ, PASSSIZE };
+
+	static const int MAXSLOTSIZE = 20;									// ray unit slots per frame (= MAXUNITBUFFSIZE in Ray.cpp)
+
+	struct GpuTime {
+		/* This structure contains the Gpu times of the passes of a frame (ms), as intervals between timestamps (the Gpu idle between them included). */
+		unsigned int frame = 0;											// frame measured (a count of the frames timed, 0: none yet)
+		float total = 0.0f, pass[PASSSIZE] = {};						// total: from the start of Update() to the end of the last pass
+		float ray2[MAXSLOTSIZE] = {}, selection[MAXSLOTSIZE] = {};		// per slot: ray2 calc of the unit, selection calc of the object (at its first slot)
+		int object[MAXSLOTSIZE] = {}, unit[MAXSLOTSIZE] = {};			// ray object handle and unit index of a slot (-1: empty)
+	};
+
+	static void EnableGpuTimer(bool enable);							// time the passes of each frame on Gpu by timer queries (off by default)
+
+	static bool GetGpuTime(GpuTime& out);								// get the latest frame measured (read back a few frames later without waiting, false: none)
+
+	// ** Export *******************************
+
+	struct ExportFrame {
+		/* This structure contains a frame read back for export. (The buffers are valid during the call of the export function only.) */
+		unsigned int frame = 0;											// frame exported (a count from 0)
+		const unsigned char* rgb = nullptr;								// screen [PIXELS_H][PIXELS_W][3] (RGB, top row first)
+		const float* depth = nullptr; const int (*index)[3] = nullptr;	// selection depth and index [PIXELS_H][PIXELS_W], as ReadSelection(..) (nullptr: not read)
+	};
+
+	static void SetExport(void(*exportframe)(const ExportFrame& frame), bool selection = false);	// read back each frame without waiting, and pass it to a function a few frames later
+																		// (on the GL thread, in order, nullptr: off) selection: also the selection depth and index
+
+	static void FlushExport(void);										// wait for the frames in flight and pass them (also by Release())
+
 };
@@ -0,0 +1,38 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	RayKernel class exposes the Cpu kernels internal to Ray class (Ray.cpp) to the micro benchmark (see MicroBench.h).
+
+*/
+
+#include <cstddef>
+#include <vector>
+
+#include "constant.h"
+
+namespace ray {
+
+	class RayKernel;
+
+}
+
+class ray::RayKernel {
+
+	/*
+		In this class:
+
+			- Run a Cpu kernel of Ray.cpp as the startup or a frame runs it, with no Gpu call. (Defined in Ray.cpp.)
+	*/
+
+public:
+
+	static void MakeCamRay(float (*outraydir)[PIXELS_W][4], float (*outraypos)[PIXELS_W][4]);	// the camera ray data (GL_LoadCamRay())
+
+	static void MakeViewmat4(float outviewmat4[4][4], const float theta[3], const float pos[3]);	// the view matrix of a camera (SetViewmat4())
+
+	static void CopyImage(const unsigned char* src, size_t size, std::vector<unsigned char>& out);	// the byte copy of an image read (Image::Image(..))
+
+	static int LoadImage(const char* file);								// read, decode and copy an image file (GL_LoadImgData()), and return its pixel count (0: failed)
+
+};
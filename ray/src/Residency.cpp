@@ -0,0 +1,623 @@
+/* ** EXPLANATION **
+
+    Residency class streams Ray Objects of a scene in and out of the (UBO) Plane/Unit Buffers.
+
+    Plane and unit data are uploaded per object as sub-ranges straight from the mapped scene file.
+
+    Runtime objects/geometries keep their data here and are uploaded the same way when added.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "Residency.h"                                                  // class ray::Residency declared here
+#include "Polytope.h"                                                   // class ray::Polytope declared here
+
+#include "constant.h"
+
+
+using namespace ray;
+
+
+#define MAXSCANSIZE 4096                                                // max number of scene objects rated per frame
+#define MAXLOADPLANES 256                                               // max number of planes uploaded per frame
+#define MAXEVICTPERLOAD 8                                               // max number of evictions to make room for a load
+
+const float MINPRIORITY = 1.0f / PIXELS_W;                              // objects rated lower (smaller than about a pixel) are not loaded
+const float NONVISIBLEWEIGHT = 0.1f;                                    // weight of the objects out of the view (loaded ahead of camera turns)
+const float LODPIXELS = 0.5f;                                           // max error of a coarser level of detail on the screen (pixels)
+const float DROPPIXELS = 1.0f;                                          // subtrahends smaller than this on the screen (pixels) are not drawn
+const float LODHYSTERESIS = 1.5f;                                       // factor of the limits to leave the current level (or drop state)
+
+static bool firstfit(std::vector<std::pair<int, int>> used, int capacity, const int* size, int sizecount);
+
+
+// *****************************************
+//  Constructor
+// *****************************************
+
+Residency::Residency(const Scene* scene, Allocator* plalloc, Allocator* unitalloc, PlaneUpload plupload, UnitUpload unitupload)
+    : scene(scene), plalloc(plalloc), unitalloc(unitalloc), plupload(plupload), unitupload(unitupload),
+    entry(scene->GetObjectSize()), geometry(scene->GetGeometrySize()) {}
+
+
+// *****************************************
+//  Destructor
+// *****************************************
+
+Residency::~Residency(void) { while (!resident.empty()) { Evict(resident.back()); } }
+
+
+// *****************************************
+//  Update
+// *****************************************
+
+void Residency::Update(const float viewmat4[4][4], const float (*modelmat4list)[4][4]) {
+
+    /*
+        Rate a slice of the scene objects, then load the best rated candidates within the upload budget.
+
+        Resident objects rated as wanted are moved to the LRU head, and evictions are taken from the LRU tail.
+
+        The levels of detail of the resident objects are refined first, as they are on the screen already.
+    */
+
+    auto less = [this](int a, int b) { return entry[a].priority < entry[b].priority; };
+
+
+    loaded.clear(); changed.clear();
+
+    // ** rate a slice of the scene objects ****
+
+    int objectsize = scene->GetObjectSize();
+    int scansize = (objectsize < MAXSCANSIZE) ? objectsize : MAXSCANSIZE;
+
+    for (int i = 0; i < scansize; ++i) {
+
+        int n = scanindex; scanindex = (scanindex + 1) % objectsize;
+
+        Rate(n, viewmat4, modelmat4list[n]);
+
+        if (entry[n].priority < MINPRIORITY) continue;
+
+        if (entry[n].residentindex >= 0) { Touch(n); }                  // still wanted
+        else if (!entry[n].queued) {
+            entry[n].queued = true; queue.push_back(n); std::push_heap(queue.begin(), queue.end(), less);
+        }
+
+    }
+
+    // ** levels of detail of the resident ones *
+
+    int budget = MAXLOADPLANES;
+
+    for (int n : resident) { Rate(n, viewmat4, modelmat4list[n]); budget -= Refine(n, budget); }
+
+    // ** load the candidates ******************
+
+    while (!queue.empty() && budget > 0) {
+
+        std::pop_heap(queue.begin(), queue.end(), less);
+        int n = queue.back(); queue.pop_back();
+
+        entry[n].queued = false;
+
+        if (entry[n].residentindex >= 0 || entry[n].priority < MINPRIORITY) continue;
+
+        int res = Load(n);
+
+        for (int i = 0; res < 0 && i < MAXEVICTPERLOAD; ++i) {          // make room from the LRU tail
+
+            if (lrutail < 0 || entry[lrutail].priority >= entry[n].priority) break;
+
+            Evict(lrutail);
+
+            res = Load(n);
+
+        }
+
+        if (res < 0) continue;                                          // re-queued when it is rated again
+
+
+        budget -= res + 1;                                              // shared geometries cost only the unit data
+
+    }
+
+}
+
+
+// *****************************************
+//  Access
+// *****************************************
+
+int Residency::GetResidentSize(void) const { return (int)resident.size(); }
+
+const int* Residency::GetResident(void) const { return resident.data(); }
+
+int Residency::GetLoadedSize(void) const { return (int)loaded.size(); }
+
+const int* Residency::GetLoaded(void) const { return loaded.data(); }
+
+int Residency::GetChangedSize(void) const { return (int)changed.size(); }
+
+const int* Residency::GetChanged(void) const { return changed.data(); }
+
+const Residency::Entry& Residency::GetEntry(int object) const { return entry[object]; }
+
+int Residency::GetObjectSize(void) const { return (int)entry.size(); }
+
+int Residency::GetGeometrySize(void) const { return (int)geometry.size(); }
+
+bool Residency::IsRuntimeObject(int object) const {
+    int n = object - scene->GetObjectSize();
+    return n >= 0 && n < (int)runtime.size() && runtime[n].alive;
+}
+
+bool Residency::IsObject(int object) const { return (object >= 0 && object < scene->GetObjectSize()) || IsRuntimeObject(object); }
+
+
+// *****************************************
+//  Runtime Objects
+// *****************************************
+
+int Residency::AddGeometry(const float (*plbuff)[POINTS_PER_UNIT], int plsize) {
+
+    /*
+        Keep a copy of the planes which bound the unit (see Polytope.h) and their bounds.
+        Runtime geometries are never removed (shapes are few compared to instances).
+    */
+
+    if (plsize <= 0) return -1;
+
+    std::vector<float> pl; Polytope::Reduce(plbuff, plsize, pl);
+
+    plsize = (int)(pl.size() / POINTS_PER_UNIT);
+
+    if (plsize > plalloc->GetCapacity()) return -1;
+
+    Scene::Range range = { (int)(runtimeplbuff.size() / POINTS_PER_UNIT), plsize };
+
+    runtimeplbuff.insert(runtimeplbuff.end(), pl.begin(), pl.end());
+    runtimerange.push_back(range);
+
+    runtimebounds.emplace_back(); Polytope::Bound((const float(*)[POINTS_PER_UNIT])pl.data(), plsize, runtimebounds.back());
+
+    geometry.emplace_back();
+
+    return (int)geometry.size() - 1;
+
+}
+
+int Residency::AddObject(const int* geometry, const Scene::Unit* unitbuff, int unitsize, const Csg::Program* program) {
+
+    /*
+        Load a runtime object at once. Streamed objects are evicted from the LRU tail while the ranges do not fit.
+
+        Nothing is evicted if the ranges would not fit even with all the streamed objects evicted, that is, first fit in the free
+        ranges between the pinned ones (see firstfit(..)).
+
+        Only the new unit records (and the planes of geometries not resident yet) are uploaded.
+    */
+
+    if (unitsize <= 0 || unitsize > MAXENTRYUNITSIZE) return -1;
+    for (int m = 0; m < unitsize; ++m) { if (geometry[m] < 0 || geometry[m] >= (int)this->geometry.size()) return -1; }
+    if (program && (program->size == 0 || !Csg::IsValid(program->code, program->size, unitsize))) return -1;
+
+    int object = -1;
+
+    if (!freeruntime.empty()) { object = freeruntime.back(); freeruntime.pop_back(); }
+    else { object = (int)entry.size(); entry.emplace_back(); runtime.emplace_back(); }
+
+    Runtime& r = runtime[object - scene->GetObjectSize()];
+
+    r.unitsize = unitsize; r.alive = true;
+    for (int m = 0; m < unitsize; ++m) { r.geometry[m] = geometry[m]; r.unit[m] = unitbuff[m]; }
+
+    Csg::Program chain; if (!program) { Csg::Chain(unitsize, GetGeometryBounds(geometry[0]), chain); program = &chain; }
+
+    r.programsize = program->size; std::copy(program->code, program->code + program->size, r.program); r.bounds = program->bounds;
+
+    entry[object] = Entry(); entry[object].pinned = true;
+
+    // the ranges left by the pinned objects (the ones of the streamed objects can all be evicted)
+
+    std::vector<std::pair<int, int>> pinnedunit, pinnedplane; std::vector<int> pinned;     // pinned: geometries of the pinned objects
+
+    for (int n : resident) {
+        if (!entry[n].pinned) continue;
+        pinnedunit.emplace_back(entry[n].unitstart, GetUnitSize(n)); pinned.insert(pinned.end(), entry[n].geometry, entry[n].geometry + GetUnitSize(n));
+    }
+
+    std::sort(pinned.begin(), pinned.end()); pinned.erase(std::unique(pinned.begin(), pinned.end()), pinned.end());
+
+    for (int g : pinned) { pinnedplane.emplace_back(this->geometry[g].plstart, GetGeometryRange(g).plsize); }
+
+    int plsize[MAXENTRYUNITSIZE] = {}, plsizecount = 0, unitgeometry[MAXENTRYUNITSIZE] = {};   // plsize: planes allocated by Load(..), in its order
+
+    for (int m = 0; m < unitsize; ++m) {
+        unitgeometry[m] = Level(object, m);                             // (as in Load(..))
+        if (std::binary_search(pinned.begin(), pinned.end(), unitgeometry[m]) || std::find(unitgeometry, unitgeometry + m, unitgeometry[m]) != unitgeometry + m) continue;
+        plsize[plsizecount++] = GetGeometryRange(unitgeometry[m]).plsize;
+    }
+
+    bool fit = firstfit(pinnedunit, unitalloc->GetCapacity(), &unitsize, 1) && firstfit(pinnedplane, plalloc->GetCapacity(), plsize, plsizecount);
+
+    int res = fit ? Load(object) : -1;
+
+    while (fit && res < 0 && lrutail >= 0) { Evict(lrutail); res = Load(object); }
+
+    if (res < 0) { r.alive = false; freeruntime.push_back(object); return -1; }
+
+    return object;
+
+}
+
+void Residency::RemoveObject(int object) {
+
+    /* Release the ranges of a runtime object. No upload is needed: the ranges are not drawn until reused. */
+
+    if (!IsRuntimeObject(object)) return;
+
+    Evict(object);
+
+    runtime[object - scene->GetObjectSize()].alive = false; freeruntime.push_back(object);
+
+}
+
+
+// *****************************************
+
+// *****************************************
+
+int Residency::GetUnitSize(int object) const {
+    int n = object - scene->GetObjectSize();
+    return (n < 0) ? scene->GetObjectBuff()[object].unitsize : runtime[n].unitsize;
+}
+
+const int* Residency::GetUnitGeometry(int object) const {
+    int n = object - scene->GetObjectSize();
+    return (n < 0) ? scene->GetUnitGeometryBuff() + scene->GetObjectBuff()[object].unitstart : runtime[n].geometry;
+}
+
+const Scene::Unit* Residency::GetUnitBuff(int object) const {
+    int n = object - scene->GetObjectSize();
+    return (n < 0) ? scene->GetUnitBuff() + scene->GetObjectBuff()[object].unitstart : runtime[n].unit;
+}
+
+const Scene::Range& Residency::GetGeometryRange(int geometry) const {
+    int n = geometry - scene->GetGeometrySize();
+    return (n < 0) ? scene->GetGeometryBuff()[geometry] : runtimerange[n];
+}
+
+const float (*Residency::GetGeometryPlanes(int geometry) const)[POINTS_PER_UNIT] {
+    /* Return the planes of a geometry. (Runtime planes move when geometries are added: do not keep the pointer.) */
+    int n = geometry - scene->GetGeometrySize();
+    if (n < 0) return scene->GetPlaneBuff() + scene->GetGeometryBuff()[geometry].plstart;
+    return (const float(*)[POINTS_PER_UNIT])runtimeplbuff.data() + runtimerange[n].plstart;
+}
+
+const Scene::Bounds& Residency::GetGeometryBounds(int geometry) const {
+    int n = geometry - scene->GetGeometrySize();
+    return (n < 0) ? scene->GetGeometryBoundsBuff()[geometry] : runtimebounds[n];
+}
+
+const Scene::Bounds& Residency::GetObjectBounds(int object) const {
+    int n = object - scene->GetObjectSize();
+    return (n < 0) ? scene->GetObjectBoundsBuff()[object] : runtime[n].bounds;
+}
+
+const Scene::Lod& Residency::GetGeometryLod(int geometry) const {
+    static const Scene::Lod none = { -1, 0.0f };
+    int n = geometry - scene->GetGeometrySize();
+    return (n < 0) ? scene->GetGeometryLodBuff()[geometry] : none;
+}
+
+int Residency::GetProgramSize(int object) const {
+    int n = object - scene->GetObjectSize();
+    return (n < 0) ? scene->GetObjectBuff()[object].programsize : runtime[n].programsize;
+}
+
+const int* Residency::GetProgram(int object) const {
+    int n = object - scene->GetObjectSize();
+    return (n < 0) ? scene->GetProgramBuff() + scene->GetObjectBuff()[object].programstart : runtime[n].program;
+}
+
+void Residency::Rate(int object, const float viewmat4[4][4], const float modelmat4[4][4]) {
+
+    /*
+        Rate a scene object by its angular size (~ screen coverage per camera distance) seen from the camera.
+
+        The bounding sphere is the one of the object's program result (see Csg.h).
+        (Empty objects are never loaded, and unbounded objects cover the screen from anywhere.)
+
+        The scale of the object on the screen is taken at the nearest point of the sphere (for the levels of detail).
+    */
+
+    Entry& e = entry[object];
+
+    if (GetUnitSize(object) > MAXENTRYUNITSIZE) { e.priority = 0.0f; return; }     // never loaded
+
+    const Scene::Bounds& g = GetObjectBounds(object);
+
+    if (g.state == Scene::BOUNDS_EMPTY) { e.priority = 0.0f; return; }
+    if (g.state == Scene::BOUNDS_UNBOUNDED) { e.priority = 1.0f; e.pixelscale = 1.0e30f; return; }
+
+    // transform the sphere into ray space
+
+    float worldcenter[3] = {}, raycenter[3] = {}, scale = 0.0f;
+
+    for (int i = 0; i < 3; ++i) { worldcenter[i] = modelmat4[i][3]; for (int j = 0; j < 3; ++j) { worldcenter[i] += modelmat4[i][j] * g.center[j]; } }
+    for (int i = 0; i < 3; ++i) { raycenter[i] = viewmat4[i][3]; for (int j = 0; j < 3; ++j) { raycenter[i] += viewmat4[i][j] * worldcenter[j]; } }
+
+    for (int j = 0; j < 3; ++j) {
+        float s2 = 0.0f; for (int i = 0; i < 3; ++i) { s2 += modelmat4[i][j] * modelmat4[i][j]; }
+        scale = std::max(scale, s2);
+    }
+
+    float radius = g.radius * std::sqrt(scale);
+
+    // test the sphere against the camera ray frustum (rays (x, 1, z): |x| <= 1, |z| <= PIXELS_H / PIXELS_W)
+
+    const float aspect = (float)PIXELS_H / PIXELS_W;
+
+    bool visible = raycenter[1] >= -radius
+        && (std::fabs(raycenter[0]) - raycenter[1]) / std::sqrt(2.0f) <= radius
+        && (std::fabs(raycenter[2]) - aspect * raycenter[1]) / std::sqrt(1.0f + aspect * aspect) <= radius;
+
+    float dist = std::sqrt(raycenter[0] * raycenter[0] + raycenter[1] * raycenter[1] + raycenter[2] * raycenter[2]);
+
+
+    e.priority = radius / std::max(dist, radius) * (visible ? 1.0f : NONVISIBLEWEIGHT);
+
+    e.pixelscale = std::sqrt(scale) * (0.5f * PIXELS_W) / std::max(dist - radius, 1.0f);     // (the screen plane is at distance 1)
+
+}
+
+void Residency::Touch(int object) {
+
+    /* Move a resident object to the head of the LRU list. (Pinned objects are not listed.) */
+
+    Entry& e = entry[object];
+
+    if (e.pinned || lruhead == object) return;
+
+    // unlink
+
+    if (e.prev >= 0) entry[e.prev].next = e.next;
+    if (e.next >= 0) entry[e.next].prev = e.prev;
+    if (lrutail == object) lrutail = e.prev;
+
+    // link at the head
+
+    e.prev = -1; e.next = lruhead;
+    if (lruhead >= 0) entry[lruhead].prev = object;
+    lruhead = object;
+    if (lrutail < 0) lrutail = object;
+
+}
+
+int Residency::Load(int object) {
+
+    /*
+        Allocate buffer ranges for an object and upload its unit data and the planes of its geometries not resident yet.
+        The units are loaded at the levels of detail of the last rating.
+
+        Fail without side effects if the ranges do not fit.
+    */
+
+    const int unitsize = GetUnitSize(object);
+
+    if (unitsize <= 0 || unitsize > MAXENTRYUNITSIZE) return -1;         // (no unit: nothing left by the program)
+
+    Entry& e = entry[object];
+
+    int unitgeometry[MAXENTRYUNITSIZE]; for (int m = 0; m < unitsize; ++m) { unitgeometry[m] = Level(object, m); }
+
+    e.unitstart = unitalloc->Alloc(unitsize);
+
+    bool res = e.unitstart >= 0, fresh[MAXENTRYUNITSIZE] = {}; int refsize = 0;    // fresh: the geometry is allocated by this load
+
+    for (; res && refsize < unitsize; ++refsize) {
+
+        GeometryEntry& g = geometry[unitgeometry[refsize]];
+
+        if (g.refsize == 0) { g.plstart = plalloc->Alloc(GetGeometryRange(unitgeometry[refsize]).plsize); res = fresh[refsize] = g.plstart >= 0; }
+
+        if (!res) break;
+
+        ++g.refsize; e.plstart[refsize] = g.plstart; e.geometry[refsize] = unitgeometry[refsize];
+
+    }
+
+    if (!res) {                                                         // roll back
+
+        for (int m = 0; m < refsize; ++m) { Release(unitgeometry[m]); e.plstart[m] = e.geometry[m] = -1; }
+        if (e.unitstart >= 0) unitalloc->Free(e.unitstart, unitsize);
+        e.unitstart = -1;
+
+        return -1;
+
+    }
+
+    e.dropped = 0;
+
+    // upload the sub-ranges
+
+    int plsize = 0;
+
+    for (int m = 0; m < unitsize; ++m) {
+
+        if (!fresh[m]) continue;                                        // already resident
+
+        const Scene::Range& range = GetGeometryRange(unitgeometry[m]);
+
+        plupload(e.plstart[m], GetGeometryPlanes(unitgeometry[m]), (unsigned int)range.plsize);
+
+        plsize += range.plsize;
+
+    }
+
+    unitupload(e.unitstart, GetUnitBuff(object), (unsigned int)unitsize);
+
+
+    e.residentindex = (int)resident.size(); resident.push_back(object);
+
+    loaded.push_back(object);
+
+    e.prev = e.next = -1; Touch(object);
+
+    return plsize;
+
+}
+
+int Residency::Level(int object, int unit) const {
+
+    /*
+        Walk the chain of the unit's geometry while the error of the next level projects under LODPIXELS,
+        or under LODPIXELS * LODHYSTERESIS up to the current level.
+    */
+
+    const Entry& e = entry[object];
+
+    int g = GetUnitGeometry(object)[unit];
+
+    bool beyond = e.geometry[unit] < 0 || e.geometry[unit] == g;       // beyond: the levels coarser than the current one
+
+    for (int next = GetGeometryLod(g).next; next >= 0; next = GetGeometryLod(g).next) {
+
+        if (GetGeometryLod(next).error * e.pixelscale >= (beyond ? LODPIXELS : LODPIXELS * LODHYSTERESIS)) break;
+
+        g = next; beyond = beyond || g == e.geometry[unit];
+
+    }
+
+    return g;
+
+}
+
+int Residency::Refine(int object, int budget) {
+
+    /*
+        Move the units of a resident object to their levels of detail, and drop or restore the units only cut out of it (see Csg.h).
+
+        A level not resident yet is uploaded within the budget, or else the unit keeps its level for now.
+        The levels are not blended: a change is under a pixel (LODPIXELS) on the screen.
+    */
+
+    Entry& e = entry[object];
+
+    const int unitsize = GetUnitSize(object), subtrahend = Csg::Subtrahends(GetProgram(object), GetProgramSize(object));
+
+    int plsize = 0; bool change = false;
+
+    for (int m = 0; m < unitsize; ++m) {
+
+        // drop the subtrahends under a pixel
+
+        if ((subtrahend >> m) & 1) {
+
+            const Scene::Bounds& bounds = GetGeometryBounds(GetUnitGeometry(object)[m]);
+
+            bool dropped = ((e.dropped >> m) & 1) != 0;
+            bool drop = bounds.state == Scene::BOUNDS_BOUNDED && 2.0f * bounds.radius * e.pixelscale < (dropped ? DROPPIXELS * LODHYSTERESIS : DROPPIXELS);
+
+            if (drop != dropped) { e.dropped ^= 1 << m; change = true; }
+
+        }
+
+        // move to the level
+
+        int level = Level(object, m);
+
+        if (level == e.geometry[m]) continue;
+
+        GeometryEntry& g = geometry[level];
+        const Scene::Range& range = GetGeometryRange(level);
+
+        if (g.refsize == 0) {
+
+            if (range.plsize > budget - plsize) continue;
+
+            g.plstart = plalloc->Alloc(range.plsize);
+            if (g.plstart < 0) continue;                                // (no room: keep the level)
+
+            plupload(g.plstart, GetGeometryPlanes(level), (unsigned int)range.plsize); plsize += range.plsize;
+
+        }
+
+        ++g.refsize; Release(e.geometry[m]);
+
+        e.geometry[m] = level; e.plstart[m] = g.plstart; change = true;
+
+    }
+
+    if (change) changed.push_back(object);
+
+    return plsize;
+
+}
+
+void Residency::Release(int geometry) {
+
+    /* Drop a reference to a unit geometry and free its planes when no resident unit references it. */
+
+    GeometryEntry& g = this->geometry[geometry];
+
+    if (--g.refsize > 0) return;
+
+    plalloc->Free(g.plstart, GetGeometryRange(geometry).plsize); g.plstart = -1;
+
+}
+
+void Residency::Evict(int object) {
+
+    /* Release the buffer ranges of a resident object. (The buffer contents are left as they are.) */
+
+    const int unitsize = GetUnitSize(object);
+
+    Entry& e = entry[object];
+
+    for (int m = 0; m < unitsize; ++m) { Release(e.geometry[m]); e.plstart[m] = e.geometry[m] = -1; }
+    unitalloc->Free(e.unitstart, unitsize); e.unitstart = -1; e.dropped = 0;
+
+    // remove from the resident list (swap with the last)
+
+    int last = resident.back();
+    resident[e.residentindex] = last; entry[last].residentindex = e.residentindex;
+    resident.pop_back(); e.residentindex = -1;
+
+    loaded.erase(std::remove(loaded.begin(), loaded.end(), object), loaded.end());      // in case it was loaded in this frame
+    changed.erase(std::remove(changed.begin(), changed.end(), object), changed.end());
+
+    // remove from the LRU list
+
+    if (e.pinned) return;
+
+    if (e.prev >= 0) entry[e.prev].next = e.next; else lruhead = e.next;
+    if (e.next >= 0) entry[e.next].prev = e.prev; else lrutail = e.prev;
+    e.prev = e.next = -1;
+
+}
+
+static bool firstfit(std::vector<std::pair<int, int>> used, int capacity, const int* size, int sizecount) {
+
+    /* Test if ranges of the sizes are allocated in order (first fit, as Allocator::Alloc(..)) in a buffer where only the used ranges (start, size) are. */
+
+    std::vector<std::pair<int, int>> gap;                               // free ranges (start, size)
+
+    std::sort(used.begin(), used.end());
+
+    int end = 0;
+    for (const auto& u : used) { if (u.first > end) gap.emplace_back(end, u.first - end); end = std::max(end, u.first + u.second); }
+    if (capacity > end) gap.emplace_back(end, capacity - end);
+
+    for (int i = 0; i < sizecount; ++i) {
+        auto it = std::find_if(gap.begin(), gap.end(), [&](const std::pair<int, int>& g) { return g.second >= size[i]; });
+        if (it == gap.end()) return false;
+        it->first += size[i]; it->second -= size[i];
+    }
+
+    return true;
+
+}
@@ -0,0 +1,176 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Residency class streams Ray Objects of a scene in and out of the (UBO) Plane/Unit Buffers,
+	so that scenes with more units than the buffers hold can be rendered.
+
+*/
+
+#include <vector>
+
+#include "Scene.h"                                                      // class ray::Scene declared here
+#include "Allocator.h"                                                  // class ray::Allocator declared here
+#include "Csg.h"                                                        // class ray::Csg declared here
+
+namespace ray {
+
+	class Residency;
+
+}
+
+class ray::Residency {
+
+	/*
+		In this class:
+
+			- Rate the scene objects by camera distance and screen coverage, a slice of the scene per frame.
+
+			- Load the best rated objects into free ranges of the buffers and evict the least recently wanted (LRU) objects to make room.
+
+			- Spread the loads over frames within a per-frame upload budget.
+
+		The buffer ranges of a resident object do not move until it is evicted, so unit indices read by the shaders are stable.
+
+		Unit geometries are shared: their planes are resident once while any resident object references them.
+
+		A resident unit takes the coarsest level of detail of its geometry (see Scene.h) whose error projects under LODPIXELS on the screen,
+		and units only cut out of their objects are dropped under DROPPIXELS. (Both with hysteresis, so the levels do not flicker at the limits.)
+
+		Objects and geometries can also be added at runtime (not in the scene file). Such objects are pinned:
+		they are loaded when added, are never evicted, and release their ranges when removed.
+	*/
+
+public:
+
+	typedef void(*PlaneUpload)(int plstartindex, const float(*plbuff)[POINTS_PER_UNIT], unsigned int plbufflines);
+
+	typedef void(*UnitUpload)(int unitstartindex, const Scene::Unit* unitbuff, unsigned int unitbuffsize);
+
+	static const int MAXENTRYUNITSIZE = Csg::MAXLEAFSIZE;				// max size of ray units per ray object (= MAXUNITSIZE in Ray.cpp)
+
+	struct Entry {
+		/* This structure contains the residency state of a scene object. */
+		int unitstart = -1, plstart[MAXENTRYUNITSIZE] = { -1, -1, -1, -1, -1, -1, -1, -1 };	// buffer ranges (-1: not resident)
+		int geometry[MAXENTRYUNITSIZE] = { -1, -1, -1, -1, -1, -1, -1, -1 };	// geometries of the units at their current levels of detail
+		int dropped = 0;												// dropped: units not drawn (bit m: unit m)
+		float priority = 0.0f, pixelscale = 0.0f;						// pixelscale: pixels per model space length at the nearest of the object
+		int prev = -1, next = -1, residentindex = -1; bool queued = false;	// prev/next: LRU list links, residentindex: index in GetResident()
+		bool pinned = false;											// pinned: added at runtime (not streamed)
+	};
+
+	struct GeometryEntry {
+		/* This structure contains the residency state of a unit geometry. */
+		int plstart = -1, refsize = 0;									// refsize: number of resident units referencing the geometry
+	};
+
+
+	Residency(const Scene* scene, Allocator* plalloc, Allocator* unitalloc, PlaneUpload plupload, UnitUpload unitupload);
+
+	~Residency(void);													// release the buffer ranges of the resident objects
+
+	void Update(const float viewmat4[4][4], const float (*modelmat4list)[4][4]);	// rate, evict and load for a frame
+																		// modelmat4list: current model matrices of all objects (scene and runtime)
+
+	int GetResidentSize(void) const;
+
+	const int* GetResident(void) const;									// indices of resident scene objects
+
+	int GetLoadedSize(void) const;
+
+	const int* GetLoaded(void) const;									// indices of scene objects loaded in the last Update(..)
+
+	int GetChangedSize(void) const;
+
+	const int* GetChanged(void) const;									// indices of resident objects whose units changed levels in the last Update(..)
+
+	const Entry& GetEntry(int object) const;
+
+	int GetObjectSize(void) const;										// scene objects and runtime objects (including removed ones)
+
+	int GetGeometrySize(void) const;									// scene geometries and runtime geometries
+
+	const Scene::Range& GetGeometryRange(int geometry) const;			// planes of a geometry (plstart: in the scene or runtime planes)
+
+	const float (*GetGeometryPlanes(int geometry) const)[POINTS_PER_UNIT];	// (runtime planes move when geometries are added: do not keep the pointer)
+
+	int GetUnitSize(int object) const;
+
+	const int* GetUnitGeometry(int object) const;						// geometry handles of an object's units
+
+	const Scene::Unit* GetUnitBuff(int object) const;
+
+	const Scene::Bounds& GetGeometryBounds(int geometry) const;			// polytope bounds of a geometry (model space)
+
+	const Scene::Bounds& GetObjectBounds(int object) const;				// bounds of the program result of an object (model space)
+
+	const Scene::Lod& GetGeometryLod(int geometry) const;				// next coarser level of a geometry (runtime geometries: none)
+
+	int GetProgramSize(int object) const;
+
+	const int* GetProgram(int object) const;							// selection program of an object's units (see Csg.h)
+
+
+	// ** runtime objects **********************
+
+	int AddGeometry(const float (*plbuff)[POINTS_PER_UNIT], int plsize);	// add a unit geometry, return its handle (-1: error)
+
+	int AddObject(const int* geometry, const Scene::Unit* unitbuff, int unitsize, const Csg::Program* program = nullptr);
+																		// add and load a pinned object, return its index (-1: no room)
+																		// evict streamed objects to make room if needed
+																		// (program: of the units in order, nullptr: the first unit minus the others)
+
+	void RemoveObject(int object);										// release a pinned object (the index is reused)
+
+	bool IsRuntimeObject(int object) const;								// a pinned object not removed
+
+	bool IsObject(int object) const;									// a scene object or a runtime object not removed
+
+private:
+
+	struct Runtime {
+		/* This structure contains the data of an object added at runtime. */
+		int unitsize = 0, geometry[MAXENTRYUNITSIZE] = {}; Scene::Unit unit[MAXENTRYUNITSIZE] = {};
+		int programsize = 0, program[Csg::MAXPROGRAMSIZE] = {}; Scene::Bounds bounds = {};
+		bool alive = false;
+	};
+
+	const Scene* scene;
+
+	Allocator* plalloc; Allocator* unitalloc;
+
+	PlaneUpload plupload; UnitUpload unitupload;
+
+	std::vector<Entry> entry;											// per scene object
+
+	std::vector<GeometryEntry> geometry;								// per unit geometry
+
+	std::vector<Runtime> runtime;										// per runtime object (indexed from the scene object size)
+
+	std::vector<int> freeruntime;										// removed runtime object indices
+
+	std::vector<float> runtimeplbuff; std::vector<Scene::Range> runtimerange;	// planes of the runtime geometries [][POINTS_PER_UNIT]
+
+	std::vector<Scene::Bounds> runtimebounds;							// bounds of the runtime geometries
+
+	std::vector<int> resident, loaded, changed, queue;					// queue: load candidates (max heap by priority)
+
+	int scanindex = 0, lruhead = -1, lrutail = -1;
+
+	void Rate(int object, const float viewmat4[4][4], const float modelmat4[4][4]);
+
+	void Touch(int object);												// move to the LRU head
+
+	int Level(int object, int unit) const;								// choose the level of detail of a unit (the geometry)
+
+	int Refine(int object, int budget);									// change the levels of a resident object, return the number of uploaded planes
+
+	int Load(int object);												// return the number of uploaded planes (-1: not loaded)
+
+	void Release(int geometry);											// drop a reference to a unit geometry
+
+	void Evict(int object);
+
+	Residency(const Residency&) = delete; Residency& operator=(const Residency&) = delete;
+
+};
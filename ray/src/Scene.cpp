@@ -0,0 +1,905 @@
+/* ** EXPLANATION **
+
+    Scene class maps a binary scene file of Ray Units/Objects into memory and converts text scene files into binary ones.
+
+    Mapping keeps the startup bounded by file I/O: nothing is parsed or copied per float.
+
+*/
+
+#include <iostream>
+#include <cstring>
+
+#include <sys/stat.h>
+
+#include "Scene.h"                                                      // class ray::Scene declared here
+#include "Csg.h"                                                        // class ray::Csg declared here
+
+
+using namespace ray;
+
+
+// *****************************************
+//  Map
+// *****************************************
+
+#ifdef _WIN32
+
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+
+struct Scene::Map {
+
+    /* This structure contains a read-only file mapping. */
+
+    HANDLE file = INVALID_HANDLE_VALUE, mapping = NULL; const char* data = nullptr; unsigned long long size = 0;
+
+    Map(const char* name) {
+
+        file = CreateFileA(name, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+        if (file == INVALID_HANDLE_VALUE) return;
+
+        LARGE_INTEGER tmpsize = {}; GetFileSizeEx(file, &tmpsize);
+        if (tmpsize.QuadPart == 0) return;
+
+        mapping = CreateFileMappingA(file, NULL, PAGE_READONLY, 0, 0, NULL);
+        if (!mapping) return;
+
+        data = (const char*)MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+        if (data) size = tmpsize.QuadPart;
+
+    }
+
+    ~Map(void) {
+        if (data) UnmapViewOfFile(data);
+        if (mapping) CloseHandle(mapping);
+        if (file != INVALID_HANDLE_VALUE) CloseHandle(file);
+    }
+
+};
+
+#else
+
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+struct Scene::Map {
+
+    /* This structure contains a read-only file mapping. */
+
+    int file = -1; const char* data = nullptr; unsigned long long size = 0;
+
+    Map(const char* name) {
+
+        file = open(name, O_RDONLY);
+        if (file < 0) return;
+
+        struct stat st = {}; if (fstat(file, &st) != 0 || st.st_size == 0) return;
+
+        void* ptr = mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, file, 0);
+        if (ptr == MAP_FAILED) return;
+
+        data = (const char*)ptr; size = (unsigned long long)st.st_size;
+
+    }
+
+    ~Map(void) {
+        if (data) munmap((void*)data, (size_t)size);
+        if (file >= 0) close(file);
+    }
+
+};
+
+#endif
+
+
+// *****************************************
+//  Constructor
+// *****************************************
+
+static bool istextsibling(const char* binfile, char* outtextfile, size_t len);
+
+static bool isnewer(const char* file, const char* thanfile);
+
+static bool isvalidsection(const Scene::Section& section, unsigned long long filesize);
+
+
+Scene::Scene(const char* file) : map(nullptr), section() {
+
+    /*
+        Map a binary scene file and locate its sections.
+
+        If the binary file is missing, or older than a text scene file of the same name ("*.txt"), the text file is converted first.
+    */
+
+    char textfile[512] = {};
+
+    if (istextsibling(file, textfile, sizeof(textfile)) && isnewer(textfile, file)) Convert(textfile, file);     // (edits of the text file are picked up)
+
+    map = new Map(file);
+
+    if (!map->data) { std::cout << "Error: Scene file cannot be opened. (\"" << file << "\")\n"; delete map; map = nullptr; return; }
+
+    // validate the header and the sections
+
+    const Header* header = (const Header*)map->data;
+
+    if (map->size >= sizeof(Header) && std::memcmp(header->magic, "DBRS", 4) == 0 && header->version != VERSION) {
+
+        if (istextsibling(file, textfile, sizeof(textfile))) {         // reconvert a file of another version
+            delete map; map = nullptr;
+            map = new Map(Convert(textfile, file) ? file : "");
+            if (!map->data) { std::cout << "Error: Scene file cannot be opened. (\"" << file << "\")\n"; delete map; map = nullptr; return; }
+            header = (const Header*)map->data;
+        }
+
+    }
+
+    bool valid = map->size >= sizeof(Header) && std::memcmp(header->magic, "DBRS", 4) == 0 && header->version == VERSION
+        && map->size >= sizeof(Header) + sizeof(Section) * (unsigned long long)header->sectionsize;
+
+    if (valid) {
+
+        const Section* tmpsection = (const Section*)(map->data + sizeof(Header));
+
+        for (unsigned int n = 0; n < header->sectionsize; ++n) {
+
+            if (!isvalidsection(tmpsection[n], map->size)) { valid = false; break; }
+
+            if (tmpsection[n].id < SECTIONIDSIZE) section[tmpsection[n].id] = &tmpsection[n];     // unknown sections are skipped
+
+        }
+
+        const unsigned int elmsize[SECTIONIDSIZE] = { sizeof(float) * POINTS_PER_UNIT, sizeof(Unit), sizeof(Range), sizeof(int), sizeof(Object), sizeof(Bounds), sizeof(Bounds), sizeof(int), sizeof(Lod) };
+
+        for (int n = 0; n < SECTIONIDSIZE; ++n) { valid = valid && section[n] && section[n]->elmsize == elmsize[n]; }
+
+        valid = valid && section[SECTION_UNITGEOMETRY]->count == section[SECTION_UNIT]->count
+            && section[SECTION_GEOMETRYBOUNDS]->count == section[SECTION_GEOMETRY]->count && section[SECTION_OBJECTBOUNDS]->count == section[SECTION_OBJECT]->count
+            && section[SECTION_GEOMETRYLOD]->count == section[SECTION_GEOMETRY]->count;
+
+    }
+
+    // validate the references between the sections
+
+    for (int n = 0; valid && n < GetGeometrySize(); ++n) {
+        const Range& range = GetGeometryBuff()[n];
+        const Lod& lod = GetGeometryLodBuff()[n];
+        valid = range.plstart >= 0 && range.plsize > 0 && range.plstart + range.plsize <= GetPlaneSize()
+            && (lod.next == -1 || (lod.next > n && lod.next < GetGeometrySize())) && lod.error >= 0.0f;     // (chained forward: no cycle)
+    }
+
+    for (int n = 0; valid && n < GetUnitSize(); ++n) { valid = GetUnitGeometryBuff()[n] >= 0 && GetUnitGeometryBuff()[n] < GetGeometrySize(); }
+
+    for (int n = 0; valid && n < GetObjectSize(); ++n) {
+        const Object& object = GetObjectBuff()[n];
+        valid = object.unitstart >= 0 && object.unitsize >= 0 && object.unitstart + object.unitsize <= GetUnitSize()
+            && object.motion >= 0 && object.motion < MOTIONSIZE
+            && object.programstart >= 0 && object.programsize >= 0 && object.programstart + object.programsize <= (int)section[SECTION_PROGRAM]->count
+            && (object.programsize > 0) == (object.unitsize > 0) && Csg::IsValid(GetProgramBuff() + object.programstart, object.programsize, object.unitsize);
+    }
+
+
+    if (!valid) { std::cout << "Error: Scene file format error. (\"" << file << "\")\n"; delete map; map = nullptr; }
+
+}
+
+
+// *****************************************
+//  Destructor
+// *****************************************
+
+Scene::~Scene(void) { delete map; }
+
+
+// *****************************************
+//  Access
+// *****************************************
+
+bool Scene::IsOpen(void) const { return map != nullptr; }
+
+int Scene::GetPlaneSize(void) const { return map ? (int)section[SECTION_PLANE]->count : 0; }
+
+int Scene::GetUnitSize(void) const { return map ? (int)section[SECTION_UNIT]->count : 0; }
+
+int Scene::GetGeometrySize(void) const { return map ? (int)section[SECTION_GEOMETRY]->count : 0; }
+
+int Scene::GetObjectSize(void) const { return map ? (int)section[SECTION_OBJECT]->count : 0; }
+
+const float (*Scene::GetPlaneBuff(void) const)[POINTS_PER_UNIT] { return (const float(*)[POINTS_PER_UNIT])GetSection(SECTION_PLANE); }
+
+const Scene::Unit* Scene::GetUnitBuff(void) const { return (const Unit*)GetSection(SECTION_UNIT); }
+
+const Scene::Range* Scene::GetGeometryBuff(void) const { return (const Range*)GetSection(SECTION_GEOMETRY); }
+
+const int* Scene::GetUnitGeometryBuff(void) const { return (const int*)GetSection(SECTION_UNITGEOMETRY); }
+
+const Scene::Range& Scene::GetUnitRange(int unit) const { return GetGeometryBuff()[GetUnitGeometryBuff()[unit]]; }
+
+const Scene::Object* Scene::GetObjectBuff(void) const { return (const Object*)GetSection(SECTION_OBJECT); }
+
+const Scene::Bounds* Scene::GetGeometryBoundsBuff(void) const { return (const Bounds*)GetSection(SECTION_GEOMETRYBOUNDS); }
+
+const Scene::Bounds* Scene::GetObjectBoundsBuff(void) const { return (const Bounds*)GetSection(SECTION_OBJECTBOUNDS); }
+
+const int* Scene::GetProgramBuff(void) const { return (const int*)GetSection(SECTION_PROGRAM); }
+
+const Scene::Lod* Scene::GetGeometryLodBuff(void) const { return (const Lod*)GetSection(SECTION_GEOMETRYLOD); }
+
+const void* Scene::GetSection(SectionId id) const {
+    /* Return the head of a section in the mapped memory. */
+    return map ? map->data + section[id]->offset : nullptr;
+}
+
+
+// *****************************************
+//  Convert
+// *****************************************
+
+#include <cstdio>
+#include <cstdlib>
+#include <map>
+#include <string>
+#include <vector>
+
+#include "Unit.h"                                                       // built-in unit shapes
+#include "Polytope.h"                                                   // class ray::Polytope (and ray::Jobs) declared here
+#include "Mesh.h"                                                       // class ray::Mesh declared here
+
+struct Shape {
+
+    /* This structure contains the planes of a named unit shape. */
+
+    std::string name; std::vector<float> pl;                            // pl: [plsize][POINTS_PER_UNIT]
+
+    int geometry;                                                       // geometry handle in the binary file (-1: not used yet)
+
+};
+
+struct Tokenizer {
+
+    /* This structure splits a text into whitespace separated tokens. ('#' comments out the rest of a line.) */
+
+    const char* ptr = nullptr; const char* end = nullptr; int line = 1;
+
+    bool Next(std::string& out);                                        // get the next token
+
+    bool NextFloat(float& out);                                         // get the next token as a float
+
+};
+
+static bool tofloat(const std::string& token, float& out);
+
+static bool readtext(const char* file, std::string& out);
+
+static bool writebinary(const char* file, const std::vector<float>& plbuff, const std::vector<Scene::Unit>& unitbuff,
+    const std::vector<Scene::Range>& geometrybuff, const std::vector<int>& unitgeometrybuff, const std::vector<Scene::Object>& objectbuff,
+    const std::vector<Scene::Bounds>& geometryboundsbuff, const std::vector<Scene::Bounds>& objectboundsbuff, const std::vector<int>& programbuff,
+    const std::vector<Scene::Lod>& geometrylodbuff);
+
+static bool parsecsg(Tokenizer& tk, std::vector<Csg::Node>& out, int depth);
+
+static int findshape(const std::vector<Shape>& shapelist, const std::string& name);
+
+static int addgeometry(const std::vector<float>& pl, std::vector<float>& plbuff, std::vector<Scene::Range>& geometrybuff, std::map<std::vector<float>, int>& geometrymap);
+
+static std::string siblingpath(const char* file, const std::string& name);
+
+
+bool Scene::Convert(const char* textfile, const char* binfile) {
+
+    /*
+        Convert a text scene file into a binary scene file.
+
+        Text format:
+
+            shape <name>                        define a unit shape from plane rows of POINTS_PER_UNIT floats
+                <pos.xyzw> <normal.xyzw> <u-axis.xyzw>
+                ...
+            end
+
+            object <motion>                     motion: static | rotatez | translate | orbit
+                matrix <16 floats, row major>   initial model matrix (identity if omitted)
+                param <4 floats>                motion parameters (rotatez: -1/800 rad per ms if omitted, others: 0)
+                unit <shape> [<texscale.x> <texscale.y>]
+                mesh <file> [<texscale.x> <texscale.y>]     units imported from an OBJ/PLY file (relative to the text file), combined by their own tree
+                ...
+                csg <tree>                      CSG tree of the units (the first unit or mesh minus the others if omitted)
+            end
+
+            tree: <unit index> | union <tree> <tree> | intersect <tree> <tree> | subtract <tree> <tree>    (prefix, units from 0)
+
+        Built-in shapes (Unit.h): default, cube, subcube, largecube, largesubcube, octahedron, suboctahedron.
+    */
+
+    #define BUILTINSIZE 7
+
+    const char* motionname[MOTIONSIZE] = { "static", "rotatez", "translate", "orbit" };
+
+
+    std::string text; if (!readtext(textfile, text)) { std::cout << "Error: Scene text file cannot be opened. (\"" << textfile << "\")\n"; return false; }
+
+    std::vector<Shape> shapelist; {
+
+        struct Builtin { const char* name; const float* buff; int size; };
+
+        const Builtin builtin[BUILTINSIZE] = {
+            { "default", defaultunit[0], sizeof(defaultunit) / sizeof(float) },
+            { "cube", cubeunit[0], sizeof(cubeunit) / sizeof(float) },
+            { "subcube", subcubeunit[0], sizeof(subcubeunit) / sizeof(float) },
+            { "largecube", largecubeunit[0], sizeof(largecubeunit) / sizeof(float) },
+            { "largesubcube", largesubcubeunit[0], sizeof(largesubcubeunit) / sizeof(float) },
+            { "octahedron", octahedronunit[0], sizeof(octahedronunit) / sizeof(float) },
+            { "suboctahedron", suboctahedronunit[0], sizeof(suboctahedronunit) / sizeof(float) }
+        };
+
+        for (int n = 0; n < BUILTINSIZE; ++n) { shapelist.push_back({ builtin[n].name, std::vector<float>(builtin[n].buff, builtin[n].buff + builtin[n].size), -1 }); }
+
+    }
+
+    std::vector<float> plbuff; std::vector<Unit> unitbuff; std::vector<Range> geometrybuff; std::vector<int> unitgeometrybuff; std::vector<Object> objectbuff;
+
+    std::map<std::vector<float>, int> geometrymap;                      // deduplicate geometries by plane data
+
+    std::vector<std::vector<Csg::Node>> treebuff;                       // CSG trees per object
+
+    std::map<std::string, Mesh::Decomposition> meshmap;                 // imported meshes by file
+
+    Jobs jobs;
+
+    Tokenizer tk = { text.data(), text.data() + text.size() };
+
+    bool valid = true; std::string token;
+
+    // process through the statements
+
+    while (valid && tk.Next(token)) {
+
+        if (token == "shape") {
+
+            Shape shape = { "", {}, -1 }; valid = tk.Next(shape.name);
+
+            while (valid && tk.Next(token) && token != "end") {
+
+                float val = 0.0f; valid = tofloat(token, val); shape.pl.push_back(val);
+
+                for (int i = 1; valid && i < POINTS_PER_UNIT; ++i) { valid = tk.NextFloat(val); shape.pl.push_back(val); }
+
+            }
+
+            valid = valid && token == "end" && !shape.pl.empty();
+
+            int index = findshape(shapelist, shape.name);
+            if (index < 0) { shapelist.push_back(shape); } else { shapelist[index] = shape; }
+
+        }
+        else if (token == "object") {
+
+            Object object = {}; object.motion = -1; for (int i = 0; i < 4; ++i) { object.modelmat4[i][i] = 1.0f; }
+
+            valid = tk.Next(token);
+            for (int i = 0; i < MOTIONSIZE; ++i) { if (token == motionname[i]) object.motion = i; }
+            valid = valid && object.motion >= 0;
+
+            if (object.motion == MOTION_ROTATEZ) object.motionparam[0] = -1.0f / 800.0f;
+
+            object.unitstart = (int)unitbuff.size();
+
+            std::vector<Csg::Node> tree, itemtree; std::vector<int> itemroot; bool csg = false;     // item: a unit or a mesh (by its tree)
+
+            while (valid && tk.Next(token) && token != "end") {
+
+                if (token == "matrix") {
+
+                    for (int i = 0; valid && i < 16; ++i) { valid = tk.NextFloat(object.modelmat4[i / 4][i % 4]); }
+
+                }
+                else if (token == "param") {
+
+                    for (int i = 0; valid && i < 4; ++i) { valid = tk.NextFloat(object.motionparam[i]); }
+
+                }
+                else if (token == "unit" || token == "mesh") {
+
+                    bool mesh = token == "mesh"; std::string name; valid = tk.Next(name);
+
+                    Unit unit = {}; unit.texscale[0] = 1.0f; unit.texscale[1] = 1.0f;
+
+                    const char* back = tk.ptr; int backline = tk.line;         // texscale is optional
+                    if (!(tk.NextFloat(unit.texscale[0]) && tk.NextFloat(unit.texscale[1]))) {
+                        tk.ptr = back; tk.line = backline; unit.texscale[0] = 1.0f; unit.texscale[1] = 1.0f;
+                    }
+
+                    if (!valid) break;
+
+                    int unitstart = (int)unitbuff.size() - object.unitstart;
+
+                    if (mesh) {                                         // import a mesh file once, and add its parts as units
+
+                        std::string file = siblingpath(textfile, name);
+
+                        auto res = meshmap.insert({ file, Mesh::Decomposition() });
+                        if (res.second && !Mesh::Import(file.c_str(), res.first->second, &jobs)) return false;
+
+                        const Mesh::Decomposition& d = res.first->second;
+
+                        for (const std::vector<float>& pl : d.part) {
+                            unitgeometrybuff.push_back(addgeometry(pl, plbuff, geometrybuff, geometrymap)); unitbuff.push_back(unit);
+                        }
+
+                        int nodestart = (int)itemtree.size();
+
+                        for (Csg::Node node : d.tree) {
+                            if (node.op == Csg::OP_LOAD) { node.left += unitstart; } else { node.left += nodestart; node.right += nodestart; }
+                            itemtree.push_back(node);
+                        }
+
+                    }
+                    else {
+
+                        int index = findshape(shapelist, name); valid = index >= 0;
+
+                        if (!valid) break;
+
+                        Shape& shape = shapelist[index];
+
+                        if (shape.geometry < 0) shape.geometry = addgeometry(shape.pl, plbuff, geometrybuff, geometrymap);     // write the planes of a shape only once
+
+                        unitgeometrybuff.push_back(shape.geometry); unitbuff.push_back(unit);
+
+                        itemtree.push_back({ Csg::OP_LOAD, unitstart, -1 });
+
+                    }
+
+                    itemroot.push_back((int)itemtree.size() - 1);
+
+                }
+                else if (token == "csg") {
+
+                    tree.clear(); valid = parsecsg(tk, tree, 0); csg = true;
+
+                }
+                else { valid = false; }
+
+            }
+
+            object.unitsize = (int)unitbuff.size() - object.unitstart;
+            valid = valid && token == "end" && object.unitsize > 0;
+
+            if (!csg && !itemroot.empty()) {                            // the first item minus the others
+                tree.swap(itemtree);
+                for (size_t m = 1; m < itemroot.size(); ++m) { tree.push_back({ Csg::OP_SUBTRACT, (m == 1) ? itemroot[0] : (int)tree.size() - 1, itemroot[m] }); }
+            }
+
+            for (const Csg::Node& node : tree) { valid = valid && (node.op != Csg::OP_LOAD || node.left < object.unitsize); }
+
+            for (int n = object.unitstart; n < object.unitstart + object.unitsize; ++n) {
+                std::memcpy(unitbuff[n].modelmat4, object.modelmat4, sizeof(object.modelmat4));     // units start with the object's matrix
+            }
+
+            objectbuff.push_back(object); treebuff.push_back(tree);
+
+        }
+        else { valid = false; }
+
+    }
+
+    if (!valid) { std::cout << "Error: Scene text format error at line " << tk.line << ". (\"" << textfile << "\")\n"; return false; }
+
+
+    // redundant planes (in parallel over the geometries): keep the planes which bound the units, and merge the geometries left the same
+
+    int redundantsize = 0, mergedsize = 0; {
+
+        std::vector<std::vector<float>> reduced(geometrybuff.size());
+
+        Polytope::Reduce((const float(*)[POINTS_PER_UNIT])plbuff.data(), geometrybuff.data(), (int)geometrybuff.size(), reduced.data(), &jobs);
+
+        std::vector<float> reducedplbuff; std::vector<Range> reducedgeometrybuff; std::map<std::vector<float>, int> reducedmap; std::vector<int> handle(geometrybuff.size());
+
+        for (size_t g = 0; g < geometrybuff.size(); ++g) {
+            redundantsize += geometrybuff[g].plsize - (int)(reduced[g].size() / POINTS_PER_UNIT);
+            handle[g] = addgeometry(reduced[g], reducedplbuff, reducedgeometrybuff, reducedmap);
+        }
+
+        for (int& geometry : unitgeometrybuff) { geometry = handle[geometry]; }
+
+        mergedsize = (int)(geometrybuff.size() - reducedgeometrybuff.size());
+
+        plbuff.swap(reducedplbuff); geometrybuff.swap(reducedgeometrybuff);
+
+    }
+
+    // bounds (in parallel over the geometries)
+
+    std::vector<Bounds> geometryboundsbuff(geometrybuff.size()), objectboundsbuff;
+
+    Polytope::Bound((const float(*)[POINTS_PER_UNIT])plbuff.data(), geometrybuff.data(), (int)geometrybuff.size(), geometryboundsbuff.data(), &jobs);
+
+    // levels of detail (in parallel over the geometries, appended as geometries of their own)
+
+    const int geometrysize = (int)geometrybuff.size();
+
+    std::vector<Lod> geometrylodbuff(geometrysize, { -1, 0.0f }); {
+
+        std::vector<std::vector<Polytope::Level>> level(geometrysize);
+
+        Polytope::Coarsen((const float(*)[POINTS_PER_UNIT])plbuff.data(), geometrybuff.data(), geometrysize, level.data(), &jobs);
+
+        for (int g = 0; g < geometrysize; ++g) {
+            for (size_t l = 0; l < level[g].size(); ++l) {
+
+                int coarse = (int)geometrybuff.size();                  // (not deduplicated: a geometry is in one chain)
+
+                geometrylodbuff[(l == 0) ? g : coarse - 1].next = coarse; geometrylodbuff.push_back({ -1, level[g][l].error });
+
+                geometrybuff.push_back({ (int)(plbuff.size() / POINTS_PER_UNIT), (int)(level[g][l].pl.size() / POINTS_PER_UNIT) });
+                plbuff.insert(plbuff.end(), level[g][l].pl.begin(), level[g][l].pl.end());
+
+            }
+        }
+
+        geometryboundsbuff.resize(geometrybuff.size());
+
+        Polytope::Bound((const float(*)[POINTS_PER_UNIT])plbuff.data(), geometrybuff.data() + geometrysize, (int)geometrybuff.size() - geometrysize, geometryboundsbuff.data() + geometrysize, &jobs);
+
+    }
+
+    // selection programs (only the units left in the programs are written)
+
+    std::vector<Unit> programunitbuff; std::vector<int> programunitgeometrybuff, programbuff;
+
+    for (size_t n = 0; n < objectbuff.size(); ++n) {
+
+        Object& object = objectbuff[n]; const std::vector<Csg::Node>& tree = treebuff[n];
+
+        std::vector<int> unitkey(object.unitsize); std::vector<Bounds> unitbounds(object.unitsize);
+
+        for (int m = 0; m < object.unitsize; ++m) {
+
+            const Unit& unit = unitbuff[object.unitstart + m]; int geometry = unitgeometrybuff[object.unitstart + m];
+
+            unitkey[m] = m;                                             // units of the same geometry and texscale are the same
+            for (int k = 0; k < m && unitkey[m] == m; ++k) {
+                if (unitgeometrybuff[object.unitstart + k] == geometry && std::memcmp(unitbuff[object.unitstart + k].texscale, unit.texscale, sizeof(unit.texscale)) == 0) unitkey[m] = k;
+            }
+
+            unitbounds[m] = geometryboundsbuff[geometry];
+
+        }
+
+        Csg::Program program;
+
+        if (!Csg::Compile(tree, (int)tree.size() - 1, unitkey.data(), unitbounds.data(), program)) {
+            std::cout << "Error: Scene object " << n << " has more than " << Csg::MAXLEAFSIZE << " units left in its CSG tree, or the tree is too deep. (\"" << textfile << "\")\n"; return false;
+        }
+
+        int unitstart = object.unitstart;
+
+        object.unitstart = (int)programunitbuff.size(); object.unitsize = (int)program.leaf.size();
+        object.programstart = (int)programbuff.size(); object.programsize = program.size;
+
+        for (int leaf : program.leaf) { programunitbuff.push_back(unitbuff[unitstart + leaf]); programunitgeometrybuff.push_back(unitgeometrybuff[unitstart + leaf]); }
+
+        programbuff.insert(programbuff.end(), program.code, program.code + program.size);
+
+        objectboundsbuff.push_back(program.bounds);
+
+    }
+
+    int prunedsize = (int)(unitbuff.size() - programunitbuff.size());
+
+    unitbuff.swap(programunitbuff); unitgeometrybuff.swap(programunitgeometrybuff);
+
+    int unboundedsize = 0, emptysize = 0;
+    for (const Bounds& bounds : geometryboundsbuff) { unboundedsize += bounds.state == BOUNDS_UNBOUNDED; emptysize += bounds.state == BOUNDS_EMPTY; }
+
+    if (emptysize > 0) { std::cout << "# Warning: " << emptysize << " unit geometries are empty (no common region of their planes). (\"" << textfile << "\")\n"; }
+
+    if (!writebinary(binfile, plbuff, unitbuff, geometrybuff, unitgeometrybuff, objectbuff, geometryboundsbuff, objectboundsbuff, programbuff, geometrylodbuff)) { std::cout << "Error: Scene file cannot be written. (\"" << binfile << "\")\n"; return false; }
+
+    std::cout << "# Converted scene \"" << textfile << "\" to \"" << binfile << "\". (" << objectbuff.size() << " objects, " << unitbuff.size() << " units, " << geometrysize << " geometries, " << geometrybuff.size() - geometrysize << " lod geometries, " << plbuff.size() / POINTS_PER_UNIT << " planes, " << unboundedsize << " unbounded geometries, " << prunedsize << " units pruned, " << redundantsize << " redundant planes removed, " << mergedsize << " geometries merged)\n";
+
+    return true;
+
+}
+
+
+// *****************************************
+//  Import
+// *****************************************
+
+static void writecsg(const std::vector<Csg::Node>& tree, int node, std::string& out);
+
+bool Scene::Import(const char* meshfile, const char* textfile) {
+
+    /*
+        Write a text scene file of a mesh: its parts as shapes ("<name>0", "<name>1", .. after the mesh file name) and a static object of them.
+
+        The shapes can be edited, or copied into other scenes, as hand-written ones.
+    */
+
+    Mesh::Decomposition d; { Jobs jobs; if (!Mesh::Import(meshfile, d, &jobs)) return false; }
+
+    std::string name(meshfile); {
+        size_t slash = name.find_last_of("/\\"); if (slash != std::string::npos) name.erase(0, slash + 1);
+        size_t dot = name.rfind('.'); if (dot != std::string::npos) name.erase(dot);
+    }
+
+    FILE* fp = std::fopen(textfile, "w"); if (!fp) { std::cout << "Error: Scene text file cannot be written. (\"" << textfile << "\")\n"; return false; }
+
+    std::fprintf(fp, "# imported from \"%s\" (%d triangles)\n\n", meshfile, d.trianglesize);
+
+    for (size_t n = 0; n < d.part.size(); ++n) {
+
+        std::fprintf(fp, "shape %s%d\n", name.c_str(), (int)n);
+
+        for (size_t r = 0; r < d.part[n].size(); r += POINTS_PER_UNIT) {
+            std::fprintf(fp, "   ");
+            for (int i = 0; i < POINTS_PER_UNIT; ++i) { std::fprintf(fp, " %.9g", d.part[n][r + i] + 0.0f); }     // (+ 0.0f: no "-0")
+            std::fprintf(fp, "\n");
+        }
+
+        std::fprintf(fp, "end\n\n");
+
+    }
+
+    std::string csg; writecsg(d.tree, (int)d.tree.size() - 1, csg);
+
+    std::fprintf(fp, "object static\n");
+    for (size_t n = 0; n < d.part.size(); ++n) { std::fprintf(fp, "    unit %s%d\n", name.c_str(), (int)n); }
+    std::fprintf(fp, "    csg%s\nend\n", csg.c_str());
+
+    bool res = std::fclose(fp) == 0;
+
+    if (!res) { std::cout << "Error: Scene text file cannot be written. (\"" << textfile << "\")\n"; return false; }
+
+    std::cout << "# Wrote scene \"" << textfile << "\".\n";
+
+    return true;
+
+}
+
+static void writecsg(const std::vector<Csg::Node>& tree, int node, std::string& out) {
+
+    /* Write a CSG tree in prefix notation. */
+
+    const char* opname[Csg::OPSIZE] = { "", "union", "intersect", "subtract", "" };
+
+    if (tree[node].op == Csg::OP_LOAD) { out += " " + std::to_string(tree[node].left); return; }
+
+    out += std::string(" ") + opname[tree[node].op];
+
+    writecsg(tree, tree[node].left, out); writecsg(tree, tree[node].right, out);
+
+}
+
+
+// *****************************************
+
+// *****************************************
+
+bool Tokenizer::Next(std::string& out) {
+
+    /* Get the next token. */
+
+    for (;;) {
+
+        while (ptr < end && (*ptr == ' ' || *ptr == '\t' || *ptr == '\r' || *ptr == '\n')) { line += (*ptr == '\n'); ++ptr; }
+
+        if (ptr < end && *ptr == '#') { while (ptr < end && *ptr != '\n') { ++ptr; } continue; }
+
+        break;
+
+    }
+
+    if (ptr >= end) return false;
+
+    const char* start = ptr; while (ptr < end && !(*ptr == ' ' || *ptr == '\t' || *ptr == '\r' || *ptr == '\n' || *ptr == '#')) { ++ptr; }
+
+    out.assign(start, ptr);
+
+    return true;
+
+}
+
+bool Tokenizer::NextFloat(float& out) {
+
+    /* Get the next token as a float. (Fail if the token is not a number.) */
+
+    std::string token; return Next(token) && tofloat(token, out);
+
+}
+
+static bool tofloat(const std::string& token, float& out) {
+
+    /* Convert a token to a float. (Fail if the token is not a number.) */
+
+    char* tail = nullptr; float val = std::strtof(token.c_str(), &tail);
+    if (token.empty() || tail != token.c_str() + token.size()) return false;
+
+    out = val; return true;
+
+}
+
+static bool readtext(const char* file, std::string& out) {
+
+    /* Read a whole text file. */
+
+    FILE* fp = std::fopen(file, "rb"); if (!fp) return false;
+
+    std::fseek(fp, 0, SEEK_END); long size = std::ftell(fp); std::fseek(fp, 0, SEEK_SET);
+
+    out.assign(size > 0 ? size : 0, '\0');
+    bool res = size <= 0 || std::fread(&out[0], 1, size, fp) == (size_t)size;
+
+
+    std::fclose(fp);
+
+    return res;
+
+}
+
+static bool writebinary(const char* file, const std::vector<float>& plbuff, const std::vector<Scene::Unit>& unitbuff,
+    const std::vector<Scene::Range>& geometrybuff, const std::vector<int>& unitgeometrybuff, const std::vector<Scene::Object>& objectbuff,
+    const std::vector<Scene::Bounds>& geometryboundsbuff, const std::vector<Scene::Bounds>& objectboundsbuff, const std::vector<int>& programbuff,
+    const std::vector<Scene::Lod>& geometrylodbuff) {
+
+    /* Write the sections with a header into a binary scene file. */
+
+    #define SECTIONALIGN 16
+
+    struct Data { const void* ptr; unsigned int elmsize, count; };
+
+    const Data datalist[Scene::SECTIONIDSIZE] = {
+        { plbuff.data(), sizeof(float) * POINTS_PER_UNIT, (unsigned int)(plbuff.size() / POINTS_PER_UNIT) },
+        { unitbuff.data(), sizeof(Scene::Unit), (unsigned int)unitbuff.size() },
+        { geometrybuff.data(), sizeof(Scene::Range), (unsigned int)geometrybuff.size() },
+        { unitgeometrybuff.data(), sizeof(int), (unsigned int)unitgeometrybuff.size() },
+        { objectbuff.data(), sizeof(Scene::Object), (unsigned int)objectbuff.size() },
+        { geometryboundsbuff.data(), sizeof(Scene::Bounds), (unsigned int)geometryboundsbuff.size() },
+        { objectboundsbuff.data(), sizeof(Scene::Bounds), (unsigned int)objectboundsbuff.size() },
+        { programbuff.data(), sizeof(int), (unsigned int)programbuff.size() },
+        { geometrylodbuff.data(), sizeof(Scene::Lod), (unsigned int)geometrylodbuff.size() }
+    };
+
+    Scene::Header header = { { 'D', 'B', 'R', 'S' }, Scene::VERSION, Scene::SECTIONIDSIZE, 0 };
+
+    Scene::Section section[Scene::SECTIONIDSIZE] = {}; {
+
+        unsigned long long offset = sizeof(header) + sizeof(section);
+
+        for (unsigned int n = 0; n < Scene::SECTIONIDSIZE; ++n) {
+
+            offset = (offset + SECTIONALIGN - 1) / SECTIONALIGN * SECTIONALIGN;
+
+            section[n] = { n, datalist[n].elmsize, datalist[n].count, 0, offset };
+
+            offset += (unsigned long long)datalist[n].elmsize * datalist[n].count;
+
+        }
+
+    }
+
+    FILE* fp = std::fopen(file, "wb"); if (!fp) return false;
+
+    bool res = std::fwrite(&header, sizeof(header), 1, fp) == 1 && std::fwrite(section, sizeof(section), 1, fp) == 1;
+
+    unsigned long long offset = sizeof(header) + sizeof(section);
+
+    for (int n = 0; res && n < Scene::SECTIONIDSIZE; ++n) {
+
+        const char zero[SECTIONALIGN] = {};
+        res = std::fwrite(zero, 1, (size_t)(section[n].offset - offset), fp) == section[n].offset - offset;     // padding
+
+        unsigned long long size = (unsigned long long)datalist[n].elmsize * datalist[n].count;
+        res = res && (size == 0 || std::fwrite(datalist[n].ptr, (size_t)size, 1, fp) == 1);
+
+        offset = section[n].offset + size;
+
+    }
+
+
+    res = (std::fclose(fp) == 0) && res;
+
+    return res;
+
+}
+
+static bool parsecsg(Tokenizer& tk, std::vector<Csg::Node>& out, int depth) {
+
+    /* Parse a CSG tree in prefix notation. The nodes are appended children first (the root is the last). */
+
+    const char* opname[Csg::OPSIZE] = { "", "union", "intersect", "subtract", "" };
+
+    std::string token; if (depth > 32 || !tk.Next(token)) return false;
+
+    for (int op = Csg::OP_UNION; op <= Csg::OP_SUBTRACT; ++op) {
+
+        if (token != opname[op]) continue;
+
+        if (!parsecsg(tk, out, depth + 1)) return false;
+        int left = (int)out.size() - 1;
+
+        if (!parsecsg(tk, out, depth + 1)) return false;
+
+        out.push_back({ op, left, (int)out.size() - 1 }); return true;
+
+    }
+
+    char* tail = nullptr; long unit = std::strtol(token.c_str(), &tail, 10);
+    if (token.empty() || tail != token.c_str() + token.size() || unit < 0 || unit > 0xFFFF) return false;
+
+    out.push_back({ Csg::OP_LOAD, (int)unit, -1 }); return true;
+
+}
+
+static int findshape(const std::vector<Shape>& shapelist, const std::string& name) {
+    /* Find a unit shape by name. */
+    for (int n = 0; n < (int)shapelist.size(); ++n) { if (shapelist[n].name == name) return n; } return -1;
+}
+
+static int addgeometry(const std::vector<float>& pl, std::vector<float>& plbuff, std::vector<Scene::Range>& geometrybuff, std::map<std::vector<float>, int>& geometrymap) {
+
+    /* Add the planes of a unit geometry, or find the same planes added already. Return the geometry handle. */
+
+    auto res = geometrymap.insert({ pl, (int)geometrybuff.size() });
+
+    if (res.second) {
+        geometrybuff.push_back({ (int)(plbuff.size() / POINTS_PER_UNIT), (int)(pl.size() / POINTS_PER_UNIT) });
+        plbuff.insert(plbuff.end(), pl.begin(), pl.end());
+    }
+
+    return res.first->second;
+
+}
+
+static std::string siblingpath(const char* file, const std::string& name) {
+
+    /* Make the path of a file named relative to the directory of another file. (Absolute names are kept.) */
+
+    if (name.empty() || name[0] == '/' || name[0] == '\\' || (name.size() > 1 && name[1] == ':')) return name;
+
+    const char* slash = std::strrchr(file, '/'); const char* backslash = std::strrchr(file, '\\');
+    if (!slash || (backslash && backslash > slash)) slash = backslash;
+
+    return slash ? std::string(file, slash + 1) + name : name;
+
+}
+
+static bool istextsibling(const char* binfile, char* outtextfile, size_t len) {
+
+    /* Make the text scene file name of a binary scene file name. ("*.dbrs" -> "*.txt") */
+
+    const char* ext = std::strrchr(binfile, '.');
+    if (!ext || std::strcmp(ext, ".dbrs") != 0) return false;
+
+    int res = std::snprintf(outtextfile, len, "%.*s.txt", (int)(ext - binfile), binfile);
+
+    return res > 0 && (size_t)res < len;
+
+}
+
+static bool isnewer(const char* file, const char* thanfile) {
+
+    /* Test if a file exists and was modified after another one (or the other one is missing). */
+
+    struct stat filestat = {}, thanstat = {};
+
+    if (stat(file, &filestat) != 0) return false;
+
+    return stat(thanfile, &thanstat) != 0 || filestat.st_mtime > thanstat.st_mtime;
+
+}
+
+static bool isvalidsection(const Scene::Section& section, unsigned long long filesize) {
+
+    /* Test if a section lies within the file and is aligned for its elements. */
+
+    unsigned long long size = (unsigned long long)section.elmsize * section.count;
+
+    return section.offset % 4 == 0 && section.offset <= filesize && size <= filesize - section.offset;
+
+}
@@ -0,0 +1,150 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Scene class maps a binary scene file (*.dbrs) of Ray Units/Objects into memory.
+
+	The plane and unit sections of the file have the same layouts as the (UBO) Plane/Unit Buffers,
+	so they are uploaded to Gpu (or read by the Cpu) directly from the mapped memory.
+
+	Unit geometries (plane sets) are stored once and shared by handle, so plane data scale with distinct shapes, not with instances.
+
+	The extent of each unit geometry (polytope vertices, AABB and bounding sphere) is found once at conversion and stored in the file.
+
+	Coarser levels of detail of the unit geometries (fewer planes enclosing the unit) are made at conversion and chained per geometry.
+
+	The CSG tree of each object is compiled into a selection program at conversion, and only the units left in the program are stored.
+
+	Binary scene files are made from text scene files by Convert(..). (See "src/scene/default.txt" for the text format.)
+
+	Triangle meshes are imported as units at conversion ("mesh" statements), or written into text scene files by Import(..).
+
+*/
+
+#ifndef POINTS_PER_UNIT
+#define POINTS_PER_UNIT 12                                              // [(pos, 1.0), (normal, 0.0), (u-axis, 0.0)]
+#endif
+
+namespace ray {
+
+	class Scene;
+
+}
+
+class ray::Scene {
+
+	/*
+		In this class:
+
+			- Map a binary scene file and expose its sections without copying them.
+
+			- Convert a text scene file into a binary scene file.
+
+		File layout (little endian):
+
+			Header, Section[sectionsize], then the section data, each aligned to 16 bytes.
+	*/
+
+public:
+
+	enum Motion { MOTION_STATIC = 0, MOTION_ROTATEZ, MOTION_TRANSLATE, MOTION_ORBIT, MOTIONSIZE };	// ray object movements (see Motion.h)
+
+	enum SectionId { SECTION_PLANE = 0, SECTION_UNIT, SECTION_GEOMETRY, SECTION_UNITGEOMETRY, SECTION_OBJECT, SECTION_GEOMETRYBOUNDS, SECTION_OBJECTBOUNDS, SECTION_PROGRAM, SECTION_GEOMETRYLOD, SECTIONIDSIZE };
+
+	enum BoundsState { BOUNDS_BOUNDED = 0, BOUNDS_UNBOUNDED, BOUNDS_EMPTY };	// extent of the half-spaces of a unit (see Polytope.h)
+
+	struct Header {
+		/* This structure contains the file header. */
+		char magic[4]; unsigned int version, sectionsize, padding;		// magic: "DBRS"
+	};
+
+	struct Section {
+		/* This structure locates a section in the file. */
+		unsigned int id, elmsize, count, padding; unsigned long long offset;	// offset: byte offset from the file head
+	};
+
+	struct Unit {
+		/* This structure contains the per-instance attribute data of a Ray Unit. (The same as in (UBO) Unit Buffer.) */
+		float modelmat4[4][4]; float texscale[2], padding[2];			// texscale: scale factor of image texture (use negative val to flip tex)
+	};
+
+	struct Range {
+		/* This structure locates the planes of a unit geometry in the plane section. */
+		int plstart, plsize;
+	};
+
+	struct Object {
+		/* This structure contains the Ray Units and the initial attribute data of a Ray Object. */
+		int unitstart, unitsize, motion, padding; float modelmat4[4][4];	// motion: Motion
+		float motionparam[4];											// motionparam: parameters of the motion (see Motion.h)
+		int programstart, programsize, padding2[2];						// program: selection program of the units in the program section (see Csg.h)
+	};
+
+	struct Bounds {
+		/* This structure contains the bounds of a unit geometry or of an object in model space. (Unbounded axes: +-1.0e30) */
+		float min[3], max[3], center[3], radius;						// AABB and bounding sphere
+		int state, vertexsize;											// state: BoundsState, vertexsize: number of polytope vertices (0: unbounded or empty)
+	};
+
+	struct Lod {
+		/* This structure chains the levels of detail of a unit geometry. (Coarser levels are stored after their finer ones.) */
+		int next; float error;											// next: the next coarser geometry (-1: none), error: max distance outside the finest level
+	};
+
+	static const unsigned int VERSION = 6;
+
+
+	Scene(const char* file);											// map a binary scene file (converted from "*.txt" of the same name if missing)
+
+	~Scene(void);														// unmap
+
+	bool IsOpen(void) const;
+
+	int GetPlaneSize(void) const;
+
+	int GetUnitSize(void) const;
+
+	int GetGeometrySize(void) const;
+
+	int GetObjectSize(void) const;
+
+	const float (*GetPlaneBuff(void) const)[POINTS_PER_UNIT];			// plane section [planesize][POINTS_PER_UNIT]
+
+	const Unit* GetUnitBuff(void) const;								// unit section [unitsize]
+
+	const Range* GetGeometryBuff(void) const;							// geometry section [geometrysize]
+
+	const int* GetUnitGeometryBuff(void) const;							// unit geometry section [unitsize] (geometry handles of the units)
+
+	const Range& GetUnitRange(int unit) const;							// planes of a unit's geometry
+
+	const Object* GetObjectBuff(void) const;							// object section [objectsize]
+
+	const Bounds* GetGeometryBoundsBuff(void) const;					// geometry bounds section [geometrysize]
+
+	const Bounds* GetObjectBoundsBuff(void) const;						// object bounds section [objectsize] (bounds of the program results)
+
+	const int* GetProgramBuff(void) const;								// program section (codes of the selection programs)
+
+	const Lod* GetGeometryLodBuff(void) const;							// geometry lod section [geometrysize]
+
+
+	// ** static *******************************
+
+	static bool Convert(const char* textfile, const char* binfile);	// convert a text scene file into a binary scene file
+
+	static bool Import(const char* meshfile, const char* textfile);	// write a text scene file of a mesh file (see Mesh.h), as its shapes and an object
+
+private:
+
+	struct Map;															// platform dependent file mapping
+
+	Map* map;
+
+	const Section* section[SECTIONIDSIZE];
+
+	const void* GetSection(SectionId id) const;
+
+	Scene(const Scene&) = delete; Scene& operator=(const Scene&) = delete;
+
+};
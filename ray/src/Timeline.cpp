@@ -0,0 +1,171 @@
+/* ** EXPLANATION **
+
+    Timeline class records Cpu scopes and Gpu ranges of the frames, and writes them as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+
+*/
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <iostream>
+#include <memory>
+#include <mutex>
+#include <vector>
+
+#include "Timeline.h"                                                   // class ray::Timeline declared here
+
+
+using namespace ray;
+
+
+#define RINGSIZE 16384                                                  // events per ring (a power of 2)
+#define READMARGIN 256                                                  // events skipped at the oldest end of a ring read while being written
+
+namespace {
+
+    struct Event {
+        /* This structure contains a recorded range. */
+        const char* name; long long begin, end; int arg;                // begin, end: the Cpu clock (ns)
+    };
+
+    struct Ring {
+        /* This structure contains the events of a thread (or of the Gpu track). Written by its thread only. */
+        Event event[RINGSIZE];
+        std::atomic<unsigned long long> size{ 0 };                      // events written (the last RINGSIZE of them are kept)
+        int track = 0;                                                  // track id (0: the Gpu, 1..: Cpu threads in the order of their first event)
+    };
+
+}
+
+static std::atomic<bool> enabled{ false };
+
+static std::mutex ringmutex;                                            // guards the ring list (taken at the first event of a thread and by Write(..))
+static std::vector<std::unique_ptr<Ring>> ringlist;                     // rings are kept after their threads exit, to be written
+
+static const std::chrono::steady_clock::time_point base = std::chrono::steady_clock::now();
+
+static Ring* getring(bool gpu);
+
+static void push(Ring* ring, const char* name, long long begin, long long end, int arg);
+
+
+// *****************************************
+//  Record
+// *****************************************
+
+Timeline::Scope::Scope(const char* name) : name(name), begin(enabled.load(std::memory_order_relaxed) ? Now() : -1) {}
+
+Timeline::Scope::~Scope(void) { if (begin >= 0) push(getring(false), name, begin, Now(), -1); }
+
+void Timeline::Enable(bool enable) { enabled.store(enable); }
+
+bool Timeline::IsEnabled(void) { return enabled.load(std::memory_order_relaxed); }
+
+long long Timeline::Now(void) { return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - base).count(); }
+
+void Timeline::Record(const char* name, long long begin, long long end, int arg) { if (IsEnabled()) push(getring(false), name, begin, end, arg); }
+
+void Timeline::RecordGpu(const char* name, long long begin, long long end, int arg) { if (IsEnabled()) push(getring(true), name, begin, end, arg); }
+
+
+static Ring* getring(bool gpu) {
+
+    /* Return the ring of this thread (or the one of the Gpu track), made at the first event. */
+
+    thread_local Ring* ring = nullptr;
+    static Ring* gpuring = nullptr;
+
+    Ring*& res = gpu ? gpuring : ring;                                  // (the Gpu ring is written by the GL thread only)
+
+    if (!res) {
+
+        std::lock_guard<std::mutex> lock(ringmutex);
+
+        ringlist.emplace_back(new Ring);
+        res = ringlist.back().get();
+
+        int cpusize = 0; for (const std::unique_ptr<Ring>& r : ringlist) { cpusize += (r->track > 0); }
+        res->track = gpu ? 0 : cpusize + 1;
+
+    }
+
+    return res;
+
+}
+
+static void push(Ring* ring, const char* name, long long begin, long long end, int arg) {
+
+    /* Write an event, then publish it. (A reader skips the slots which may be rewritten while read.) */
+
+    unsigned long long n = ring->size.load(std::memory_order_relaxed);
+
+    ring->event[n & (RINGSIZE - 1)] = { name, begin, end, arg };
+
+    ring->size.store(n + 1, std::memory_order_release);
+
+}
+
+
+// *****************************************
+//  Write
+// *****************************************
+
+bool Timeline::Write(const char* file) {
+
+    /*
+        Write the events recorded as Chrome trace JSON: complete events ("X") in microseconds, a track (tid) per thread and one for the Gpu.
+
+        Events are read while the threads may go on writing: the slots a writer may have reached during the read are dropped.
+    */
+
+    FILE* fp = std::fopen(file, "w"); if (!fp) { std::cout << "Error: Trace file cannot be written. (\"" << file << "\")\n"; return false; }
+
+    std::lock_guard<std::mutex> lock(ringmutex);
+
+    std::fprintf(fp, "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n");
+
+    bool first = true; size_t eventsize = 0;
+
+    for (const std::unique_ptr<Ring>& ring : ringlist) {
+
+        std::fprintf(fp, "%s{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"name\":\"%s %d\"}}", first ? "" : ",\n",
+            ring->track, (ring->track == 0) ? "Gpu" : "Cpu", ring->track);
+        std::fprintf(fp, ",\n{\"name\":\"thread_sort_index\",\"ph\":\"M\",\"pid\":1,\"tid\":%d,\"args\":{\"sort_index\":%d}}", ring->track, ring->track);
+        first = false;
+
+        unsigned long long end = ring->size.load(std::memory_order_acquire);
+        unsigned long long begin = (end > RINGSIZE - READMARGIN) ? end - (RINGSIZE - READMARGIN) : 0;
+
+        std::vector<Event> event(end - begin);
+        for (unsigned long long n = begin; n < end; ++n) { event[n - begin] = ring->event[n & (RINGSIZE - 1)]; }
+
+        std::atomic_thread_fence(std::memory_order_acquire);            // (the copy is done before size is read again)
+
+        unsigned long long now = ring->size.load(std::memory_order_relaxed);    // slots rewritten during the read: [end - RINGSIZE, now - RINGSIZE]
+        unsigned long long valid = (now >= RINGSIZE) ? now - RINGSIZE + 1 : 0;  // (event now - RINGSIZE: its slot may be being written)
+
+        for (unsigned long long n = std::max(begin, valid); n < end; ++n) {
+
+            const Event& e = event[n - begin];
+
+            std::fprintf(fp, ",\n{\"name\":\"%s\",\"cat\":\"%s\",\"ph\":\"X\",\"pid\":1,\"tid\":%d,\"ts\":%.3f,\"dur\":%.3f",
+                e.name, (ring->track == 0) ? "gpu" : "cpu", ring->track, e.begin * 1.0e-3, (e.end - e.begin) * 1.0e-3);
+
+            if (e.arg >= 0) std::fprintf(fp, ",\"args\":{\"arg\":%d}", e.arg);
+
+            std::fprintf(fp, "}"); ++eventsize;
+
+        }
+
+    }
+
+    std::fprintf(fp, "\n]}\n");
+
+    if (std::fclose(fp) != 0) { std::cout << "Error: Trace file cannot be written. (\"" << file << "\")\n"; return false; }
+
+    std::cout << "# Wrote " << eventsize << " trace events to \"" << file << "\".\n";
+
+    return true;
+
+}
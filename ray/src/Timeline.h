@@ -0,0 +1,52 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Timeline class records Cpu scopes and Gpu ranges of the frames, and writes them as a Chrome trace (chrome://tracing, ui.perfetto.dev).
+
+*/
+
+namespace ray {
+
+	class Timeline;
+
+}
+
+class ray::Timeline {
+
+	/*
+		In this class:
+
+			- Record the Cpu scopes of a thread into a ring buffer of its own, without a lock: the thread is the only writer,
+			  and publishes the events by an atomic count. (A thread takes its ring at its first event.)
+
+			- Record the Gpu ranges (the timestamp queries of the passes read back, see Ray::EnableGpuTimer(..)) on a track of their own,
+			  shifted into the Cpu clock.
+
+			- Write the events in the rings as Chrome trace JSON on demand. (The oldest events of a full ring are overwritten.)
+
+		Event names are not copied: they must be string literals (or live as long as the program).
+	*/
+
+public:
+
+	struct Scope {
+		/* This structure records a Cpu scope, from its construction to its destruction. */
+		Scope(const char* name);
+		~Scope(void);
+		const char* name; long long begin;								// begin: -1: not recorded (disabled)
+	};
+
+	static void Enable(bool enable);									// start/stop recording (off by default, the events recorded are kept)
+
+	static bool IsEnabled(void);
+
+	static long long Now(void);											// the Cpu clock (ns)
+
+	static void Record(const char* name, long long begin, long long end, int arg = -1);	// record a Cpu range of this thread (arg >= 0: shown as an argument)
+
+	static void RecordGpu(const char* name, long long begin, long long end, int arg = -1);	// record a Gpu range (in the Cpu clock, recorded by the GL thread only)
+
+	static bool Write(const char* file);								// write the events recorded as Chrome trace JSON
+
+};
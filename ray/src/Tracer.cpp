@@ -0,0 +1,229 @@
+/* ** EXPLANATION **
+
+    Tracer class traces rays against Ray Objects on the Cpu, through a BVH over the objects.
+
+    Planes are (pos, normal, u-axis) rows with normals pointing out of the unit, as read by ray2.frag.
+
+*/
+
+#include <algorithm>
+#include <cmath>
+
+#include "Tracer.h"                                                     // class ray::Tracer declared here
+
+#include "constant.h"
+
+
+using namespace ray;
+
+
+#define PARALLELSIZE 256                                                // min number of objects updated as jobs
+
+const float BIGVAL = 1.0e30f;
+
+const Bvh::Box EMPTYBOX = { { BIGVAL, BIGVAL, BIGVAL }, { -BIGVAL, -BIGVAL, -BIGVAL } };
+
+
+// *****************************************
+//  Constructor
+// *****************************************
+
+Tracer::Tracer(const Residency* residency, Jobs* jobs) : residency(residency), jobs(jobs) {}
+
+
+// *****************************************
+//  Update
+// *****************************************
+
+namespace {
+
+    struct Context {
+        /* This structure contains a ray traced through the BVH. */
+        const void* tracer; float pos[3], dir[3];
+    };
+
+    struct UpdateContext {
+        /* This structure contains the objects to be updated as jobs. */
+        void* tracer; const int* object;                                // object: object list (nullptr: all)
+    };
+
+    struct UnitContext {
+        /* This structure contains a ray in the model space of an object, loading the intervals of its units. (Csg::Load) */
+        const Residency* residency; const int* geometry; float pos[3], dir[3];
+    };
+
+}
+
+void Tracer::Update(const float (*modelmat4list)[4][4], int objectsize, const int* moved, int movedsize) {
+
+    /*
+        Rebuild when the objects were added or removed: the bounds of all objects are set in parallel, then the BVH is built in parallel.
+        Otherwise refit the BVH for the moved objects only, or rebuild it if one of them was left out of it (empty) and has bounds now.
+    */
+
+    this->modelmat4list = modelmat4list;
+
+    if (valid && objectsize == bvh.GetItemSize()) {
+
+        if (movedsize == 0) return;
+
+        UpdateContext context = { this, moved };
+
+        jobs->Run(movedsize, PARALLELSIZE, ObjectTask, &context);      // a few moved objects are set on this thread
+
+        if (bvh.Refit(objectbox.data(), moved, movedsize)) return;
+
+        bvh.Build(objectbox.data(), objectsize, jobs);                  // an object left out (empty) has bounds now
+
+        return;
+
+    }
+
+    // rebuild
+
+    objectbox.resize(objectsize); inversebuff.resize(12 * (size_t)objectsize);
+
+    UpdateContext objectcontext = { this, nullptr };
+
+    jobs->Run(objectsize, PARALLELSIZE, ObjectTask, &objectcontext);
+
+    bvh.Build(objectbox.data(), objectsize, jobs);
+
+    valid = true;
+
+}
+
+void Tracer::Invalidate(void) { valid = false; }
+
+
+// *****************************************
+//  Trace
+// *****************************************
+
+int Tracer::Trace(const float pos[3], const float dir[3], float* outdist) const {
+
+    Context context = { this, { pos[0], pos[1], pos[2] }, { dir[0], dir[1], dir[2] } };
+
+    return bvh.Traverse(pos, dir, RAYDIST, Hit, &context, outdist);
+
+}
+
+
+// *****************************************
+
+// *****************************************
+
+void Tracer::SetObject(int object) {
+
+    /* Transform the bounds of the object's program result by the model matrix (center and extent), and invert the model matrix. */
+
+    Bvh::Box& box = objectbox[object]; box = EMPTYBOX;
+
+    float (*inverse)[4] = (float(*)[4])&inversebuff[12 * (size_t)object];
+
+    if (!residency->IsObject(object) || residency->GetUnitSize(object) > Residency::MAXENTRYUNITSIZE) return;
+
+    const float (*m)[4] = modelmat4list[object];
+
+    // inverse (affine)
+
+    float cof[3][3] = {};
+    for (int i = 0; i < 3; ++i) {
+        for (int j = 0; j < 3; ++j) {
+            int i1 = (i + 1) % 3, i2 = (i + 2) % 3, j1 = (j + 1) % 3, j2 = (j + 2) % 3;
+            cof[i][j] = m[j1][i1] * m[j2][i2] - m[j1][i2] * m[j2][i1];  // transposed cofactor
+        }
+    }
+
+    float det = m[0][0] * cof[0][0] + m[0][1] * cof[1][0] + m[0][2] * cof[2][0];
+
+    if (std::fabs(det) < 1.0e-12f) return;                              // degenerate: not traced
+
+    for (int i = 0; i < 3; ++i) {
+        inverse[i][3] = 0.0f;
+        for (int j = 0; j < 3; ++j) { inverse[i][j] = cof[i][j] / det; }
+        for (int j = 0; j < 3; ++j) { inverse[i][3] -= inverse[i][j] * m[j][3]; }
+    }
+
+    // bounds
+
+    const Scene::Bounds& local = residency->GetObjectBounds(object);
+
+    if (local.state == Scene::BOUNDS_EMPTY) return;
+
+    for (int i = 0; i < 3; ++i) {
+
+        float center = m[i][3], extent = 0.0f;
+
+        for (int j = 0; j < 3; ++j) {
+            center += m[i][j] * 0.5f * (local.min[j] + local.max[j]); extent += std::fabs(m[i][j]) * 0.5f * (local.max[j] - local.min[j]);
+        }
+
+        box.min[i] = center - extent; box.max[i] = center + extent;
+
+    }
+
+}
+
+void Tracer::ObjectTask(void* context, int begin, int end) {
+
+    /* Set the objects [begin, end) of the list (or of all). */
+
+    const UpdateContext& c = *(const UpdateContext*)context;
+    Tracer& tracer = *(Tracer*)c.tracer;
+
+    for (int n = begin; n < end; ++n) { tracer.SetObject(c.object ? c.object[n] : n); }
+
+}
+
+static void unitinterval(void* context, int operand, Csg::Interval& out);
+
+float Tracer::Hit(void* context, int object, float tmax) {
+
+    /*
+        Intersect the ray with an object in model space (the ray parameter does not change by an affine map).
+
+        The intervals of the units are combined by the object's program like select.frag, keeping the front piece if split.
+    */
+
+    const Context& c = *(const Context*)context;
+    const Tracer& tracer = *(const Tracer*)c.tracer;
+
+    const float (*inverse)[4] = (const float(*)[4])&tracer.inversebuff[12 * (size_t)object];
+
+    UnitContext unit = { tracer.residency, tracer.residency->GetUnitGeometry(object), {}, {} };
+
+    for (int i = 0; i < 3; ++i) {
+        unit.pos[i] = inverse[i][3];
+        for (int j = 0; j < 3; ++j) { unit.pos[i] += inverse[i][j] * c.pos[j]; unit.dir[i] += inverse[i][j] * c.dir[j]; }
+    }
+
+    Csg::Interval res = Csg::Run(tracer.residency->GetProgram(object), tracer.residency->GetProgramSize(object), unitinterval, &unit);
+
+    return (res.t[0] < res.t[1] && res.t[0] < tmax) ? res.t[0] : -1.0f;
+
+}
+
+static void unitinterval(void* context, int operand, Csg::Interval& out) {
+
+    /* Clip the ray by the planes of a unit. */
+
+    const UnitContext& c = *(const UnitContext*)context;
+
+    const int plsize = c.residency->GetGeometryRange(c.geometry[operand]).plsize;
+    const float (*pl)[POINTS_PER_UNIT] = c.residency->GetGeometryPlanes(c.geometry[operand]);
+
+    out.t[0] = 0.0f; out.t[1] = RAYDIST;
+
+    for (int n = 0; n < plsize && out.t[0] < out.t[1]; ++n) {
+
+        float sdist = 0.0f, cosine = 0.0f;                              // signed distance from the plane, cos to the normal
+        for (int i = 0; i < 3; ++i) { sdist += pl[n][4 + i] * (c.pos[i] - pl[n][i]); cosine += pl[n][4 + i] * c.dir[i]; }
+
+        if (cosine < 0.0f) { out.t[0] = std::max(out.t[0], -sdist / cosine); }         // entering
+        else if (cosine > 0.0f) { out.t[1] = std::min(out.t[1], -sdist / cosine); }    // leaving
+        else if (sdist > 0.0f) { out.t[1] = -1.0f; }                                    // parallel outside
+
+    }
+
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	Tracer class traces rays against Ray Objects on the Cpu, through a BVH over the objects.
+
+	A ray is tested against an object the same way as the Ray2 and Selection calculations on the Gpu:
+	the ray intervals in the units, combined by the object's selection program (see Csg.h).
+
+*/
+
+#include <vector>
+
+#include "Residency.h"                                                  // class ray::Residency (and ray::Scene) declared here
+#include "Bvh.h"                                                        // class ray::Bvh (and ray::Jobs) declared here
+
+namespace ray {
+
+	class Tracer;
+
+}
+
+class ray::Tracer {
+
+	/*
+		In this class:
+
+			- Bound each object by the bounds of its program result and its model matrix.
+
+			- Refit the BVH for moved objects every frame, and rebuild it in parallel after objects are added or removed.
+
+			- Trace rays front to back through the BVH, testing the objects in model space.
+
+		Objects and geometries are read from Residency, which holds both the scene objects and the runtime objects.
+	*/
+
+public:
+
+	Tracer(const Residency* residency, Jobs* jobs);
+
+	void Update(const float (*modelmat4list)[4][4], int objectsize, const int* moved, int movedsize);
+																		// refit for moved objects (rebuild if invalidated or resized)
+
+	void Invalidate(void);												// objects were added or removed (rebuilt in the next Update(..))
+
+	int Trace(const float pos[3], const float dir[3], float* outdist) const;	// return the closest object hit by a ray (-1: none)
+																		// outdist: hit distance in units of dir
+
+private:
+
+	const Residency* residency; Jobs* jobs;
+
+	std::vector<Bvh::Box> objectbox;									// per object (world space, empty: not traced)
+
+	std::vector<float> inversebuff;										// inverse model matrices per object [objectsize][3][4]
+
+	const float (*modelmat4list)[4][4] = nullptr;						// (given to the last Update(..))
+
+	Bvh bvh; bool valid = false;
+
+	void SetObject(int object);											// set the bounds and the inverse matrix of an object
+
+	static void ObjectTask(void* context, int begin, int end);			// Jobs::Task
+
+	static float Hit(void* context, int object, float tmax);			// Bvh::Hit
+
+};
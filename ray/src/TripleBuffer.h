@@ -0,0 +1,56 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	TripleBuffer class passes the latest state from a writer thread to a reader thread without a lock, and without either waiting.
+
+*/
+
+#include <atomic>
+
+namespace ray {
+
+	template <typename T> class TripleBuffer;
+
+}
+
+template <typename T> class ray::TripleBuffer {
+
+	/*
+		In this class:
+
+			- Keep 3 copies of the state: one written by the writer (back), one read by the reader (front), and the latest one
+			  published between them (middle).
+
+			- Publish(): the writer swaps its back copy with the middle one, marked new. Read(): the reader swaps its front copy
+			  with the middle one if it is new. Each is a single atomic exchange: the writer may publish any number of times
+			  between reads, and the reader gets the latest state, whole.
+
+		One writer thread and one reader thread (they may be the same thread).
+	*/
+
+public:
+
+	TripleBuffer(const T& value = T()) { for (T& b : buffer) b = value; }
+
+	T& Back(void) { return buffer[back]; }								// the copy to be written (writer)
+
+	void Publish(void) { back = middle.exchange(back | NEW, std::memory_order_acq_rel) & INDEX; }	// publish the back copy (writer)
+
+	const T& Read(void) {												// the latest copy published (reader)
+		if (middle.load(std::memory_order_acquire) & NEW) front = middle.exchange(front, std::memory_order_acq_rel) & INDEX;
+		return buffer[front];
+	}
+
+private:
+
+	static const unsigned int INDEX = 3, NEW = 4;						// middle: index of the copy, and new bit (not read yet)
+
+	T buffer[3];
+
+	unsigned int back = 0, front = 1;									// (owned by the writer, the reader)
+	std::atomic<unsigned int> middle{ 2 };
+
+	TripleBuffer(const TripleBuffer&) = delete; TripleBuffer& operator=(const TripleBuffer&) = delete;
+
+};
@@ -0,0 +1,250 @@
+/* ** EXPLANATION **
+
+    VideoStream class writes the frames read back by Ray (see Ray::SetExport(..)) as a raw video stream to stdout, a named pipe or a file.
+
+*/
+
+#include <algorithm>
+#include <csignal>
+#include <cstring>
+#include <iostream>
+
+#if defined(_WIN32)
+#include <fcntl.h>
+#include <io.h>
+#else
+#include <unistd.h>
+#endif
+
+#include "VideoStream.h"                                                // class ray::VideoStream declared here
+
+#include "constant.h"
+
+
+using namespace ray;
+
+
+struct VideoStream::Item {
+    /* This structure contains a frame queued. */
+    std::vector<unsigned char> rgb;                                     // top row first
+};
+
+static FILE* openstdout(void);
+
+static void rgbtoyuv(const unsigned char* rgb, int width, int height, unsigned char* yuv);
+
+
+// *****************************************
+//  Constructor
+// *****************************************
+
+VideoStream::VideoStream(const char* target, int fps) : fps(std::max(fps, 1)), failed(false), writtensize(0), droppedsize(0) {
+
+    /* Open the target, write the Y4M header, make the buffers and start the writer. */
+
+    this->target = target ? target : "";
+
+    format = (this->target.size() >= 4 && this->target.compare(this->target.size() - 4, 4, ".rgb") == 0) ? FORMAT_RGB : FORMAT_Y4M;
+
+#if !defined(_WIN32)
+    std::signal(SIGPIPE, SIG_IGN);                                      // (a reader which quits fails the write, instead of ending the program)
+#endif
+
+    fp = (this->target == "-") ? openstdout() : std::fopen(this->target.c_str(), "wb");
+
+    if (!fp) { std::cout << "Error: Video stream cannot be opened. (\"" << this->target << "\")\n"; return; }
+
+    if (format == FORMAT_Y4M) {                                         // 4:2:0, chroma centered (jpeg siting), progressive, square pixels
+        std::fprintf(fp, "YUV4MPEG2 W%d H%d F%d:1 Ip A1:1 C420jpeg XYSCSS=420JPEG\n", PIXELS_W, PIXELS_H, this->fps);
+    }
+
+    for (int n = 0; n < BUFFERSIZE; ++n) { pool.emplace_back(new Item); pool.back()->rgb.resize(3 * (size_t)PIXELS_W * PIXELS_H); freelist.push_back(pool.back().get()); }
+
+    writer = std::thread(&VideoStream::Work, this);
+
+}
+
+static FILE* openstdout(void) {
+
+    /*
+        Return a stream of the stdout file, and point stdout at stderr, so that the console output of the program
+        does not go into the video.
+    */
+
+    std::fflush(stdout);
+
+#if defined(_WIN32)
+    int fd = _dup(_fileno(stdout)); if (fd < 0) return nullptr;
+    _dup2(_fileno(stderr), _fileno(stdout));
+    _setmode(fd, _O_BINARY);
+    return _fdopen(fd, "wb");
+#else
+    int fd = dup(STDOUT_FILENO); if (fd < 0) return nullptr;
+    dup2(STDERR_FILENO, STDOUT_FILENO);
+    return fdopen(fd, "wb");
+#endif
+
+}
+
+
+// *****************************************
+//  Close
+// *****************************************
+
+VideoStream::~VideoStream(void) { Close(); }
+
+void VideoStream::Close(void) {
+
+    { std::lock_guard<std::mutex> lock(mutex); quit = true; }
+
+    wake.notify_all();
+
+    if (writer.joinable()) writer.join();                               // (the writer empties the queue first)
+
+    if (fp) { if (std::fclose(fp) != 0 && !failed) std::cout << "Error: Video stream cannot be written. (\"" << target << "\")\n"; fp = nullptr; }
+
+}
+
+
+// *****************************************
+//  Push
+// *****************************************
+
+bool VideoStream::IsOpen(void) const { return fp != nullptr; }
+
+int VideoStream::GetWrittenSize(void) const { return writtensize.load(); }
+
+int VideoStream::GetDroppedSize(void) const { return droppedsize.load(); }
+
+void VideoStream::Push(const Ray::ExportFrame& frame) {
+
+    /* Take a free buffer, copy the frame into it, and queue it. Without a free buffer, drop the frame. */
+
+    if (!frame.rgb) return;
+
+    Item* item = nullptr;
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+
+        if (quit || failed || freelist.empty()) { ++droppedsize; return; }
+
+        item = freelist.back(); freelist.pop_back();
+    }
+
+    std::memcpy(item->rgb.data(), frame.rgb, item->rgb.size());
+
+    { std::lock_guard<std::mutex> lock(mutex); queue.push_back(item); }
+
+    wake.notify_one();
+
+}
+
+
+// *****************************************
+//  Write
+// *****************************************
+
+void VideoStream::Work(void) {
+
+    /* Write the frames queued until quit, then the ones left. */
+
+    std::vector<unsigned char> yuv((size_t)PIXELS_W * PIXELS_H + 2 * (size_t)((PIXELS_W + 1) / 2) * ((PIXELS_H + 1) / 2));
+
+    std::unique_lock<std::mutex> lock(mutex);
+
+    while (true) {
+
+        wake.wait(lock, [this] { return quit || !queue.empty(); });
+
+        if (queue.empty()) break;                                       // (quit)
+
+        Item* item = queue.front(); queue.erase(queue.begin());
+
+        lock.unlock();
+
+        if (!failed) {
+            if (Write(*item, yuv)) ++writtensize;
+            else { failed = true; std::cout << "Error: Video stream cannot be written, closed. (\"" << target << "\")\n"; }
+        }
+        if (failed) ++droppedsize;
+
+        lock.lock();
+
+        freelist.push_back(item);
+
+    }
+
+}
+
+bool VideoStream::Write(const Item& item, std::vector<unsigned char>& yuv) {
+
+    /* Write a frame: "FRAME" and the Y, U, V planes (Y4M), or the RGB pixels. Flushed, so that the reader gets it at once. */
+
+    if (format == FORMAT_RGB) return std::fwrite(item.rgb.data(), 1, item.rgb.size(), fp) == item.rgb.size() && std::fflush(fp) == 0;
+
+    rgbtoyuv(item.rgb.data(), PIXELS_W, PIXELS_H, yuv.data());
+
+    return std::fwrite("FRAME\n", 1, 6, fp) == 6 && std::fwrite(yuv.data(), 1, yuv.size(), fp) == yuv.size() && std::fflush(fp) == 0;
+
+}
+
+
+// *****************************************
+//  Conversion
+// *****************************************
+
+static void rgbtoyuv(const unsigned char* rgb, int width, int height, unsigned char* yuv) {
+
+    /*
+        Convert RGB (top row first) into planar YUV 4:2:0, BT.601 limited range, in 8 bit fixed point:
+
+            Y = 16 + ( 66 R + 129 G +  25 B) / 256
+            U = 128 + (-38 R -  74 G + 112 B) / 256        (of the mean of 2 x 2 pixels)
+            V = 128 + (112 R -  94 G -  18 B) / 256
+
+        The sums are offset to stay positive, so that a shift divides them. The loops have no branches and no dependency
+        between pixels, so that the compiler vectorizes them (SSE2/NEON by default, AVX2 with the option).
+    */
+
+    const int cwidth = (width + 1) / 2, cheight = (height + 1) / 2;
+
+    unsigned char* yplane = yuv; unsigned char* uplane = yuv + (size_t)width * height; unsigned char* vplane = uplane + (size_t)cwidth * cheight;
+
+    for (int y = 0; y < height; ++y) {
+
+        const unsigned char* src = rgb + 3 * (size_t)width * y; unsigned char* dst = yplane + (size_t)width * y;
+
+        for (int x = 0; x < width; ++x) {
+            const int r = src[3 * x], g = src[3 * x + 1], b = src[3 * x + 2];
+            dst[x] = (unsigned char)((66 * r + 129 * g + 25 * b + (16 << 8) + 128) >> 8);
+        }
+
+    }
+
+    for (int cy = 0; cy < cheight; ++cy) {
+
+        const unsigned char* row0 = rgb + 3 * (size_t)width * (2 * cy);
+        const unsigned char* row1 = rgb + 3 * (size_t)width * std::min(2 * cy + 1, height - 1);    // (the last row twice at an odd height)
+
+        unsigned char* udst = uplane + (size_t)cwidth * cy; unsigned char* vdst = vplane + (size_t)cwidth * cy;
+
+        for (int cx = 0; cx < width / 2; ++cx) {                       // sums of 2 x 2 pixels (x4), divided with the coefficients
+            const int i = 6 * cx;
+            const int r = row0[i] + row0[i + 3] + row1[i] + row1[i + 3];
+            const int g = row0[i + 1] + row0[i + 4] + row1[i + 1] + row1[i + 4];
+            const int b = row0[i + 2] + row0[i + 5] + row1[i + 2] + row1[i + 5];
+            udst[cx] = (unsigned char)((-38 * r - 74 * g + 112 * b + (128 << 10) + 512) >> 10);
+            vdst[cx] = (unsigned char)((112 * r - 94 * g - 18 * b + (128 << 10) + 512) >> 10);
+        }
+
+        if (width & 1) {                                                // (the last column twice at an odd width)
+            const int i = 3 * (width - 1);
+            const int r = 2 * (row0[i] + row1[i]), g = 2 * (row0[i + 1] + row1[i + 1]), b = 2 * (row0[i + 2] + row1[i + 2]);
+            udst[cwidth - 1] = (unsigned char)((-38 * r - 74 * g + 112 * b + (128 << 10) + 512) >> 10);
+            vdst[cwidth - 1] = (unsigned char)((112 * r - 94 * g - 18 * b + (128 << 10) + 512) >> 10);
+        }
+
+    }
+
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+/* ** EXPLANATION **
+
+	VideoStream class writes the frames read back by Ray (see Ray::SetExport(..)) as a raw video stream to stdout, a named pipe or a file.
+
+*/
+
+#include <atomic>
+#include <condition_variable>
+#include <cstdio>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+
+#include "Ray.h"
+
+namespace ray {
+
+	class VideoStream;
+
+}
+
+class ray::VideoStream {
+
+	/*
+		In this class:
+
+			- Copy a frame passed by Ray into one of BUFFERSIZE buffers, and queue it. (The GL thread only copies.)
+
+			- Convert the frames queued into YUV 4:2:0 (BT.601, limited range) on a writer thread, and write them as a Y4M stream,
+			  or write them as raw RGB (24 bit, top row first). The conversion is fixed point, in loops of independent pixels
+			  which the compiler vectorizes.
+
+		The target is "-" (stdout: the console output of the program goes to stderr instead), or a file or a named pipe
+		(format by extension: ".rgb": raw RGB, else Y4M). A named pipe is opened when its reader opens it.
+
+		Unlike Exporter, the stream never makes rendering wait: if the writer is BUFFERSIZE frames behind (a slow reader),
+		the frame is dropped and counted. A stream which cannot be written (the reader has quit) is closed.
+	*/
+
+public:
+
+	enum Format { FORMAT_Y4M = 0, FORMAT_RGB };
+
+	static const int BUFFERSIZE = 2;									// frames in the buffers (one written, one filled)
+
+	VideoStream(const char* target, int fps = 60);						// fps: frame rate of the Y4M header
+
+	~VideoStream(void);													// close
+
+	void Close(void);													// write the frames queued, join the writer and close the target
+
+	bool IsOpen(void) const;											// false: the target cannot be opened
+
+	void Push(const Ray::ExportFrame& frame);							// copy a frame and queue it, or drop it (GL thread)
+
+	int GetWrittenSize(void) const;										// frames written
+
+	int GetDroppedSize(void) const;										// frames dropped (the writer was behind, or the stream is closed)
+
+private:
+
+	struct Item;														// a frame queued (or a free buffer)
+
+	std::string target; Format format = FORMAT_Y4M; int fps; FILE* fp = nullptr;
+
+	std::vector<std::unique_ptr<Item>> pool;							// all the buffers
+	std::vector<Item*> queue, freelist;									// queue: frames to be written, oldest first
+
+	std::mutex mutex; std::condition_variable wake; bool quit = false;
+
+	std::atomic<bool> failed;											// a write failed (the frames after are dropped)
+	std::atomic<int> writtensize, droppedsize;
+
+	std::thread writer;
+
+	void Work(void);													// writer thread loop
+
+	bool Write(const Item& item, std::vector<unsigned char>& yuv);		// convert and write a frame
+
+	VideoStream(const VideoStream&) = delete; VideoStream& operator=(const VideoStream&) = delete;
+
+};
@@ -1,3 +1,8 @@
 #pragma once
 
 const int PIXELS_W = 1280, PIXELS_H = 720;
+
+const float RAYDIST = 1000.0f;                                          // max ray distance (as in the ray2 and culling shaders)
+
+
+const char* const SCENEFILE = "src/scene/default.dbrs";                // default scene file (converted from "default.txt" if missing or older)
@@ -12,7 +12,50 @@
 
     Edit shaders in directory '/src/sh' to modify the ray calculations.
 
-    Type, number, parameters of Ray Units/Objects can be edited in the Ray class constructor in Ray.cpp.
+    Type, number, parameters of Ray Units/Objects can be edited in the text scene file '/src/scene/default.txt' (converted into the binary
+    scene file 'default.dbrs' at the next run).
+
+
+    Usage:
+
+        ray [scene.dbrs]                        run with a binary scene file (default: src/scene/default.dbrs)
+
+        ray --trace trace.json ...              record a timeline of the Cpu scopes and Gpu passes (with any of the usages), and write it
+                                                as a Chrome trace at exit (key P writes it while running)
+
+        ray --export frame%05d.png ...          write every frame as an image file (.png, .ppm, else raw RGB) by a pixel buffer readback
+        ray --export-selection sel%05d ...      write the selection depth and index of every frame as raw files (with --export)
+        ray --stream video.y4m ...              stream every frame as Y4M (YUV 4:2:0), or raw RGB (".rgb"), to a file, a named pipe or stdout ("-")
+                                                (frames are read back asynchronously and written on threads of their own)
+
+        ray --stats-log stats.log ...           append the frame time statistics of each interval to a log file (windowed run)
+        ray --stats-metrics metrics.prom ...    keep the frame time statistics in a metrics text file (Prometheus format, windowed run)
+
+        ray --convert scene.txt scene.dbrs      convert a text scene file into a binary scene file
+
+        ray --import mesh.obj scene.txt         write a text scene file of the units imported from a mesh file (OBJ/PLY)
+
+        ray --headless frames [scene.dbrs [image.ppm]]
+                                                render frames without a window or a display, and write the last one (built with RAY_EGL or RAY_OSMESA)
+
+        ray --bench frames [scene.dbrs [result.json]]
+        ray --bench-headless frames [scene.dbrs [result.json]]
+                                                time frames along a scripted camera path, vsync off, and write the frame time statistics
+
+        ray --bench-scaling frames [result.csv]
+        ray --bench-scaling-headless frames [result.csv]
+        ray --bench-scaling-cpu frames [result.csv]
+                                                time synthetic scenes swept along the object count, the units per object, the planes per unit
+                                                and the pixel count, and write the time per pixel per plane of each (cpu: the Cpu ray tracer)
+
+        ray --regress golden [update]           render reference scenes and camera poses on each backend available (window, headless),
+                                                compare the color, selection depth and index outputs with the goldens in a directory
+                                                and the frame times with the baselines of the backend, and fail on a regression
+                                                (update: write the goldens and the baselines instead)
+
+        ray --microbench [repetitions [warmup [cpu [scene.dbrs]]]]
+                                                time the Cpu kernels (camera rays, view matrices, image copy, ray object tables, Cpu ray traces)
+                                                on a thread pinned to a cpu (-1: not pinned), and print their throughput
 
 
     (An overview of the processing flow and buffer definitions is provided in a separate PDF ("RayCalcWorkflow.pdf").)
@@ -21,27 +64,103 @@
 
 #include <stdio.h>
 #include <stdlib.h>
+#include <math.h>
+
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <string>
+#include <thread>
+#include <vector>
 
 #include <glew.h>
 #include <glfw3.h>
 
+#if defined(RAY_EGL)                                                    // headless context: EGL (surfaceless) or OSMesa (e.g. llvmpipe)
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+#elif defined(RAY_OSMESA)
+#include <GL/osmesa.h>
+#endif
+
 #define SUCCESS 1
 
 // *****************************************
 //  main
 // *****************************************
 
+#include <string.h>
+
 #include "Ray.h"                                                        // namespace ray and class ray::Ray are declared here
+#include "Scene.h"                                                      // class ray::Scene is declared here
+#include "Timeline.h"                                                   // class ray::Timeline is declared here
+#include "FrameStats.h"                                                 // class ray::FrameStats is declared here
+#include "Exporter.h"                                                   // class ray::Exporter is declared here
+#include "VideoStream.h"                                                // class ray::VideoStream is declared here
+#include "TripleBuffer.h"                                               // class ray::TripleBuffer is declared here
+#include "MicroBench.h"                                                 // class ray::MicroBench is declared here
+#include "constant.h"
+
 
+#define STATSINTERVAL 1000                                              // interval of the frame time statistics (ms)
+
+#define TRACEFILE "trace.json"                                          // timeline file of key P (without --trace)
 
 static int Initialize(void);
 
+static void Render(const char* scenefile);
+
+static int WaitEvents(void);
+
 static int Update(double time); 
 
 static void Release(void);
 
+static int Headless(int framesize, const char* scenefile, const char* imagefile);
+
+static int Bench(int framesize, const char* scenefile, const char* resultfile, bool headless);
+
+#define SCALINGWINDOW 0                                                 // backends of the scaling sweep
+#define SCALINGHEADLESS 1
+#define SCALINGCPU 2
+
+static int BenchScaling(int framesize, const char* resultfile, int backend);
+
+static int MicroBench(int repetitions, int warmup, int cpu, const char* scenefile);
+
+static int Regress(const char* goldendir, bool update);
+
+static void WriteTrace(void);
+
+static void PushExport(const ray::Ray::ExportFrame& frame);
+
+static void CloseExport(void);
+
+static void PublishInput(void);
+
+
+static const char* tracefile = NULL;                                    // timeline file (NULL: not recording)
 
-int main(void) {
+static ray::FrameStats* framestats = NULL;                              // frame time statistics of the windowed run
+
+static ray::Exporter* exporter = NULL;                                  // frame export (NULL: not exporting)
+
+static ray::VideoStream* videostream = NULL;                            // frame stream (NULL: not streaming)
+
+namespace {
+
+    struct Input {
+        /* This structure contains a snapshot of the inputs, published by the event thread and read by the render thread. */
+        float pos[3] = {}, theta[3] = {};                               // camera (see ray::Call(..))
+        bool gputimer = false;                                          // time the passes on the Gpu (key T)
+    };
+
+}
+
+static ray::TripleBuffer<Input> input;                                  // inputs (see PublishInput())
+
+
+int main(int argc, char* argv[]) {
 
     /*
         Initialize GLEW, GLFW and OpenGL for ray calculations.
@@ -49,30 +168,110 @@ int main(void) {
         Initialize Ray Units/Objects and process their calculations.
     */
 
+    const char* statslog = NULL; const char* statsmetrics = NULL; const char* exportfile = NULL; const char* exportselection = NULL;
+    const char* streamtarget = NULL;
+
+    while (argc >= 3 && (strcmp(argv[1], "--trace") == 0 || strcmp(argv[1], "--stats-log") == 0 || strcmp(argv[1], "--stats-metrics") == 0
+        || strcmp(argv[1], "--export") == 0 || strcmp(argv[1], "--export-selection") == 0 || strcmp(argv[1], "--stream") == 0)) {
+
+        if (strcmp(argv[1], "--trace") == 0) {                          // record a timeline (written at exit)
+            if (!tracefile) { ray::Timeline::Enable(true); atexit(WriteTrace); }
+            tracefile = argv[2];
+        }
+        else if (strcmp(argv[1], "--stats-log") == 0) { statslog = argv[2]; }
+        else if (strcmp(argv[1], "--stats-metrics") == 0) { statsmetrics = argv[2]; }
+        else if (strcmp(argv[1], "--export") == 0) { exportfile = argv[2]; }
+        else if (strcmp(argv[1], "--export-selection") == 0) { exportselection = argv[2]; }
+        else { streamtarget = argv[2]; }
+
+        argc -= 2; argv += 2;                                           // then read the other arguments
+
+    }
+
+    if (exportselection && !exportfile) { printf("Error: --export-selection needs --export.\n"); return 1; }
+
+    if (exportfile || streamtarget) {                                   // export/stream the frames (the ones in flight are flushed by Ray::Release(), the queues at exit)
+
+        atexit(CloseExport);
+
+        if (exportfile) { exporter = new ray::Exporter(exportfile, exportselection); if (!exporter->IsOpen()) return 1; }
+
+        if (streamtarget) { videostream = new ray::VideoStream(streamtarget); if (!videostream->IsOpen()) return 1; }
+
+        ray::Ray::SetExport(PushExport, exporter && exporter->HasSelection());
+
+    }
+
+    if (argc == 4 && strcmp(argv[1], "--convert") == 0) {              // convert a text scene file and exit
+
+        return ray::Scene::Convert(argv[2], argv[3]) ? 0 : 1;
+
+    }
+
+    if (argc == 4 && strcmp(argv[1], "--import") == 0) {               // import a mesh into a text scene file and exit
+
+        return ray::Scene::Import(argv[2], argv[3]) ? 0 : 1;
+
+    }
+
+    if (argc >= 3 && argc <= 5 && strcmp(argv[1], "--headless") == 0) {     // render frames offscreen and exit
+
+        return Headless(atoi(argv[2]), (argc > 3) ? argv[3] : SCENEFILE, (argc > 4) ? argv[4] : NULL) == SUCCESS ? 0 : 1;
+
+    }
+
+    if (argc >= 3 && argc <= 5 && (strcmp(argv[1], "--bench") == 0 || strcmp(argv[1], "--bench-headless") == 0)) {     // time frames and exit
+
+        return Bench(atoi(argv[2]), (argc > 3) ? argv[3] : SCENEFILE, (argc > 4) ? argv[4] : NULL, strcmp(argv[1], "--bench-headless") == 0) == SUCCESS ? 0 : 1;
+
+    }
+
+    if (argc >= 3 && argc <= 4 && (strcmp(argv[1], "--bench-scaling") == 0 || strcmp(argv[1], "--bench-scaling-headless") == 0 || strcmp(argv[1], "--bench-scaling-cpu") == 0)) {     // time a sweep of synthetic scenes and exit
+
+        const int backend = (strcmp(argv[1], "--bench-scaling-headless") == 0) ? SCALINGHEADLESS : (strcmp(argv[1], "--bench-scaling-cpu") == 0) ? SCALINGCPU : SCALINGWINDOW;
+
+        return BenchScaling(atoi(argv[2]), (argc > 3) ? argv[3] : NULL, backend) == SUCCESS ? 0 : 1;
+
+    }
+
+    if (argc >= 3 && argc <= 4 && strcmp(argv[1], "--regress") == 0) {    // check the outputs and frame times against goldens and exit
+
+        if (argc == 4 && strcmp(argv[3], "update") != 0) { printf("Error: Unknown regression option. (\"%s\")\n", argv[3]); return 1; }
+
+        return Regress(argv[2], argc == 4) == SUCCESS ? 0 : 1;
+
+    }
+
+    if (argc >= 2 && argc <= 6 && strcmp(argv[1], "--microbench") == 0) {     // time the Cpu kernels and exit (no window, no Gpu)
+
+        return MicroBench((argc > 2) ? atoi(argv[2]) : 20, (argc > 3) ? atoi(argv[3]) : 3, (argc > 4) ? atoi(argv[4]) : -1, (argc > 5) ? argv[5] : SCENEFILE) == SUCCESS ? 0 : 1;
+
+    }
+
+    const char* scenefile = (argc > 1) ? argv[1] : SCENEFILE;
+
     // ** Initialize ***************************
 
     if(Initialize()) {                                                  // init GLFW, GLEW, OPENGL and input callbacks
 
-        ray::Ray::Initialize();                                         // init Gpu memory and shaders for ray calc
+        framestats = new ray::FrameStats(STATSINTERVAL);               // report the frame times (on a thread of its own)
+        framestats->SetOutput(true, statslog, statsmetrics);
 
-        {
-            ray::Ray ray;                                               // init ray units/objects
+        glfwMakeContextCurrent(NULL);                                   // (the context moves to the render thread)
 
-            // ** Update *******************************
+        std::thread render(Render, scenefile);                          // init, process ray calc for frames and release on the render thread
 
-            printf("# Running while Loop.\n");
+        // ** Update *******************************
 
-            while (Update(glfwGetTime())) {
+        printf("# Running while Loop.\n");
 
-                ray.Update();                                           // process ray calc for a frame
+        while (WaitEvents()) {}                                         // process inputs (published to the render thread) until the window is closed
 
-            }
-    
-            // ** Release ******************************
+        // ** Release ******************************
 
-        }                                                               // release ray units/objects
+        render.join();
 
-        ray::Ray::Release();                                            // release Gpu memory and shaders
+        delete framestats; framestats = NULL;                           // (reports the last interval)
     
     }
 
@@ -91,8 +290,6 @@ static GLFWwindow* window = NULL;
 //  Initialize
 // *****************************************
 
-#include "constant.h"
-
 
 static void error_callback(int error, const char* description);
 
@@ -101,6 +298,44 @@ static void key_callback(GLFWwindow* window, int key, int scancode, int action,
 static void cursor_callback(GLFWwindow* window, double xpos, double ypos);
 
 
+static void WriteTrace(void) { if (tracefile) ray::Timeline::Write(tracefile); }
+
+static void PushExport(const ray::Ray::ExportFrame& frame) {
+
+    if (exporter) exporter->Push(frame);
+
+    if (videostream) videostream->Push(frame);
+
+}
+
+static void CloseExport(void) {
+
+    /* Write the frames queued, and report. */
+
+    if (exporter) {
+
+        if (exporter->IsOpen()) {
+            exporter->Close();
+            printf("# Exported %d frames (%d failed, %d waits for the writers).\n", exporter->GetWrittenSize(), exporter->GetFailedSize(), exporter->GetWaitSize());
+        }
+
+        delete exporter; exporter = NULL;
+
+    }
+
+    if (videostream) {
+
+        if (videostream->IsOpen()) {
+            videostream->Close();
+            printf("# Streamed %d frames (%d dropped).\n", videostream->GetWrittenSize(), videostream->GetDroppedSize());
+        }
+
+        delete videostream; videostream = NULL;
+
+    }
+
+}
+
 static int Initialize(void) {
 
     /*
@@ -146,21 +381,83 @@ static int Initialize(void) {
 
 static const int MAXDISPTIME = 1000;
 
-static double prevtime = -MAXDISPTIME;
+static double prevtime = -MAXDISPTIME, gpuprinttime = 0.0;
+
+static bool gputimer = false;                                           // print the Gpu times of the passes (toggled by key T, event thread)
+
+static std::atomic<bool> quit{ false }, renderquit{ false };           // quit: the window is closed, renderquit: the render thread has ended
+
+static void Render(const char* scenefile) {
+
+    /*
+        Render frames on a thread of its own, which owns the GL context, until the window is closed.
+
+        The event thread handles inputs and publishes them as snapshots (see PublishInput()), which the render thread reads
+        at the start of a frame without a lock. Neither thread waits for the other: a long frame does not hold up the events,
+        and the swaps are paced by vert sync alone.
+    */
+
+    glfwMakeContextCurrent(window);
+
+    glfwSwapInterval(1);                                                // enable vertical sync (of this context)
+
+    ray::Ray::Initialize();                                             // init Gpu memory and shaders for ray calc
+
+    {
+        ray::Ray ray(scenefile);                                        // init ray units/objects
+
+        while (Update(glfwGetTime())) {
+
+            ray.Update();                                               // process ray calc for a frame
+
+        }
+
+    }                                                                   // release ray units/objects
+
+    ray::Ray::Release();                                                // release Gpu memory and shaders
+
+    glfwMakeContextCurrent(NULL);
+
+    renderquit = true; glfwPostEmptyEvent();                            // (wake the event thread)
+
+}
+
+static int WaitEvents(void) {
+
+    /* Wait for events and process them. Return !SUCCESS (and quit the render thread) when the window is closed or the render thread has ended. */
+
+    if (!glfwWindowShouldClose(window) && !renderquit) glfwWaitEvents();
+
+    if (glfwWindowShouldClose(window) || renderquit) { quit = true; return !SUCCESS; }
+
+    return SUCCESS;
+
+}
 
 static int Update(double time) {
 
-    /* Update GLFW and process inputs. */
+    /* Swap the frame, count its time and apply the inputs other than the camera. (Render thread.) */
 
-    if (glfwWindowShouldClose(window)) return !SUCCESS;
+    if (quit) return !SUCCESS;
 
     glfwSwapBuffers(window);                                            // update with vert sync ON by default
-    glfwPollEvents();
 
     double difftime = (time - prevtime) * 1000.0;
 
-    char str[6] = "---"; if (difftime < MAXDISPTIME) snprintf(str, sizeof(str), "%05.1lf", difftime);
-    printf("\r%s", str);                                                // output elapsed time (vert sync is ON by default)
+    if (difftime < MAXDISPTIME && framestats) framestats->Record(difftime);    // count the elapsed time (reported at intervals, vert sync is ON by default)
+
+    static bool gpuenabled = false; const bool gpuprint = input.Read().gputimer;
+
+    if (gpuprint != gpuenabled) { gpuenabled = gpuprint; ray::Ray::EnableGpuTimer(gpuprint); }
+
+    ray::Ray::GpuTime gpu;
+
+    if (gpuprint && time - gpuprinttime >= STATSINTERVAL / 1000.0 && ray::Ray::GetGpuTime(gpu)) {     // output the Gpu times of a frame a few frames ago
+        gpuprinttime = time;
+        printf("\ngpu %6.2f ms: upload %5.2f cull %5.2f ray2 %6.2f (init %5.2f) selection %6.2f draw %5.2f hiz %5.2f\n", gpu.total,
+            gpu.pass[ray::Ray::PASS_UPLOAD], gpu.pass[ray::Ray::PASS_CULL], gpu.pass[ray::Ray::PASS_RAY2INIT] + gpu.pass[ray::Ray::PASS_RAY2], gpu.pass[ray::Ray::PASS_RAY2INIT],
+            gpu.pass[ray::Ray::PASS_SELECTION], gpu.pass[ray::Ray::PASS_DRAW], gpu.pass[ray::Ray::PASS_HIZ]);
+    }
     
 
     prevtime = time;
@@ -186,7 +483,176 @@ static void Release(void) {
 }
 
 
-static  float theta[3] = {}, pos[3] = {};                               // theta: cam orientation, pos: cam pos
+// *****************************************
+//  Headless
+// *****************************************
+
+static int InitializeHeadless(void);
+
+static void ReleaseHeadless(void);
+
+static int WriteImage(const char* file, const unsigned char* rgb);
+
+
+static int Headless(int framesize, const char* scenefile, const char* imagefile) {
+
+    /*
+        Render frames on a context without a window or a display, into a frame buffer object of the screen size,
+        and write the last frame as an image (PPM) if given. The camera stays at its initial position.
+    */
+
+    if (framesize <= 0) { printf("Error: Headless frame size error. (%d)\n", framesize); return !SUCCESS; }
+
+    int res = InitializeHeadless();
+
+    if (res == SUCCESS) {
+
+        ray::Ray::Initialize(true);                                     // init Gpu memory and shaders (rendered offscreen)
+
+        {
+            ray::Ray ray(scenefile);
+
+            printf("# Rendering %d frames offscreen.\n", framesize);
+
+            for (int n = 0; n < framesize; ++n) { ray.Update(); }
+
+            if (imagefile) {
+
+                unsigned char* rgb = (unsigned char*)malloc(3 * (size_t)PIXELS_W * PIXELS_H);
+
+                if (rgb) { ray::Ray::ReadScreen(rgb); res = WriteImage(imagefile, rgb); free(rgb); } else { res = !SUCCESS; }
+
+                if (res != SUCCESS) printf("Error: Image file cannot be written. (\"%s\")\n", imagefile);
+
+            }
+
+        }
+
+        ray::Ray::Release();
+
+    }
+
+    ReleaseHeadless();
+
+
+    return res;
+
+}
+
+#if defined(RAY_EGL)
+static EGLDisplay egldisplay = EGL_NO_DISPLAY;
+static EGLContext eglcontext = EGL_NO_CONTEXT;
+#elif defined(RAY_OSMESA)
+static OSMesaContext osmesacontext = NULL;
+static void* osmesabuffer = NULL;
+#endif
+
+static int InitializeHeadless(void) {
+
+    /*
+        Create an OpenGL 4.1 core context without a window, and initialize GLEW.
+
+        EGL: a surfaceless context (EGL_MESA_platform_surfaceless if found, else the default display) without a default frame buffer.
+        OSMesa: a context on a frame buffer in memory (the Cpu renderer, e.g. llvmpipe), not drawn into.
+    */
+
+#if defined(RAY_EGL)
+
+    PFNEGLGETPLATFORMDISPLAYEXTPROC getplatformdisplay = (PFNEGLGETPLATFORMDISPLAYEXTPROC)eglGetProcAddress("eglGetPlatformDisplayEXT");
+
+    if (getplatformdisplay) egldisplay = getplatformdisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, NULL);
+    if (egldisplay == EGL_NO_DISPLAY) egldisplay = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+
+    if (egldisplay == EGL_NO_DISPLAY || !eglInitialize(egldisplay, NULL, NULL)) { printf("Error: EGL Init failure.\n"); return !SUCCESS; }
+
+    const EGLint configattrib[] = { EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE };
+
+    EGLConfig config = NULL; EGLint configsize = 0;
+    if (!eglChooseConfig(egldisplay, configattrib, &config, 1, &configsize)) configsize = 0;     // (none: a context without a config)
+
+    const EGLint contextattrib[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4, EGL_CONTEXT_MINOR_VERSION, 1,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT, EGL_NONE
+    };
+
+    if (eglBindAPI(EGL_OPENGL_API)) eglcontext = eglCreateContext(egldisplay, (configsize > 0) ? config : (EGLConfig)0, EGL_NO_CONTEXT, contextattrib);
+
+    if (eglcontext == EGL_NO_CONTEXT || !eglMakeCurrent(egldisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, eglcontext)) {
+        printf("Error: EGL create context failure. (0x%x)\n", (unsigned int)eglGetError()); return !SUCCESS;
+    }
+
+#elif defined(RAY_OSMESA)
+
+    const int attrib[] = {
+        OSMESA_FORMAT, OSMESA_RGBA, OSMESA_DEPTH_BITS, 0, OSMESA_PROFILE, OSMESA_CORE_PROFILE,
+        OSMESA_CONTEXT_MAJOR_VERSION, 4, OSMESA_CONTEXT_MINOR_VERSION, 1, 0
+    };
+
+    osmesacontext = OSMesaCreateContextAttribs(attrib, NULL);
+    osmesabuffer = malloc(4 * (size_t)PIXELS_W * PIXELS_H);
+
+    if (!osmesacontext || !osmesabuffer || !OSMesaMakeCurrent(osmesacontext, osmesabuffer, GL_UNSIGNED_BYTE, PIXELS_W, PIXELS_H)) {
+        printf("Error: OSMesa create context failure.\n"); return !SUCCESS;
+    }
+
+#else
+
+    printf("Error: Headless mode is not built in. (Define RAY_EGL or RAY_OSMESA.)\n"); return !SUCCESS;
+
+#endif
+
+    // ** Initialize GLEW **********************
+
+    glewExperimental = GL_TRUE;
+
+    GLenum res = glewInit();
+
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    if (res == GLEW_ERROR_NO_GLX_DISPLAY) res = GLEW_OK;                // (GLEW built for GLX: the core functions are loaded before the display is checked)
+#endif
+
+    if (res != GLEW_OK) { printf("Error: GLEW Init failure.\n"); return !SUCCESS; }
+
+
+    return SUCCESS;
+
+}
+
+static void ReleaseHeadless(void) {
+
+    /* Release the headless context. */
+
+#if defined(RAY_EGL)
+    if (egldisplay != EGL_NO_DISPLAY) {
+        eglMakeCurrent(egldisplay, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        if (eglcontext != EGL_NO_CONTEXT) eglDestroyContext(egldisplay, eglcontext);
+        eglTerminate(egldisplay);
+    }
+    egldisplay = EGL_NO_DISPLAY; eglcontext = EGL_NO_CONTEXT;
+#elif defined(RAY_OSMESA)
+    if (osmesacontext) OSMesaDestroyContext(osmesacontext);
+    free(osmesabuffer); osmesacontext = NULL; osmesabuffer = NULL;
+#endif
+
+}
+
+static int WriteImage(const char* file, const unsigned char* rgb) {
+
+    /* Write an RGB image as a binary PPM file. */
+
+    FILE* fp = fopen(file, "wb"); if (!fp) return !SUCCESS;
+
+    int res = fprintf(fp, "P6\n%d %d\n255\n", PIXELS_W, PIXELS_H) > 0
+        && fwrite(rgb, 3 * (size_t)PIXELS_W, PIXELS_H, fp) == (size_t)PIXELS_H;
+
+    res = (fclose(fp) == 0) && res;
+
+    return res ? SUCCESS : !SUCCESS;
+
+}
+
+
+static  float theta[3] = {}, pos[3] = {};                               // theta: cam orientation, pos: cam pos (published by PublishInput())
 
 // *****************************************
 //  ray::Call(..)
@@ -198,54 +664,950 @@ static  float theta[3] = {}, pos[3] = {};                               // theta
 
 void ray::Call(float outpos[3], float outtheta[3]) {
 
-    /* Output values for camera positions and orientations. */
+    /* Output values for camera positions and orientations. (The latest snapshot published, see PublishInput().) */
 
-    outtheta[0] = theta[0]; outtheta[1] = theta[1]; outtheta[2] = theta[2];
+    const Input& in = input.Read();
 
-    outpos[0] = pos[0]; outpos[1] = pos[1]; outpos[2] = pos[2];
+    outtheta[0] = in.theta[0]; outtheta[1] = in.theta[1]; outtheta[2] = in.theta[2];
+
+    outpos[0] = in.pos[0]; outpos[1] = in.pos[1]; outpos[2] = in.pos[2];
 
 }
 
+static void PublishInput(void) {
 
-// *****************************************
+    /* Publish the inputs as a snapshot for the render thread. Called by the thread which writes them (the event thread, or the benchmarks). */
 
-// *****************************************
+    Input& in = input.Back();
 
-static void error_callback(int errcode, const char* description)
-    { printf("GLFW Error: %s (%d)\n", description, errcode);  glfwSetWindowShouldClose(window, 1); }
+    for (int i = 0; i < 3; ++i) { in.pos[i] = pos[i]; in.theta[i] = theta[i]; }
 
+    in.gputimer = gputimer;
 
-// *****************************************
+    input.Publish();
 
+}
+
+
+// *****************************************
+//  Bench
 // *****************************************
 
-static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+#define WARMUPFRAMES 10                                                 // frames rendered before timing (shader variants, scene loading)
 
-    /* Determine camera positions from key inputs. */
+static void SetBenchCamera(int frame, int framesize);
 
-    const float v = 2.1f;                                               // arbitrary value
+static int WriteBenchResult(const char* file, const char* scenefile, bool headless, std::vector<double>& frametime, const double* gputime);
 
-    float tmp[3] = {}; {
 
-        if (action == GLFW_PRESS || action == GLFW_REPEAT)
-        {
-            tmp[0] = v * ((key == GLFW_KEY_RIGHT) - (key == GLFW_KEY_LEFT));
-            tmp[1] = v * ((key == GLFW_KEY_UP) - (key == GLFW_KEY_DOWN));
-            tmp[2] = v * ((key == GLFW_KEY_LEFT_ALT) - (key == GLFW_KEY_LEFT_CONTROL));
-        }
+static int Bench(int framesize, const char* scenefile, const char* resultfile, bool headless) {
 
-    }
+    /*
+        Time frames along a scripted camera path with vsync off, each frame bounded by glFinish(), and write the statistics.
 
-    pos[0] += tmp[0]; pos[1] += tmp[1]; pos[2] += tmp[2];
+        The runs are deterministic: the camera is set per frame, and the game time of Ray advances by a fixed step per frame.
+        The warmup frames follow the start of the path and are not timed.
+
+        The passes are also timed on Gpu (Ray::EnableGpuTimer(..)), and their means over the timed frames read back are written.
+    */
+
+    if (framesize <= 0) { printf("Error: Bench frame size error. (%d)\n", framesize); return !SUCCESS; }
+
+    int res = headless ? InitializeHeadless() : Initialize();
+
+    if (res == SUCCESS) {
+
+        if (!headless) glfwSwapInterval(0);                             // vsync off
+
+        ray::Ray::Initialize(headless);
+
+        ray::Ray::EnableGpuTimer(true);
+
+        {
+            ray::Ray ray(scenefile);
+
+            for (int n = 0; n < WARMUPFRAMES; ++n) { SetBenchCamera(0, framesize); ray.Update(); }
+
+            glFinish();
+
+            printf("# Timing %d frames.\n", framesize);
+
+            std::vector<double> frametime(framesize);                   // (ms)
+
+            double gputime[ray::Ray::PASSSIZE + 1] = {}; int gpusize = 0; unsigned int gpuframe = WARMUPFRAMES;     // gputime: sums per pass, then the total
+
+            for (int n = 0; n < framesize; ++n) {
+
+                SetBenchCamera(n, framesize);
+
+                auto start = std::chrono::steady_clock::now();
+
+                ray.Update(); glFinish();
+
+                frametime[n] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                if (!headless) { glfwSwapBuffers(window); glfwPollEvents(); }     // (not timed)
+
+                ray::Ray::GpuTime gpu;
+
+                if (ray::Ray::GetGpuTime(gpu) && gpu.frame > gpuframe) {    // (a timed frame read back)
+                    for (int p = 0; p < ray::Ray::PASSSIZE; ++p) { gputime[p] += gpu.pass[p]; }
+                    gputime[ray::Ray::PASSSIZE] += gpu.total; gpuframe = gpu.frame; ++gpusize;
+                }
+
+            }
+
+            for (double& g : gputime) { g /= std::max(gpusize, 1); }
+
+            res = WriteBenchResult(resultfile, scenefile, headless, frametime, (gpusize > 0) ? gputime : NULL);
+
+        }
+
+        ray::Ray::Release();
+
+    }
+
+    if (headless) ReleaseHeadless(); else Release();
+
+
+    return res;
+
+}
+
+static void SetBenchCamera(int frame, int framesize) {
+
+    /* Set the camera of a frame on the scripted path: a turn to each side while dollying forward and back. */
+
+    const float pi = 3.141592f;
+
+    float u = (float)frame / framesize;                                 // [0, 1)
+
+    theta[0] = 0.2f * sinf(4.0f * pi * u); theta[1] = 0.0f; theta[2] = 0.6f * sinf(2.0f * pi * u);
+
+    pos[0] = 2.0f * sinf(2.0f * pi * u); pos[1] = 4.0f * (1.0f - cosf(2.0f * pi * u)); pos[2] = 0.0f;
+
+    PublishInput();
+
+}
+
+static int WriteBenchResult(const char* file, const char* scenefile, bool headless, std::vector<double>& frametime, const double* gputime) {
+
+    /* Print the frame time statistics (and the mean Gpu times of the passes if measured) and write them as JSON if a file is given. (Percentiles by nearest rank.) */
+
+    const char* passname[ray::Ray::PASSSIZE + 1] = { "upload", "cull", "ray2init", "ray2", "selection", "draw", "hiz", "total" };
+
+    std::sort(frametime.begin(), frametime.end());
+
+    const size_t size = frametime.size();
+
+    double sum = 0.0; for (double t : frametime) { sum += t; }
+
+    auto percentile = [&](double p) { size_t rank = (size_t)(p / 100.0 * size + 0.999999); return frametime[std::min(std::max(rank, (size_t)1), size) - 1]; };
+
+    const double stat[5] = { frametime[0], percentile(50.0), percentile(99.0), frametime[size - 1], sum / size };
+
+    printf("# Frame time (ms): min %.3f, median %.3f, p99 %.3f, max %.3f, mean %.3f (%.1f fps)\n", stat[0], stat[1], stat[2], stat[3], stat[4], 1000.0 / stat[4]);
+
+    if (gputime) {
+        printf("# Gpu time (ms, mean):");
+        for (int p = 0; p <= ray::Ray::PASSSIZE; ++p) { printf("%s %s %.3f", (p == 0) ? "" : ",", passname[p], gputime[p]); }
+        printf("\n");
+    }
+
+    if (!file) return SUCCESS;
+
+    FILE* fp = fopen(file, "w"); if (!fp) { printf("Error: Bench result file cannot be written. (\"%s\")\n", file); return !SUCCESS; }
+
+    fprintf(fp, "{\n  \"scene\": \"");
+    for (const char* c = scenefile; *c; ++c) { if (*c == '"' || *c == '\\') fputc('\\', fp); fputc(*c, fp); }
+    fprintf(fp, "\",\n  \"mode\": \"%s\",\n  \"width\": %d,\n  \"height\": %d,\n  \"frames\": %d,\n", headless ? "headless" : "window", PIXELS_W, PIXELS_H, (int)size);
+    fprintf(fp, "  \"min_ms\": %.4f,\n  \"median_ms\": %.4f,\n  \"p99_ms\": %.4f,\n  \"max_ms\": %.4f,\n  \"mean_ms\": %.4f", stat[0], stat[1], stat[2], stat[3], stat[4]);
+
+    if (gputime) {
+        fprintf(fp, ",\n  \"gpu_ms\": {");
+        for (int p = 0; p <= ray::Ray::PASSSIZE; ++p) { fprintf(fp, "%s\"%s\": %.4f", (p == 0) ? " " : ", ", passname[p], gputime[p]); }
+        fprintf(fp, " }");
+    }
+
+    fprintf(fp, "\n}\n");
+
+    if (fclose(fp) != 0) { printf("Error: Bench result file cannot be written. (\"%s\")\n", file); return !SUCCESS; }
+
+    return SUCCESS;
+
+}
+
+
+// *****************************************
+//  Micro Bench
+// *****************************************
+
+#if defined(_WIN32)
+#define NOMINMAX                                                        // (std::min, std::max above)
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+static int PinThread(int cpu);
+
+static int MicroBench(int repetitions, int warmup, int cpu, const char* scenefile) {
+
+    /*
+        Time the Cpu kernels (see ray::MicroBench::Run(..)) on this thread, pinned to a cpu so that it is not moved between cores
+        during the runs. (cpu < 0: not pinned.)
+    */
+
+    if (cpu >= 0 && PinThread(cpu) != SUCCESS) { printf("Error: Thread cannot be pinned to cpu %d.\n", cpu); return !SUCCESS; }
+
+    printf("# Micro benchmark: %d repetitions, %d warmup, cpu %d, scene \"%s\"\n", repetitions, warmup, cpu, scenefile);
+
+    ray::MicroBench::Run(repetitions, warmup, scenefile);
+
+    return SUCCESS;
+
+}
+
+static int PinThread(int cpu) {
+
+    /* Pin this thread to a cpu. */
+
+#if defined(_WIN32)
+    if (cpu >= (int)(8 * sizeof(DWORD_PTR))) return !SUCCESS;
+    return SetThreadAffinityMask(GetCurrentThread(), (DWORD_PTR)1 << cpu) != 0 ? SUCCESS : !SUCCESS;
+#elif defined(__linux__)
+    if (cpu >= CPU_SETSIZE) return !SUCCESS;
+    cpu_set_t set; CPU_ZERO(&set); CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0 ? SUCCESS : !SUCCESS;
+#else
+    (void)cpu; return !SUCCESS;                                         // (not supported)
+#endif
+
+}
+
+
+// *****************************************
+//  Bench Scaling
+// *****************************************
+
+#define SCALINGSCENEFILE "src/scene/scaling"                           // synthetic scene files written by the sweep (".txt", ".dbrs", removed after)
+
+namespace {
+
+    struct ScalingPoint {
+        /* This structure contains a point of the scaling sweep. */
+        const char* axis; int objectsize, unitsize, plsize, area;       // unitsize: units per ray object, plsize: planes per unit, area: screen rect (% of the pixels)
+    };
+
+}
+
+static const ScalingPoint scalingpoint[] = {                            // the base point (2 objects, 2 units, 8 planes, 100%) varied along an axis at a time
+    { "objects", 1, 2, 8, 100 }, { "objects", 2, 2, 8, 100 }, { "objects", 4, 2, 8, 100 }, { "objects", 8, 2, 8, 100 }, { "objects", 16, 2, 8, 100 },
+    { "objects", 32, 2, 8, 100 }, { "objects", 64, 2, 8, 100 }, { "objects", 256, 2, 8, 100 },
+    { "units", 2, 1, 8, 100 }, { "units", 2, 2, 8, 100 }, { "units", 2, 4, 8, 100 }, { "units", 2, 8, 8, 100 },     // (8: the max units per ray object)
+    { "planes", 2, 2, 4, 100 }, { "planes", 2, 2, 6, 100 }, { "planes", 2, 2, 8, 100 }, { "planes", 2, 2, 16, 100 }, { "planes", 2, 2, 32, 100 },
+    { "planes", 2, 2, 64, 100 }, { "planes", 2, 2, 128, 100 },
+    { "pixels", 2, 2, 8, 6 }, { "pixels", 2, 2, 8, 25 }, { "pixels", 2, 2, 8, 50 }, { "pixels", 2, 2, 8, 100 }
+};
+
+static int WriteScalingScene(const char* file, const ScalingPoint& point);
+
+static void TraceScalingFrame(ray::Ray& ray, int width, int height);
+
+static void MakeScalingShape(int plsize, float scale, const float center[3], unsigned int seed, std::vector<float>& outpl);
+
+
+static int BenchScaling(int framesize, const char* resultfile, int backend) {
+
+    /*
+        Time synthetic scenes swept along four axes, to find where the calcs stop scaling: the object count (draws per unit and slot count),
+        the units per object (ray2 layers and selection loads), the planes per unit (full screen ray2 fill per plane) and the pixel count,
+        on a backend: the Gpu calcs in the window or the headless context, or the Cpu ray tracer (Ray::Trace(..)) without a context.
+
+        A scene has a grid of ray objects facing the camera, each the first unit minus the others (notches cut into its front).
+        The first unit is a built-in shape (Unit.h) at 6 planes (cube) and 8 planes (octahedron), and else a convex set of random planes.
+
+        The screen size is fixed at compile time, so the pixel axis scissors the passes to a centered rect of the screen (Ray::SetScreenRect(..)).
+        The camera is fixed, and the median frame time is taken per point. The time per pixel per plane is over the planes resident,
+        as each plane is drawn over the screen rect (units or planes beyond the buffers are not resident).
+
+        The Gpu backends hold at most ray::Ray::MAXSLOTSIZE units (and 200 planes) resident, so their points beyond show the resident
+        counts capped, as stated in the result file. The Cpu backend traces a ray per pixel of the screen rect through the bvh of all the
+        ray objects, which are all counted.
+    */
+
+    if (framesize <= 0) { printf("Error: Bench frame size error. (%d)\n", framesize); return !SUCCESS; }
+
+    const bool headless = (backend == SCALINGHEADLESS), cpu = (backend == SCALINGCPU);
+
+    int res = cpu ? SUCCESS : headless ? InitializeHeadless() : Initialize();
+
+    FILE* fp = NULL;
+
+    if (res == SUCCESS && resultfile) {
+
+        fp = fopen(resultfile, "w");
+
+        if (fp) {
+            fprintf(fp, "# gpu modes (window, headless): at most %d units and 200 planes resident (the slot and plane buffers), beyond: resident counts capped; "
+                "cpu mode: all units and planes traced, a ray per pixel\n", ray::Ray::MAXSLOTSIZE);
+            fprintf(fp, "mode,axis,objects,units_per_object,planes_per_unit,pixels,resident_units,resident_planes,min_ms,median_ms,ns_per_pixel_plane\n");
+        }
+        else { printf("Error: Bench result file cannot be written. (\"%s\")\n", resultfile); res = !SUCCESS; }
+
+    }
+
+    if (res == SUCCESS) {
+
+        if (!cpu && !headless) glfwSwapInterval(0);                     // vsync off
+
+        if (!cpu) ray::Ray::Initialize(headless);
+
+        const std::string textfile = SCALINGSCENEFILE ".txt", binfile = SCALINGSCENEFILE ".dbrs";
+
+        theta[0] = 2.0f * 3.141592f * 20.0f / 360.0f; theta[1] = 0.0f; theta[2] = 0.0f;  // level, looking along +y (see makeviewmat4(..) in Ray.cpp)
+        pos[0] = 0.0f; pos[1] = 0.0f; pos[2] = 0.0f; PublishInput();
+
+        printf("# %-8s %7s %5s %6s %8s %8s %8s %10s %12s\n", "axis", "objects", "units", "planes", "pixels", "resident", "planes", "median(ms)", "ns/px/plane");
+
+        for (const ScalingPoint& point : scalingpoint) {
+
+            if (WriteScalingScene(textfile.c_str(), point) != SUCCESS || !ray::Scene::Convert(textfile.c_str(), binfile.c_str())) {
+                printf("Error: Scaling scene cannot be written. (\"%s\")\n", textfile.c_str()); res = !SUCCESS; break;
+            }
+
+            int w = (int)(PIXELS_W * sqrt(point.area / 100.0) + 0.5), h = (int)(PIXELS_H * sqrt(point.area / 100.0) + 0.5);
+
+            if (!cpu) ray::Ray::SetScreenRect((PIXELS_W - w) / 2, (PIXELS_H - h) / 2, w, h);
+
+            ray::Ray ray(binfile.c_str());
+
+            for (int n = 0; n < WARMUPFRAMES; ++n) { if (cpu) TraceScalingFrame(ray, w, h); else ray.Update(); }     // (cpu: the bvh is built by the first trace)
+
+            if (!cpu) glFinish();
+
+            std::vector<double> frametime(framesize);                   // (ms)
+
+            for (int n = 0; n < framesize; ++n) {
+
+                auto start = std::chrono::steady_clock::now();
+
+                if (cpu) TraceScalingFrame(ray, w, h);
+                else { ray.Update(); glFinish(); }
+
+                frametime[n] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+                if (!cpu && !headless) { glfwSwapBuffers(window); glfwPollEvents(); }     // (not timed)
+
+            }
+
+            std::sort(frametime.begin(), frametime.end());
+
+            const double median = frametime[(frametime.size() - 1) / 2];
+            const int unitsize = cpu ? point.objectsize * point.unitsize : ray.GetResidentUnitSize();
+            const int plsize = cpu ? point.objectsize * point.unitsize * point.plsize : ray.GetResidentPlaneSize();
+            const double perpixelplane = (plsize > 0) ? median * 1.0e6 / ((double)w * h * plsize) : 0.0;
+
+            printf("  %-8s %7d %5d %6d %8d %8d %8d %10.3f %12.4f\n", point.axis, point.objectsize, point.unitsize, point.plsize, w * h, unitsize, plsize, median, perpixelplane);
+
+            if (fp) fprintf(fp, "%s,%s,%d,%d,%d,%d,%d,%d,%.4f,%.4f,%.6f\n", cpu ? "cpu" : headless ? "headless" : "window", point.axis,
+                point.objectsize, point.unitsize, point.plsize, w * h, unitsize, plsize, frametime[0], median, perpixelplane);
+
+        }
+
+        remove(textfile.c_str()); remove(binfile.c_str());
+
+        if (!cpu) { ray::Ray::SetScreenRect(0, 0, PIXELS_W, PIXELS_H); ray::Ray::Release(); }
+
+    }
+
+    if (fp && fclose(fp) != 0) { printf("Error: Bench result file cannot be written. (\"%s\")\n", resultfile); res = !SUCCESS; }
+
+    if (cpu) {}
+    else if (headless) ReleaseHeadless(); else Release();
+
+
+    return res;
+
+}
+
+static void TraceScalingFrame(ray::Ray& ray, int width, int height) {
+
+    /* Trace a camera ray per pixel of the centered screen rect on the Cpu (the camera at the origin, looking along +y, as in the sweep). */
+
+    const float pos[3] = {};
+
+    const int x0 = (PIXELS_W - width) / 2, y0 = (PIXELS_H - height) / 2;
+
+    for (int y = y0; y < y0 + height; ++y) {
+        for (int x = x0; x < x0 + width; ++x) {
+            const float dir[3] = { 2.0f * (x + 0.5f) / PIXELS_W - 1.0f, 1.0f, (2.0f * (y + 0.5f) / PIXELS_H - 1.0f) * PIXELS_H / PIXELS_W };
+            ray.Trace(pos, dir);
+        }
+    }
+
+}
+
+static int WriteScalingScene(const char* file, const ScalingPoint& point) {
+
+    /*
+        Write the text scene of a point of the sweep (see default.txt for the format).
+
+        The ray objects are on a square grid in the plane y = dist, at a dist where the grid fits in the height of the screen,
+        and tilted to show three faces. The shapes of the units are the same in all the ray objects.
+    */
+
+    FILE* fp = fopen(file, "w"); if (!fp) return !SUCCESS;
+
+    const float pi = 3.141592f;
+
+    fprintf(fp, "# scaling benchmark scene (%s: %d objects, %d units per object, %d planes per unit)\n\n", point.axis, point.objectsize, point.unitsize, point.plsize);
+
+    // shapes
+
+    std::vector<float> pl;
+
+    const char* first = (point.plsize == 6) ? "cube" : (point.plsize == 8) ? "octahedron" : "shape0";
+
+    const float inradius = (point.plsize == 8) ? 0.577350f : 1.0f;      // of the first unit (built-in octahedron: faces at 1 / sqrt(3))
+
+    for (int m = 0; m < point.unitsize; ++m) {
+
+        if (m == 0 && point.plsize != 6 && point.plsize != 8) {
+
+            const float center[3] = {};
+            MakeScalingShape(point.plsize, 1.0f, center, 1, pl);
+
+        }
+        else if (m > 0) {
+
+            const float angle = 2.0f * pi * (m - 1) / (point.unitsize - 1);    // notches on a ring around the front (-y) of the first unit
+            const float center[3] = { 0.45f * inradius * cosf(angle), -0.8f * inradius, 0.45f * inradius * sinf(angle) };
+            MakeScalingShape(point.plsize, 0.4f * inradius, center, 1 + m, pl);
+
+        }
+        else continue;
+
+        fprintf(fp, "shape shape%d\n", m);
+        for (size_t r = 0; r < pl.size(); r += 12) {
+            fprintf(fp, "   ");
+            for (int i = 0; i < 12; ++i) { fprintf(fp, " %.6f", pl[r + i] + 0.0f); }     // (+ 0.0f: no "-0")
+            fprintf(fp, "\n");
+        }
+        fprintf(fp, "end\n\n");
+
+    }
+
+    // objects
+
+    int side = 1; while (side * side < point.objectsize) { ++side; }
+
+    const int rowsize = (point.objectsize + side - 1) / side;
+
+    const float spacing = 3.0f, dist = 1.5f * spacing * side + 2.0f;
+
+    const float a = 0.5f, b = 0.4f;                                     // tilt: Rz(a) * Rx(b)
+    const float rot[3][3] = {
+        { cosf(a), -sinf(a) * cosf(b), sinf(a) * sinf(b) },
+        { sinf(a), cosf(a) * cosf(b), -cosf(a) * sinf(b) },
+        { 0.0f, sinf(b), cosf(b) }
+    };
+
+    for (int n = 0; n < point.objectsize; ++n) {
+
+        float x = spacing * (n % side - (side - 1) / 2.0f), z = spacing * ((rowsize - 1) / 2.0f - n / side);
+
+        fprintf(fp, "object static\n    matrix ");
+        for (int i = 0; i < 3; ++i) { fprintf(fp, " %.6f %.6f %.6f %.6f  ", rot[i][0], rot[i][1], rot[i][2], (i == 0) ? x : (i == 1) ? dist : z); }
+        fprintf(fp, " 0.0 0.0 0.0 1.0\n");
+
+        for (int m = 0; m < point.unitsize; ++m) { fprintf(fp, "    unit %s %s\n", (m == 0) ? first : ("shape" + std::to_string(m)).c_str(), (m == 0) ? "1.0 1.0" : "1.0 -1.0"); }
+
+        fprintf(fp, "end\n\n");
+
+    }
+
+    return (fclose(fp) == 0) ? SUCCESS : !SUCCESS;
+
+}
+
+static void MakeScalingShape(int plsize, float scale, const float center[3], unsigned int seed, std::vector<float>& outpl) {
+
+    /*
+        Make a convex shape of planes tangent to a sphere (radius scale, at center): the normals of the octahedron (8 planes),
+        of the cube (6 planes), else of the tetrahedron (bounded) and random ones (a fixed sequence by seed), so that no plane is redundant.
+
+        Rows: (pos, 1.0) (normal, 0.0) (u-axis, 0.0).
+    */
+
+    const float s = 0.577350f;                                          // 1 / sqrt(3)
+
+    const float octahedron[8][3] = { { s, s, s }, { s, -s, s }, { s, s, -s }, { s, -s, -s }, { -s, s, s }, { -s, -s, s }, { -s, s, -s }, { -s, -s, -s } };
+    const float cube[6][3] = { { 1, 0, 0 }, { -1, 0, 0 }, { 0, 1, 0 }, { 0, -1, 0 }, { 0, 0, 1 }, { 0, 0, -1 } };
+    const float tetrahedron[4][3] = { { s, s, s }, { s, -s, -s }, { -s, s, -s }, { -s, -s, s } };
+
+    unsigned int state = seed * 2654435761u;                            // lcg
+    auto random = [&state]() { state = state * 1664525u + 1013904223u; return (state >> 8) / 8388608.0f - 1.0f; };   // [-1, 1)
+
+    outpl.clear();
+
+    for (int p = 0; p < plsize; ++p) {
+
+        float nr[3] = {};
+
+        if (plsize == 8) { nr[0] = octahedron[p][0]; nr[1] = octahedron[p][1]; nr[2] = octahedron[p][2]; }
+        else if (plsize == 6) { nr[0] = cube[p][0]; nr[1] = cube[p][1]; nr[2] = cube[p][2]; }
+        else if (p < 4) { nr[0] = tetrahedron[p][0]; nr[1] = tetrahedron[p][1]; nr[2] = tetrahedron[p][2]; }
+        else {
+            float len = 0.0f;
+            while (len < 0.1f || len > 1.0f) { nr[0] = random(); nr[1] = random(); nr[2] = random(); len = sqrtf(nr[0] * nr[0] + nr[1] * nr[1] + nr[2] * nr[2]); }
+            nr[0] /= len; nr[1] /= len; nr[2] /= len;                   // (uniform on the sphere)
+        }
+
+        float ax[3] = { nr[1], -nr[0], 0.0f };                          // u-axis: normal x (0, 0, 1), or (1, 0, 0) near the z axis
+        if (fabsf(nr[2]) > 0.9f) { ax[0] = 0.0f; ax[1] = nr[2]; ax[2] = -nr[1]; }
+        float len = sqrtf(ax[0] * ax[0] + ax[1] * ax[1] + ax[2] * ax[2]);
+
+        const float row[12] = {
+            center[0] + scale * nr[0], center[1] + scale * nr[1], center[2] + scale * nr[2], 1.0f,
+            nr[0], nr[1], nr[2], 0.0f, ax[0] / len, ax[1] / len, ax[2] / len, 0.0f
+        };
+
+        outpl.insert(outpl.end(), row, row + 12);
+
+    }
+
+}
+
+
+// *****************************************
+//  Regress
+// *****************************************
+
+#define REGRESSSCENEFILE "src/scene/regress"                           // synthetic scene files of the cases (".txt", ".dbrs", removed after)
+
+#define REGRESSFRAMES 30                                                // frames timed per case
+#define REGRESSCOLORTOL 8                                               // color difference of a channel (0-255) beyond which a pixel differs
+#define REGRESSDEPTHTOL 1.0e-4f                                         // selection depth difference beyond which a pixel differs
+#define REGRESSPIXELTOL 0.001                                           // fraction of the pixels which may differ (rasterization at the silhouettes)
+#define REGRESSSIGMA 4.0                                                // frame time noise (robust sigmas) a regression must exceed
+#define REGRESSRATIO 0.15                                               // frame time ratio a regression must exceed (drift between runs)
+#define REGRESSMINTIME 0.05                                             // frame time a regression must exceed (ms)
+
+namespace {
+
+    struct RegressCase {
+        /* This structure contains a reference scene and a camera pose. */
+        const char* name; ScalingPoint point; float theta[3], pos[3];  // point: a synthetic scene (see WriteScalingScene(..)), objectsize 0: the default scene
+    };
+
+    struct RegressOutput {
+        /* This structure contains the outputs of a case. */
+        std::vector<unsigned char> rgb; std::vector<float> depth; std::vector<int> index;  // index: (ray object, unit, plane) per pixel
+        std::vector<float> tracedepth; std::vector<int> traceobject;    // the Cpu tracer on the same frame: depth and ray object per pixel
+        double median = 0.0, mad = 0.0;                                 // frame time median and median absolute deviation (ms)
+    };
+
+}
+
+static const float LEVEL = 2.0f * 3.141592f * 20.0f / 360.0f;           // theta[0] of a level camera (see makeviewmat4(..) in Ray.cpp)
+
+static const RegressCase regresscase[] = {                              // the csg scenes cut notches into the front of the objects (subtract)
+    { "default",            { "", 0, 0, 0, 100 }, { 0.0f, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+    { "default_turn",       { "", 0, 0, 0, 100 }, { 0.1f, 0.0f, 0.4f }, { 1.0f, 2.0f, 0.0f } },
+    { "default_back",       { "", 0, 0, 0, 100 }, { -0.1f, 0.0f, -0.5f }, { -1.0f, 6.0f, 0.0f } },
+    { "csg_cube",           { "", 2, 2, 6, 100 }, { LEVEL, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+    { "csg_octahedron",     { "", 2, 3, 8, 100 }, { LEVEL, 0.0f, 0.0f }, { 0.0f, 0.0f, 0.0f } },
+    { "csg_random",         { "", 4, 4, 16, 100 }, { LEVEL, 0.0f, 0.1f }, { 0.0f, 0.0f, 0.0f } }
+};
+
+static int RunRegressCase(const RegressCase& c, bool headless, RegressOutput& out);
+
+static int CheckRegressOutput(const char* goldendir, const RegressCase& c, const RegressOutput& out);
+
+static int CheckRegressTrace(const RegressCase& c, const RegressOutput& out);
+
+static int ReadImage(const char* file, unsigned char* outrgb);
+
+static int WriteRaw(const char* file, const void* data, size_t size);
+
+static int ReadRaw(const char* file, void* outdata, size_t size);
+
+
+static int Regress(const char* goldendir, bool update) {
+
+    /*
+        Render the reference cases on each backend available: the window (GLFW) and the headless context (EGL or OSMesa, if built),
+        and trace each frame rendered on the Cpu (Ray::Trace(..), the bvh of the Cpu calcs).
+
+        Outputs: the color of the screen, and the depth and index of the selection calc (the result of the selection programs of Csg.h),
+        compared with the goldens "<case>.ppm", "<case>.sel" of the golden directory. They are shared by the backends:
+        a pixel differs beyond REGRESSCOLORTOL, REGRESSDEPTHTOL or by its index, and a case fails if more than REGRESSPIXELTOL of them differ.
+        Without goldens (not recorded yet by update), the outputs are not compared with them.
+
+        Cpu tracer: the depth and the ray object of the selection calc are compared with the ones traced on the Cpu for the same frame,
+        with the same tolerances. This needs no golden, so the selection programs are checked by a fresh checkout.
+
+        Frame times: the median over REGRESSFRAMES frames, compared with the baseline of the backend ("baseline-<backend>.txt").
+        A case fails if it is slower than the baseline by the noise of both (REGRESSSIGMA robust sigmas of the median absolute deviations),
+        by REGRESSRATIO and by REGRESSMINTIME, all of them, and again when it is timed a second time.
+
+        update: write the goldens from the first backend and the baselines of each backend, then check the other backends against the goldens.
+    */
+
+    const int casesize = sizeof(regresscase) / sizeof(regresscase[0]);
+
+    int backendsize = 0, failsize = 0; bool goldenwritten = false;
+
+    for (int b = 0; b < 2; ++b) {
+
+        const bool headless = (b == 1);
+
+#if defined(RAY_EGL)
+        const char* backend = headless ? "egl" : "window";
+#elif defined(RAY_OSMESA)
+        const char* backend = headless ? "osmesa" : "window";
+#else
+        const char* backend = "window";
+        if (headless) break;                                            // (not built)
+#endif
+
+        printf("# Backend %s:\n", backend);
+
+        if ((headless ? InitializeHeadless() : Initialize()) != SUCCESS) {
+            printf("  (not available)\n"); if (headless) ReleaseHeadless(); else Release(); continue;
+        }
+
+        if (!headless) glfwSwapInterval(0);                             // vsync off
+
+        ray::Ray::Initialize(headless);
+
+        ++backendsize;
+
+        const std::string baselinefile = std::string(goldendir) + "/baseline-" + backend + ".txt";
+
+        std::vector<std::string> baselinename; std::vector<double> baselinemedian, baselinemad;
+
+        if (FILE* fp = update ? NULL : fopen(baselinefile.c_str(), "r")) {
+            char name[64]; double median = 0.0, mad = 0.0;
+            while (fscanf(fp, "%63s %lf %lf", name, &median, &mad) == 3) { baselinename.push_back(name); baselinemedian.push_back(median); baselinemad.push_back(mad); }
+            fclose(fp);
+        }
+        else if (!update) { printf("  (no baseline \"%s\": the frame times are not checked)\n", baselinefile.c_str()); }
+
+        std::string baseline;
+
+        for (const RegressCase& c : regresscase) {
+
+            RegressOutput out;
+
+            if (RunRegressCase(c, headless, out) != SUCCESS) { printf("  %-16s FAIL (cannot be rendered)\n", c.name); ++failsize; continue; }
+
+            char line[128]; snprintf(line, sizeof(line), "%s %.4f %.4f\n", c.name, out.median, out.mad); baseline += line;
+
+            bool fail = CheckRegressTrace(c, out) != SUCCESS;
+
+            if (update && !goldenwritten) {
+
+                const std::string file = std::string(goldendir) + "/" + c.name;
+
+                std::vector<unsigned char> sel(out.depth.size() * sizeof(float) + out.index.size() * sizeof(int));
+                memcpy(sel.data(), out.depth.data(), out.depth.size() * sizeof(float));
+                memcpy(sel.data() + out.depth.size() * sizeof(float), out.index.data(), out.index.size() * sizeof(int));
+
+                if (WriteImage((file + ".ppm").c_str(), out.rgb.data()) != SUCCESS || WriteRaw((file + ".sel").c_str(), sel.data(), sel.size()) != SUCCESS) {
+                    printf("Error: Golden file cannot be written. (\"%s\")\n", file.c_str()); ++failsize; continue;
+                }
+
+                printf("  %-16s golden written, %.3f ms (mad %.3f)\n", c.name, out.median, out.mad);
+
+                if (fail) ++failsize;
+
+                continue;
+
+            }
+
+            fail = CheckRegressOutput(goldendir, c, out) != SUCCESS || fail;
+
+            for (size_t i = 0; i < baselinename.size(); ++i) {
+
+                if (baselinename[i] != c.name) continue;
+
+                const double noise = 1.4826 * sqrt(baselinemad[i] * baselinemad[i] + out.mad * out.mad);     // (robust sigma of the difference)
+                const double threshold = std::max(std::max(REGRESSSIGMA * noise, REGRESSRATIO * baselinemedian[i]), REGRESSMINTIME);
+                bool slow = out.median - baselinemedian[i] > threshold;
+
+                RegressOutput again;                                    // (a slow case is timed again, and fails if slow both times)
+
+                if (slow && RunRegressCase(c, headless, again) == SUCCESS && again.median < out.median) { out.median = again.median; slow = out.median - baselinemedian[i] > threshold; }
+
+                printf("  %-16s time %.3f ms, baseline %.3f ms (threshold +%.3f): %s\n", c.name, out.median, baselinemedian[i], threshold, slow ? "FAIL (slower)" : "ok");
+
+                fail = fail || slow;
+
+            }
+
+            if (fail) ++failsize;
+
+        }
+
+        if (update) {
+            if (WriteRaw(baselinefile.c_str(), baseline.data(), baseline.size()) != SUCCESS) { printf("Error: Baseline file cannot be written. (\"%s\")\n", baselinefile.c_str()); ++failsize; }
+            else printf("  baseline written (\"%s\")\n", baselinefile.c_str());
+        }
+
+        goldenwritten = goldenwritten || update;
+
+        ray::Ray::Release();
+
+        if (headless) ReleaseHeadless(); else Release();
+
+    }
+
+    remove(REGRESSSCENEFILE ".txt"); remove(REGRESSSCENEFILE ".dbrs");
+
+    if (backendsize == 0) { printf("Error: No backend is available for the regression check.\n"); return !SUCCESS; }
+
+    printf("# Regression check: %d backends, %d cases, %d failed.\n", backendsize, casesize, failsize);
+
+    return (failsize == 0) ? SUCCESS : !SUCCESS;
+
+}
+
+static int RunRegressCase(const RegressCase& c, bool headless, RegressOutput& out) {
+
+    /* Render a case from a fresh ray object table, read its outputs after the warmup frames and trace the same frame on the Cpu, then time it. */
+
+    std::string scenefile = SCENEFILE;
+
+    if (c.point.objectsize > 0) {
+
+        const std::string textfile = REGRESSSCENEFILE ".txt"; scenefile = REGRESSSCENEFILE ".dbrs";
+
+        if (WriteScalingScene(textfile.c_str(), c.point) != SUCCESS || !ray::Scene::Convert(textfile.c_str(), scenefile.c_str())) return !SUCCESS;
+
+    }
+
+    theta[0] = c.theta[0]; theta[1] = c.theta[1]; theta[2] = c.theta[2];
+    pos[0] = c.pos[0]; pos[1] = c.pos[1]; pos[2] = c.pos[2]; PublishInput();
+
+    const size_t size = (size_t)PIXELS_W * PIXELS_H;
+
+    out.rgb.resize(3 * size); out.depth.resize(size); out.index.resize(3 * size);
+
+    ray::Ray ray(scenefile.c_str());
+
+    for (int n = 0; n < WARMUPFRAMES; ++n) { ray.Update(); }           // (the game time advances by a fixed step per frame)
+
+    ray::Ray::ReadScreen(out.rgb.data());
+    ray.ReadSelection(out.depth.data(), (int(*)[3])out.index.data());
+
+    out.tracedepth.resize(size); out.traceobject.resize(size);         // (the bvh is built by the first trace, and refit by the frames timed)
+
+    for (int y = 0; y < PIXELS_H; ++y) {
+        for (int x = 0; x < PIXELS_W; ++x) {
+            const size_t p = (size_t)y * PIXELS_W + x;
+            float raypos[3] = {}, raydir[3] = {}, dist = 0.0f;
+            ray::Ray::GetCameraRay(x, y, raypos, raydir);
+            out.traceobject[p] = ray.Trace(raypos, raydir, &dist);
+            out.tracedepth[p] = (out.traceobject[p] < 0) ? 1.0f : dist / RAYDIST;
+        }
+    }
+
+    std::vector<double> frametime(REGRESSFRAMES), deviation(REGRESSFRAMES);     // (ms)
+
+    for (int n = 0; n < REGRESSFRAMES; ++n) {
+
+        auto start = std::chrono::steady_clock::now();
+
+        ray.Update(); glFinish();
+
+        frametime[n] = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+
+        if (!headless) { glfwSwapBuffers(window); glfwPollEvents(); }     // (not timed)
+
+    }
+
+    std::sort(frametime.begin(), frametime.end());
+
+    out.median = frametime[(REGRESSFRAMES - 1) / 2];
+
+    for (int n = 0; n < REGRESSFRAMES; ++n) { deviation[n] = fabs(frametime[n] - out.median); }
+
+    std::sort(deviation.begin(), deviation.end());
+
+    out.mad = deviation[(REGRESSFRAMES - 1) / 2];
+
+    return SUCCESS;
+
+}
+
+static int CheckRegressOutput(const char* goldendir, const RegressCase& c, const RegressOutput& out) {
+
+    /* Compare the outputs of a case with its goldens, and print the pixels which differ. */
+
+    const size_t size = (size_t)PIXELS_W * PIXELS_H;
+
+    const std::string file = std::string(goldendir) + "/" + c.name;
+
+    std::vector<unsigned char> rgb(3 * size); std::vector<float> depth(size); std::vector<int> index(3 * size);
+
+    std::vector<unsigned char> sel(depth.size() * sizeof(float) + index.size() * sizeof(int));
+
+    if (ReadImage((file + ".ppm").c_str(), rgb.data()) != SUCCESS || ReadRaw((file + ".sel").c_str(), sel.data(), sel.size()) != SUCCESS) {
+        printf("  %-16s (no golden \"%s\": not compared, see --regress <dir> update)\n", c.name, file.c_str()); return SUCCESS;
+    }
+
+    memcpy(depth.data(), sel.data(), depth.size() * sizeof(float));
+    memcpy(index.data(), sel.data() + depth.size() * sizeof(float), index.size() * sizeof(int));
+
+    size_t colordiff = 0, depthdiff = 0, indexdiff = 0;
+
+    for (size_t p = 0; p < size; ++p) {
+
+        bool color = false;
+        for (int i = 0; i < 3; ++i) { color = color || abs((int)out.rgb[3 * p + i] - (int)rgb[3 * p + i]) > REGRESSCOLORTOL; }
+
+        colordiff += color;
+        depthdiff += !(fabsf(out.depth[p] - depth[p]) <= REGRESSDEPTHTOL);    // (nan: differs)
+        indexdiff += (out.index[3 * p] != index[3 * p] || out.index[3 * p + 1] != index[3 * p + 1] || out.index[3 * p + 2] != index[3 * p + 2]);
+
+    }
+
+    const size_t tol = (size_t)(REGRESSPIXELTOL * size);
+
+    const bool fail = colordiff > tol || depthdiff > tol || indexdiff > tol;
+
+    printf("  %-16s pixels differing: color %zu, depth %zu, index %zu (tolerance %zu): %s\n", c.name, colordiff, depthdiff, indexdiff, tol, fail ? "FAIL (output)" : "ok");
+
+    return fail ? !SUCCESS : SUCCESS;
+
+}
+
+static int CheckRegressTrace(const RegressCase& c, const RegressOutput& out) {
+
+    /* Compare the depth and the ray object of the selection calc of a case with the ones traced on the Cpu, and print the pixels which differ. */
+
+    const size_t size = (size_t)PIXELS_W * PIXELS_H;
+
+    size_t depthdiff = 0, objectdiff = 0;
+
+    for (size_t p = 0; p < size; ++p) {
+        objectdiff += (out.traceobject[p] != out.index[3 * p]);
+        depthdiff += (out.traceobject[p] >= 0 || out.index[3 * p] >= 0) && !(fabsf(out.tracedepth[p] - out.depth[p]) <= REGRESSDEPTHTOL);   // (none: any depth)
+    }
+
+    const size_t tol = (size_t)(REGRESSPIXELTOL * size);
+
+    const bool fail = depthdiff > tol || objectdiff > tol;
+
+    printf("  %-16s cpu trace differing: depth %zu, object %zu (tolerance %zu): %s\n", c.name, depthdiff, objectdiff, tol, fail ? "FAIL (output)" : "ok");
+
+    return fail ? !SUCCESS : SUCCESS;
+
+}
+
+static int ReadImage(const char* file, unsigned char* outrgb) {
+
+    /* Read an RGB image of the screen size from a binary PPM file (as written by WriteImage(..)). */
+
+    FILE* fp = fopen(file, "rb"); if (!fp) return !SUCCESS;
+
+    int w = 0, h = 0, maxval = 0;
+
+    int res = fscanf(fp, "P6 %d %d %d", &w, &h, &maxval) == 3 && w == PIXELS_W && h == PIXELS_H && maxval == 255
+        && fgetc(fp) != EOF && fread(outrgb, 3 * (size_t)PIXELS_W, PIXELS_H, fp) == (size_t)PIXELS_H;
+
+    fclose(fp);
+
+    return res ? SUCCESS : !SUCCESS;
+
+}
+
+static int WriteRaw(const char* file, const void* data, size_t size) {
+
+    FILE* fp = fopen(file, "wb"); if (!fp) return !SUCCESS;
+
+    int res = fwrite(data, 1, size, fp) == size;
+
+    res = (fclose(fp) == 0) && res;
+
+    return res ? SUCCESS : !SUCCESS;
+
+}
+
+static int ReadRaw(const char* file, void* outdata, size_t size) {
+
+    /* Read a file of an exact size. */
+
+    FILE* fp = fopen(file, "rb"); if (!fp) return !SUCCESS;
+
+    int res = fread(outdata, 1, size, fp) == size && fgetc(fp) == EOF;
+
+    fclose(fp);
+
+    return res ? SUCCESS : !SUCCESS;
+
+}
+
+
+// *****************************************
+
+// *****************************************
+
+static void error_callback(int errcode, const char* description)
+    { printf("GLFW Error: %s (%d)\n", description, errcode);  glfwSetWindowShouldClose(window, 1); }
+
+
+// *****************************************
+
+// *****************************************
+
+static void key_callback(GLFWwindow* window, int key, int scancode, int action, int mods) {
+
+    /* Determine camera positions from key inputs. (Event thread.) */
+
+    const float v = 2.1f;                                               // arbitrary value
+
+    float tmp[3] = {}; {
+
+        if (action == GLFW_PRESS || action == GLFW_REPEAT)
+        {
+            tmp[0] = v * ((key == GLFW_KEY_RIGHT) - (key == GLFW_KEY_LEFT));
+            tmp[1] = v * ((key == GLFW_KEY_UP) - (key == GLFW_KEY_DOWN));
+            tmp[2] = v * ((key == GLFW_KEY_LEFT_ALT) - (key == GLFW_KEY_LEFT_CONTROL));
+        }
+
+    }
+
+    pos[0] += tmp[0]; pos[1] += tmp[1]; pos[2] += tmp[2];
+
+    if (key == GLFW_KEY_T && action == GLFW_PRESS) {                    // toggle the Gpu times of the passes
+
+        gputimer = !gputimer;                                           // (applied by the render thread, see Update(..))
+
+    }
+
+    PublishInput();
+
+    if (key == GLFW_KEY_P && action == GLFW_PRESS) {                    // write the timeline (start recording first if not)
+
+        if (!tracefile) { tracefile = TRACEFILE; ray::Timeline::Enable(true); atexit(WriteTrace); printf("\n# Recording a timeline.\n"); }
+        else { printf("\n"); WriteTrace(); }
+
+    }
 
 }
 
 static void cursor_callback(GLFWwindow* window, double xpos, double ypos) {
 
-    /* Determine camera orientations from mouse inputs. */
+    /* Determine camera orientations from mouse inputs. (Event thread.) */
 
     float tmp[3] = { 5.0f * ((float)ypos / PIXELS_H - 0.5f), 0.0f, 5.0f * ((float)xpos / PIXELS_W - 0.5f) };
 
     theta[0] = tmp[0]; theta[1] = tmp[1]; theta[2] = tmp[2];
 
+    PublishInput();
+
 }
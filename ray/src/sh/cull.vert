@@ -0,0 +1,128 @@
+
+/*
+    Invoked once per ray unit slot of the ubo unit buffer (points, rasterizer discarded, captured by transform feedback).
+
+    Test the bounding sphere of the ray object against the camera frustum and the depth of the last frame (Hi-Z), and the one of the ray unit
+    against the frustum, then output the indirect draw commands of the Ray2 and Selection calculations for the slot. (Culled: zero commands.)
+
+    The slots drawn are given compacted ray unit segments of the Ray2 buffer: the segment of a slot is the number of the slots drawn before it,
+    counted by every invocation (no atomics in GLSL 3.30). The segment is output in the clear command of the slot (first: 6 * segment), which
+    initializes the segment and is read by ray2.geom and select.frag. A ray object whose slots drawn do not all fit in the MAXRAY2SEGMENTSIZE
+    segments is culled.
+
+    A ray unit is drawn only with its ray object, and is never occlusion culled by itself (it may carve the surface which occludes it).
+    The selection command is output at the first slot of the object.
+
+    (MAXUNITBUFFSIZE, MAXPLANEBUFFSIZE and MAXRAY2SEGMENTSIZE are defined by the shader loader in Ray.cpp.)
+*/
+
+#version 330
+
+const int SLOTSTRIDE = 6 * MAXPLANEBUFFSIZE;                            // vertex index stride of a slot (6 vertices per plane of the ubo plane buffer)
+
+struct Unit {
+    /* This structure contains an attribute data of a ray unit. */
+    mat4 modelmat4; vec2 texscale, padding;                             // modelmat4: model matrix of a ray unit
+};
+
+struct Slot {
+    /* This structure contains a ray unit slot. */
+    vec4 sphere; ivec4 range;                                           // sphere: bounding sphere in model space (radius < 0: empty unit)
+                                                                        // range: (plstart, plsize, unitstart, unitsize) (unitsize 0: empty slot)
+    vec4 objectsphere; ivec4 program;                                   // objectsphere: bounding sphere of the ray object (of its program result)
+};
+
+
+flat out uvec4 ray2command;                                             // (count, instancecount, first, baseinstance) of the ray2 calc
+flat out uvec4 selectcommand;                                           // (count, instancecount, first, baseinstance) of the selection calc
+flat out uvec4 clearcommand;                                            // (count, instancecount, first, baseinstance) of the segment initialization
+
+
+layout(std140, row_major) uniform UboUnitBuffer { Unit unit[MAXUNITBUFFSIZE]; };     // ubo unit buffer. stores ray unit attribute data
+layout(std140) uniform UboSlotBuffer { Slot slot[MAXUNITBUFFSIZE]; };   // ubo slot buffer. stores ray unit bounds and plane ranges
+
+uniform sampler2D hizbuffer;                                            // max depth pyramid of the last frame
+uniform int hizvalid;                                                   // 0: the last frame is not comparable (e.g. the camera moved)
+
+uniform mat4 viewmat4;                                                  // view matrix
+
+
+bool Drawn(int index);
+bool Visible(vec4 sphere, int index, bool occlusion);
+
+void main() {
+
+    int primary = slot[gl_VertexID].range.z;
+
+    int segment = 0, objectsegment = 0;                                 // segment: slots drawn before this one, objectsegment: before the end of its object
+    for (int m = 0; m < primary + slot[gl_VertexID].range.w; ++m) {
+        int drawn = int(Drawn(m)); segment += (m < gl_VertexID) ? drawn : 0; objectsegment += drawn;
+    }
+
+    bool visible = Drawn(gl_VertexID) && objectsegment <= MAXRAY2SEGMENTSIZE;
+
+    ray2command = uint(visible) * uvec4(6 * slot[gl_VertexID].range.y, 1, gl_VertexID * SLOTSTRIDE + 6 * slot[gl_VertexID].range.x, 0);
+    selectcommand = uint(visible && primary == gl_VertexID) * uvec4(6, 1, 6 * gl_VertexID, 0);
+    clearcommand = uint(visible) * uvec4(6, 1, 6 * segment, 0);
+
+}
+
+bool Drawn(int index) {
+
+    /* Test a slot: the sphere of its ray object (by occlusion too), then its own (frustum only). */
+
+    return slot[index].range.w > 0 && Visible(slot[index].objectsphere, slot[index].range.z, hizvalid != 0) && Visible(slot[index].sphere, index, false);
+
+}
+
+bool Visible(vec4 sphere, int index, bool occlusion) {
+
+    /* Test a bounding sphere in the model space of a ray unit (in ray space, the camera rays (x, 1, z) for |x| <= 1, |z| <= height / width of the screen). */
+
+    const float raydist = 1000.0f;                                      // maximum ray distance
+
+    ivec2 screen = textureSize(hizbuffer, 0);                           // (the pyramid base has the screen size)
+
+    float aspect = float(screen.y) / screen.x;
+    float maxraypos = sqrt(2.0f + aspect * aspect);                     // max distance of the ray start points (on the screen plane y = 1) from the camera
+
+    if (sphere.w < 0.0f) return false;                                  // empty
+    if (sphere.w >= 1.0e29f) return true;                               // unbounded
+
+    mat4 mat = viewmat4 * unit[index].modelmat4;
+
+    vec3 c = (mat * vec4(sphere.xyz, 1.0f)).xyz;
+    float r = sphere.w * sqrt(max(dot(mat[0].xyz, mat[0].xyz), max(dot(mat[1].xyz, mat[1].xyz), dot(mat[2].xyz, mat[2].xyz))));
+
+    // frustum
+
+    bool frustum = c.y >= -r
+        && (abs(c.x) - c.y) / sqrt(2.0f) <= r
+        && (abs(c.z) - aspect * c.y) / sqrt(1.0f + aspect * aspect) <= r
+        && length(c) - r <= raydist + maxraypos;
+
+    if (!frustum || !occlusion || c.y - r <= 1.0f) return frustum;     // (occlusion test: spheres beyond the screen plane)
+
+    // occlusion: the nearest distance of the sphere against the max depth of the last frame over its screen rect
+
+    vec2 lo = vec2(min((c.x - r) / (c.y - r), (c.x - r) / (c.y + r)), min((c.z - r) / (c.y - r), (c.z - r) / (c.y + r)));
+    vec2 hi = vec2(max((c.x + r) / (c.y - r), (c.x + r) / (c.y + r)), max((c.z + r) / (c.y - r), (c.z + r) / (c.y + r)));
+
+    ivec2 p0 = ivec2(clamp(floor(lo * float(screen.x) / 2.0f + vec2(screen) / 2.0f), vec2(0.0f), vec2(screen - 1)));     // pixels (as in the camera rays)
+    ivec2 p1 = ivec2(clamp(floor(hi * float(screen.x) / 2.0f + vec2(screen) / 2.0f), vec2(0.0f), vec2(screen - 1)));
+
+    int size = max(p1.x - p0.x, p1.y - p0.y) + 1, maxlevel = int(log2(float(max(screen.x, screen.y))));
+
+    int level = 0; while ((1 << level) < size && level < maxlevel) { ++level; }    // the rect spans 2 x 2 texels at most
+
+    ivec2 levelsize = textureSize(hizbuffer, level);
+
+    float maxdepth = 0.0f;
+    for (int i = 0; i < 4; ++i) {
+        ivec2 p = min(ivec2((i % 2 == 0) ? p0.x : p1.x, (i / 2 == 0) ? p0.y : p1.y) >> level, levelsize - 1);
+        maxdepth = max(maxdepth, texelFetch(hizbuffer, p, level).x);
+    }
+
+    return (length(c) - r - maxraypos) / raydist <= maxdepth;
+
+}
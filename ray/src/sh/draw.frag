@@ -3,10 +3,17 @@
 	Render the results of the Ray Selection stage to the screen.
 
 	Planes and Ray Unit attributes are re-read to calculate the intersection point and read the texel color.
+
+	Ray Units of texscale (0, 0) are not textured. The variant of TEXTURE 0 (no ray unit drawn is textured) does not read the image.
+	(MAXUNITBUFFSIZE and MAXPLANEBUFFSIZE are injected by the shader loader.)
 */ 
 
 #version 330
 
+#ifndef TEXTURE
+#define TEXTURE 1
+#endif
+
 const int PLELMSIZE = 3, PLPOS = 0, PLNORMAL = 1, PLUAXIS = 2;
 const int RAYBUFFSIZE = 2, RAYPOS = 0, RAYDIR = 1;
 const int UNITINDEX = 0, PLINDEX = 1;
@@ -25,8 +32,8 @@ struct Plane{
 out vec4 outcolor;														// output the rendered color
 
 
-layout(std140, row_major) uniform UboUnitBuffer { Unit unit[20]; };		// ubo unit buffer. stores ray unit attribute data
-layout(std140) uniform UboPlaneBuffer { Plane mdpl[200]; };				// ubo plane buffer. stores ray unit plane data
+layout(std140, row_major) uniform UboUnitBuffer { Unit unit[MAXUNITBUFFSIZE]; };	// ubo unit buffer. stores ray unit attribute data
+layout(std140) uniform UboPlaneBuffer { Plane mdpl[MAXPLANEBUFFSIZE]; };	// ubo plane buffer. stores ray unit plane data
 
 uniform sampler2DArray depthbuffer;										// fbo selection depth buffer. stores ray distances to planes from the selection stage
 uniform usampler2DArray indexbuffer;									// fbo selection index buffer. stores ray unit and plane indices from the selection stage
@@ -46,11 +53,11 @@ void main() {
 
 	float depth = texelFetch(depthbuffer, ivec3(gl_FragCoord.xy, 0), 0).x;
 
-	vec4 light; vec2 texcoord; {										// light: light intensity, texcoord: texel coord on a scaled image
+	vec4 light; vec2 texcoord; bool textured; {							// light: light intensity, texcoord: texel coord on a scaled image
 
 		vec3 intersectpos; {											// ray intersection pos on the concerned plane
 
-			vec4 ray[RAYBUFFSIZE]; for (int i = 0; i < RAYBUFFSIZE; ++i) { ray[i] = texelFetch(raybuffer[i], ivec2(gl_FragCoord.xy), 0); }
+			vec4 ray[RAYBUFFSIZE] = vec4[](texelFetch(raybuffer[RAYPOS], ivec2(gl_FragCoord.xy), 0), texelFetch(raybuffer[RAYDIR], ivec2(gl_FragCoord.xy), 0));	// (sampler arrays take constant indices in GLSL 3.30)
 
 			intersectpos = ray[RAYPOS].xyz + depth * raydist * ray[RAYDIR].xyz;
 		}
@@ -65,6 +72,8 @@ void main() {
 		}
 
 
+		textured = texscale != vec2(0.0f); texscale += vec2(!textured);	// (untextured: any scale)
+
 		texcoord = vec2(
 			(dot(intersectpos - pl.vec[PLPOS].xyz, pl.vec[PLUAXIS].xyz / texscale.x) + 1.0f) / 2.0f,
 			1.0f - (dot(intersectpos - pl.vec[PLPOS].xyz, cross(pl.vec[PLNORMAL].xyz, pl.vec[PLUAXIS].xyz)) / texscale.y + 1.0f) / 2.0f		// derive the v-axis from the normal and the u-axis
@@ -76,7 +85,14 @@ void main() {
 
 	// output
 	
-	outcolor = int(depth != 1.0f) * light * vec4(texture(img, texcoord).xyz, 1.0f);
+#if TEXTURE
+	vec3 color = texture(img, texcoord).xyz;							// (sampled in uniform control flow)
+	if (!textured) color = vec3(1.0f);
+#else
+	vec3 color = vec3(1.0f);
+#endif
+
+	outcolor = int(depth != 1.0f) * light * vec4(color, 1.0f);
 	
 }
 
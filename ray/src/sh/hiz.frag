@@ -0,0 +1,34 @@
+
+/*
+    Build a level of the max depth pyramid (Hi-Z) from the Selection depth buffer (level 0) or from the previous level.
+
+    A texel takes the max of the 2 x 2 texels below, and of the 3rd row/column at odd sizes, so the pyramid stays conservative.
+*/
+
+#version 330
+
+out float outdepth;                                                     // output the max depth
+
+uniform sampler2DArray depthbuffer;                                     // fbo selection depth buffer
+uniform sampler2D hizbuffer;                                            // the previous level (the only level in the texture's level range)
+
+uniform int level;                                                      // level to be built
+
+
+void main() {
+
+    ivec2 p = ivec2(gl_FragCoord.xy);
+
+    if (level == 0) { outdepth = texelFetch(depthbuffer, ivec3(p, 0), 0).x; return; }
+
+    ivec2 prevsize = textureSize(hizbuffer, 0);
+    ivec2 end = min(2 * p + 1 + (prevsize & 1) * ivec2(equal(p, prevsize / 2 - 1)), prevsize - 1);  // include the 3rd texel at the last odd row/column
+
+    float depth = 0.0f;
+    for (int y = 2 * p.y; y <= end.y; ++y) {
+        for (int x = 2 * p.x; x <= end.x; ++x) { depth = max(depth, texelFetch(hizbuffer, ivec2(x, y), 0).x); }
+    }
+
+    outdepth = depth;
+
+}
@@ -5,6 +5,10 @@
 
 #version 330
 
+#ifndef CLEAR
+#define CLEAR 0
+#endif
+
 const int PLELMSIZE = 3, PLPOS = 0, PLNORMAL = 1;
 const int RAYBUFFSIZE = 2, RAYPOS = 0, RAYDIR = 1;
 
@@ -25,6 +29,11 @@ uniform sampler2D raybuffer[RAYBUFFSIZE];								// ray pos and dir buffers
 
 void main() {
 
+#if CLEAR
+	outindex = uvec2(0xFFFFu, 0xFFFFu); gl_FragDepth = 0.0f;			// initialize a ray unit segment (see ray2.geom)
+	return;
+#endif
+
 	const float raydist = 1000.0f;										// maximum ray distance
 
 
@@ -33,7 +42,7 @@ void main() {
 	float sdist, cosine; {												// sdist: signed distance to the plane from the ray side of this invocation
 																		// cosine: cos of the angle between the plane normal and the ray dir vec for this ray side invocation
 
-		vec4 ray[RAYBUFFSIZE]; for (int i = 0; i < RAYBUFFSIZE; ++i) { ray[i] = texelFetch(raybuffer[i], ivec2(gl_FragCoord.xy), 0); }
+		vec4 ray[RAYBUFFSIZE] = vec4[](texelFetch(raybuffer[RAYPOS], ivec2(gl_FragCoord.xy), 0), texelFetch(raybuffer[RAYDIR], ivec2(gl_FragCoord.xy), 0));	// (sampler arrays take constant indices in GLSL 3.30)
 
 		sdist = dot(pl.vec[PLNORMAL].xyz, (ray[RAYPOS].xyz - pl.vec[PLPOS].xyz) / raydist + rayside * ray[RAYDIR].xyz);
 		cosine = dot(pl.vec[PLNORMAL].xyz, ((1 - rayside) * 1.0f + rayside * (-1.0f)) * ray[RAYDIR].xyz);
@@ -0,0 +1,16 @@
+
+/* Render the triangles that cover the screen, and pass the vertex index (which locates the ray unit slot and the plane). */
+
+#version 330
+
+flat out int vertexid;                                                  // output the vertex index (including the first index of the draw command)
+
+void main(void){
+
+	const float triangle[] = float[](-1.0f,1.0f,  1.0f,-1.0f,  1.0f,1.0f,  -1.0f,-1.0f,  1.0f,-1.0f,  -1.0f,1.0f);
+
+	vertexid = gl_VertexID;
+
+	gl_Position = vec4(triangle[2 * (gl_VertexID % 6)], triangle[2 * (gl_VertexID % 6) + 1], 0.0f, 1.0f);
+
+}
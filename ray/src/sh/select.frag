@@ -1,86 +1,173 @@
 
 /*
-	Layer 0, tests if the two rays in the Ray2 stage have captured actual regions.
+	Layer 0, runs the selection program of the Ray Object (see Csg.h), loading the actual regions captured by the two rays in the Ray2 stage.
 
-	In Layer 1, the actual region of the Ray Primary Unit gets subtracted by the regions of the Ray Subordinate Units.
+	In Layer 1, the actual regions of the Ray Units are combined by union, intersection and subtraction, keeping a single region per register.
 
-	Layer 2, outputs a result from the captured actual region(s).
+	Layer 2, outputs a result from the captured actual region.
+
+	Invoked once per Ray Object (by a draw command written in cull.vert), which reads the Ray Unit segments of its slots in the Ray2 buffer.
+	(The segment of a slot is in its clear command, first: 6 * segment.)
+
+	A variant of a program (see Ray.cpp) has PROGRAM, PROGRAMSIZE and REGSIZE defined and runs it as constants.
+	The generic shader reads the program from the slots.
 */
 
 #version 330
 
+#ifndef PROGRAM
+#define PROGRAMSIZE 16														// max size of a program (= Csg::MAXPROGRAMSIZE)
+#define REGSIZE 4															// max stack depth of a program (= Csg::MAXREGSIZE)
+#endif
+
 struct Cell {
 	/* This structure contains an actual region, captured from both ray sides. */
-	float depth[2]; uvec2 index[2];										// depth: intersection distance, index: ray unit and plane indices
+	float t[2]; uvec2 index[2];											// t: entry and exit distances (t[0] >= t[1]: nothing), index: ray unit and plane indices
+};
+
+
+struct Slot {
+	/* This structure contains a ray unit slot. */
+	vec4 sphere; ivec4 range;											// range: (plstart, plsize, unitstart, unitsize)
+	vec4 objectsphere; ivec4 program;									// program: (2 codes of the selection program, programsize, 0)
 };
 
 
 out uvec2 outindex; 													// output the final ray unit and plane indices for subsequent rendering
 
 
+flat in int slotindex;													// input the ray unit slot of the first ray unit
+
+layout(std140) uniform UboSlotBuffer { Slot slot[MAXUNITBUFFSIZE]; };	// ubo slot buffer. stores ray unit bounds, plane ranges and programs
+
+
 uniform sampler2DArray depthbuffer;										// fbo ray2 depth buffer. stores ray distances to planes from the ray2 stage
 uniform usampler2DArray indexbuffer;									// fbo ray2 index buffer. stores ray unit and plane indices from the ray2 stage
+uniform usamplerBuffer commandbuffer;									// draw commands from the culling stage. (ray2, selection, clear) per slot
 
 
-void main() { 
+Cell Load(int unitslot);
+int Code(int n);
+
+void main() {
+
+	const int OP_LOAD = 0, OP_UNION = 1, OP_INTERSECT = 2, OP_SUBTRACT = 3, OP_REVSUBTRACT = 4;
 
-	const int RAYSIDELEN = 2, UNITSEGSIZE = 3;							// RAYSIDELEN: number of the ray sides
-																		// UNITSEGSIZE: number of ray unit segments contained in an ray object segment of the fbo ray2 buffer
-	const int PRMCELL = 0;												// index of the ray primary unit cell
-	
 	const Cell defcell = Cell(float[](1.0f, 0.0f), uvec2[](uvec2(-1, -1), uvec2(-1, -1)));		// initial val of the cell
 
 
-	// (-- layer 0: capture test --) test if the two rays have captured actual regions of the ray units
+#ifdef PROGRAM
+	const int programsize = PROGRAMSIZE;								// (a constant loop: unrolled by the compiler)
+#else
+	int programsize = min(slot[slotindex].program.z, PROGRAMSIZE);
+#endif
 
-	Cell cell[UNITSEGSIZE]; for(int i = 0; i < UNITSEGSIZE; ++i) {
+	Cell reg[REGSIZE]; int depth = 0;									// registers (a stack)
 
-		float depth[RAYSIDELEN]; for (int n = 0; n < RAYSIDELEN; ++n) { depth[n] = texelFetch(depthbuffer, ivec3(gl_FragCoord.xy, i * RAYSIDELEN + n), 0).x; }
+	bool skip = false;													// skip: the next op is known to keep the top region
 
-		bool D = depth[0] + depth[1] < 1.0f;
-		
-		for (int n = 0; n < RAYSIDELEN; ++n) { cell[i].depth[n] = int(D) * depth[n] + (1 - int(D)) * defcell.depth[n]; }
-		for (int n = 0; n < RAYSIDELEN; ++n) { cell[i].index[n] = uint(D) * texelFetch(indexbuffer, ivec3(gl_FragCoord.xy, i * RAYSIDELEN + n), 0).xy + (uint(1) - uint(D)) * defcell.index[n]; }
-	
-	}
+	for (int n = 0; n < programsize; ++n) {
 
-	// (-- layer 1: subtraction --) starting from the ray primary unit, re-capture actual regions by subtracting each ray subordinate unit
+		int code = Code(n), op = code & 15;
 
-	Cell actcell = cell[PRMCELL];										// store a subtracted and re-captured actual region
-	
-	for(int i = PRMCELL + 1; i < UNITSEGSIZE; ++i){
+		if (skip) { skip = false; continue; }
+
+		// (-- layer 0: load --) the region of a ray unit (skipped if it is cut from, or intersected with, nothing)
+
+		if (op == OP_LOAD) {
+
+			int next = (n + 1 < programsize) ? Code(n + 1) & 15 : OP_LOAD;
+
+			if (depth > 0 && !(reg[depth - 1].t[0] < reg[depth - 1].t[1]) && (next == OP_SUBTRACT || next == OP_INTERSECT)) { skip = true; continue; }
+
+			reg[min(depth, REGSIZE - 1)] = Load(min(slotindex + (code >> 4), MAXUNITBUFFSIZE - 1)); depth = min(depth + 1, REGSIZE);
+
+			continue;
 
-		Cell subcell; {
-			for (int n = 0; n < RAYSIDELEN; ++n) { subcell.depth[n] = 1.0f - cell[i].depth[(n + 1) % RAYSIDELEN]; }
-			for (int n = 0; n < RAYSIDELEN; ++n) { subcell.index[n] = cell[i].index[(n + 1) % RAYSIDELEN]; }
 		}
 
-		int tmpptr = 0; Cell tmpcell[RAYSIDELEN];						// temporarily store the results of subtracting a ray sub unit from an actual region
-		for(int n = 0; n < RAYSIDELEN; ++n) {
+		// (-- layer 1: combination --) pop two regions and push the result
+
+		if (depth < 2) break;
+
+		Cell b = reg[depth - 1], a = reg[depth - 2]; --depth;
+
+		if (op == OP_REVSUBTRACT) { Cell tmp = a; a = b; b = tmp; op = OP_SUBTRACT; }
+
+		bool A = a.t[0] < a.t[1], B = b.t[0] < b.t[1];
+
+		if (op == OP_UNION) {											// (apart: the front one)
 
-			bool Dm[RAYSIDELEN]; for (int m = 0; m < RAYSIDELEN; ++m){ Dm[m] = (actcell.depth[m] < subcell.depth[m]) ^^ (bool(n) ^^ bool(m)); }
+			if (!A || (B && a.t[0] <= b.t[1] && b.t[0] <= a.t[1])) {
+				if (A) {
+					if (a.t[0] < b.t[0]) { b.t[0] = a.t[0]; b.index[0] = a.index[0]; }
+					if (a.t[1] > b.t[1]) { b.t[1] = a.t[1]; b.index[1] = a.index[1]; }
+				}
+				a = b;
+			}
+			else if (B && b.t[0] < a.t[0]) { a = b; }
 
-			float depth[RAYSIDELEN]; for (int m = 0; m < RAYSIDELEN; ++m){ depth[m] = int(Dm[m]) * actcell.depth[m] + (1 - int(Dm[m])) * subcell.depth[m]; }
+		}
+		else if (op == OP_INTERSECT) {
 
-			for (int m = 0; m < RAYSIDELEN; ++m){ tmpcell[tmpptr].depth[m] = depth[m]; }
-			for (int m = 0; m < RAYSIDELEN; ++m){ tmpcell[tmpptr].index[m] = uint(Dm[m]) * actcell.index[m] + (uint(1) - uint(Dm[m])) * subcell.index[m]; }
-				
-			bool D = depth[0] + depth[1] < 1.0f;						// test if an actual region is captured
+			if (b.t[0] > a.t[0]) { a.t[0] = b.t[0]; a.index[0] = b.index[0]; }
+			if (b.t[1] < a.t[1]) { a.t[1] = b.t[1]; a.index[1] = b.index[1]; }
 
-			tmpptr += int(D);
-		
 		}
+		else if (op == OP_SUBTRACT && B) {								// the front piece, or else the back piece (entering at the exit of b)
+
+			if (a.t[0] < min(a.t[1], b.t[0])) { if (b.t[0] < a.t[1]) { a.t[1] = b.t[0]; a.index[1] = b.index[0]; } }
+			else if (b.t[1] > a.t[0]) { a.t[0] = b.t[1]; a.index[0] = b.index[1]; }
 
-		bool D = tmpptr > 0;											// move the closest result from the re-captured regions
+		}
 
-		for (int n = 0; n < RAYSIDELEN; ++n){ actcell.depth[n] = int(D) * tmpcell[0].depth[n] + (1 - int(D)) * defcell.depth[n]; }
-		for (int n = 0; n < RAYSIDELEN; ++n){ actcell.index[n] = uint(D) * tmpcell[0].index[n] + (uint(1) - uint(D)) * defcell.index[n]; }
+		reg[depth - 1] = a;
 
 	}
-	
-	// (-- layer 2: output --) output an arbitrary result from the captured actual region(s)
 
-	gl_FragDepth = actcell.depth[0];									// simply output
+	// (-- layer 2: output --) output the entry of the captured actual region
+
+	Cell actcell = (depth > 0 && reg[0].t[0] < reg[0].t[1]) ? reg[0] : defcell;
+
+	gl_FragDepth = actcell.t[0];										// simply output
 	outindex = actcell.index[0];
 
 }
+
+int Code(int n) {
+
+	/* Read the code n of the program. */
+
+#ifdef PROGRAM
+	const int program[PROGRAMSIZE] = PROGRAM;
+	return program[n];
+#else
+	return slot[min(slotindex + n / 2, MAXUNITBUFFSIZE - 1)].program[n % 2];
+#endif
+
+}
+
+Cell Load(int unitslot) {
+
+	/* Load the actual region captured in the ray unit segment of a slot. (Units culled capture nothing, and have no segment.) */
+
+	const int RAYSIDELEN = 2;											// RAYSIDELEN: number of the ray sides
+	const int COMMANDSIZE = 3, CLEARCOMMAND = 2;						// draw commands per slot in the command buffer (as in Ray.cpp)
+
+	uvec4 clearcommand = texelFetch(commandbuffer, COMMANDSIZE * unitslot + CLEARCOMMAND);
+
+	if (clearcommand.x == uint(0)) return Cell(float[](1.0f, 0.0f), uvec2[](uvec2(-1, -1), uvec2(-1, -1)));
+
+	int segment = int(clearcommand.z) / 6;
+
+	float depth[RAYSIDELEN]; for (int n = 0; n < RAYSIDELEN; ++n) { depth[n] = texelFetch(depthbuffer, ivec3(gl_FragCoord.xy, segment * RAYSIDELEN + n), 0).x; }
+
+	Cell cell;
+
+	cell.t[0] = depth[0]; cell.t[1] = 1.0f - depth[1];					// (the other ray runs backward from the ray end)
+
+	for (int n = 0; n < RAYSIDELEN; ++n) { cell.index[n] = texelFetch(indexbuffer, ivec3(gl_FragCoord.xy, segment * RAYSIDELEN + n), 0).xy; }
+
+	return cell;
+
+}
@@ -0,0 +1,16 @@
+
+/* Render the triangles that cover the screen, and pass the ray unit slot of the ray primary unit (the draw command starts at 6 * slot). */
+
+#version 330
+
+flat out int slotindex;                                                 // output the ray unit slot of the ray primary unit
+
+void main(void){
+
+	const float triangle[] = float[](-1.0f,1.0f,  1.0f,-1.0f,  1.0f,1.0f,  -1.0f,-1.0f,  1.0f,-1.0f,  -1.0f,1.0f);
+
+	slotindex = gl_VertexID / 6;
+
+	gl_Position = vec4(triangle[2 * (gl_VertexID % 6)], triangle[2 * (gl_VertexID % 6) + 1], 0.0f, 1.0f);
+
+}